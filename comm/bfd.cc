@@ -40,6 +40,16 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "codesloop/comm/bfd.hh"
 #include "codesloop/common/libev/evwrap.h"
 #include "codesloop/common/logger.hh"
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <vector>
+#ifndef WIN32
+#include <sys/uio.h>
+#include <netinet/tcp.h>
+#endif /*WIN32*/
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif /*__linux__*/
 
 #ifndef BFD_DEBUG_STATE
 #define BFD_DEBUG_STATE(WHICH) \
@@ -74,9 +84,13 @@ namespace csl
 {
   namespace comm
   {
-    bfd::bfd() : fd_(bfd::not_initialized_), use_exc_(true) { }
+    bfd::bfd() : fd_(bfd::not_initialized_),
+                 out_(0), out_len_(0), out_size_(out_default_), out_writev_(false),
+                 use_exc_(true) { }
 
-    bfd::bfd(int fd) : fd_(fd), use_exc_(true)
+    bfd::bfd(int fd) : fd_(fd),
+                       out_(0), out_len_(0), out_size_(out_default_), out_writev_(false),
+                       use_exc_(true)
     {
       ENTER_FUNCTION();
       CSL_DEBUGF( L"bfd(fd:%d)",fd );
@@ -87,6 +101,7 @@ namespace csl
     bfd::~bfd()
     {
       this->close();
+      if( out_ ) ::free( out_ );
     }
 
     uint64_t bfd::internal_read( int op_type,
@@ -124,98 +139,138 @@ namespace csl
             CSL_DEBUGF(L"cannot allocate more space");
             break;
           }
-          else if( can_read(timeout_ms) )
-          {
-            err = -1;
 
-            switch( op_type )
-            {
-              case read_op_:
-              {
-                err = ::read( fd_,tmp.data(),static_cast<size_t>(tmp.bytes()) );
-                CSL_DEBUGF(L"read(fd:%d, ptr:%p, len:%lld) => %d",
-                            fd_,
-                            tmp.data(),
-                            tmp.bytes(),
-                            err );
-                break;
-              }
-
-              case recv_op_:
-              {
-                err = ::recv( fd_,tmp.data(),static_cast<size_t>(tmp.bytes()), 0 );
-                CSL_DEBUGF(L"recv(fd:%d, ptr:%p, len:%lld, 0) => %d",
-                            fd_,
-                            tmp.data(),
-                            tmp.bytes(),
-                            err );
-                break;
-              }
-
-              case recvfrom_op_:
-              {
-                socklen_t slen = sizeof(SAI);
-                err = ::recvfrom( fd_,tmp.data(),static_cast<size_t>(tmp.bytes()), 0,
-                                  reinterpret_cast<struct sockaddr *>(&from),
-                                  &slen );
-                CSL_DEBUGF(L"recvfrom(fd:%d, ptr:%p, len:%lld, 0, from, len) => %d from [%s:%d]",
-                            fd_,
-                            tmp.data(),
-                            tmp.bytes(),
-                            err,
-                            inet_ntoa(from.sin_addr),
-                            ntohs(from.sin_port) );
-                break;
-              }
-
-              default:
-              {
-                THR(comm::exc::rs_unknown_op,ret);
-              }
-            };
-
-            if( err < 0 )
+          // try a non-blocking read first and wait only if the socket is empty.
+          // once some data arrived, the rest is read without waiting.
+          err = would_block_;
+          if( op_type != read_op_ ) err = read_once( op_type, tmp, from, true );
+
+          if( err == would_block_ )
+          {
+            uint32_t no_wait = 0;
+            if( can_read( ret > 0 ? no_wait : timeout_ms ) )
             {
-              CSL_DEBUGF(L"closing bad socket:%d",fd_);
-              CloseSocket( fd_ );
-              fd_ = fd_error_;
-              buf_.adjust( tmp, 0 );
-              break;
+              err = read_once( op_type, tmp, from, false );
             }
-            else if( err == 0 )
+            if( err == would_block_ )
             {
-              CSL_DEBUGF(L"peer closed connection. closing socket:%d",fd_);
-              CloseSocket( fd_ );
-              fd_ = closed_;
+              CSL_DEBUGF(L"cannot read");
               buf_.adjust( tmp, 0 );
               break;
             }
-            else if( err == static_cast<int>(tmp.bytes()) )
-            {
-              CSL_DEBUGF(L"filled the whole reserved %lld bytes, retry reading %lld bytes",
-                         read_amount, read_amount*2 );
-              read_amount *= 2;
-              ret += err;
-            }
-            else // err < tmp.bytes()
-            {
-              CSL_DEBUGF(L"read %d bytes into %lld bytes reserved",err,tmp.bytes());
-              ret += err;
-              buf_.adjust( tmp, err );
-              break;
-            }
           }
-          else
+
+          if( err < 0 )
           {
-            CSL_DEBUGF(L"cannot read");
+            CSL_DEBUGF(L"closing bad socket:%d",fd_);
+            CloseSocket( fd_ );
+            fd_ = fd_error_;
             buf_.adjust( tmp, 0 );
             break;
           }
+          else if( err == 0 )
+          {
+            CSL_DEBUGF(L"peer closed connection. closing socket:%d",fd_);
+            CloseSocket( fd_ );
+            fd_ = closed_;
+            buf_.adjust( tmp, 0 );
+            break;
+          }
+          else if( err == static_cast<int>(tmp.bytes()) )
+          {
+            CSL_DEBUGF(L"filled the whole reserved %lld bytes, retry reading %lld bytes",
+                       read_amount, read_amount*2 );
+            read_amount *= 2;
+            ret += err;
+          }
+          else // err < tmp.bytes()
+          {
+            CSL_DEBUGF(L"read %d bytes into %lld bytes reserved",err,tmp.bytes());
+            ret += err;
+            buf_.adjust( tmp, err );
+            break;
+          }
         }
       }
       RETURN_FUNCTION( ret );
     }
 
+    int bfd::read_once( int op_type,
+                        read_res & tmp,
+                        SAI & from,
+                        bool dontwait )
+    {
+      ENTER_FUNCTION();
+      int err = -1;
+      int flags = 0;
+
+#ifdef MSG_DONTWAIT
+      if( dontwait ) flags = MSG_DONTWAIT;
+#else
+      // no per-call non-blocking flag: wait for readiness first
+      if( dontwait ) RETURN_FUNCTION( would_block_ );
+#endif /*MSG_DONTWAIT*/
+
+      switch( op_type )
+      {
+        case read_op_:
+        {
+          err = ::read( fd_,tmp.data(),static_cast<size_t>(tmp.bytes()) );
+          CSL_DEBUGF(L"read(fd:%d, ptr:%p, len:%lld) => %d",
+                      fd_,
+                      tmp.data(),
+                      tmp.bytes(),
+                      err );
+          break;
+        }
+
+        case recv_op_:
+        {
+          err = ::recv( fd_,tmp.data(),static_cast<size_t>(tmp.bytes()), flags );
+          CSL_DEBUGF(L"recv(fd:%d, ptr:%p, len:%lld, %d) => %d",
+                      fd_,
+                      tmp.data(),
+                      tmp.bytes(),
+                      flags,
+                      err );
+          break;
+        }
+
+        case recvfrom_op_:
+        {
+          socklen_t slen = sizeof(SAI);
+          err = ::recvfrom( fd_,tmp.data(),static_cast<size_t>(tmp.bytes()), flags,
+                            reinterpret_cast<struct sockaddr *>(&from),
+                            &slen );
+          CSL_DEBUGF(L"recvfrom(fd:%d, ptr:%p, len:%lld, %d, from, len) => %d from [%s:%d]",
+                      fd_,
+                      tmp.data(),
+                      tmp.bytes(),
+                      flags,
+                      err,
+                      inet_ntoa(from.sin_addr),
+                      ntohs(from.sin_port) );
+          break;
+        }
+
+        default:
+        {
+          THR(comm::exc::rs_unknown_op,err);
+        }
+      };
+
+      if( err < 0 && dontwait && errno == EINTR )
+      {
+        err = would_block_;
+      }
+      else if( err < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) )
+      {
+        // also after the wait: the fd may be non-blocking and the data gone
+        err = would_block_;
+      }
+      RETURN_FUNCTION( err );
+    }
+
     uint64_t bfd::read_some(uint32_t & timeout_ms)
     {
       ENTER_FUNCTION();
@@ -343,15 +398,13 @@ namespace csl
 
       if( timeout_ms > 0 ) gettimeofday( &start_time, NULL );
 
-      fd_set         fds;
-      unsigned long  timeout_sec    = timeout_ms/1000;
-      unsigned long  timeout_usec   = (timeout_ms%1000)*1000;
-      struct timeval tv             = { timeout_sec, timeout_usec };
+      struct pollfd  pfd;
 
-      FD_ZERO( &fds );
-      FD_SET( fd_, &fds );
+      pfd.fd      = fd_;
+      pfd.events  = POLLIN;
+      pfd.revents = 0;
 
-      int err = ::select( fd_+1,&fds,NULL,NULL,&tv );
+      int err = PollSocket( &pfd, 1, static_cast<int>(timeout_ms) );
 
       if( timeout_ms > 0 )
       {
@@ -377,7 +430,7 @@ namespace csl
 
       if( err < 0 ) /* error */
       {
-        CSL_DEBUGF( L"select(...) => ERROR %d [%s] (closing socket)",
+        CSL_DEBUGF( L"poll(...) => ERROR %d [%s] (closing socket)",
                     err, strerror(errno) );
 
         CloseSocket( fd_ );
@@ -411,8 +464,10 @@ namespace csl
     {
       ENTER_FUNCTION();
       CSL_DEBUGF( L"close() fd:%d",fd_ );
+      if( fd_ > 0 && out_len_ > 0 ) { flush(); }
       if( fd_ > 0 ) { CloseSocket(fd_); }
       fd_ = closed_;
+      out_len_ = 0;
       LEAVE_FUNCTION();
     }
 
@@ -422,6 +477,8 @@ namespace csl
       CSL_DEBUGF( L"init(fd:%d)",fd );
       CSL_DEBUG_ASSERT( fd > 0 );
       fd_ = fd;
+      out_len_ = 0;
+      out_writev_ = false;
       LEAVE_FUNCTION();
     }
 
@@ -440,10 +497,18 @@ namespace csl
 
       if( !data || !sz ) { CSL_DEBUGF( L"invalid params");    goto bail; }
       if( fd_ <= 0 )     { CSL_DEBUGF( L"invalid fd:%d",fd_); goto bail; }
+      if( out_len_ > 0 ) { ret = internal_flush( data, sz, 0, 0 ); goto bail; }
 
       err = ::write( fd_, data, static_cast<size_t>(sz) );
 
-      if( err < 0 )
+      if( (err < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) ||
+          (err > 0 && static_cast<uint64_t>(err) < sz) )
+      {
+        // non-blocking fd: internal_flush() waits for room and sends the rest
+        uint64_t done = (err > 0 ? static_cast<uint64_t>(err) : 0);
+        ret = internal_flush( data+done, sz-done, 0, 0 );
+      }
+      else if( err < 0 )
       {
         CSL_DEBUGF( L"write(fd:%d, ptr:%p, sz:%lld) ERROR %d [%s]",
                     fd_, data, sz, err,strerror(errno) );
@@ -474,10 +539,18 @@ namespace csl
 
       if( !data || !sz ) { CSL_DEBUGF( L"invalid params"); goto bail; }
       if( fd_ <= 0 )     { CSL_DEBUGF( L"invalid fd:%d",fd_); goto bail; }
+      if( out_len_ > 0 ) { ret = internal_flush( data, sz, 0, 0 ); goto bail; }
 
       err = ::send( fd_, data, static_cast<size_t>(sz), 0 );
 
-      if( err < 0 )
+      if( (err < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) ||
+          (err > 0 && static_cast<uint64_t>(err) < sz) )
+      {
+        // non-blocking socket: internal_flush() waits for room and sends the rest
+        uint64_t done = (err > 0 ? static_cast<uint64_t>(err) : 0);
+        ret = internal_flush( data+done, sz-done, 0, 0 );
+      }
+      else if( err < 0 )
       {
         CSL_DEBUGF( L"send(fd:%d, ptr:%p, sz:%lld, 0) ERROR (returned %d)", fd_, data, sz, err );
         ShutdownCloseSocket( fd_ );
@@ -542,6 +615,461 @@ namespace csl
                   (ret==true?"TRUE":"FALSE") );
       RETURN_FUNCTION( ret );
     }
+
+    void bfd::set_out_size(uint64_t sz)
+    {
+      ENTER_FUNCTION();
+      CSL_DEBUGF( L"set_out_size(sz:%lld)",sz );
+      if( out_len_ > 0 ) { flush(); }
+      if( out_ ) { ::free( out_ ); out_ = 0; }
+      out_size_ = sz;
+      LEAVE_FUNCTION();
+    }
+
+    bool bfd::append(const uint8_t * data, uint64_t sz)
+    {
+      ENTER_FUNCTION();
+      CSL_DEBUGF( L"append(data:%p, sz:%lld) pending:%lld",data,sz,out_len_ );
+
+      if( !data || !sz ) { CSL_DEBUGF( L"invalid params"); RETURN_FUNCTION( false ); }
+      if( fd_ <= 0 )     { CSL_DEBUGF( L"invalid fd:%d",fd_); RETURN_FUNCTION( false ); }
+
+      if( out_len_ + sz > out_size_ )
+      {
+        // does not fit: send the buffered bytes together with this piece
+        RETURN_FUNCTION( internal_flush( data, sz, 0, 0 ) );
+      }
+
+      if( !out_ )
+      {
+        out_ = reinterpret_cast<uint8_t *>(::malloc( static_cast<size_t>(out_size_) ));
+        if( !out_ ) { RETURN_FUNCTION( internal_flush( data, sz, 0, 0 ) ); }
+      }
+
+      ::memcpy( out_+out_len_, data, static_cast<size_t>(sz) );
+      out_len_ += sz;
+      RETURN_FUNCTION( true );
+    }
+
+    bool bfd::fill(const uint8_t * data, uint64_t sz)
+    {
+      ENTER_FUNCTION();
+      CSL_DEBUGF( L"fill(data:%p, sz:%lld)",data,sz );
+      read_res tmp;
+      buf_.reserve( sz, tmp );
+      if( tmp.bytes() != sz )
+      {
+        if( tmp.bytes() > 0 ) buf_.adjust( tmp, 0 );
+        RETURN_FUNCTION( false );
+      }
+      ::memcpy( tmp.data(), data, static_cast<size_t>(sz) );
+      BFD_DEBUG_STATE("filled");
+      RETURN_FUNCTION( true );
+    }
+
+    void bfd::out_sent(uint64_t n)
+    {
+      if( n >= out_len_ ) { out_len_ = 0; return; }
+      ::memmove( out_, out_+n, static_cast<size_t>(out_len_-n) );
+      out_len_ -= n;
+    }
+
+    bool bfd::flush(bool more)
+    {
+      ENTER_FUNCTION();
+      if( out_len_ == 0 ) { RETURN_FUNCTION( true ); }
+      int flags = 0;
+#ifdef MSG_MORE
+      if( more ) flags = MSG_MORE;
+#endif /*MSG_MORE*/
+      RETURN_FUNCTION( internal_flush( 0, 0, 0, flags ) );
+    }
+
+    bool bfd::flush_to(const SAI & to)
+    {
+      ENTER_FUNCTION();
+      if( out_len_ == 0 ) { RETURN_FUNCTION( true ); }
+      RETURN_FUNCTION( internal_flush( 0, 0, &to, 0 ) );
+    }
+
+    bool bfd::flush_nb()
+    {
+      ENTER_FUNCTION();
+      if( out_len_ == 0 ) { RETURN_FUNCTION( true ); }
+      if( fd_ <= 0 )      { CSL_DEBUGF( L"invalid fd:%d",fd_); RETURN_FUNCTION( false ); }
+
+#if defined(MSG_DONTWAIT) && !defined(WIN32)
+      int flags = MSG_DONTWAIT;
+#ifdef MSG_NOSIGNAL
+      flags |= MSG_NOSIGNAL;
+#endif /*MSG_NOSIGNAL*/
+
+      while( out_len_ > 0 && out_writev_ == false )
+      {
+        ssize_t err = ::send( fd_, out_, static_cast<size_t>(out_len_), flags );
+
+        CSL_DEBUGF( L"send(fd:%d, len:%lld, MSG_DONTWAIT) => %lld",fd_,out_len_,
+                    static_cast<long long>(err) );
+
+        if( err > 0 )                                           { out_sent( static_cast<uint64_t>(err) ); continue; }
+        if( err < 0 && errno == EINTR )                         { continue; }
+        if( err < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) ) { RETURN_FUNCTION( true ); }
+        if( err < 0 && errno == ENOTSOCK )                      { break; }
+
+        CSL_DEBUGF( L"send on fd:%d ERROR [%s]",fd_,(err < 0 ? strerror(errno) : "closed") );
+        ShutdownCloseSocket( fd_ );
+        fd_ = (err == 0 ? closed_ : fd_error_);
+        RETURN_FUNCTION( false );
+      }
+      if( out_len_ == 0 ) { RETURN_FUNCTION( true ); }
+#endif /*MSG_DONTWAIT*/
+
+      // no per-call non-blocking send here
+      RETURN_FUNCTION( internal_flush( 0, 0, 0, 0 ) );
+    }
+
+    bool bfd::set_cork(bool on)
+    {
+      ENTER_FUNCTION();
+      bool ret = false;
+#ifdef TCP_CORK
+      int val = (on ? 1 : 0);
+      if( fd_ > 0 && ::setsockopt( fd_, IPPROTO_TCP, TCP_CORK, &val, sizeof(val) ) == 0 )
+      {
+        ret = true;
+      }
+#endif /*TCP_CORK*/
+      CSL_DEBUGF( L"set_cork(%s) fd:%d => %s",(on?"TRUE":"FALSE"),fd_,(ret?"TRUE":"FALSE") );
+      RETURN_FUNCTION( ret );
+    }
+
+    bool bfd::internal_flush( const uint8_t * extra,
+                              uint64_t extra_sz,
+                              const SAI * to,
+                              int flags )
+    {
+      ENTER_FUNCTION();
+      CSL_DEBUGF( L"internal_flush(extra:%p, extra_sz:%lld, to:%p, flags:%d) pending:%lld",
+                  extra, extra_sz, to, flags, out_len_ );
+
+      if( fd_ <= 0 ) { CSL_DEBUGF( L"invalid fd:%d",fd_); RETURN_FUNCTION( false ); }
+
+#ifdef WIN32
+      // no gathering calls, send the pieces one by one
+      bool wr = true;
+      if( out_len_ > 0 )
+      {
+        uint64_t len = out_len_;
+        out_len_ = 0;
+        wr = (to ? sendto(out_,len,*to) : send(out_,len));
+      }
+      if( wr && extra_sz > 0 )
+      {
+        wr = (to ? sendto(extra,extra_sz,*to) : send(extra,extra_sz));
+      }
+      RETURN_FUNCTION( wr );
+#else
+      struct iovec   iov[2];
+      struct msghdr  mh;
+      int            n_iov = 0;
+      bool           ret   = false;
+
+      if( out_len_ > 0 )
+      {
+        iov[n_iov].iov_base = out_;
+        iov[n_iov].iov_len  = static_cast<size_t>(out_len_);
+        ++n_iov;
+      }
+      if( extra && extra_sz > 0 )
+      {
+        iov[n_iov].iov_base = const_cast<uint8_t *>(extra);
+        iov[n_iov].iov_len  = static_cast<size_t>(extra_sz);
+        ++n_iov;
+      }
+
+      ::memset( &mh, 0, sizeof(mh) );
+      if( to )
+      {
+        mh.msg_name    = const_cast<SAI *>(to);
+        mh.msg_namelen = sizeof(SAI);
+      }
+
+      struct iovec * pos = iov;
+
+      while( n_iov > 0 )
+      {
+        ssize_t err = -1;
+
+        if( out_writev_ )
+        {
+          err = ::writev( fd_, pos, n_iov );
+        }
+        else
+        {
+          mh.msg_iov    = pos;
+          mh.msg_iovlen = n_iov;
+          err = ::sendmsg( fd_, &mh, flags );
+
+          if( err < 0 && errno == ENOTSOCK && !to )
+          {
+            // not a socket: use writev() from now on
+            CSL_DEBUGF( L"fd:%d is not a socket, falling back to writev()",fd_ );
+            out_writev_ = true;
+            continue;
+          }
+        }
+
+        CSL_DEBUGF( L"%s(fd:%d, n_iov:%d) => %lld",(out_writev_?"writev":"sendmsg"),fd_,n_iov,
+                    static_cast<long long>(err) );
+
+        if( err < 0 )
+        {
+          if( errno == EINTR ) continue;
+          if( errno == EAGAIN || errno == EWOULDBLOCK )
+          {
+            struct pollfd pfd;
+            pfd.fd      = fd_;
+            pfd.events  = POLLOUT;
+            pfd.revents = 0;
+            if( PollSocket( &pfd, 1, static_cast<int>(write_wait_ms_) ) > 0 ) continue;
+          }
+
+          CSL_DEBUGF( L"gathering write on fd:%d ERROR [%s]",fd_,strerror(errno) );
+          ShutdownCloseSocket( fd_ );
+          fd_ = fd_error_;
+          break;
+        }
+        else if( err == 0 )
+        {
+          CSL_DEBUGF( L"gathering write on fd:%d SOCKET CLOSED (returned 0)",fd_ );
+          ShutdownCloseSocket( fd_ );
+          fd_ = closed_;
+          break;
+        }
+
+        // skip the bytes written, a partial write leaves the rest in place
+        size_t done = static_cast<size_t>(err);
+        while( n_iov > 0 && done >= pos->iov_len )
+        {
+          done -= pos->iov_len;
+          ++pos;
+          --n_iov;
+        }
+        if( n_iov > 0 )
+        {
+          pos->iov_base = reinterpret_cast<uint8_t *>(pos->iov_base) + done;
+          pos->iov_len -= done;
+        }
+      }
+
+      if( n_iov == 0 ) ret = true;
+      out_len_ = 0;
+      RETURN_FUNCTION( ret );
+#endif /*WIN32*/
+    }
+
+    bool bfd::send_file(int fd, uint64_t offset, uint64_t len)
+    {
+      ENTER_FUNCTION();
+      bool ret = false;
+      CSL_DEBUGF( L"send_file(fd:%d, offset:%lld, len:%lld)",fd,offset,len );
+
+      if( fd < 0 )       { CSL_DEBUGF( L"invalid source fd:%d",fd); goto bail; }
+      if( fd_ <= 0 )     { CSL_DEBUGF( L"invalid fd:%d",fd_); goto bail; }
+      if( out_len_ > 0 && internal_flush( 0, 0, 0, 0 ) == false ) goto bail;
+      if( len == 0 )     { ret = true; goto bail; }
+
+#ifdef __linux__
+      {
+        struct stat st;
+        if( ::fstat( fd, &st ) == 0 && S_ISREG(st.st_mode) )
+          ret = sendfile_range( fd, offset, len );
+        else
+          ret = splice_range( fd, len );
+      }
+#else
+      ret = copy_range( fd, offset, len, true );
+#endif /*__linux__*/
+
+    bail:
+      CSL_DEBUGF( L"send_file(fd:%d, offset:%lld, len:%lld) => %s",fd,offset,len,(ret==true?"TRUE":"FALSE") );
+      RETURN_FUNCTION( ret );
+    }
+
+    bool bfd::send_zfile(const char * filename)
+    {
+      ENTER_FUNCTION();
+      bool ret = false;
+      int  fd  = -1;
+      struct stat st;
+
+      if( !filename ) { CSL_DEBUGF( L"invalid filename"); goto bail; }
+
+      fd = ::open( filename, O_RDONLY );
+      if( fd < 0 )    { CSL_DEBUGF( L"cannot open %s",filename); goto bail; }
+
+      if( ::fstat( fd, &st ) == 0 )
+      {
+        ret = send_file( fd, 0, static_cast<uint64_t>(st.st_size) );
+      }
+      ::close( fd );
+
+    bail:
+      CSL_DEBUGF( L"send_zfile(%s) => %s",(filename?filename:"NULL"),(ret==true?"TRUE":"FALSE") );
+      RETURN_FUNCTION( ret );
+    }
+
+    bool bfd::wait_writable()
+    {
+      struct pollfd pfd;
+      pfd.fd      = fd_;
+      pfd.events  = POLLOUT;
+      pfd.revents = 0;
+      return ( PollSocket( &pfd, 1, static_cast<int>(write_wait_ms_) ) > 0 );
+    }
+
+    void bfd::fail_transfer( const char * what )
+    {
+      CSL_DEBUGF( L"%s on fd:%d ERROR [%s]",what,fd_,strerror(errno) );
+      ShutdownCloseSocket( fd_ );
+      fd_ = fd_error_;
+    }
+
+    bool bfd::sendfile_range( int fd, uint64_t offset, uint64_t len )
+    {
+#ifdef __linux__
+      off_t    off  = static_cast<off_t>(offset);
+      uint64_t sent = 0;
+
+      while( sent < len )
+      {
+        uint64_t chunk = len-sent;
+        if( chunk > file_chunk_ ) chunk = file_chunk_;
+
+        ssize_t err = ::sendfile( fd_, fd, &off, static_cast<size_t>(chunk) );
+
+        if( err > 0 ) { sent += static_cast<uint64_t>(err); continue; }
+        if( err < 0 && errno == EINTR ) continue;
+        if( err < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && wait_writable() ) continue;
+
+        if( err < 0 && (errno == EINVAL || errno == ENOSYS) && sent == 0 )
+        {
+          CSL_DEBUGF( L"sendfile() is not supported on fd:%d, copying",fd_ );
+          return copy_range( fd, offset, len, true );
+        }
+
+        // err == 0 : the file is shorter than the range
+        fail_transfer( "sendfile" );
+        return false;
+      }
+      return true;
+#else
+      return copy_range( fd, offset, len, true );
+#endif /*__linux__*/
+    }
+
+    bool bfd::splice_range( int fd, uint64_t len )
+    {
+#ifdef __linux__
+      int pp[2];
+      if( ::pipe( pp ) != 0 ) return copy_range( fd, 0, len, false );
+
+      uint64_t     sent  = 0;
+      bool         ret   = true;
+
+      while( ret && sent < len )
+      {
+        uint64_t chunk = len-sent;
+        if( chunk > pipe_chunk_ ) chunk = pipe_chunk_;
+
+        ssize_t in = ::splice( fd, 0, pp[1], 0, static_cast<size_t>(chunk), SPLICE_F_MOVE );
+
+        if( in < 0 && errno == EINTR ) continue;
+        if( in < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) )
+        {
+          struct pollfd pfd;
+          pfd.fd      = fd;
+          pfd.events  = POLLIN;
+          pfd.revents = 0;
+          if( PollSocket( &pfd, 1, static_cast<int>(write_wait_ms_) ) > 0 ) continue;
+        }
+        if( in < 0 && (errno == EINVAL || errno == ENOSYS) && sent == 0 )
+        {
+          CSL_DEBUGF( L"splice() is not supported on the source fd:%d, copying",fd );
+          ret = copy_range( fd, 0, len, false );
+          break;
+        }
+        if( in <= 0 ) { fail_transfer( "splice from source" ); ret = false; break; }
+
+        // move what is in the pipe to fd_, hinting more only while the range continues
+        uint64_t     left  = static_cast<uint64_t>(in);
+        unsigned int flags = SPLICE_F_MOVE;
+        if( sent+left < len ) flags |= SPLICE_F_MORE;
+        while( left > 0 )
+        {
+          ssize_t out = ::splice( pp[0], 0, fd_, 0, static_cast<size_t>(left), flags );
+
+          if( out > 0 ) { left -= static_cast<uint64_t>(out); continue; }
+          if( out < 0 && errno == EINTR ) continue;
+          if( out < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && wait_writable() ) continue;
+          if( out < 0 && errno == EINVAL )
+          {
+            // fd_ does not take splice(): copy what is in the pipe and the rest
+            CSL_DEBUGF( L"splice() is not supported on fd:%d, copying",fd_ );
+            ret = ( copy_range( pp[0], 0, left, false ) &&
+                    copy_range( fd, 0, len-sent-static_cast<uint64_t>(in), false ) );
+            sent = len;
+            break;
+          }
+          fail_transfer( "splice to fd" );
+          ret = false;
+          break;
+        }
+        if( sent < len ) sent += static_cast<uint64_t>(in);
+      }
+
+      ::close( pp[0] );
+      ::close( pp[1] );
+      return ret;
+#else
+      return copy_range( fd, 0, len, false );
+#endif /*__linux__*/
+    }
+
+    bool bfd::copy_range( int fd, uint64_t offset, uint64_t len, bool seekable )
+    {
+      std::vector<uint8_t> buf( static_cast<size_t>(len < pipe_chunk_ ? len : pipe_chunk_) );
+
+      while( len > 0 )
+      {
+        size_t  chunk = static_cast<size_t>(len < buf.size() ? len : buf.size());
+        ssize_t rd    = -1;
+
+#ifndef WIN32
+        if( seekable ) rd = ::pread( fd, &(buf[0]), chunk, static_cast<off_t>(offset) );
+        else           rd = ::read( fd, &(buf[0]), chunk );
+#else
+        if( seekable && ::lseek( fd, static_cast<long>(offset), SEEK_SET ) < 0 ) rd = -1;
+        else rd = ::read( fd, &(buf[0]), static_cast<unsigned int>(chunk) );
+#endif /*WIN32*/
+
+        if( rd < 0 && errno == EINTR ) continue;
+        if( rd < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) )
+        {
+          struct pollfd pfd;
+          pfd.fd      = fd;
+          pfd.events  = POLLIN;
+          pfd.revents = 0;
+          if( PollSocket( &pfd, 1, static_cast<int>(write_wait_ms_) ) > 0 ) continue;
+        }
+        if( rd <= 0 ) { fail_transfer( "read from source" ); return false; }
+
+        if( internal_flush( &(buf[0]), static_cast<uint64_t>(rd), 0, 0 ) == false ) return false;
+        offset += static_cast<uint64_t>(rd);
+        len    -= static_cast<uint64_t>(rd);
+      }
+      return true;
+    }
   }
 }
 
@@ -60,7 +60,10 @@ namespace csl
     Buffering helps to merge small pieces together. However the application must keep in mind that it only
     have a limited buffer space, so care must be taken.
 
-    The write-like operations are not buffered at all.
+    The write(), send() and sendto() operations are not buffered. For messages built from many small
+    pieces append() collects the pieces in an output buffer, and flush() or flush_to() sends them
+    with a single gathering syscall (writev() or sendmsg()). The output buffer is flushed automatically
+    when it would overflow, and before write() and send() so the byte order is kept.
 
     The internal buffer space is initially 1k, this may grow dynamically up to 256k.
     */
@@ -98,12 +101,104 @@ namespace csl
         bool send(const uint8_t * data, uint64_t sz);   ///<send() to fd_ without buffering
         bool sendto(const uint8_t * data, uint64_t sz,const SAI & to); ///<sendto() on fd_ without buffering
 
+        /**
+        @brief appends data to the output buffer
+        @param data is the data to be sent
+        @param sz is the size of data
+        @return false if the buffer had to be flushed and that failed
+
+        small pieces are copied into the output buffer. when the piece does not fit, the
+        buffered bytes and the piece are sent together, without copying the piece.
+        */
+        bool append(const uint8_t * data, uint64_t sz);
+
+        /**
+        @brief sends the output buffer
+        @param more tells the kernel that more data follows (MSG_MORE on sockets)
+        @return true if all buffered bytes were sent
+        */
+        bool flush(bool more=false);
+
+        /** @brief sends the output buffer as a single datagram to the given address */
+        bool flush_to(const SAI & to);
+
+        /**
+        @brief sends as much of the output buffer as the socket takes without waiting
+        @return false if the send failed, the fd is closed then
+
+        the bytes not sent stay in the buffer, out_pending() tells how many. this lets
+        an event loop wait for the socket to be writable instead of blocking in flush().
+        */
+        bool flush_nb();
+
+        /**
+        @brief sends a range of an other fd without copying it through user space
+        @param fd is the source: a regular file, a pipe or a socket
+        @param offset is the start of the range (ignored if fd is not a regular file)
+        @param len is the number of bytes to send
+        @return true if all len bytes were sent
+
+        the buffered output goes first. regular files are sent by sendfile(), other
+        sources are spliced through a pipe. where the kernel supports neither, the
+        bytes are copied through a small buffer. a failed transfer closes the fd as
+        the receiver cannot tell where the range was cut.
+        */
+        bool send_file(int fd, uint64_t offset, uint64_t len);
+
+        /**
+        @brief sends a file written by common::zfile::write_zfile() as it is
+        @param filename is the name of the compressed file
+        @return true if the whole file was sent
+
+        the compressed bytes go from the page cache to the socket, the receiver
+        passes them to common::zfile::put_zdata(). the size is not sent, the caller
+        frames the transfer.
+        */
+        bool send_zfile(const char * filename);
+
+        /**
+        @brief sets TCP_CORK on the socket
+        @return false if not supported or setsockopt() failed
+
+        while corked the kernel only sends full frames. uncorking sends the pending partial frame.
+        */
+        bool set_cork(bool on);
+
+        /**
+        @brief sets the output buffer size
+        @param sz is the size of the output buffer (0 disables buffering in append())
+
+        the buffer is allocated on the first append(), the default is out_default_ bytes
+        */
+        void set_out_size(uint64_t sz);
+
+        /**
+        @brief appends data received by other means to the input buffer
+        @return false if the buffer cannot grow enough
+
+        this lets an io_uring driven loop hand over the completed reads
+        */
+        bool fill(const uint8_t * data, uint64_t sz);
+
+        /** @brief the buffered output bytes, to be sent by other means */
+        const uint8_t * out_data() const { return out_; }
+
+        /** @brief drops n bytes from the front of the output buffer after they were sent by other means */
+        void out_sent(uint64_t n);
+
+        uint64_t out_size() const    { return out_size_; } ///<returns the output buffer size
+        uint64_t out_pending() const { return out_len_;  } ///<returns the number of buffered output bytes
+
         static const int ok_                =  0;
         static const int unknonwn_error_    = -1;
         static const int not_initialized_   = -2;
         static const int closed_            = -3;
         static const int fd_error_          = -4;
         static const uint64_t max_size_     = 256*1024;
+        static const uint64_t out_default_  = 4*1024;
+        static const uint32_t write_wait_ms_ = 10000;
+        static const uint64_t file_chunk_    = 1024*1024*1024;  ///<largest sendfile() call
+        static const uint64_t pipe_chunk_    = 64*1024;         ///<largest splice() and copy step
 
         int state() const;         ///<returns the fd state
         uint64_t size() const;     ///<returns the available data size
@@ -114,6 +209,10 @@ namespace csl
         @return true if available
         @param timeout_ms tells how many milliseconds to wait for data
 
+        poll() is used, so there is no limit on the fd number. note that the
+        read-like operations do not call this before every read: they try a
+        non-blocking read first, and only wait when the socket is empty.
+
         timeout_ms will be modified to tell how many milliseconds left from the
         given timeout
         */
@@ -133,11 +232,45 @@ namespace csl
         static const int recv_op_      = 2;
         static const int recvfrom_op_  = 3;
 
+        static const int would_block_  = -2;
+
         uint64_t internal_read( int op_type,
                                 SAI & from,
                                 uint32_t & timeout_ms );
+
+        /* a single read-like call, returns would_block_ if dontwait was set and there is no data */
+        int read_once( int op_type,
+                       read_res & tmp,
+                       SAI & from,
+                       bool dontwait );
+
+        /* sends the output buffer followed by extra in one gathering call */
+        bool internal_flush( const uint8_t * extra,
+                             uint64_t extra_sz,
+                             const SAI * to,
+                             int flags );
+
+        /* waits until fd_ can take more bytes */
+        bool wait_writable();
+
+        /* the transfer paths of send_file(), offset is ignored by the non-seekable ones */
+        bool sendfile_range( int fd, uint64_t offset, uint64_t len );
+        bool splice_range( int fd, uint64_t len );
+        bool copy_range( int fd, uint64_t offset, uint64_t len, bool seekable );
+
+        /* closes fd_ after a failed transfer */
+        void fail_transfer( const char * what );
+
         int        fd_;
         buf_t      buf_;
+        uint8_t *  out_;
+        uint64_t   out_len_;
+        uint64_t   out_size_;
+        bool       out_writev_;
+
+        // no-copy
+        bfd(const bfd & other);
+        bfd & operator=(const bfd & other);
 
         CSL_OBJ(csl::comm,bfd);
         USE_EXC();
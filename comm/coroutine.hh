@@ -0,0 +1,875 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _csl_comm_coroutine_hh_included_
+#define _csl_comm_coroutine_hh_included_
+
+/**
+   @file coroutine.hh
+   @brief stackless coroutines for writing connection handlers as linear code
+ */
+
+#include "codesloop/comm/handler.hh"
+#include "codesloop/comm/connid.hh"
+#include "codesloop/comm/sai.hh"
+#include "codesloop/comm/bfd.hh"
+#include "codesloop/comm/tcp_lstnr.hh"
+#include "codesloop/nthread/rwlock.hh"
+#include "codesloop/nthread/mutex.hh"
+#include "codesloop/nthread/event.hh"
+#include "codesloop/nthread/thread.hh"
+#include "codesloop/nthread/timer_wheel.hh"
+#include "codesloop/common/metrics.hh"
+#include "codesloop/common/common.h"
+#ifdef __cplusplus
+#include <map>
+#include <vector>
+
+/* the awaitables of co_coroutine are there when built with -std=c++20 */
+#if defined(__cpp_impl_coroutine) && (__cpp_impl_coroutine >= 201902L)
+# define CSL_COMM_CXX20_COROUTINES 1
+# include <coroutine>
+#endif
+
+namespace csl
+{
+  namespace comm
+  {
+    /**
+       @brief base class of the stackless, per connection coroutines
+
+       the coroutine body is the resume() function written between CSL_CO_BEGIN
+       and CSL_CO_END. the await macros save the position and return to the
+       caller when the awaited data is not in the buffer yet. the next resume()
+       call jumps back to the saved position, so a multi-step protocol exchange
+       reads as straight code while no thread is blocked between the steps.
+
+       besides data, a coroutine run by an attached coro_handler may wait for
+       its output to be sent (CSL_CO_WRITE), for some time (CSL_CO_SLEEP), for
+       a co_event (CSL_CO_AWAIT_EVENT) and for its deadline.
+
+       these are protothread style coroutines, not C++20 ones: the tree is
+       built with the compiler's default language standard, and C++20
+       coroutines would need -std=c++20 for every user of the comm headers.
+       the code built with -std=c++20 may use co_coroutine instead, which
+       runs a real C++20 coroutine on top of this class.
+
+       the position is kept in a switch statement (like Duff's device), so:
+
+       - local variables do not survive an await, keep the state in members
+       - the await macros may not be used inside a nested switch statement
+
+       @code
+       class greeter : public coroutine
+       {
+         read_res rr_;
+         public:
+           status_t resume(bfd & b)
+           {
+             CSL_CO_BEGIN;
+             CSL_CO_READ( b, 4, rr_ );       // wait for the 4 byte hello
+             b.send( rr_.data(), 4 );
+             CSL_CO_READ( b, 8, rr_ );       // wait for the request
+             ...
+             CSL_CO_END;
+           }
+       };
+       @endcode
+     */
+    class coroutine
+    {
+      public:
+        enum status_t {
+          wait_   = 0,  ///<waits for more data
+          done_   = 1,  ///<finished, the connection is to be closed
+          failed_ = 2   ///<protocol error or the deadline passed
+        };
+
+        /**
+           @brief resumes the suspended coroutines without data arrival
+
+           implemented by coro_handler, the coroutine calls it when it is
+           suspended on a timer, an event or its output
+         */
+        class scheduler
+        {
+          public:
+            /** @brief resumes the connection's coroutine soon, may be called from any thread */
+            virtual void wake(connid_t id) = 0;
+
+            /** @brief resumes the coroutine at the given metrics::now_usec() time, 0 disarms */
+            virtual void set_alarm(coroutine & c, uint64_t at_usec) = 0;
+
+            /** @brief called by the timer wheel when an alarm fires */
+            virtual void on_alarm(connid_t id) = 0;
+
+            virtual ~scheduler() { }
+        };
+
+        inline coroutine() : co_line_(0), co_deadline_(0), co_wakeup_(0),
+                             co_alarm_at_(0), co_wake_(false), co_alarm_set_(false),
+                             id_(0), sched_(0) { alarm_.co_ = this; }
+
+        virtual ~coroutine() { if( sched_ ) sched_->set_alarm( *this, 0 ); }
+
+        /**
+           @brief runs the coroutine until it awaits or finishes
+           @param b is the connection's buffered fd
+          */
+        virtual status_t resume(bfd & b) = 0;
+
+        /**
+           @brief called once before the first resume()
+           @param s resumes the coroutine on timers and events, NULL if only data arrival does
+          */
+        inline void start(connid_t id, const SAI & peer, scheduler * s=0)
+        {
+          id_      = id;
+          peer_    = peer;
+          co_line_ = 0;
+          sched_   = s;
+        }
+
+        /** @brief true if the coroutine has finished */
+        inline bool is_finished() const { return co_line_ == -1; }
+
+        /** @brief the connection id */
+        inline connid_t id() const { return id_; }
+
+        /** @brief the peer's address */
+        inline const SAI & peer() const { return peer_; }
+
+        /**
+           @brief sets a deadline for the following awaits
+           @param timeout_ms is counted from now, 0 clears the deadline
+
+           the deadline is checked whenever the coroutine is resumed, so it
+           catches peers sending a message byte by byte. with a scheduler the
+           suspended coroutine is also resumed when the deadline passes, so a
+           silent peer fails the same way.
+          */
+        inline void set_deadline(uint32_t timeout_ms)
+        {
+          co_deadline_ = ( timeout_ms == 0 ? 0 :
+                           common::metrics::now_usec()+1000ULL*timeout_ms );
+        }
+
+        /** @brief true if the deadline has passed */
+        inline bool deadline_passed() const
+        {
+          return ( co_deadline_ != 0 && common::metrics::now_usec() > co_deadline_ );
+        }
+
+        /** @brief starts a CSL_CO_SLEEP */
+        inline void sleep_for(uint32_t timeout_ms)
+        {
+          co_wakeup_ = common::metrics::now_usec()+1000ULL*timeout_ms;
+        }
+
+        /** @brief true when the time of CSL_CO_SLEEP has passed */
+        inline bool slept()
+        {
+          if( common::metrics::now_usec() < co_wakeup_ ) return false;
+          co_wakeup_ = 0;
+          return true;
+        }
+
+        /** @brief true if the output is sent, otherwise asks to be resumed once it is */
+        inline bool output_sent(bfd & b)
+        {
+          if( b.out_pending() == 0 ) return true;
+          co_wake_ = true;
+          return false;
+        }
+
+        /** @brief called by the await macros before they return: arms the alarm, asks for the wakeup */
+        inline void suspend()
+        {
+          if( sched_ == 0 ) return;
+
+          uint64_t at = co_deadline_;
+          if( co_wakeup_ != 0 && (at == 0 || co_wakeup_ < at) ) at = co_wakeup_;
+          if( at != 0 || co_alarm_set_ )
+          {
+            sched_->set_alarm( *this, at );
+            co_alarm_set_ = (at != 0);
+          }
+
+          if( co_wake_ )
+          {
+            co_wake_ = false;
+            sched_->wake( id_ );
+          }
+        }
+
+        /** @brief the scheduler given to start() */
+        inline scheduler * get_scheduler() const { return sched_; }
+
+      protected:
+        int        co_line_;
+        uint64_t   co_deadline_;
+        uint64_t   co_wakeup_;
+
+      private:
+        template <typename C> friend class coro_handler;
+
+        /* fires on the deadline or at the end of a CSL_CO_SLEEP */
+        class alarm : public nthread::timer_wheel::timer
+        {
+          public:
+            alarm() : co_(0) { }
+            virtual void operator()(void) { co_->sched_->on_alarm( co_->id_ ); }
+            coroutine * co_;
+        };
+
+        alarm        alarm_;
+        uint64_t     co_alarm_at_;    ///<guarded by the scheduler
+        bool         co_wake_;
+        bool         co_alarm_set_;
+        connid_t     id_;
+        SAI          peer_;
+        scheduler *  sched_;
+    };
+
+    /**
+       @brief an event the coroutines wait for with CSL_CO_AWAIT_EVENT or co_wait()
+
+       nthread::event blocks the waiting thread, a co_event suspends the
+       waiting coroutines instead and wakes them through their scheduler.
+       like with nthread::event, every notification lets one wait succeed,
+       and the notifications nobody waits for are kept for the next waits.
+       a notification resumes all the waiting coroutines, the ones that do
+       not get it wait again. the waiters closed in the meantime are not
+       woken: tcp::lstnr drops the wakes of the closed connection ids, so
+       a new connection reusing the slot is not resumed by mistake.
+     */
+    class co_event
+    {
+      public:
+        inline co_event() : available_(0) { }
+
+        /** @brief lets n waits succeed, may be called from any thread */
+        inline void notify(unsigned int n=1)
+        {
+          waiters_t w;
+          {
+            nthread::scoped_mutex m(mtx_);
+            available_ += n;
+            w.swap( waiters_ );
+          }
+          for( size_t i=0;i<w.size();++i ) w[i].first->wake( w[i].second );
+        }
+
+        /** @brief takes a notification, or registers the coroutine for the next one */
+        inline bool take(coroutine & c)
+        {
+          nthread::scoped_mutex m(mtx_);
+          if( available_ > 0 ) { --available_; return true; }
+
+          coroutine::scheduler * s = c.get_scheduler();
+          if( s != 0 )
+          {
+            waiter w( s, c.id() );
+            for( size_t i=0;i<waiters_.size();++i ) if( waiters_[i] == w ) return false;
+            waiters_.push_back( w );
+          }
+          return false;
+        }
+
+        /** @brief the number of notifications not taken yet */
+        inline unsigned int available_count()
+        {
+          nthread::scoped_mutex m(mtx_);
+          return available_;
+        }
+
+      private:
+        typedef std::pair<coroutine::scheduler *, connid_t> waiter;
+        typedef std::vector<waiter> waiters_t;
+
+        nthread::mutex   mtx_;
+        unsigned int     available_;
+        waiters_t        waiters_;
+
+        /* no-copy */
+        co_event(const co_event & other);
+        co_event & operator=(const co_event & other);
+    };
+
+/** @brief starts the coroutine body */
+#define CSL_CO_BEGIN \
+  switch( this->co_line_ ) { case 0:
+
+/** @brief finishes the coroutine body, the connection is closed */
+#define CSL_CO_END \
+  } this->co_line_ = -1; return csl::comm::coroutine::done_
+
+/** @brief returns until COND becomes true, fails when the deadline passes */
+#define CSL_CO_AWAIT(COND) \
+  do { \
+    this->co_line_ = __LINE__; case __LINE__: \
+    if( !(COND) ) { \
+      if( this->deadline_passed() ) { \
+        this->co_line_ = -1; return csl::comm::coroutine::failed_; \
+      } \
+      this->suspend(); \
+      return csl::comm::coroutine::wait_; \
+    } \
+  } while(0)
+
+/** @brief waits until at least N bytes are in the buffer */
+#define CSL_CO_AWAIT_BYTES(BFD,N) \
+  CSL_CO_AWAIT( (BFD).size() >= static_cast<uint64_t>(N) )
+
+/** @brief waits for N bytes and reads them into the RR read_res */
+#define CSL_CO_READ(BFD,N,RR) \
+  do { \
+    CSL_CO_AWAIT_BYTES( BFD, N ); \
+    (BFD).read_buf( (RR), (N) ); \
+  } while(0)
+
+/** @brief appends N bytes of DATA to the output and waits until they are sent */
+#define CSL_CO_WRITE(BFD,DATA,N) \
+  do { \
+    if( (BFD).append( (DATA), (N) ) == false ) CSL_CO_FAIL; \
+    CSL_CO_AWAIT( this->output_sent( BFD ) ); \
+  } while(0)
+
+/** @brief waits for MS milliseconds */
+#define CSL_CO_SLEEP(MS) \
+  do { \
+    this->sleep_for( MS ); \
+    CSL_CO_AWAIT( this->slept() ); \
+  } while(0)
+
+/** @brief waits for a notification of the EV co_event */
+#define CSL_CO_AWAIT_EVENT(EV) \
+  CSL_CO_AWAIT( (EV).take( *this ) )
+
+/** @brief returns, and continues here at the next data arrival */
+#define CSL_CO_YIELD \
+  do { \
+    this->co_line_ = __LINE__; this->suspend(); return csl::comm::coroutine::wait_; \
+    case __LINE__: ; \
+  } while(0)
+
+/** @brief finishes the coroutine, the connection is closed */
+#define CSL_CO_RETURN \
+  do { this->co_line_ = -1; return csl::comm::coroutine::done_; } while(0)
+
+/** @brief finishes the coroutine with an error, the connection is closed */
+#define CSL_CO_FAIL \
+  do { this->co_line_ = -1; return csl::comm::coroutine::failed_; } while(0)
+
+#ifdef CSL_COMM_CXX20_COROUTINES
+    /**
+       @brief the frame of a co_coroutine's body
+
+       the body starts suspended, and stays suspended at its end, so the
+       co_coroutine decides when it runs and when its frame goes away.
+       an exception leaving the body fails the coroutine.
+     */
+    class co_task
+    {
+      public:
+        struct promise_type
+        {
+          bool failed_;
+
+          promise_type() : failed_(false) { }
+
+          co_task get_return_object()
+          {
+            return co_task( std::coroutine_handle<promise_type>::from_promise(*this) );
+          }
+
+          std::suspend_always initial_suspend() noexcept { return std::suspend_always(); }
+          std::suspend_always final_suspend() noexcept   { return std::suspend_always(); }
+          void return_void() { }
+          void unhandled_exception() { failed_ = true; }
+        };
+
+        typedef std::coroutine_handle<promise_type> handle_t;
+
+        inline co_task() : h_() { }
+        inline co_task(co_task && other) : h_(other.h_) { other.h_ = handle_t(); }
+        inline ~co_task() { reset(); }
+
+        inline co_task & operator=(co_task && other)
+        {
+          if( this != &other )
+          {
+            reset();
+            h_ = other.h_;
+            other.h_ = handle_t();
+          }
+          return *this;
+        }
+
+        /** @brief destroys the frame with the locals of the body */
+        inline void reset()
+        {
+          if( h_ ) h_.destroy();
+          h_ = handle_t();
+        }
+
+        inline bool valid() const  { return static_cast<bool>(h_); }
+        inline bool done() const   { return h_.done(); }
+        inline bool failed() const { return h_.promise().failed_; }
+        inline void resume()       { h_.resume(); }
+
+      private:
+        explicit co_task(handle_t h) : h_(h) { }
+
+        handle_t h_;
+    };
+
+    /**
+       @brief a coroutine written as a C++20 coroutine
+
+       the body is the run() function, it is started at the first resume()
+       and awaits the co_read(), co_write(), co_sleep(), co_wait() and
+       co_fail() awaitables. these wait the same way as the CSL_CO_READ,
+       CSL_CO_WRITE, CSL_CO_SLEEP and CSL_CO_AWAIT_EVENT macros do, with the
+       same deadline handling, so coro_handler runs both kinds alike. unlike
+       with the macros, the local variables survive the awaits.
+
+       the body finishes the coroutine with co_return, and fails it with
+       co_await co_fail() or with an exception.
+
+       @code
+       class greeter : public co_coroutine
+       {
+         public:
+           co_task run(bfd & b)
+           {
+             read_res rr;
+             co_await co_read( b, 4, rr );      // wait for the 4 byte hello
+             co_await co_write( b, rr.data(), 4 );
+             co_await co_read( b, 8, rr );      // wait for the request
+             ...
+           }
+       };
+       @endcode
+     */
+    class co_coroutine : public coroutine
+    {
+      public:
+        inline co_coroutine() : pending_(0), co_failed_(false) { }
+
+        /** @brief the body of the coroutine, called at the first resume() */
+        virtual co_task run(bfd & b) = 0;
+
+        virtual status_t resume(bfd & b)
+        {
+          if( co_line_ == -1 ) return ( co_failed_ ? failed_ : done_ );
+
+          if( co_line_ == 0 )
+          {
+            co_failed_ = false;
+            pending_   = 0;
+            task_      = run( b );
+            co_line_   = 1;
+          }
+          else if( pending_ != 0 && pending_->ready() == false )
+          {
+            if( deadline_passed() ) return finish( true );
+            suspend();
+            return wait_;
+          }
+
+          pending_ = 0;
+          task_.resume();
+
+          if( task_.done() ) return finish( task_.failed() );
+          if( co_failed_ || deadline_passed() ) return finish( true );
+          suspend();
+          return wait_;
+        }
+
+      protected:
+        /* the condition of a co_await, checked again when the coroutine is resumed */
+        class condition
+        {
+          public:
+            inline condition(co_coroutine * c) : co_(c) { }
+            virtual ~condition() { }
+            virtual bool ready() = 0;
+
+            inline bool await_ready() { return ready(); }
+            inline void await_suspend(std::coroutine_handle<>) { co_->pending_ = this; }
+
+          protected:
+            co_coroutine * co_;
+        };
+
+        /* waits for n bytes and reads them into rr */
+        class read_awaiter : public condition
+        {
+          public:
+            inline read_awaiter(co_coroutine * c, bfd & b, uint64_t n, common::read_res & rr)
+              : condition(c), b_(b), n_(n), rr_(rr) { }
+
+            virtual bool ready() { return ( b_.size() >= n_ ); }
+            inline void await_resume() { b_.read_buf( rr_, n_ ); }
+
+          private:
+            bfd &               b_;
+            uint64_t            n_;
+            common::read_res &  rr_;
+        };
+
+        /* appends the data to the output and waits until it is sent */
+        class write_awaiter : public condition
+        {
+          public:
+            inline write_awaiter(co_coroutine * c, bfd & b, const uint8_t * data, uint64_t n)
+              : condition(c), b_(b), ok_(b.append( data, n )) { }
+
+            virtual bool ready()
+            {
+              if( ok_ == false ) { co_->co_failed_ = true; return false; }
+              return co_->output_sent( b_ );
+            }
+            inline void await_resume() { }
+
+          private:
+            bfd &  b_;
+            bool   ok_;
+        };
+
+        /* waits until co_sleep()'s time has passed */
+        class sleep_awaiter : public condition
+        {
+          public:
+            inline sleep_awaiter(co_coroutine * c) : condition(c) { }
+            virtual bool ready() { return co_->slept(); }
+            inline void await_resume() { }
+        };
+
+        /* waits for a notification of the co_event */
+        class event_awaiter : public condition
+        {
+          public:
+            inline event_awaiter(co_coroutine * c, co_event & ev) : condition(c), ev_(ev) { }
+            virtual bool ready() { return ev_.take( *co_ ); }
+            inline void await_resume() { }
+
+          private:
+            co_event & ev_;
+        };
+
+        /* never resumed, the coroutine fails */
+        class fail_awaiter : public condition
+        {
+          public:
+            inline fail_awaiter(co_coroutine * c) : condition(c) { }
+            virtual bool ready() { co_->co_failed_ = true; return false; }
+            inline void await_resume() { }
+        };
+
+        /** @brief waits until n bytes are in the buffer and reads them into rr */
+        inline read_awaiter co_read(bfd & b, uint64_t n, common::read_res & rr)
+        {
+          return read_awaiter( this, b, n, rr );
+        }
+
+        /** @brief appends n bytes of data to the output and waits until they are sent */
+        inline write_awaiter co_write(bfd & b, const uint8_t * data, uint64_t n)
+        {
+          return write_awaiter( this, b, data, n );
+        }
+
+        /** @brief waits for ms milliseconds */
+        inline sleep_awaiter co_sleep(uint32_t ms)
+        {
+          sleep_for( ms );
+          return sleep_awaiter( this );
+        }
+
+        /** @brief waits for a notification of ev */
+        inline event_awaiter co_wait(co_event & ev)
+        {
+          return event_awaiter( this, ev );
+        }
+
+        /** @brief finishes the coroutine with an error, the connection is closed */
+        inline fail_awaiter co_fail()
+        {
+          return fail_awaiter( this );
+        }
+
+      private:
+        inline status_t finish(bool failed)
+        {
+          co_failed_ = failed;
+          co_line_   = -1;
+          pending_   = 0;
+          task_.reset();
+          return ( failed ? failed_ : done_ );
+        }
+
+        co_task       task_;
+        condition *   pending_;
+        bool          co_failed_;
+    };
+#endif /* CSL_COMM_CXX20_COROUTINES */
+
+    /**
+       @brief adapts a coroutine type to the comm::handler interface
+
+       one C instance is created for every accepted connection and resumed on
+       every data arrival. C must be default constructible and derived from
+       coroutine. the handler closes the connection when the coroutine has
+       finished or failed.
+
+       the coroutine objects are kept in a map indexed by the connection id.
+       the map is read on every data arrival but only changed when connections
+       come and go, so it is guarded by a reader-writer lock. the listener never
+       runs two handler calls for the same connection concurrently, so the
+       coroutines themselves need no locking.
+
+       once attached to the listener, the handler resumes the coroutines that
+       wait for their output, a timer or a co_event through tcp::lstnr::wake().
+       the alarms are kept in a timer wheel with tick_ms_ resolution, advanced
+       by a thread of the handler.
+
+       @code
+       coro_handler<greeter> h;
+       tcp::lstnr l;
+       h.attach( l );
+       l.init( h, addr );
+       l.start();
+       @endcode
+     */
+    template <typename C> class coro_handler : public handler, public coroutine::scheduler
+    {
+      public:
+        typedef std::map<connid_t, C *> coros_t;
+
+        enum { tick_ms_ = 10 };
+
+        inline coro_handler() : lstnr_(0), wheel_(tick_ms_), ticker_(this), finished_(0), failed_(0)
+        {
+          ticker_thread_.set_entry( ticker_ );
+        }
+
+        virtual ~coro_handler()
+        {
+          if( ticker_thread_.is_running() )
+          {
+            ticker_.stop_ = 1;
+            ticker_.wakeup_.notify();
+            ticker_thread_.exit_event().wait( 10000 );
+          }
+
+          nthread::scoped_wrlock l(lock_);
+          for( typename coros_t::iterator it=coros_.begin();it!=coros_.end();++it )
+            delete it->second;
+          coros_.clear();
+        }
+
+        /**
+           @brief lets the coroutines be resumed without data arrival
+           @param l is the listener running this handler
+           @return false if the timer thread cannot be started
+
+           to be called once, before the listener is started
+          */
+        inline bool attach(tcp::lstnr & l)
+        {
+          lstnr_ = &l;
+          if( ticker_thread_.start() == false ) return false;
+          return ticker_thread_.start_event().wait( 10000 );
+        }
+
+        virtual bool on_connected( connid_t id, const SAI & sai, bfd & buf_fd )
+        {
+          C * c = new C();
+          c->start( id, sai, this );
+
+          /* the coroutine may talk first */
+          coroutine::status_t st = c->resume( buf_fd );
+          if( st != coroutine::wait_ )
+          {
+            count( st );
+            delete c;
+            return false;
+          }
+
+          C * old = 0;
+          {
+            nthread::scoped_wrlock l(lock_);
+            typename coros_t::iterator it = coros_.find( id );
+            if( it != coros_.end() ) { old = it->second; it->second = c; }
+            else                     { coros_.insert( std::make_pair(id,c) ); }
+          }
+          delete old;
+          return true;
+        }
+
+        virtual bool on_data_arrival( connid_t id, const SAI & sai, bfd & buf_fd )
+        {
+          C * c = 0;
+          {
+            nthread::scoped_rdlock l(lock_);
+            typename coros_t::iterator it = coros_.find( id );
+            if( it != coros_.end() ) c = it->second;
+          }
+
+          if( c == 0 ) return false;
+          coroutine::status_t st = c->resume( buf_fd );
+          if( st == coroutine::wait_ ) return true;
+
+          /* the listener does not call on_disconnected() after a false return */
+          count( st );
+          remove( id );
+          return false;
+        }
+
+        virtual void on_disconnected( connid_t id, const SAI & sai )
+        {
+          remove( id );
+        }
+
+        /** @brief number of live coroutines */
+        inline size_t size()
+        {
+          nthread::scoped_rdlock l(lock_);
+          return coros_.size();
+        }
+
+        /** @brief number of coroutines that ran to their end */
+        inline uint64_t finished_count() const { return finished_; }
+
+        /** @brief number of coroutines that failed */
+        inline uint64_t failed_count() const { return failed_; }
+
+        virtual void wake(connid_t id)
+        {
+          if( lstnr_ ) lstnr_->wake( id );
+        }
+
+        virtual void set_alarm(coroutine & c, uint64_t at_usec)
+        {
+          nthread::scoped_mutex m(timer_mtx_);
+          if( at_usec == 0 || lstnr_ == 0 )
+          {
+            if( c.alarm_.is_armed() ) wheel_.cancel( c.alarm_ );
+            return;
+          }
+          if( c.co_alarm_at_ == at_usec && c.alarm_.is_armed() ) return;
+
+          uint64_t now = common::metrics::now_usec();
+          c.co_alarm_at_ = at_usec;
+          wheel_.arm( c.alarm_, (at_usec > now ? (at_usec-now+999)/1000 : 0) );
+        }
+
+        /* called from tick() with timer_mtx_ held */
+        virtual void on_alarm(connid_t id)
+        {
+          fired_.push_back( id );
+        }
+
+      private:
+        /* advances the timer wheel, the fired alarms wake the coroutines */
+        class ticker : public nthread::thread::callback
+        {
+          public:
+            ticker(coro_handler * h) : h_(h), stop_(0) { }
+            virtual ~ticker() { }
+
+            virtual void operator()(void)
+            {
+              while( stop_ == 0 )
+              {
+                wakeup_.wait( tick_ms_ );
+                if( stop_ ) break;
+                h_->tick();
+              }
+            }
+
+            coro_handler *   h_;
+            volatile int     stop_;
+            nthread::event   wakeup_;
+        };
+
+        /*
+        ** the alarms are called with timer_mtx_ held, so a coroutine being
+        ** deleted (its destructor disarms the alarm) is never called, and
+        ** the listener is only called after the lock is released
+        */
+        inline void tick()
+        {
+          std::vector<connid_t> ids;
+          {
+            nthread::scoped_mutex m(timer_mtx_);
+            wheel_.advance();
+            ids.swap( fired_ );
+          }
+          for( size_t i=0;i<ids.size();++i ) wake( ids[i] );
+        }
+
+        inline void count(coroutine::status_t st)
+        {
+          if( st == coroutine::done_ ) __sync_fetch_and_add( &finished_, 1 );
+          else                         __sync_fetch_and_add( &failed_, 1 );
+        }
+
+        inline void remove(connid_t id)
+        {
+          C * c = 0;
+          {
+            nthread::scoped_wrlock l(lock_);
+            typename coros_t::iterator it = coros_.find( id );
+            if( it == coros_.end() ) return;
+            c = it->second;
+            coros_.erase( it );
+          }
+          delete c;
+        }
+
+        coros_t                 coros_;
+        nthread::rwlock         lock_;
+        tcp::lstnr *            lstnr_;
+        nthread::mutex          timer_mtx_;
+        nthread::timer_wheel    wheel_;
+        std::vector<connid_t>   fired_;
+        ticker                  ticker_;
+        nthread::thread         ticker_thread_;
+        uint64_t                finished_;
+        uint64_t                failed_;
+
+        /* no-copy */
+        coro_handler(const coro_handler & other);
+        coro_handler & operator=(const coro_handler & other);
+    };
+  }
+}
+
+#endif /* __cplusplus */
+#endif /* _csl_comm_coroutine_hh_included_ */
+
+/* EOF */
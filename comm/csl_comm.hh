@@ -32,10 +32,16 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
 #include "codesloop/comm/exc.hh"
+#include "codesloop/comm/tcp_pool.hh"
+#include "codesloop/comm/udp_pool.hh"
+#include "codesloop/comm/udp_sendq.hh"
 #include "codesloop/comm/udp_recvr.hh"
+#include "codesloop/comm/udp_sharded.hh"
 #include "codesloop/comm/udp_hello.hh"
 #include "codesloop/comm/udp_auth.hh"
+#include "codesloop/comm/udp_session.hh"
 #include "codesloop/comm/udp_data.hh"
+#include "codesloop/comm/coroutine.hh"
 
 #ifdef __cplusplus
 #endif /* __cplusplus */
@@ -73,6 +73,7 @@ namespace csl
         case rs_assert:               return L"assert failed";
         case rs_unknown_op:           return L"unknown op received";
         case rs_internal_state:       return L"internal state inconsystency";
+        case rs_poll_failed:          return L"poll() call failed.";
         case rs_unknown:
           default:                    return L"Unknown reason";
       };
@@ -82,6 +82,7 @@ namespace csl
           rs_assert,              ///<assert failed
           rs_unknown_op,          ///<uknown op
           rs_internal_state,      ///<internal state is bad
+          rs_poll_failed,         ///<poll() call failed.
         };
 
         /** @brief converts reason code to string */
@@ -58,6 +58,22 @@ namespace csl
           return true;
         }
 
+        /**
+           @brief tells wether a listener running the handlers inline should
+                  hand this on_data_arrival() call to its worker pool
+           @return false by default, the call runs in the event loop thread
+
+           handlers doing slow work (disk IO, heavy crypto) should return true,
+           so they do not hold up the other connections of the loop.
+           see tcp::lstnr::set_inline()
+         */
+        virtual bool offload( connid_t id,
+                              const SAI & sai,
+                              bfd & buf_fd )
+        {
+          return false;
+        }
+
         virtual void on_disconnected( connid_t id,
                                       const SAI & sai )
         {
@@ -39,6 +39,10 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "codesloop/comm/tcp_client.hh"
 #include "codesloop/comm/exc.hh"
 #include "codesloop/common/logger.hh"
+#ifndef WIN32
+#include <fcntl.h>
+#include <netinet/tcp.h>
+#endif /*WIN32*/
 
 namespace csl
 {
@@ -56,15 +60,60 @@ namespace csl
       }
 
       bool client::init(SAI address)
+      {
+        return init(address, 0);
+      }
+
+      bool client::init(SAI address, uint32_t timeout_ms)
       {
         ENTER_FUNCTION();
-        CSL_DEBUGF( L"init(%s:%d)",inet_ntoa(address.sin_addr),ntohs(address.sin_port));
+        CSL_DEBUGF( L"init(%s:%d,%d)",inet_ntoa(address.sin_addr),ntohs(address.sin_port),timeout_ms);
 
         int sock = ::socket( AF_INET, SOCK_STREAM, 0 );
         if( sock < 0 ) { THRC(exc::rs_socket_failed,false); }
 
+#ifndef WIN32
+        int flags = ::fcntl( sock, F_GETFL, 0 );
+        if( flags < 0 || ::fcntl( sock, F_SETFL, flags|O_NONBLOCK ) < 0 )
+        {
+          CloseSocket(sock);
+          THRC(exc::rs_connect_failed,false);
+        }
+
+        int err = ::connect( sock, reinterpret_cast<struct sockaddr *>(&address), sizeof(SAI) );
+        if( err < 0 && errno == EINPROGRESS )
+        {
+          struct pollfd pfd;
+          pfd.fd      = sock;
+          pfd.events  = POLLOUT;
+          pfd.revents = 0;
+
+          do
+          {
+            err = PollSocket( &pfd, 1, (timeout_ms == 0 ? -1 : static_cast<int>(timeout_ms)) );
+          } while( err < 0 && errno == EINTR );
+
+          if( err == 0 )
+          {
+            CloseSocket(sock);
+            THR(exc::rs_timeout,false);
+          }
+          else if( err > 0 )
+          {
+            int       so_err = 0;
+            socklen_t so_len = sizeof(so_err);
+            err = ::getsockopt( sock, SOL_SOCKET, SO_ERROR, &so_err, &so_len );
+            if( err == 0 && so_err != 0 ) { errno = so_err; err = -1; }
+          }
+        }
+        if( err < 0 ) { int e = errno; CloseSocket(sock); errno = e; THRC(exc::rs_connect_failed,false); }
+
+        ::fcntl( sock, F_SETFL, flags );
+#else
+        /* no portable non-blocking connect here, timeout_ms is ignored */
         int err = ::connect( sock, reinterpret_cast<struct sockaddr *>(&address), sizeof(SAI) );
         if( err < 0 ) { CloseSocket(sock); THRC(exc::rs_connect_failed,false); }
+#endif /*WIN32*/
         CSL_DEBUGF( L"connected to (%s:%d)",inet_ntoa(address.sin_addr),ntohs(address.sin_port));
 
         socklen_t slen = sizeof(SAI);
@@ -75,9 +124,38 @@ namespace csl
 
         peer_addr_ = address;
 
+        bfd_.close();
         bfd_.init( sock );
         RETURN_FUNCTION( true );
       }
+
+      bool client::set_nodelay(bool on)
+      {
+        int sock = bfd_.file_descriptor();
+        if( sock <= 0 ) return false;
+        int v = (on ? 1 : 0);
+        return (::setsockopt( sock, IPPROTO_TCP, TCP_NODELAY,
+                              reinterpret_cast<const char *>(&v), sizeof(v) ) == 0);
+      }
+
+      bool client::healthy()
+      {
+        int sock = bfd_.file_descriptor();
+        if( sock <= 0 )     return false;
+        if( bfd_.size() )   return false;
+
+        struct pollfd pfd;
+        pfd.fd      = sock;
+        pfd.events  = POLLIN;
+        pfd.revents = 0;
+
+        int err = PollSocket( &pfd, 1, 0 );
+        if( err == 0 ) return true;
+        if( err < 0 )  return (errno == EINTR);
+
+        /* readable: either the peer closed it, or a stray reply is waiting */
+        return false;
+      }
     }
   }
 }
@@ -54,8 +54,19 @@ namespace csl
           client();
           virtual ~client() { }
 
+          /** @brief connects to address, waits for the connection without a time limit */
           bool init(SAI address);
 
+          /**
+          @brief connects to address with a non-blocking connect()
+          @param address is the peer address
+          @param timeout_ms is the time limit of the connection setup (0 means no limit)
+          @return true if connected
+
+          the socket is switched back to blocking mode after the connection is set up
+          */
+          bool init(SAI address, uint32_t timeout_ms);
+
           /* network ops */
           read_res & read(uint64_t sz, uint32_t timeout_ms, read_res & rr)
           {
@@ -67,6 +78,35 @@ namespace csl
             return bfd_.send(data, sz);
           }
 
+          /**
+          @brief buffers data to be sent by flush()
+
+          pipelining callers may append several requests and flush() them together,
+          then read the replies in order
+          */
+          bool append(const uint8_t * data, uint64_t sz) { return bfd_.append(data, sz); }
+
+          /** @brief sends the appended data */
+          bool flush() { return bfd_.flush(); }
+
+          /** @brief sets TCP_NODELAY on the socket */
+          bool set_nodelay(bool on);
+
+          /**
+          @brief checks wether the connection may be used for a new request
+
+          a connection is not healthy if it is closed, the peer closed it or
+          reset it, or there is unread data on it (a late reply to an earlier
+          request). the check does not block.
+          */
+          bool healthy();
+
+          /** @brief closes the connection */
+          void close() { bfd_.close(); }
+
+          /** @brief the socket or a negative bfd state */
+          int socket() const { return bfd_.file_descriptor(); }
+
           /* address, to be setup during initialization */
           const SAI & peer_addr() const { return peer_addr_; }
 
@@ -41,14 +41,23 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "codesloop/common/auto_close.hh"
 #include "codesloop/common/queue.hh"
 #include "codesloop/common/logger.hh"
+#include "codesloop/common/metrics.hh"
 #include "codesloop/comm/exc.hh"
 #include "codesloop/comm/tcp_lstnr.hh"
 #include "codesloop/comm/bfd.hh"
 #include "codesloop/comm/sai.hh"
+#include "codesloop/comm/uring.hh"
 #include "codesloop/nthread/mutex.hh"
 #include "codesloop/nthread/thread.hh"
 #include "codesloop/nthread/thrpool.hh"
+#include "codesloop/nthread/cpuset.hh"
+#include "codesloop/nthread/timer_wheel.hh"
 #include "codesloop/nthread/event.hh"
+#include <vector>
+#ifndef WIN32
+#include <sys/uio.h>
+#include <fcntl.h>
+#endif /*WIN32*/
 
 namespace csl
 {
@@ -61,6 +70,20 @@ namespace csl
     {
       namespace
       {
+        struct ev_data;
+
+        /* closes the connection when it was idle for too long */
+        class idle_timer : public timer_wheel::timer
+        {
+          public:
+            idle_timer(ev_data * d) : data_(d) { }
+            virtual void operator()(void);
+            virtual ~idle_timer() { }
+
+          private:
+            ev_data * data_;
+        };
+
         struct ev_data
         {
           ev_io              watcher_;
@@ -69,8 +92,14 @@ namespace csl
           mutex              mtx_;
           bfd                bfd_;
           SAI                peer_addr_;
-
-          ev_data(const ev_data & other) : use_exc_(true)
+          idle_timer         idle_timer_;
+          int                slot_;        ///<the io_uring read buffer of the queued read or -1
+          bool               sending_;     ///<io_uring is sending the buffered output
+          bool               writing_;     ///<the watcher waits for room for the rest of the output
+          bool               closing_;     ///<removed while sending, freed when the send completes
+          bool               wake_;        ///<woken while busy, the handler runs again once it waits for data
+
+          ev_data(const ev_data & other) : idle_timer_(this), slot_(-1), sending_(false), writing_(false), closing_(false), wake_(false), use_exc_(true)
           {
             ENTER_FUNCTION();
             THRNORET(exc::rs_not_implemented);
@@ -92,6 +121,12 @@ namespace csl
               id_(id),
               bfd_(fd),
               peer_addr_(sai),
+              idle_timer_(this),
+              slot_(-1),
+              sending_(false),
+              writing_(false),
+              closing_(false),
+              wake_(false),
               use_exc_(true) { }
 
           CSL_OBJ(csl::comm::anonymous,ev_data);
@@ -102,15 +137,22 @@ namespace csl
         void lstnr_wakeup_cb( struct ev_loop *loop, struct ev_async *w, int revents );
         void lstnr_timer_cb( struct ev_loop *loop, struct ev_timer *w, int revents );
         void lstnr_new_data_cb( struct ev_loop *loop, ev_io *w, int revents );
+        void lstnr_ring_cb( struct ev_loop *loop, struct ev_io *w, int revents );
+        void lstnr_prepare_cb( struct ev_loop *loop, struct ev_prepare *w, int revents );
 
         class conn_queue : public csl::common::queue<ev_data *>
         {
           private:
-            mutex mtx_;
-            event evt_;
+            mutex              mtx_;
+            event              evt_;
+            metrics::gauge &   depth_;
 
           public:
-            void on_new_item()       { evt_.notify(); }
+            conn_queue(const char * depth_name)
+              : depth_(metrics::instance().get_gauge(depth_name)) { }
+
+            void on_new_item()       { depth_.inc(); evt_.notify(); }
+            void on_del_item()       { depth_.dec(); }
             void on_lock_queue()     { mtx_.lock();   }
             void on_unlock_queue()   { mtx_.unlock(); }
             event & new_item_event() { return evt_;   }
@@ -142,6 +184,40 @@ namespace csl
             virtual void operator()(void) { impl_->listener_entry_cb(); }
         };
 
+        enum {
+          timer_tick_ms_  = 100,
+          max_loops_      = 256
+        };
+
+        /* io_uring: the kind of the request is in the top byte of the user data */
+        enum {
+          uring_entries_     = 256,
+          uring_slot_size_   = 4096,
+          uring_batch_       = 64,
+          ud_accept_         = 1,
+          ud_read_           = 2,
+          ud_send_           = 3,
+          ud_cancel_         = 4
+        };
+
+        struct read_slot
+        {
+          uint8_t *  buf_;
+          ev_data *  conn_;   ///<NULL when the connection went away before the read completed
+        };
+
+        static inline uint64_t user_data(uint64_t kind, uint64_t idx) { return ((kind<<56)|idx); }
+        static inline uint64_t ud_kind(uint64_t ud)                   { return (ud>>56);         }
+        static inline uint64_t ud_index(uint64_t ud)                  { return (ud & ((1ULL<<56)-1)); }
+
+        /*
+        ** the connection id: the ev_pool_ slot in the low 32 bits, the loop index
+        ** in the next 8 and the generation of the slot in the top 24, so a wake for
+        ** a closed connection does not reach the next one in its slot
+        */
+        static inline uint64_t id_slot(connid_t id)      { return (id & 0xffffffffULL); }
+        static inline unsigned int id_loop(connid_t id)  { return static_cast<unsigned int>((id>>32) & 0xff); }
+
         typedef inpvec<ev_data>     ev_data_vec_t;
         typedef inpvec<ev_data *>   ev_data_ptr_vec_t;
 
@@ -160,6 +236,58 @@ namespace csl
         conn_queue           new_data_queue_;
         data_handler         new_data_handler_;
         conn_queue           idle_data_queue_;
+        thrpool::placement_t placement_;
+        int                  loop_cpu_;
+        timer_wheel          timers_;
+        unsigned int         idle_timeout_ms_;
+
+        /* multi-loop mode: loop 0 owns the other loops */
+        unsigned int         n_loops_;
+        unsigned int         loop_index_;
+        connid_t             id_base_;
+        uint32_t             next_gen_;
+        unsigned int         min_workers_;
+        unsigned int         max_workers_;
+        std::vector<impl *>  siblings_;
+        bool                 inline_;
+
+        /* backpressure, the parked connections are only touched by the loop */
+        limits               limits_;
+        bool                 accept_paused_;
+        std::vector<ev_data *> parked_;
+
+        /* the connections to be woken by the loop, see wake() */
+        std::vector<connid_t> wakes_;
+
+        /* io_uring backend, only touched by the loop thread */
+        backend_t            backend_;
+        unsigned int         n_uring_buffers_;
+        uring                ring_;
+        bool                 use_uring_;
+        bool                 accept_multishot_;
+        bool                 accept_armed_;
+        uint64_t             accept_gen_;
+        uint8_t *            slot_mem_;
+        std::vector<read_slot>    slots_;
+        std::vector<unsigned int> free_slots_;
+        std::vector<int>          accepted_fds_;   ///<accepted by io_uring while paused
+        unsigned int         n_sending_;
+        ev_io                ring_watcher_;
+        ev_prepare           submit_watcher_;
+
+        /* operational numbers, see common::metrics */
+        metrics::counter &   accepted_;
+        metrics::counter &   rejected_;
+        metrics::gauge &     connections_;
+        metrics::counter &   idle_closed_;
+        metrics::counter &   inline_calls_;
+        metrics::counter &   offloaded_;
+        metrics::counter &   limit_connections_;
+        metrics::counter &   limit_queued_;
+        metrics::counter &   limit_buffered_;
+        metrics::counter &   uring_submits_;
+        metrics::counter &   uring_completions_;
+        metrics::counter &   uring_no_slot_;
 
         bool stop_me()
         {
@@ -180,7 +308,41 @@ namespace csl
         impl() : entry_(this),
                  stop_me_(false),
                  handler_(0),
+                 new_data_queue_("comm.tcp.lstnr.new_data_queue"),
                  new_data_handler_(this, &new_data_queue_),
+                 idle_data_queue_("comm.tcp.lstnr.idle_data_queue"),
+                 placement_(thrpool::place_none_),
+                 loop_cpu_(-1),
+                 timers_(timer_tick_ms_),
+                 idle_timeout_ms_(0),
+                 n_loops_(1),
+                 loop_index_(0),
+                 id_base_(0),
+                 next_gen_(0),
+                 min_workers_(1),
+                 max_workers_(4),
+                 inline_(false),
+                 accept_paused_(false),
+                 backend_(libev_),
+                 n_uring_buffers_(default_uring_buffers_),
+                 use_uring_(false),
+                 accept_multishot_(true),
+                 accept_armed_(false),
+                 accept_gen_(0),
+                 slot_mem_(0),
+                 n_sending_(0),
+                 accepted_(metrics::instance().get_counter("comm.tcp.lstnr.accepted")),
+                 rejected_(metrics::instance().get_counter("comm.tcp.lstnr.rejected")),
+                 connections_(metrics::instance().get_gauge("comm.tcp.lstnr.connections")),
+                 idle_closed_(metrics::instance().get_counter("comm.tcp.lstnr.idle_closed")),
+                 inline_calls_(metrics::instance().get_counter("comm.tcp.lstnr.inline_calls")),
+                 offloaded_(metrics::instance().get_counter("comm.tcp.lstnr.offloaded")),
+                 limit_connections_(metrics::instance().get_counter("comm.tcp.lstnr.limit.connections")),
+                 limit_queued_(metrics::instance().get_counter("comm.tcp.lstnr.limit.queued")),
+                 limit_buffered_(metrics::instance().get_counter("comm.tcp.lstnr.limit.buffered")),
+                 uring_submits_(metrics::instance().get_counter("comm.tcp.lstnr.uring.submits")),
+                 uring_completions_(metrics::instance().get_counter("comm.tcp.lstnr.uring.completions")),
+                 uring_no_slot_(metrics::instance().get_counter("comm.tcp.lstnr.uring.no_slot")),
                  use_exc_(false)
         {
           // create loop object
@@ -194,22 +356,117 @@ namespace csl
           ev_async_init( &wakeup_watcher_, lstnr_wakeup_cb );
           wakeup_watcher_.data = this;
 
-          // timer init
+          // timer init: drives the timer wheel
           ev_init( &periodic_watcher_, lstnr_timer_cb );
-          periodic_watcher_.repeat = 15.0;
+          periodic_watcher_.repeat = timer_tick_ms_ / 1000.0;
           periodic_watcher_.data   = this;
 
+          // io_uring completion and submission drivers, started when io_uring is in use
+          ev_init( &ring_watcher_, lstnr_ring_cb );
+          ring_watcher_.data = this;
+          ev_prepare_init( &submit_watcher_, lstnr_prepare_cb );
+          submit_watcher_.data = this;
+
           // set thread entry
           listener_thread_.set_entry( entry_ );
         }
 
         ~impl()
         {
+          for( size_t i=0;i<siblings_.size();++i ) delete siblings_[i];
+          siblings_.clear();
           if( loop_ ) ev_loop_destroy( loop_ );
           loop_ = 0;
+          ring_.destroy();
+          if( slot_mem_ ) ::free( slot_mem_ );
+          slot_mem_ = 0;
+        }
+
+        void set_loops(unsigned int n_loops)
+        {
+          scoped_mutex m(mtx_);
+          if( n_loops < 1 )         n_loops = 1;
+          if( n_loops > max_loops_ ) n_loops = max_loops_;
+          n_loops_ = n_loops;
+        }
+
+        void set_workers(unsigned int min_workers, unsigned int max_workers)
+        {
+          scoped_mutex m(mtx_);
+          if( min_workers < 1 )           min_workers = 1;
+          if( max_workers < min_workers ) max_workers = min_workers;
+          min_workers_ = min_workers;
+          max_workers_ = max_workers;
+        }
+
+        void set_inline(bool yesno)
+        {
+          scoped_mutex m(mtx_);
+          inline_ = yesno;
+          for( size_t i=0;i<siblings_.size();++i ) siblings_[i]->set_inline( yesno );
+        }
+
+        void set_limits(const limits & l)
+        {
+          scoped_mutex m(mtx_);
+          limits_ = l;
+          for( size_t i=0;i<siblings_.size();++i ) siblings_[i]->set_limits( l );
+        }
+
+        /* the connection ids of the loops are kept apart by the loop index */
+        void set_loop_index(unsigned int idx)
+        {
+          loop_index_ = idx;
+          id_base_    = (static_cast<connid_t>(idx) << 32);
+        }
+
+        /* the id of a new connection in the given slot, called by the loop thread */
+        connid_t new_id(uint64_t slot)
+        {
+          connid_t gen = static_cast<connid_t>(++next_gen_ & 0xffffff);
+          return ( (gen << 40) | id_base_ | slot );
         }
 
         bool init(handler & h, SAI address, int backlog)
+        {
+          ENTER_FUNCTION();
+
+          unsigned int n_loops = 0;
+          {
+            scoped_mutex m(mtx_);
+            n_loops = n_loops_;
+          }
+
+          if( open(h, address, backlog, (n_loops > 1)) == false ) RETURN_FUNCTION(false);
+
+          {
+            scoped_mutex m(mtx_);
+            address = addr_;
+          }
+
+          /* every further loop gets its own listening socket on the same port */
+          for( unsigned int i=1;i<n_loops;++i )
+          {
+            impl * s = new impl();
+            s->set_loop_index( i );
+            s->n_loops_          = n_loops;
+            s->min_workers_      = min_workers_;
+            s->max_workers_      = max_workers_;
+            s->idle_timeout_ms_  = idle_timeout_ms_;
+            s->placement_        = placement_;
+            s->loop_cpu_         = loop_cpu_;
+            s->inline_           = inline_;
+            s->limits_           = limits_;
+            s->backend_          = backend_;
+            s->n_uring_buffers_  = n_uring_buffers_;
+            siblings_.push_back( s );
+
+            if( s->open(h, address, backlog, true) == false ) RETURN_FUNCTION(false);
+          }
+          RETURN_FUNCTION(true);
+        }
+
+        bool open(handler & h, SAI address, int backlog, bool reuse_port)
         {
           ENTER_FUNCTION();
           {
@@ -232,11 +489,29 @@ namespace csl
 
             CSL_DEBUGF(L"setsockopt has set SO_REUSEADDR on %d",sock);
 
+            if( reuse_port )
+            {
+#ifdef SO_REUSEPORT
+              // the kernel spreads the incoming connections among the sockets
+              if( ::setsockopt( sock, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on) ) < 0 )
+                THRC(exc::rs_setsockopt,false);
+
+              CSL_DEBUGF(L"setsockopt has set SO_REUSEPORT on %d",sock);
+#else
+              THRC(exc::rs_setsockopt,false);
+#endif /*SO_REUSEPORT*/
+            }
+
             if( ::bind( sock,
                         reinterpret_cast<const struct sockaddr *>(&address),
                         sizeof(address) ) < 0 )
               THRC(exc::rs_bind_failed,false);
 
+            // port 0 is resolved here, the sibling loops bind to the same port
+            socklen_t len = sizeof(address);
+            if( ::getsockname( sock, reinterpret_cast<struct sockaddr *>(&address), &len ) < 0 )
+              THRC(exc::rs_getsockname_failed,false);
+
             CSL_DEBUGF(L"socket %d bound to (%s:%d)",
                         sock,
                         inet_ntoa(address.sin_addr),
@@ -256,9 +531,15 @@ namespace csl
             //  - register async notifier
             ev_async_start( loop_, &wakeup_watcher_ );
 
+            //  - set up io_uring if asked for, libev is the fallback
+            if( backend_ == uring_ ) setup_uring();
+
             //  - register accept watcher
             ev_io_set( &accept_watcher_, sock, EV_READ  );
-            ev_io_start( loop_, &accept_watcher_ );
+            start_accepting();
+
+            //  - start the timer wheel driver
+            ev_timer_again( loop_, &periodic_watcher_ );
           }
           RETURN_FUNCTION(true);
         }
@@ -275,6 +556,9 @@ namespace csl
 
             remove_all_connections();
 
+            // the timer is stopped here, in the loop thread
+            ev_timer_stop( loop_, &periodic_watcher_ );
+
             // unqueue all event watchers
             ev_unloop( loop_, EVUNLOOP_ALL );
           }
@@ -291,7 +575,7 @@ namespace csl
               CSL_DEBUGF( L"popped conn_id:%lld from idle connections "
                            "now requeueing it", dta->id_ );
 
-              ev_io_start( loop_, &(dta->watcher_) );
+              rearm( dta );
 
               if( idle_data_queue_.new_item_event().wait_nb() != true )
               {
@@ -300,16 +584,164 @@ namespace csl
                 THRNORET( exc::rs_internal_state );
               }
             }
+
+            resume_parked();
+            resume_accept();
+            run_wakes();
+          }
+          LEAVE_FUNCTION();
+        }
+
+        /* queues the connection for the handler, routed to the loop owning it */
+        bool wake( connid_t id )
+        {
+          unsigned int idx = id_loop( id );
+          if( idx != loop_index_ )
+          {
+            if( idx == 0 || idx > siblings_.size() ) return false;
+            return siblings_[idx-1]->wake( id );
+          }
+
+          scoped_mutex m(mtx_);
+          if( loop_ == 0 || stop_me_ ) return false;
+          wakes_.push_back( id );
+          ev_async_send( loop_, &wakeup_watcher_ );
+          return true;
+        }
+
+        /* the waiting connections go to the handler, the busy ones once they wait again */
+        void run_wakes()
+        {
+          std::vector<connid_t> ids;
+          {
+            scoped_mutex m(mtx_);
+            ids.swap( wakes_ );
+          }
+
+          for( size_t i=0;i<ids.size();++i )
+          {
+            ev_data * dta = 0;
+            {
+              scoped_mutex m(mtx_);
+              dta = ev_pool_.get_ptr( id_slot(ids[i]) );
+            }
+            if( dta == 0 || dta->id_ != ids[i] || dta->closing_ ) continue;
+
+            CSL_DEBUGF( L"waking up conn_id:%lld", dta->id_ );
+
+            if( use_uring_ && dta->slot_ >= 0 )
+            {
+              // read_done() hands it over when the cancelled read completes
+              dta->wake_ = true;
+              ring_.cancel( user_data( ud_read_,static_cast<uint64_t>(dta->slot_) ),
+                            user_data( ud_cancel_,0 ) );
+            }
+            else if( dta->writing_ == false && ev_is_active( &(dta->watcher_) ) )
+            {
+              if( inline_ == false ) ev_io_stop( loop_, &(dta->watcher_) );
+              timers_.cancel( dta->idle_timer_ );
+              if( over_queue( dta ) == false ) dispatch( dta );
+            }
+            else
+            {
+              // in a worker, parked, sending or writing: watch() wakes it again
+              dta->wake_ = true;
+            }
+          }
+        }
+
+        /* the number of open connections */
+        uint64_t n_connections()
+        {
+          scoped_mutex m(mtx_);
+          return ev_pool_.n_items();
+        }
+
+        /* called from the loop thread when the worker queue may have drained */
+        void resume_parked()
+        {
+          uint64_t max_queued = limits_.max_queued_;
+
+          while( parked_.empty() == false &&
+                 (max_queued == 0 || new_data_queue_.n_items() < max_queued) )
+          {
+            ev_data * dta = parked_.back();
+            parked_.pop_back();
+            CSL_DEBUGF( L"resume reading parked conn_id:%lld", dta->id_ );
+
+            if( use_uring_ && dta->bfd_.size() > 0 )
+            {
+              // io_uring has read the data already
+              dispatch( dta );
+            }
+            else
+            {
+              // the unread data makes the watcher fire right away
+              watch( dta );
+              arm_idle_timer( dta );
+            }
+          }
+        }
+
+        /* called from the loop thread when connections have been closed */
+        void resume_accept()
+        {
+          if( accept_paused_ == false ) return;
+
+          uint64_t max_conns = limits_.max_connections_;
+
+          // the connections io_uring accepted in the meantime go first
+          while( accepted_fds_.empty() == false &&
+                 (max_conns == 0 || n_connections() < max_conns) )
+          {
+            int fd = accepted_fds_.front();
+            accepted_fds_.erase( accepted_fds_.begin() );
+            accepted( fd, peer_of( fd ), false );
           }
+
+          if( accepted_fds_.empty() && (max_conns == 0 || n_connections() < max_conns) )
+          {
+            CSL_DEBUGF( L"resume accepting connections" );
+            accept_paused_ = false;
+            start_accepting();
+          }
+        }
+
+        void timer_cb( struct ev_timer *w, int revents )
+        {
+          ENTER_FUNCTION();
+          timers_.advance();
           LEAVE_FUNCTION();
         }
 
-        void timer_cb( struct ev_timer *w, int revents ) // TODO
+        void arm_idle_timer( ev_data * dta )
+        {
+          unsigned int tmo = idle_timeout_ms_;
+          if( tmo ) timers_.arm( dta->idle_timer_, tmo );
+        }
+
+        /* called from the loop thread by the timer wheel */
+        void idle_cb( ev_data * dta )
         {
           ENTER_FUNCTION();
+          CSL_DEBUGF( L"closing idle conn_id:%lld fd:%d",
+                       dta->id_,
+                       dta->bfd_.file_descriptor() );
+
+          idle_closed_.inc();
+          unwatch( dta );
+          handler_->on_disconnected( dta->id_, dta->peer_addr_ );
+          remove_connection( dta );
           LEAVE_FUNCTION();
         }
 
+        void set_idle_timeout(unsigned int timeout_ms)
+        {
+          scoped_mutex m(mtx_);
+          idle_timeout_ms_ = timeout_ms;
+          for( size_t i=0;i<siblings_.size();++i ) siblings_[i]->set_idle_timeout( timeout_ms );
+        }
+
         void accept_cb( struct ev_io *w, int revents )
         {
           ENTER_FUNCTION();
@@ -319,14 +751,58 @@ namespace csl
                        w->events,
                        revents );
 
+          uint64_t max_conns = limits_.max_connections_;
+          bool     over      = ( max_conns > 0 && n_connections() >= max_conns );
+
+          if( over && limits_.on_max_connections_ == pause_ )
+          {
+            // the new connections wait in the kernel's backlog
+            CSL_DEBUGF( L"connection limit reached, pause accepting" );
+            limit_connections_.inc();
+            stop_accepting();
+            accept_paused_ = true;
+            LEAVE_FUNCTION();
+          }
+
           SAI addr;
           socklen_t sz = sizeof(addr);
           int conn_fd = ::accept( w->fd,
                                   reinterpret_cast<struct sockaddr *>(&addr),
                                   &sz );
 
-          if( conn_fd > 0 )
+          if( conn_fd > 0 ) { accepted( conn_fd, addr, over ); }
+          else              { CSL_DEBUGF( L"accept failed" );   }
+
+          LEAVE_FUNCTION();
+        }
+
+        /* sets up a new connection, over tells if the connection limit is reached */
+        void accepted( int conn_fd, const SAI & addr, bool over )
+        {
+          ENTER_FUNCTION();
+
+          if( over )
           {
+            CSL_DEBUGF( L"connection limit reached, reject fd:%d", conn_fd );
+            limit_connections_.inc();
+            rejected_.inc();
+            ::close( conn_fd );
+          }
+          else
+          {
+            accepted_.inc();
+
+#ifndef WIN32
+            // the loop only sends what the socket takes, the watcher waits for the rest.
+            // io_uring fails the requests on O_NONBLOCK sockets instead of waiting, and
+            // its reads and sends do not block the loop anyway
+            if( use_uring_ == false )
+            {
+              int flags = ::fcntl( conn_fd, F_GETFL, 0 );
+              if( flags >= 0 ) ::fcntl( conn_fd, F_SETFL, flags|O_NONBLOCK );
+            }
+#endif /*WIN32*/
+
             ev_data * ed = 0;
             ev_data_vec_t::iterator * evit_ptr = 0;
 
@@ -347,7 +823,7 @@ namespace csl
               ed = ev_it_ref.set(  loop_,
                                    conn_fd,
                                    addr,
-                                   ev_it_ref.get_pos() );
+                                   new_id( ev_it_ref.get_pos() ) );
 
               CSL_DEBUG_ASSERT( ed != NULL );
 
@@ -368,26 +844,26 @@ namespace csl
             else if( cres == false )
             {
               CSL_DEBUG(L"handler returned FALSE, this tells to close the connection");
+              rejected_.inc();
               scoped_mutex m(mtx_);
               evit_ptr->free();
             }
             else
             {
               CSL_DEBUG(L"handler returned TRUE for connection startup");
+              connections_.inc();
 
-              // the lock may not neccessary here as libev claims to be threadsafe
-              scoped_mutex m(mtx_);
-              // initialize connection watcher
-              ev_init( &(ed->watcher_), lstnr_new_data_cb );
-              ed->watcher_.data = this;
-              ev_io_set( &(ed->watcher_), conn_fd, EV_READ  );
-              ev_io_start( loop_, &(ed->watcher_) );
+              {
+                // the lock may not neccessary here as libev claims to be threadsafe
+                scoped_mutex m(mtx_);
+                // initialize connection watcher
+                ev_init( &(ed->watcher_), lstnr_new_data_cb );
+                ed->watcher_.data = this;
+                ev_io_set( &(ed->watcher_), conn_fd, EV_READ  );
+              }
+              rearm( ed );
             }
           }
-          else
-          {
-            CSL_DEBUGF( L"accept failed" );
-          }
 
           LEAVE_FUNCTION();
         }
@@ -447,6 +923,8 @@ namespace csl
 
           ev_data * dta = reinterpret_cast<ev_data *>(w);
 
+          if( dta->writing_ ) { write_cb( dta ); LEAVE_FUNCTION(); }
+
           int fd = dta->bfd_.file_descriptor();
 
           CSL_DEBUGF( L"data arrived on fd:%d conn_id:%lld revents:%d bfd_state:%d",
@@ -455,30 +933,114 @@ namespace csl
                        revents,
                        dta->bfd_.state() );
 
-          // remove watcher from the loop
-          ev_io_stop( loop_, w );
+          // in inline mode the watcher stays active unless the call is offloaded
+          if( inline_ == false ) ev_io_stop( loop_, w );
+          timers_.cancel( dta->idle_timer_ );
+
+          // the workers are behind: leave the data in the socket or close
+          if( over_queue( dta ) ) LEAVE_FUNCTION();
 
           // try to read data
           uint32_t timeout_ms = 0;
-          uint64_t res = dta->bfd_.recv_some( timeout_ms );
+          dta->bfd_.recv_some( timeout_ms );
+
+          dispatch( dta );
+          LEAVE_FUNCTION();
+        }
+
+        /* checks the worker queue limit, parks or closes the connection if reached */
+        bool over_queue( ev_data * dta )
+        {
+          uint64_t max_queued = limits_.max_queued_;
+          if( inline_ == false && max_queued > 0 && new_data_queue_.n_items() >= max_queued )
+          {
+            limit_queued_.inc();
+
+            if( limits_.on_max_queued_ == pause_ )
+            {
+              CSL_DEBUGF( L"queue limit reached, park conn_id:%lld", dta->id_ );
+              parked_.push_back( dta );
+            }
+            else
+            {
+              CSL_DEBUGF( L"queue limit reached, close conn_id:%lld", dta->id_ );
+              handler_->on_disconnected( dta->id_, dta->peer_addr_ );
+              remove_connection( dta );
+            }
+            return true;
+          }
+          return false;
+        }
+
+        /* new data was read into the connection's buffer */
+        void dispatch( ev_data * dta )
+        {
+          ENTER_FUNCTION();
+
+          uint64_t max_buffered = limits_.max_buffered_;
+          bool     over_buffer  = ( max_buffered > 0 && dta->bfd_.size() > max_buffered );
 
           // check for errors
-          if( dta->bfd_.state() != bfd::ok_ )
+          if( dta->bfd_.state() != bfd::ok_ || over_buffer )
           {
-            CSL_DEBUGF( L"error during read on fd:%d conn_id:%lld",fd, dta->id_ );
+            CSL_DEBUGF( L"error during read on fd:%d conn_id:%lld",
+                         dta->bfd_.file_descriptor(), dta->id_ );
             CSL_DEBUGF( L"remove watcher conn_id:%lld from the loop", dta->id_ );
 
+            if( over_buffer ) limit_buffered_.inc();
+
+            unwatch( dta );
+
             // signal connection close
             handler_->on_disconnected( dta->id_, dta->peer_addr_ );
 
             // free connection
             remove_connection( dta );
           }
-          else
+          else if( inline_ == false )
           {
             // hand over the connection to the data handler
             new_data_queue_.push( dta );
           }
+          else if( handler_->offload( dta->id_, dta->peer_addr_, dta->bfd_ ) )
+          {
+            CSL_DEBUGF( L"handler asked to offload conn_id:%lld", dta->id_ );
+            offloaded_.inc();
+            unwatch( dta );
+            new_data_queue_.push( dta );
+          }
+          else
+          {
+            process_inline( dta );
+          }
+          LEAVE_FUNCTION();
+        }
+
+        /* run-to-completion: the handler is called from the loop thread */
+        void process_inline( ev_data * dta )
+        {
+          ENTER_FUNCTION();
+          inline_calls_.inc();
+
+          bool hres = false;
+          {
+            scoped_mutex m(dta->mtx_);
+            hres = handler_->on_data_arrival( dta->id_,
+                                              dta->peer_addr_,
+                                              dta->bfd_ );
+          }
+
+          if( hres == false || dta->bfd_.state() != bfd::ok_ )
+          {
+            CSL_DEBUGF( L"removing conn_id:%lld after the inline handler", dta->id_ );
+            unwatch( dta );
+            remove_connection( dta );
+          }
+          else
+          {
+            // the libev watcher is still active, io_uring needs a new read
+            rearm( dta );
+          }
           LEAVE_FUNCTION();
         }
 
@@ -488,11 +1050,28 @@ namespace csl
           CSL_DEBUG_ASSERT( dta != NULL );
           CSL_DEBUGF(L"remove_connection(dta[id:%lld])",dta->id_);
 
+          timers_.cancel( dta->idle_timer_ );
+
+          if( dta->closing_ ) LEAVE_FUNCTION();
+          if( dta->sending_ )
+          {
+            // the kernel still reads the output buffer, send_done() frees the connection
+            dta->closing_ = true;
+            ring_.cancel( user_data( ud_send_,id_slot(dta->id_) ), user_data( ud_cancel_,0 ) );
+            LEAVE_FUNCTION();
+          }
+          if( dta->slot_ >= 0 ) forget_uring( dta );
+          if( dta->writing_ ) stop_writing( dta );
+
           scoped_mutex m(mtx_);
           {
             dta->mtx_.lock();
-            ev_pool_.free_at( dta->id_ );
+            ev_pool_.free_at( id_slot(dta->id_) );
           }
+          connections_.dec();
+
+          // the loop resumes accepting, this may be called from a worker
+          if( accept_paused_ ) ev_async_send( loop_, &wakeup_watcher_ );
           LEAVE_FUNCTION();
         }
 
@@ -511,6 +1090,9 @@ namespace csl
             remove_connection( dta );
           }
 
+          // the parked connections are removed with the active ones
+          parked_.clear();
+
           // loop through all active connections and remove them
           {
             scoped_mutex m(mtx_);
@@ -528,12 +1110,34 @@ namespace csl
         void listener_entry_cb( )
         {
           thrpool              tpool;
-          // TODO : make these configurable
-          unsigned int         min_threads = 1;
-          unsigned int         max_threads = 4;
+          unsigned int         min_threads = min_workers_;
+          unsigned int         max_threads = max_workers_;
           unsigned int         timeout_ms  = 1000;
           unsigned int         attempts    = 3;
 
+          // placement: the loop first, so the workers can be put next to it
+          int loop_cpu = loop_cpu_;
+          if( n_loops_ > 1 && placement_ != thrpool::place_none_ )
+          {
+            // one loop per CPU, starting at loop_cpu_ when given
+            cpuset allowed;
+            if( cpuset::allowed(allowed) && allowed.count() > 0 )
+            {
+              unsigned int first = 0;
+              for( unsigned int i=0;loop_cpu_>=0 && i<allowed.count();++i )
+                if( allowed.nth(i) == loop_cpu_ ) first = i;
+              loop_cpu = allowed.nth( (first+loop_index_) % allowed.count() );
+            }
+          }
+          else if( loop_cpu < 0 && placement_ == thrpool::place_near_ ) loop_cpu = cpuset::current_cpu();
+          if( loop_cpu >= 0 )
+          {
+            cpuset cs;
+            cs.set( loop_cpu );
+            cpuset::pin_current( cs );
+          }
+          tpool.set_placement( placement_, loop_cpu );
+
           if( tpool.init( min_threads,
                           max_threads,
                           timeout_ms,
@@ -550,6 +1154,7 @@ namespace csl
             CSL_DEBUGF(L"launch loop: %p",loop_);
             ev_loop( loop_, 0 );
             CSL_DEBUGF(L"loop has been stopped: %p",loop_);
+            if( use_uring_ ) shutdown_uring();
             ev_loop_destroy( loop_ );
             loop_ = 0;
           }
@@ -560,9 +1165,477 @@ namespace csl
           CSL_DEBUGF(L"exiting listener thread");
         }
 
+        void set_backend(backend_t b, unsigned int n_buffers)
+        {
+          scoped_mutex m(mtx_);
+          backend_         = b;
+          n_uring_buffers_ = (n_buffers ? n_buffers : 1);
+          for( size_t i=0;i<siblings_.size();++i ) siblings_[i]->set_backend( b, n_buffers );
+        }
+
+        backend_t backend()
+        {
+          scoped_mutex m(mtx_);
+          return (use_uring_ ? uring_ : libev_);
+        }
+
+        /* sets up the ring and its read buffers, leaves use_uring_ false on failure */
+        void setup_uring()
+        {
+          ENTER_FUNCTION();
+          use_uring_ = false;
+
+          if( uring::available() == false || ring_.init( uring_entries_ ) == false )
+          {
+            CSL_DEBUGF( L"io_uring is not available, falling back to libev" );
+            LEAVE_FUNCTION();
+          }
+
+          unsigned int n = n_uring_buffers_;
+          void * mem = 0;
+          if( ::posix_memalign( &mem, uring_slot_size_, static_cast<size_t>(n)*uring_slot_size_ ) != 0 )
+          {
+            ring_.destroy();
+            LEAVE_FUNCTION();
+          }
+          slot_mem_ = reinterpret_cast<uint8_t *>(mem);
+
+          std::vector<struct iovec> iov(n);
+          slots_.resize(n);
+          free_slots_.clear();
+          for( unsigned int i=0;i<n;++i )
+          {
+            slots_[i].buf_   = slot_mem_ + static_cast<size_t>(i)*uring_slot_size_;
+            slots_[i].conn_  = 0;
+            iov[i].iov_base  = slots_[i].buf_;
+            iov[i].iov_len   = uring_slot_size_;
+            free_slots_.push_back( n-1-i );
+          }
+
+          // registered buffers save the page pinning per read, plain recv works without them
+          if( ring_.register_buffers( &(iov[0]), n ) == false )
+          {
+            CSL_DEBUGF( L"cannot register the io_uring buffers, using recv" );
+          }
+
+          ev_io_set( &ring_watcher_, ring_.fd(), EV_READ );
+          ev_io_start( loop_, &ring_watcher_ );
+          ev_prepare_start( loop_, &submit_watcher_ );
+          use_uring_ = true;
+          LEAVE_FUNCTION();
+        }
+
+        void start_accepting()
+        {
+          if( use_uring_ == false )  { ev_io_start( loop_, &accept_watcher_ ); }
+          else if( !accept_armed_ )
+          {
+            ++accept_gen_;
+            accept_armed_ = ring_.accept( accept_watcher_.fd,
+                                          user_data( ud_accept_,accept_gen_ ),
+                                          accept_multishot_ );
+            if( accept_armed_ == false ) { ev_io_start( loop_, &accept_watcher_ ); }
+          }
+        }
+
+        void stop_accepting()
+        {
+          ev_io_stop( loop_, &accept_watcher_ );
+          if( use_uring_ && accept_armed_ )
+          {
+            ring_.cancel( user_data( ud_accept_,accept_gen_ ), user_data( ud_cancel_,0 ) );
+            accept_armed_ = false;
+          }
+        }
+
+        /* waits for data on the connection: queues an io_uring read or starts the watcher */
+        void watch( ev_data * dta )
+        {
+          if( use_uring_ && dta->slot_ >= 0 ) return;
+
+          if( dta->wake_ )
+          {
+            // woken while it was busy, the handler runs at the next wakeup
+            dta->wake_ = false;
+            wake( dta->id_ );
+          }
+
+          if( use_uring_ )
+          {
+            if( free_slots_.empty() == false )
+            {
+              unsigned int i = free_slots_.back();
+              int          fd = dta->bfd_.file_descriptor();
+              uint64_t     ud = user_data( ud_read_,i );
+              bool         ok = false;
+
+              if( ring_.has_fixed_buffers() )
+                ok = ring_.read_fixed( fd, slots_[i].buf_, uring_slot_size_, static_cast<uint16_t>(i), ud );
+              else
+                ok = ring_.recv( fd, slots_[i].buf_, uring_slot_size_, ud );
+
+              if( ok )
+              {
+                free_slots_.pop_back();
+                slots_[i].conn_ = dta;
+                dta->slot_      = static_cast<int>(i);
+                return;
+              }
+            }
+            uring_no_slot_.inc();
+          }
+          ev_io_start( loop_, &(dta->watcher_) );
+        }
+
+        /* stops waiting for data on the connection */
+        void unwatch( ev_data * dta )
+        {
+          ev_io_stop( loop_, &(dta->watcher_) );
+          if( dta->writing_ ) stop_writing( dta );
+          if( dta->slot_ >= 0 ) forget_uring( dta );
+        }
+
+        /* detaches the connection from its queued read */
+        void forget_uring( ev_data * dta )
+        {
+          // the buffer is reused when the cancelled read completes
+          unsigned int i = static_cast<unsigned int>(dta->slot_);
+          slots_[i].conn_ = 0;
+          dta->slot_      = -1;
+          ring_.cancel( user_data( ud_read_,i ), user_data( ud_cancel_,0 ) );
+        }
+
+        /*
+        ** with io_uring a send is queued for the next submission and the output stays
+        ** in the bfd until it completes. with libev, or when the ring cannot take the
+        ** send, what the socket takes is sent right away and the watcher waits for room
+        ** for the rest. returns true if output is still in flight.
+        */
+        bool queue_output( ev_data * dta )
+        {
+          if( dta->bfd_.out_pending() == 0 ) return false;
+
+          if( use_uring_ )
+          {
+            int      fd  = dta->bfd_.file_descriptor();
+            uint32_t len = static_cast<uint32_t>(dta->bfd_.out_pending());
+            uint64_t ud  = user_data( ud_send_,id_slot(dta->id_) );
+            bool     ok  = ring_.send( fd, dta->bfd_.out_data(), len, ud );
+
+            if( ok == false && ring_.submit( 0 ) >= 0 )
+            {
+              // the submission queue was full
+              uring_submits_.inc();
+              ok = ring_.send( fd, dta->bfd_.out_data(), len, ud );
+            }
+            if( ok )
+            {
+              dta->sending_ = true;
+              ++n_sending_;
+              return true;
+            }
+          }
+
+          if( dta->bfd_.flush_nb() == false || dta->bfd_.out_pending() == 0 ) return false;
+
+          // the handler may not run while the output buffer is being sent
+          ev_io_stop( loop_, &(dta->watcher_) );
+          ev_io_set( &(dta->watcher_), dta->bfd_.file_descriptor(), EV_WRITE );
+          ev_io_start( loop_, &(dta->watcher_) );
+          dta->writing_ = true;
+          return true;
+        }
+
+        /* the watcher waits for data again */
+        void stop_writing( ev_data * dta )
+        {
+          ev_io_stop( loop_, &(dta->watcher_) );
+          ev_io_set( &(dta->watcher_), dta->bfd_.file_descriptor(), EV_READ );
+          dta->writing_ = false;
+        }
+
+        /* the socket has room for more of the output */
+        void write_cb( ev_data * dta )
+        {
+          ENTER_FUNCTION();
+          bool ok = dta->bfd_.flush_nb();
+
+          // the idle timer only fires when the peer stopped reading
+          if( ok && dta->bfd_.out_pending() > 0 ) { arm_idle_timer( dta ); LEAVE_FUNCTION(); }
+
+          stop_writing( dta );
+          if( ok ) { watch( dta ); arm_idle_timer( dta ); }
+          else     { output_failed( dta ); }
+          LEAVE_FUNCTION();
+        }
+
+        void output_failed( ev_data * dta )
+        {
+          CSL_DEBUGF( L"send failed on conn_id:%lld", dta->id_ );
+          timers_.cancel( dta->idle_timer_ );
+          unwatch( dta );
+          handler_->on_disconnected( dta->id_, dta->peer_addr_ );
+          remove_connection( dta );
+        }
+
+        /* waits for the next request once the output is sent, send_done() and write_cb() do it otherwise */
+        void rearm( ev_data * dta )
+        {
+          if( queue_output( dta ) )
+          {
+            // io_uring: the libev watcher may still be active in inline mode
+            if( dta->sending_ ) ev_io_stop( loop_, &(dta->watcher_) );
+          }
+          else if( dta->bfd_.state() != bfd::ok_ )
+          {
+            output_failed( dta );
+            return;
+          }
+          else
+          {
+            watch( dta );
+          }
+          arm_idle_timer( dta );
+        }
+
+        void accept_done( const uring::completion & c )
+        {
+          bool current = ( ud_index(c.user_data_) == accept_gen_ );
+
+          if( c.res_ >= 0 && accept_paused_ )
+          {
+            // accepted before the cancellation took effect, served on resume
+            accepted_fds_.push_back( c.res_ );
+          }
+          else if( c.res_ >= 0 )
+          {
+            uint64_t max_conns = limits_.max_connections_;
+            bool     over      = ( max_conns > 0 && n_connections() >= max_conns );
+
+            if( over && limits_.on_max_connections_ == pause_ )
+            {
+              CSL_DEBUGF( L"connection limit reached, pause accepting" );
+              limit_connections_.inc();
+              stop_accepting();
+              accept_paused_ = true;
+              accepted_fds_.push_back( c.res_ );
+            }
+            else
+            {
+              accepted( c.res_, peer_of( c.res_ ), over );
+            }
+          }
+          else if( current && c.res_ == -EINVAL && accept_multishot_ )
+          {
+            CSL_DEBUGF( L"multishot accept is not supported, falling back to single shot" );
+            accept_multishot_ = false;
+          }
+
+          // re-arm when the request finished and it was not cancelled by stop_accepting()
+          if( current && c.more() == false && accept_armed_ )
+          {
+            accept_armed_ = false;
+            if( accept_paused_ == false ) start_accepting();
+          }
+        }
+
+        static SAI peer_of( int fd )
+        {
+          SAI addr;
+          socklen_t sz = sizeof(addr);
+          ::memset( &addr,0,sizeof(addr) );
+          ::getpeername( fd, reinterpret_cast<struct sockaddr *>(&addr), &sz );
+          return addr;
+        }
+
+        void read_done( const uring::completion & c )
+        {
+          unsigned int i   = static_cast<unsigned int>(ud_index(c.user_data_));
+          ev_data *    dta = slots_[i].conn_;
+
+          slots_[i].conn_ = 0;
+          if( dta == 0 ) { free_slots_.push_back( i ); return; }
+
+          dta->slot_ = -1;
+          timers_.cancel( dta->idle_timer_ );
+
+          bool woken = dta->wake_;
+          dta->wake_ = false;
+          if( woken && (c.res_ == -ECANCELED || c.res_ == -EINTR) )
+          {
+            // cancelled by run_wakes()
+            free_slots_.push_back( i );
+            if( over_queue( dta ) == false ) dispatch( dta );
+            return;
+          }
+
+          bool ok = ( c.res_ > 0 &&
+                      dta->bfd_.fill( slots_[i].buf_, static_cast<uint64_t>(c.res_) ) );
+          free_slots_.push_back( i );
+
+          if( ok == false )
+          {
+            CSL_DEBUGF( L"read failed on conn_id:%lld res:%d", dta->id_, c.res_ );
+            if( c.res_ > 0 ) limit_buffered_.inc();
+            handler_->on_disconnected( dta->id_, dta->peer_addr_ );
+            remove_connection( dta );
+          }
+          else if( over_queue( dta ) == false )
+          {
+            dispatch( dta );
+          }
+        }
+
+        void send_done( const uring::completion & c )
+        {
+          ev_data * dta = 0;
+          {
+            scoped_mutex m(mtx_);
+            dta = ev_pool_.get_ptr( ud_index(c.user_data_) );
+          }
+          if( dta == 0 || dta->sending_ == false ) return;
+
+          dta->sending_ = false;
+          --n_sending_;
+
+          if( dta->closing_ )
+          {
+            dta->closing_ = false;
+            remove_connection( dta );
+            return;
+          }
+
+          if( c.res_ > 0 || c.res_ == -EAGAIN || c.res_ == -EINTR )
+          {
+            // the rest of a short send is queued again, or left to the watcher if the ring is full
+            if( c.res_ > 0 ) dta->bfd_.out_sent( static_cast<uint64_t>(c.res_) );
+            if( queue_output( dta ) ) return;
+          }
+          else
+          {
+            // the output is dropped, close() would try to flush it
+            CSL_DEBUGF( L"io_uring send failed on conn_id:%lld res:%d", dta->id_, c.res_ );
+            dta->bfd_.out_sent( dta->bfd_.out_pending() );
+            dta->bfd_.close();
+          }
+
+          if( dta->bfd_.state() != bfd::ok_ )
+          {
+            output_failed( dta );
+          }
+          else
+          {
+            watch( dta );
+            arm_idle_timer( dta );
+          }
+        }
+
+        void completion_cb( const uring::completion & c )
+        {
+          switch( ud_kind(c.user_data_) )
+          {
+            case ud_accept_: accept_done( c ); break;
+            case ud_read_:   read_done( c );   break;
+            case ud_send_:   send_done( c );   break;
+            default:         break;
+          };
+        }
+
+        /* processes the completions until there is nothing left to do */
+        void drain_uring()
+        {
+          uring::completion c[uring_batch_];
+          unsigned int got = 0;
+          while( (got=ring_.reap( c, uring_batch_ )) > 0 )
+          {
+            uring_completions_.add( got );
+            for( unsigned int i=0;i<got;++i ) completion_cb( c[i] );
+          }
+        }
+
+        void ring_cb( struct ev_io *w, int revents )
+        {
+          ENTER_FUNCTION();
+          drain_uring();
+          LEAVE_FUNCTION();
+        }
+
+        /* called before the loop blocks: submits what the iteration queued */
+        void prepare_cb( struct ev_prepare *w, int revents )
+        {
+          ENTER_FUNCTION();
+          drain_uring();
+          if( ring_.queued() > 0 )
+          {
+            ring_.submit( 0 );
+            uring_submits_.inc();
+          }
+          LEAVE_FUNCTION();
+        }
+
+        /* cancels the queued requests and waits for the buffers to be released */
+        void shutdown_uring()
+        {
+          ENTER_FUNCTION();
+          ev_io_stop( loop_, &ring_watcher_ );
+          ev_prepare_stop( loop_, &submit_watcher_ );
+          stop_accepting();
+
+          for( size_t i=0;i<slots_.size();++i )
+          {
+            if( slots_[i].conn_ ) slots_[i].conn_->slot_ = -1;
+            slots_[i].conn_ = 0;
+            ring_.cancel( user_data( ud_read_,i ), user_data( ud_cancel_,0 ) );
+          }
+          ring_.submit( 0 );
+
+          // the connections removed while sending are freed as their cancelled sends complete
+          uring::completion c[uring_batch_];
+          for( unsigned int tries=0;tries<20 && (free_slots_.size()<slots_.size() || n_sending_>0);++tries )
+          {
+            struct pollfd pfd;
+            pfd.fd      = ring_.fd();
+            pfd.events  = POLLIN;
+            pfd.revents = 0;
+            PollSocket( &pfd, 1, 50 );
+
+            unsigned int got = 0;
+            while( (got=ring_.reap( c, uring_batch_ )) > 0 )
+            {
+              for( unsigned int i=0;i<got;++i )
+              {
+                if( ud_kind(c[i].user_data_) == ud_read_ )
+                  free_slots_.push_back( static_cast<unsigned int>(ud_index(c[i].user_data_)) );
+                else if( ud_kind(c[i].user_data_) == ud_send_ )
+                  send_done( c[i] );
+                else if( ud_kind(c[i].user_data_) == ud_accept_ && c[i].res_ >= 0 )
+                  ::close( c[i].res_ );
+              }
+            }
+          }
+          for( size_t i=0;i<accepted_fds_.size();++i ) ::close( accepted_fds_[i] );
+          accepted_fds_.clear();
+          ring_.destroy();
+          use_uring_ = false;
+          LEAVE_FUNCTION();
+        }
+
+        void set_placement(thrpool::placement_t p, int loop_cpu)
+        {
+          scoped_mutex m(mtx_);
+          placement_ = p;
+          loop_cpu_  = loop_cpu;
+          for( size_t i=0;i<siblings_.size();++i ) siblings_[i]->set_placement( p, loop_cpu );
+        }
+
         bool start()
         {
           ENTER_FUNCTION();
+          for( size_t i=0;i<siblings_.size();++i )
+          {
+            if( siblings_[i]->start() == false ) RETURN_FUNCTION(false);
+          }
+
           bool ret = listener_thread_.start();
 
           if( ret )
@@ -581,13 +1654,15 @@ namespace csl
           ENTER_FUNCTION();
           bool ret = false;
 
+          // the other loops are stopped first, so exit_event() covers them too
+          for( size_t i=0;i<siblings_.size();++i ) siblings_[i]->stop();
+
           // send a wakeup event if not sent before
           if( stop_me() == false )
           {
             CSL_DEBUGF( L"waking up the event loop" );
             stop_me( true );
             ev_async_send( loop_, &wakeup_watcher_ );
-            ev_timer_stop( loop_, &periodic_watcher_ );
           }
 
           CSL_DEBUGF( L"check if listener_thread_ has exited. if not wait 5 secs" );
@@ -662,6 +1737,24 @@ namespace csl
           this_ptr->new_data_cb(w, revents);
         }
 
+        void lstnr_ring_cb( struct ev_loop *loop, struct ev_io *w, int revents )
+        {
+          lstnr::impl * this_ptr = reinterpret_cast<lstnr::impl *>(w->data);
+          this_ptr->ring_cb(w, revents);
+        }
+
+        void lstnr_prepare_cb( struct ev_loop *loop, struct ev_prepare *w, int revents )
+        {
+          lstnr::impl * this_ptr = reinterpret_cast<lstnr::impl *>(w->data);
+          this_ptr->prepare_cb(w, revents);
+        }
+
+        void idle_timer::operator()(void)
+        {
+          lstnr::impl * this_ptr = reinterpret_cast<lstnr::impl *>(data_->watcher_.data);
+          this_ptr->idle_cb(data_);
+        }
+
         void data_handler::operator()(void)
         {
           conn_queue::handler h;
@@ -682,6 +1775,45 @@ namespace csl
         return impl_->init(h,address,backlog);
       }
 
+      void lstnr::set_idle_timeout(unsigned int timeout_ms)
+      {
+        impl_->set_idle_timeout(timeout_ms);
+      }
+
+      void lstnr::set_placement(nthread::thrpool::placement_t p, int loop_cpu)
+      {
+        impl_->set_placement(p,loop_cpu);
+      }
+
+      void lstnr::set_loops(unsigned int n_loops)
+      {
+        impl_->set_loops(n_loops);
+      }
+
+      void lstnr::set_workers(unsigned int min_workers, unsigned int max_workers)
+      {
+        impl_->set_workers(min_workers,max_workers);
+      }
+
+      void lstnr::set_inline(bool yesno)
+      {
+        impl_->set_inline(yesno);
+      }
+
+      void lstnr::set_limits(const limits & l)
+      {
+        impl_->set_limits(l);
+      }
+
+      void lstnr::set_backend(backend_t b, unsigned int n_buffers)
+      {
+        impl_->set_backend(b,n_buffers);
+      }
+
+      lstnr::backend_t lstnr::backend() const { return impl_->backend(); }
+
+      bool lstnr::wake(connid_t id) { return impl_->wake(id); }
+
       bool lstnr::start() { return impl_->start(); }
       bool lstnr::stop()  { return impl_->stop();  }
 
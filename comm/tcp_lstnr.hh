@@ -39,6 +39,7 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "codesloop/common/common.h"
 #include "codesloop/common/obj.hh"
 #include "codesloop/nthread/pevent.hh"
+#include "codesloop/nthread/thrpool.hh"
 #ifdef __cplusplus
 #include <memory>
 
@@ -53,13 +54,171 @@ namespace csl
       class lstnr
       {
         public:
+          /** @brief what happens when a limit is hit */
+          enum overload_t {
+            pause_  = 0,  ///<stop accepting or reading until there is room again
+            reject_ = 1   ///<close the new connection
+          };
+
+          /** @brief how the loops do the socket IO */
+          enum backend_t {
+            libev_  = 0,  ///<readiness notification followed by accept() and recv() calls
+            uring_  = 1   ///<Linux io_uring, falls back to libev_ when not available
+          };
+
+          enum {
+            default_uring_buffers_ = 256   ///<default number of registered read buffers per loop
+          };
+
+          /**
+             @brief the limits protecting the listener from overload
+
+             a zero limit means unlimited, which is the default. the limits apply
+             to every loop separately.
+           */
+          struct limits
+          {
+            unsigned int  max_connections_;     ///<open connections
+            overload_t    on_max_connections_;  ///<pause_ stops the accept watcher, reject_ accepts and closes
+            unsigned int  max_queued_;          ///<readable connections waiting for a worker
+            overload_t    on_max_queued_;       ///<pause_ stops reading them until the queue drains, reject_ closes them
+            uint64_t      max_buffered_;        ///<bytes buffered per connection, the connection is closed above this
+
+            limits()
+              : max_connections_(0), on_max_connections_(pause_),
+                max_queued_(0), on_max_queued_(pause_), max_buffered_(0) {}
+          };
+
           lstnr();
           virtual ~lstnr();
 
-          /* address, to be setup during initialization */
+          /* the bound address, with the chosen port if init() got port 0 */
           const SAI & own_addr() const;
 
           bool init(handler & h, SAI address, int backlog=100);
+
+          /**
+             @brief sets the CPU placement of the loop and the worker threads
+             @param p is the thrpool placement of the workers
+             @param loop_cpu pins the event loop thread to this CPU, -1 leaves it
+                    where it starts (place_near_ pins it there)
+
+             to be called before start()
+           */
+          void set_placement(nthread::thrpool::placement_t p, int loop_cpu=-1);
+
+          /**
+             @brief sets the number of event loops
+             @param n_loops is 1 by default: a single loop does all the accepts
+
+             with more loops every loop has its own SO_REUSEPORT listening socket
+             on the same address, its own thread pool and its own connections,
+             so the kernel spreads the incoming connections among the loops.
+             the loop index of a connection is ((id>>32) & 0xff), the bits above
+             it count the reuses of the connection's slot. with a placement set,
+             the loops are pinned to consecutive allowed CPUs (starting at
+             loop_cpu when given) and the workers are placed near their loop.
+
+             to be called before init()
+           */
+          void set_loops(unsigned int n_loops);
+
+          /**
+             @brief sets the size of the worker pools of the loops
+             @param min_workers is the minimum pool size (1 by default)
+             @param max_workers is the maximum pool size (4 by default)
+
+             to be called before init()
+           */
+          void set_workers(unsigned int min_workers, unsigned int max_workers);
+
+          /**
+             @brief runs the handlers in the event loop thread (run-to-completion)
+             @param yesno turns the inline mode on or off (off by default)
+
+             by default every readable connection is handed to the worker pool
+             and handed back afterwards, that is two queue operations and two
+             thread wakeups per request. in inline mode the loop reads and calls
+             on_data_arrival() itself, and the connection's watcher stays
+             active. all the connections that became readable in an iteration
+             of the loop are served in that iteration.
+
+             this suits short handlers. a handler may still send a call to the
+             worker pool by returning true from handler::offload().
+
+             to be called before start()
+           */
+          void set_inline(bool yesno);
+
+          /**
+             @brief sets the overload limits
+             @param l are the limits, see the limits structure
+
+             a paused listener leaves the pending connections in the kernel's
+             backlog and the unread data in the socket buffers, so the peers
+             are slowed down by TCP flow control instead of the process growing
+             without bounds. the number of times the limits fired are counted
+             in common::metrics: comm.tcp.lstnr.limit.connections,
+             comm.tcp.lstnr.limit.queued and comm.tcp.lstnr.limit.buffered.
+           */
+          void set_limits(const limits & l);
+
+          /**
+             @brief closes the connections that were idle for the given time
+             @param timeout_ms is the idle timeout, 0 (the default) disables it
+
+             the timeouts are kept in a timer wheel driven by the listener's
+             event loop with 100 ms resolution. the handler's on_disconnected()
+             is called for the closed connections.
+           */
+          void set_idle_timeout(unsigned int timeout_ms);
+
+          /**
+             @brief selects the IO backend
+             @param b is libev_ (the default) or uring_
+             @param n_buffers is the number of read buffers of a loop (uring_ only)
+
+             with uring_ the loop keeps a multishot accept and one read per
+             connection queued in an io_uring instance, and the reads land in
+             4k buffers registered with the kernel. the requests queued in an
+             iteration of the loop are submitted by a single system call, and
+             so are the replies the handlers append()-ed to the bfd. a reply
+             stays in the bfd until its send completes and the connection is
+             only read again after that, so a peer that does not read its
+             replies holds up its own connection only. direct bfd::send() and
+             write() calls stay synchronous.
+
+             the io_uring file descriptor itself is watched by libev, so the
+             timers, the wakeups and the worker pool work as before. when all
+             buffers are in use the further connections are read the libev
+             way. when io_uring cannot be set up (old kernel, seccomp, no
+             support in the build) the loop falls back to libev_ entirely,
+             backend() tells which one is in use.
+
+             to be called before init()
+           */
+          void set_backend(backend_t b, unsigned int n_buffers=default_uring_buffers_);
+
+          /** @brief the backend in use, valid after init() */
+          backend_t backend() const;
+
+          /**
+             @brief calls the handler's on_data_arrival() without new data
+             @param id is the connection
+             @return false if the listener is not running
+
+             may be called from any thread. a connection waiting for data is
+             handed to the handler at the next iteration of its loop, a busy
+             one (in the handler or sending its reply) right after that. the
+             call may come with an empty buffer, the handler has to cope with
+             that. the ids carry a generation of their slot, so the wakes of a
+             closed connection are dropped instead of reaching the connection
+             that took its slot (until the 24 bit generation wraps around).
+             coro_handler uses this to resume the coroutines waiting for a
+             timer, a co_event or their output to be sent.
+           */
+          bool wake(connid_t id);
+
           bool start();
           bool stop();
 
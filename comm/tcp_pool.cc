@@ -0,0 +1,399 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+   @file tcp_pool.cc
+   @brief pool of warm tcp client connections, shared by many caller threads
+ */
+
+#include "codesloop/comm/tcp_pool.hh"
+#include "codesloop/nthread/mutex.hh"
+#include "codesloop/nthread/event.hh"
+#include "codesloop/common/metrics.hh"
+#include "codesloop/common/common.h"
+#include <vector>
+#include <map>
+
+namespace csl
+{
+  using namespace nthread;
+  using common::metrics;
+
+  namespace comm
+  {
+    namespace tcp
+    {
+      namespace
+      {
+        struct idle_conn
+        {
+          client *  client_;
+          uint64_t  since_ms_;
+        };
+
+        typedef std::vector<idle_conn> idle_conns_t;
+        typedef std::vector<client *>  clients_t;
+
+        /* closing a connection may block, so the clients are deleted after the lock is released */
+        inline void destroy(clients_t & v)
+        {
+          for( clients_t::iterator it=v.begin();it!=v.end();++it ) { delete *it; }
+          v.clear();
+        }
+
+        struct host
+        {
+          idle_conns_t  idle_;      ///<oldest first, leased from the back
+          unsigned int  n_open_;    ///<leased and connecting connections
+
+          host() : n_open_(0) { }
+        };
+
+        typedef std::map<uint64_t,host *> hosts_t;
+
+        inline uint64_t key_of(const SAI & a)
+        {
+          return ((static_cast<uint64_t>(a.sin_addr.s_addr) << 16) |
+                   static_cast<uint64_t>(a.sin_port));
+        }
+
+        inline uint64_t now_ms() { return metrics::now_usec()/1000; }
+      }
+
+      struct pool::impl
+      {
+        mutex          mtx_;
+        event          freed_;
+        hosts_t        hosts_;
+        unsigned int   n_waiting_;
+        unsigned int   max_per_host_;
+        unsigned int   max_idle_;
+        uint32_t       idle_timeout_ms_;
+        uint32_t       connect_timeout_ms_;
+
+        metrics::counter &  hits_;
+        metrics::counter &  connects_;
+        metrics::counter &  connect_errors_;
+        metrics::counter &  broken_;
+        metrics::counter &  reaped_;
+        metrics::counter &  timeouts_;
+
+        impl() : n_waiting_(0),
+                 max_per_host_(default_max_per_host_),
+                 max_idle_(default_max_idle_),
+                 idle_timeout_ms_(default_idle_timeout_ms_),
+                 connect_timeout_ms_(default_connect_timeout_ms_),
+                 hits_(metrics::instance().get_counter("comm.tcp.pool.hits")),
+                 connects_(metrics::instance().get_counter("comm.tcp.pool.connects")),
+                 connect_errors_(metrics::instance().get_counter("comm.tcp.pool.connect_errors")),
+                 broken_(metrics::instance().get_counter("comm.tcp.pool.broken")),
+                 reaped_(metrics::instance().get_counter("comm.tcp.pool.reaped")),
+                 timeouts_(metrics::instance().get_counter("comm.tcp.pool.timeouts")) { }
+
+        ~impl()
+        {
+          clear();
+          for( hosts_t::iterator it=hosts_.begin();it!=hosts_.end();++it ) { delete it->second; }
+        }
+
+        /* must be called with mtx_ held */
+        host & get_host(const SAI & addr)
+        {
+          uint64_t k = key_of(addr);
+          hosts_t::iterator it = hosts_.find(k);
+          if( it != hosts_.end() ) return *(it->second);
+          host * h = new host();
+          hosts_.insert( hosts_t::value_type(k,h) );
+          return *h;
+        }
+
+        /* moves the expired idle connections of h to dead, must be called with mtx_ held */
+        unsigned int reap(host & h, uint64_t now, clients_t & dead)
+        {
+          unsigned int n = 0;
+          while( n < h.idle_.size() && now - h.idle_[n].since_ms_ > idle_timeout_ms_ )
+          {
+            dead.push_back( h.idle_[n].client_ );
+            ++n;
+          }
+          if( n ) { h.idle_.erase( h.idle_.begin(), h.idle_.begin()+n ); reaped_.add(n); }
+          return n;
+        }
+
+        void clear()
+        {
+          clients_t dead;
+          {
+            scoped_mutex m(mtx_);
+            for( hosts_t::iterator it=hosts_.begin();it!=hosts_.end();++it )
+            {
+              idle_conns_t & idle(it->second->idle_);
+              for( idle_conns_t::iterator i=idle.begin();i!=idle.end();++i ) { dead.push_back(i->client_); }
+              idle.clear();
+            }
+          }
+          destroy(dead);
+        }
+
+        /* a new connection, or NULL if cannot connect */
+        client * connect(const SAI & addr)
+        {
+          std::auto_ptr<client> c(new client());
+          if( c->init(addr,connect_timeout_ms_) == false )
+          {
+            connect_errors_.inc();
+            return 0;
+          }
+          c->set_nodelay(true);
+          connects_.inc();
+          return c.release();
+        }
+
+        client * lease(const SAI & addr)
+        {
+          uint64_t deadline = now_ms() + connect_timeout_ms_;
+
+          while( true )
+          {
+            uint64_t  wait_ms   = 0;
+            bool      timed_out = false;
+            client *  candidate = 0;
+            clients_t dead;
+            {
+              scoped_mutex m(mtx_);
+              host & h(get_host(addr));
+              uint64_t now = now_ms();
+              reap(h,now,dead);
+
+              if( h.idle_.size() > 0 )
+              {
+                /* the slot is reserved while the candidate is checked */
+                candidate = h.idle_.back().client_;
+                h.idle_.pop_back();
+                ++h.n_open_;
+              }
+              else if( h.n_open_ < max_per_host_ )
+              {
+                /* reserve the slot, connect without holding the lock */
+                ++h.n_open_;
+              }
+              else
+              {
+                if( now >= deadline )
+                {
+                  timeouts_.inc();
+                  timed_out = true;
+                }
+                else
+                {
+                  /* counted under the lock, so give_back() cannot miss the waiter */
+                  ++n_waiting_;
+                  wait_ms = deadline-now;
+                }
+              }
+            }
+
+            destroy(dead);
+            if( timed_out ) return 0;
+
+            if( candidate )
+            {
+              /* healthy() polls the socket, the lock is not held */
+              if( candidate->healthy() )
+              {
+                hits_.inc();
+                return candidate;
+              }
+              broken_.inc();
+              delete candidate;
+              release_slot(addr);
+              continue;
+            }
+
+            if( wait_ms )
+            {
+              freed_.wait( static_cast<unsigned long>(wait_ms) );
+              scoped_mutex m(mtx_);
+              --n_waiting_;
+              continue;
+            }
+
+            client * c = connect(addr);
+            if( c == 0 ) { release_slot(addr); }
+            return c;
+          }
+        }
+
+        void release_slot(const SAI & addr)
+        {
+          scoped_mutex m(mtx_);
+          --(get_host(addr).n_open_);
+          if( n_waiting_ ) freed_.notify();
+        }
+
+        void give_back(client * c, bool reusable)
+        {
+          if( c == 0 ) return;
+
+          /* the caller still owns c, check it before taking the lock */
+          if( reusable && c->healthy() == false ) { reusable = false; }
+
+          {
+            scoped_mutex m(mtx_);
+            if( n_waiting_ ) freed_.notify();
+            host & h(get_host(c->peer_addr()));
+            --h.n_open_;
+
+            if( reusable == false )
+            {
+              broken_.inc();
+            }
+            else if( h.idle_.size() < max_idle_ )
+            {
+              idle_conn ic;
+              ic.client_   = c;
+              ic.since_ms_ = now_ms();
+              h.idle_.push_back(ic);
+              c = 0;
+            }
+          }
+          delete c;
+        }
+
+        unsigned int warm(const SAI & addr, unsigned int n)
+        {
+          while( true )
+          {
+            {
+              scoped_mutex m(mtx_);
+              host & h(get_host(addr));
+              unsigned int idle = static_cast<unsigned int>(h.idle_.size());
+              if( idle >= n || idle >= max_idle_ ||
+                  h.n_open_ + idle >= max_per_host_ ) { return idle; }
+              ++h.n_open_;
+            }
+            client * c = connect(addr);
+            if( c == 0 ) { release_slot(addr); return n_idle(addr); }
+            give_back(c,true);
+          }
+        }
+
+        unsigned int n_idle(const SAI & addr)
+        {
+          scoped_mutex m(mtx_);
+          return static_cast<unsigned int>(get_host(addr).idle_.size());
+        }
+      };
+
+      /* handle */
+      pool::handle::handle(pool & p, const SAI & addr)
+        : pool_(p), client_(p.lease(addr)), reusable_(true) { }
+
+      pool::handle::~handle() { release(); }
+
+      void pool::handle::release()
+      {
+        if( client_ ) { pool_.give_back(client_,reusable_); client_ = 0; }
+      }
+
+      /* pool */
+      pool::pool() : impl_(new impl()) { }
+
+      pool::~pool() { }
+
+      client * pool::lease(const SAI & addr)
+      {
+        return impl_->lease(addr);
+      }
+
+      void pool::give_back(client * c, bool reusable)
+      {
+        impl_->give_back(c,reusable);
+      }
+
+      unsigned int pool::warm(const SAI & addr, unsigned int n)
+      {
+        return impl_->warm(addr,n);
+      }
+
+      unsigned int pool::reap()
+      {
+        clients_t dead;
+        unsigned int ret = 0;
+        {
+          scoped_mutex m(impl_->mtx_);
+          uint64_t now = now_ms();
+          for( hosts_t::iterator it=impl_->hosts_.begin();it!=impl_->hosts_.end();++it )
+          {
+            ret += impl_->reap(*(it->second),now,dead);
+          }
+        }
+        destroy(dead);
+        return ret;
+      }
+
+      void pool::clear()
+      {
+        impl_->clear();
+      }
+
+      unsigned int pool::n_idle()
+      {
+        scoped_mutex m(impl_->mtx_);
+        unsigned int ret = 0;
+        for( hosts_t::iterator it=impl_->hosts_.begin();it!=impl_->hosts_.end();++it )
+        {
+          ret += static_cast<unsigned int>(it->second->idle_.size());
+        }
+        return ret;
+      }
+
+      unsigned int pool::n_leased()
+      {
+        scoped_mutex m(impl_->mtx_);
+        unsigned int ret = 0;
+        for( hosts_t::iterator it=impl_->hosts_.begin();it!=impl_->hosts_.end();++it )
+        {
+          ret += it->second->n_open_;
+        }
+        return ret;
+      }
+
+      void pool::max_per_host(unsigned int n)         { impl_->max_per_host_ = (n ? n : 1); }
+      unsigned int pool::max_per_host() const         { return impl_->max_per_host_; }
+
+      void pool::max_idle(unsigned int n)             { impl_->max_idle_ = n; }
+      unsigned int pool::max_idle() const             { return impl_->max_idle_; }
+
+      void pool::idle_timeout_ms(uint32_t ms)         { impl_->idle_timeout_ms_ = ms; }
+      uint32_t pool::idle_timeout_ms() const          { return impl_->idle_timeout_ms_; }
+
+      void pool::connect_timeout_ms(uint32_t ms)      { impl_->connect_timeout_ms_ = ms; }
+      uint32_t pool::connect_timeout_ms() const       { return impl_->connect_timeout_ms_; }
+    }
+  }
+}
+
+/* EOF */
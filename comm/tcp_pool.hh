@@ -0,0 +1,189 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _csl_comm_tcp_pool_hh_included_
+#define _csl_comm_tcp_pool_hh_included_
+
+/**
+   @file tcp_pool.hh
+   @brief pool of warm tcp client connections, shared by many caller threads
+ */
+
+#include "codesloop/comm/tcp_client.hh"
+#include "codesloop/comm/sai.hh"
+#include "codesloop/common/common.h"
+#include "codesloop/common/obj.hh"
+#ifdef __cplusplus
+#include <memory>
+
+namespace csl
+{
+  namespace comm
+  {
+    namespace tcp
+    {
+      /**
+      @brief keeps connected tcp::client objects per peer address
+
+      callers lease() a connection for a request (or for a pipelined batch of
+      requests) and give_back() it when the replies are read. the connection
+      setup only happens when there is no idle connection to the address, so
+      in steady state it disappears from the request latency.
+
+      - connections are opened with a non-blocking connect(), limited by
+        connect_timeout_ms(), and have TCP_NODELAY set
+      - at most max_per_host() connections are open to an address. when all of
+        them are leased, lease() waits for one to be given back, but not longer
+        than connect_timeout_ms()
+      - idle connections are kept in LIFO order, so the most recently used (and
+        warmest) one is leased first. at most max_idle() of them are kept per
+        address, and the ones idle for more than idle_timeout_ms() are closed
+        by reap(). lease() reaps the address it works on.
+      - every idle connection is health checked before it is leased: the
+        connections closed or reset by the peer, and the ones with unread
+        data on them are dropped
+
+      the pool must outlive the leased connections.
+
+      @code
+      pool p;
+      pool::handle h(p,addr);
+      if( h.ok() && h->write(req,sz) ) { h->read(...); }
+      else                             { h.broken();   }
+      @endcode
+      */
+      class pool : public csl::common::obj
+      {
+        public:
+          enum {
+            default_max_per_host_       = 16,     ///<default limit of open connections per address
+            default_max_idle_           = 8,      ///<default limit of idle connections per address
+            default_idle_timeout_ms_    = 60000,  ///<default idle time before a connection is closed
+            default_connect_timeout_ms_ = 3000    ///<default time limit of connect and of waiting in lease()
+          };
+
+          /**
+          @brief leases a connection on construction and gives it back on destruction
+
+          when the request failed in the middle, broken() tells the pool not to
+          reuse the connection.
+          */
+          class handle
+          {
+            public:
+              handle(pool & p, const SAI & addr);
+              ~handle();
+
+              inline client * get() const        { return client_; }
+              inline client * operator->() const { return client_; }
+              inline bool ok() const             { return (client_ != 0); }
+
+              /** @brief the connection will be closed instead of given back */
+              inline void broken()               { reusable_ = false; }
+
+              /** @brief gives back the connection before the handle goes out of scope */
+              void release();
+
+            private:
+              pool &    pool_;
+              client *  client_;
+              bool      reusable_;
+
+              handle(const handle & other);
+              handle & operator=(const handle & other);
+          };
+
+          pool();
+          virtual ~pool();
+
+          /**
+          @brief returns a connection to addr
+          @param addr is the peer address
+          @return the connection or NULL if it cannot be connected, or the
+                  connection limit was reached and none was given back in time
+
+          the returned connection must be given back by give_back()
+          */
+          client * lease(const SAI & addr);
+
+          /**
+          @brief gives back a leased connection
+          @param c is the connection returned by lease()
+          @param reusable tells if the connection may be leased again. false closes it.
+          */
+          void give_back(client * c, bool reusable=true);
+
+          /**
+          @brief opens idle connections ahead of the first requests
+          @param addr is the peer address
+          @param n is the number of idle connections wanted
+          @return the number of idle connections to addr
+          */
+          unsigned int warm(const SAI & addr, unsigned int n);
+
+          /**
+          @brief closes the connections idle for more than idle_timeout_ms()
+          @return the number of connections closed
+          */
+          unsigned int reap();
+
+          /** @brief closes all idle connections */
+          void clear();
+
+          unsigned int n_idle();    ///<number of idle connections
+          unsigned int n_leased();  ///<number of leased connections
+
+          /* configuration, may be changed while in use */
+          void max_per_host(unsigned int n);
+          unsigned int max_per_host() const;
+
+          void max_idle(unsigned int n);
+          unsigned int max_idle() const;
+
+          void idle_timeout_ms(uint32_t ms);
+          uint32_t idle_timeout_ms() const;
+
+          void connect_timeout_ms(uint32_t ms);
+          uint32_t connect_timeout_ms() const;
+
+          struct impl;
+
+        private:
+          std::auto_ptr<impl> impl_;
+
+          /* no-copy */
+          pool(const pool & other);
+          pool & operator=(const pool & other);
+
+          CSL_OBJ(csl::comm::tcp,pool);
+      };
+    }
+  }
+}
+
+#endif /*__cplusplus*/
+#endif /* _csl_comm_tcp_pool_hh_included_ */
+
+/* EOF */
@@ -175,6 +175,9 @@ namespace csl
       {
         try
         {
+          /* the message may hold a smaller received packet */
+          if( m.alloc() == false ) { THR(comm::exc::rs_internal_state,false); }
+
           if( pkt_salt.size() != salt_size_v )  { THR(comm::exc::rs_salt_size,false); }
           if( comm_salt.size() != salt_size_v ) { THR(comm::exc::rs_salt_size,false); }
           if( sesskey.size() == 0 )             { THR(comm::exc::rs_sesskey_empty,false); }
@@ -270,7 +273,7 @@ namespace csl
               /* empty message */
               return;
             }
-            m.copy_to(ms);
+            ms.take(m);
           }
           else
           {
@@ -327,15 +330,7 @@ namespace csl
           }
 
           /* send data back */
-          socklen_t len = sizeof(ms.sender_);
-
-          if( ::sendto( socket_, reinterpret_cast<const char *>(ms.data_), ms.size_, 0,
-              reinterpret_cast<const struct sockaddr *>(&(ms.sender_)), len ) != static_cast<int>(ms.size_) )
-          {
-            FPRINTF(stderr,L"[%ls:%d] Error in sendto(%d)\n",L""__FILE__,__LINE__,socket_);
-            perror("sendto");
-            return;
-          }
+          send_reply( ms );
         }
         catch( common::exc e )
         {
@@ -437,6 +432,9 @@ namespace csl
       {
         try
         {
+          /* the message may hold a smaller received packet */
+          if( m.alloc() == false ) { THR(comm::exc::rs_internal_state,false); }
+
           /* unencrypted part */
           pbuf    outer;
           xdrbuf  xbo(outer);
@@ -694,21 +692,13 @@ namespace csl
           THRC(exc::rs_send_failed,false);
         }
 
-        fd_set rfds;
-        struct timeval tv = { 0,0 };
-        struct timeval * ptv = 0;
-
-        if( timeout_ms )
-        {
-          ptv = &tv;
-          tv.tv_sec  = timeout_ms/1000;
-          tv.tv_usec = (timeout_ms%1000)*1000;
-        }
-
-        FD_ZERO(&rfds);
-        FD_SET(sock_,&rfds);
+        struct pollfd pfd;
+        pfd.fd      = sock_;
+        pfd.events  = POLLIN;
+        pfd.revents = 0;
 
-        err = ::select(sock_+1,&rfds,NULL,NULL,ptv);
+        /* zero timeout means wait forever */
+        err = PollSocket( &pfd, 1, (timeout_ms ? static_cast<int>(timeout_ms) : -1) );
 
         if( err > 0 )
         {
@@ -737,7 +727,7 @@ namespace csl
         else
         {
           /* error */
-          THRC(exc::rs_select_failed,false);
+          THRC(exc::rs_poll_failed,false);
         }
       }
     } /* end of udp namespace */
@@ -79,6 +79,12 @@ namespace csl
           return false;
         }
 
+        if( replies_ && replies_->socket() == sock )
+        {
+          memcpy( &(m.sender_),&addr,sizeof(addr) );
+          return replies_->send(m);
+        }
+
         if( (::sendto( sock, reinterpret_cast<const char *>(m.data_), m.size_ , 0,
           reinterpret_cast<const struct sockaddr *>(&(addr)), sizeof(addr) )) != static_cast<int>(m.size_) )
         {
@@ -186,7 +192,7 @@ namespace csl
             THR(comm::exc::rs_xdr_error,false);
           }
 
-          if( xbi.get_data( recvdta,sz,m.max_len() ) == false )
+          if( xbi.get_data( recvdta,sz,msg::max_len_v ) == false )
           {
             THR(comm::exc::rs_xdr_error,false);
           }
@@ -219,6 +225,9 @@ namespace csl
       {
         try
         {
+          /* the message may hold a smaller received packet */
+          if( m.alloc() == false ) { THR(comm::exc::rs_internal_state,false); }
+
           if( senddta.size() == 0 )            { THR(comm::exc::rs_null_param,false); }
           if( old_salt.size() != salt_size_v ) { THR(comm::exc::rs_salt_size,false); }
           if( new_salt.size() != salt_size_v ) { THR(comm::exc::rs_salt_size,false); }
@@ -315,7 +324,7 @@ namespace csl
               /* empty message */
               return;
             }
-            m.copy_to(ms);
+            ms.take(m);
           }
           else
           {
@@ -333,11 +342,19 @@ namespace csl
 
           if( get_salt(old_salt,ms) == false ) { return; }
 
-          /* lookup session key */
-          if( lookup_session_cb_ &&
-              (*lookup_session_cb_)(old_salt, ms.sender_, sesskey) == false )
+          /* lookup session key, the callback is only asked on cache misses */
+          if( session_cache_ == 0 || session_cache_->lookup(old_salt, ms.sender_, sesskey) == false )
           {
-            return;
+            /* the session may have been evicted with an update not written yet */
+            if( session_cache_ && update_session_cb_ ) { session_cache_->flush_evicted(*update_session_cb_); }
+
+            if( lookup_session_cb_ &&
+                (*lookup_session_cb_)(old_salt, ms.sender_, sesskey) == false )
+            {
+              return;
+            }
+
+            if( session_cache_ && lookup_session_cb_ ) { session_cache_->insert(old_salt, ms.sender_, sesskey); }
           }
 
           if( init_data(new_salt, sesskey, ms, recvdta) == false ) { return; }
@@ -350,8 +367,14 @@ namespace csl
           }
 
           /* register new salt for looking up session key */
-          if( update_session_cb_ &&
-              (*update_session_cb_)(old_salt, new_salt, ms.sender_, sesskey) == false )
+          if( session_cache_ )
+          {
+            /* write-behind: the callback gets the coalesced updates */
+            session_cache_->update(old_salt, new_salt, ms.sender_, sesskey);
+            if( update_session_cb_ && session_cache_->flush_due() ) { session_cache_->flush(*update_session_cb_); }
+          }
+          else if( update_session_cb_ &&
+                   (*update_session_cb_)(old_salt, new_salt, ms.sender_, sesskey) == false )
           {
             return;
           }
@@ -399,6 +422,8 @@ namespace csl
         thread_.set_entry( receiver_ );
         handler_.socket( receiver_.socket() );
 
+        if( handler_.handle_data_cb_ ) { handler_.handle_data_cb_->reply_queue( handler_.reply_queue() ); }
+
         /* launch receiver threads */
         if( thread_.start() == false ) { THR(exc::rs_thread_start,false); }
 
@@ -420,6 +445,12 @@ namespace csl
           thread_.stop();
         }
 
+        /* the handlers are gone, write the pending session updates */
+        if( handler_.session_cache_ && handler_.update_session_cb_ )
+        {
+          handler_.session_cache_->flush( *(handler_.update_session_cb_) );
+        }
+
         return ret;
       }
 
@@ -444,26 +475,19 @@ namespace csl
         if( init() == false ) { THR(exc::rs_init_failed,false); }
 
         /* wait for data arrival */
-        fd_set rfds;
-        struct timeval tv = { 0,0 };
-        struct timeval * ptv = 0;
-
-        if( timeout_ms )
-        {
-          ptv = &tv;
-          tv.tv_sec  = timeout_ms/1000;
-          tv.tv_usec = (timeout_ms%1000)*1000;
-        }
-
-        FD_ZERO(&rfds);
-        FD_SET(sock_,&rfds);
+        struct pollfd pfd;
+        pfd.fd      = sock_;
+        pfd.events  = POLLIN;
+        pfd.revents = 0;
 
-        int err = ::select(sock_+1,&rfds,NULL,NULL,ptv);
+        /* zero timeout means wait forever */
+        int err = PollSocket( &pfd, 1, (timeout_ms ? static_cast<int>(timeout_ms) : -1) );
 
         if( err > 0 )
         {
           msg m;
 
+          if( m.alloc() == false ) { THR(exc::rs_internal_state,false); }
           err = ::recv(sock_,reinterpret_cast<char *>(m.data_), m.max_len(), 0);
           //
           if( err > 0 )
@@ -493,7 +517,7 @@ namespace csl
         else
         {
           /* error */
-          THRC(exc::rs_select_failed,false);
+          THRC(exc::rs_poll_failed,false);
         }
       }
 
@@ -27,6 +27,7 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define _csl_comm_udp_data_hh_included_
 
 #include "codesloop/comm/udp_auth.hh"
+#include "codesloop/comm/udp_session.hh"
 #include "codesloop/common/common.h"
 #include "codesloop/common/obj.hh"
 #ifdef __cplusplus
@@ -67,8 +68,13 @@ namespace csl
       class handle_data_callback
       {
         public:
+          handle_data_callback() : replies_(0) {}
           virtual ~handle_data_callback() {}
 
+          /* send_reply() queues the replies here when set, data_srv::start() sets it */
+          inline sendq * reply_queue() const { return replies_; }
+          inline void reply_queue(sendq * q) { replies_ = q; }
+
           virtual bool send_reply( const saltbuf_t & old_salt,
                                    const saltbuf_t & new_salt,
                                    const SAI & addr,
@@ -82,6 +88,9 @@ namespace csl
                                    const ustr & sesskey,        // in: looked up in cb
                                    int sock,                    // in: from handler
                                    const b1024_t & data ) = 0;  // in: decrypted from request
+
+        protected:
+          sendq * replies_;
       };
 
       class update_session_callback
@@ -106,7 +115,10 @@ namespace csl
           handle_data_callback     * handle_data_cb_;
           update_session_callback  * update_session_cb_;
 
-          data_handler() : lookup_session_cb_(0), handle_data_cb_(0), update_session_cb_(0) {}
+          /* when set, the callbacks above are only used on misses and write-behind */
+          session_cache            * session_cache_;
+
+          data_handler() : lookup_session_cb_(0), handle_data_cb_(0), update_session_cb_(0), session_cache_(0) {}
 
           /* data packet */
           bool get_salt( saltbuf_t & old_salt,    // received in packet header
@@ -149,6 +161,15 @@ namespace csl
           /* update session with the new salts to be used */
           void update_session_cb(update_session_callback & cb)  { handler_.update_session_cb_ = &cb; }
 
+          /* cache the sessions in-process, see session_cache. stop() writes the pending updates */
+          void use_session_cache(session_cache & c)            { handler_.session_cache_ = &c; }
+
+          /* batch the replies into sendmmsg() calls, see recvr::reply_batch() */
+          inline void reply_batch(unsigned int n, unsigned int flush_ms=sendq::default_flush_ms_)
+          {
+            receiver_.reply_batch(n,flush_ms);
+          }
+
           /* debug ? */
           inline void debug(bool yesno) { debug_ = yesno; }
           inline bool debug() const     { return debug_;  }
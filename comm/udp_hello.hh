@@ -128,6 +128,12 @@ namespace csl
             /* hello callback */
             void hello_cb(hello_callback & cb) { handler_.hello_cb_ = &cb; }
 
+            /* batch the replies into sendmmsg() calls, see recvr::reply_batch() */
+            inline void reply_batch(unsigned int n, unsigned int flush_ms=sendq::default_flush_ms_)
+            {
+              receiver_.reply_batch(n,flush_ms);
+            }
+
             /* debug ? */
             inline void debug(bool yesno) { debug_ = yesno; }
             inline bool debug() const     { return debug_;  }
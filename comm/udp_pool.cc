@@ -0,0 +1,179 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**
+   @file udp_pool.cc
+   @brief size-classed packet buffers for the udp receivers
+ */
+
+#include "codesloop/comm/udp_pool.hh"
+#include "codesloop/nthread/adaptive_mutex.hh"
+#include "codesloop/common/metrics.hh"
+#include "codesloop/common/common.h"
+#include <vector>
+
+namespace csl
+{
+  using nthread::adaptive_mutex;
+  using nthread::scoped_adaptive_mutex;
+  using common::metrics;
+
+  namespace comm
+  {
+    namespace udp
+    {
+      namespace
+      {
+        static const unsigned int class_sizes_[bufpool::n_classes_] = { 512, 2048, 8192, 65536 };
+
+        /* free buffers link to each other through their first bytes */
+        struct free_buf
+        {
+          free_buf * next_;
+        };
+      }
+
+      struct bufpool::impl
+      {
+        struct sizeclass
+        {
+          adaptive_mutex                mtx_;
+          free_buf *                    free_;
+          uint64_t                      n_buffers_;
+          uint64_t                      n_free_;
+          std::vector<unsigned char *>  slabs_;
+
+          sizeclass() : free_(0), n_buffers_(0), n_free_(0) {}
+        };
+
+        sizeclass             classes_[n_classes_];
+        metrics::gauge &      bytes_;
+
+        impl() : bytes_(metrics::instance().get_gauge("comm.udp.pool.bytes")) {}
+
+        ~impl()
+        {
+          for( unsigned int c=0;c<n_classes_;++c )
+          {
+            std::vector<unsigned char *> & v(classes_[c].slabs_);
+            for( size_t i=0;i<v.size();++i ) ::free( v[i] );
+          }
+        }
+
+        /* carves a new slab into buffers, the class lock must be held */
+        bool grow(unsigned int cls)
+        {
+          sizeclass & sc(classes_[cls]);
+          size_t bsz  = class_sizes_[cls];
+          size_t ssz  = (bsz > slab_size_ ? bsz : static_cast<size_t>(slab_size_));
+          unsigned char * slab = reinterpret_cast<unsigned char *>(::malloc( ssz ));
+
+          if( !slab ) return false;
+
+          sc.slabs_.push_back( slab );
+          bytes_.add( static_cast<int64_t>(ssz) );
+
+          for( size_t off=0;off+bsz<=ssz;off+=bsz )
+          {
+            free_buf * fb = reinterpret_cast<free_buf *>(slab+off);
+            fb->next_ = sc.free_;
+            sc.free_  = fb;
+            ++sc.n_buffers_;
+            ++sc.n_free_;
+          }
+          return true;
+        }
+      };
+
+      bufpool & bufpool::instance()
+      {
+        // never destructed: msgs released from static destructors still need it
+        static bufpool * pool_ = new bufpool();
+        return *pool_;
+      }
+
+      unsigned int bufpool::class_of(unsigned int sz)
+      {
+        unsigned int c = 0;
+        while( c < n_classes_ && class_sizes_[c] < sz ) ++c;
+        return c;
+      }
+
+      unsigned int bufpool::class_size(unsigned int cls)
+      {
+        return (cls < n_classes_ ? class_sizes_[cls] : 0);
+      }
+
+      unsigned char * bufpool::get(unsigned int cls)
+      {
+        if( cls >= n_classes_ ) return 0;
+
+        impl::sizeclass & sc(impl_->classes_[cls]);
+        scoped_adaptive_mutex m(sc.mtx_);
+
+        if( !sc.free_ && !impl_->grow(cls) ) return 0;
+
+        free_buf * fb = sc.free_;
+        sc.free_ = fb->next_;
+        --sc.n_free_;
+        return reinterpret_cast<unsigned char *>(fb);
+      }
+
+      void bufpool::put(unsigned char * p, unsigned int cls)
+      {
+        if( !p || cls >= n_classes_ ) return;
+
+        impl::sizeclass & sc(impl_->classes_[cls]);
+        scoped_adaptive_mutex m(sc.mtx_);
+
+        free_buf * fb = reinterpret_cast<free_buf *>(p);
+        fb->next_ = sc.free_;
+        sc.free_  = fb;
+        ++sc.n_free_;
+      }
+
+      uint64_t bufpool::n_buffers(unsigned int cls) const
+      {
+        if( cls >= n_classes_ ) return 0;
+        impl::sizeclass & sc(impl_->classes_[cls]);
+        scoped_adaptive_mutex m(sc.mtx_);
+        return sc.n_buffers_;
+      }
+
+      uint64_t bufpool::n_free(unsigned int cls) const
+      {
+        if( cls >= n_classes_ ) return 0;
+        impl::sizeclass & sc(impl_->classes_[cls]);
+        scoped_adaptive_mutex m(sc.mtx_);
+        return sc.n_free_;
+      }
+
+      bufpool::bufpool() : impl_(new impl()) { }
+
+      bufpool::~bufpool() { }
+    }
+  }
+}
+
+/* EOF */
@@ -0,0 +1,107 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef _csl_comm_udp_pool_hh_included_
+#define _csl_comm_udp_pool_hh_included_
+
+/**
+   @file udp_pool.hh
+   @brief size-classed packet buffers for the udp receivers
+ */
+
+#include "codesloop/common/common.h"
+#include "codesloop/common/obj.hh"
+#ifdef __cplusplus
+#include <memory>
+
+namespace csl
+{
+  namespace comm
+  {
+    namespace udp
+    {
+      /**
+      @brief process wide slab of size-classed packet buffers
+
+      buffers are carved from slab_size_ sized malloc()-ed blocks and kept on per class
+      free lists. they are never given back to the system, so get() and put() are a
+      free list pop and push under a per class lock.
+
+      the classes are 512, 2048, 8192 and 65536 bytes. udp::msg holds one buffer and
+      gives it back when released.
+      */
+      class bufpool
+      {
+        public:
+          enum {
+            n_classes_  = 4,
+            min_size_   = 512,
+            max_size_   = 65536,
+            slab_size_  = 65536
+          };
+
+          /** @brief the process wide pool */
+          static bufpool & instance();
+
+          /** @brief the smallest class that holds sz bytes, n_classes_ if sz is too big */
+          static unsigned int class_of(unsigned int sz);
+
+          /** @brief the buffer size of the given class */
+          static unsigned int class_size(unsigned int cls);
+
+          /**
+          @brief returns a buffer of the given class
+          @return 0 if cls is invalid or out of memory
+          */
+          unsigned char * get(unsigned int cls);
+
+          /** @brief gives back a buffer returned by get() */
+          void put(unsigned char * p, unsigned int cls);
+
+          uint64_t n_buffers(unsigned int cls) const; ///<number of buffers carved in the class
+          uint64_t n_free(unsigned int cls) const;    ///<number of buffers on the free list
+
+          bufpool();
+          ~bufpool();
+
+          struct impl;
+
+        private:
+          std::auto_ptr<impl> impl_;
+
+          // no-copy
+          bufpool(const bufpool & other);
+          bufpool & operator=(const bufpool & other);
+
+          CSL_OBJ(csl::comm::udp,bufpool);
+      };
+
+    } /* end of udp namespace */
+  } /* end of comm namespace */
+} /* end of csl namespace */
+
+#endif /* __cplusplus */
+#endif /* _csl_comm_udp_pool_hh_included_ */
+
+/* EOF */
@@ -28,6 +28,14 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "codesloop/nthread/mutex.hh"
 #include "codesloop/common/common.h"
 
+#if defined(__linux__) && defined(MSG_WAITFORONE)
+#define CSL_HAVE_RECVMMSG 1
+#endif
+
+#ifndef WIN32
+#include <sys/uio.h>
+#endif /*WIN32*/
+
 namespace csl
 {
   using namespace nthread;
@@ -36,6 +44,34 @@ namespace csl
   {
     namespace udp
     {
+      namespace
+      {
+        /* gives the msg a slot sized buffer, a bigger one left over from a large packet is released */
+        static inline bool prepare_slot(msg & m, unsigned int slot_size)
+        {
+          m.size_ = 0;
+          if( m.data_ && m.max_len() != bufpool::class_size(bufpool::class_of(slot_size)) ) m.release();
+          return m.alloc(slot_size);
+        }
+
+        /* moves a packet that did not fit into the slot into a buffer of its own size class */
+        static inline bool unspill(msg & m, unsigned int recvd, const unsigned char * spill)
+        {
+          unsigned int head = m.max_len();
+          if( recvd <= head ) { m.size_ = recvd; return true; }
+
+          unsigned int cls = bufpool::class_of(recvd);
+          unsigned char * p = bufpool::instance().get(cls);
+          if( !p ) { m.size_ = 0; return false; }
+
+          memcpy( p, m.data_, head );
+          memcpy( p+head, spill, recvd-head );
+          m.adopt( p, bufpool::class_size(cls) );
+          m.size_ = recvd;
+          return true;
+        }
+      }
+
       bool recvr::start( unsigned int min_threads,
                          unsigned int max_threads,
                          unsigned int timeout_ms,
@@ -44,6 +80,7 @@ namespace csl
                          int tsock )
       {
         /* init thread pool and handlers */
+        msgs_.max_items(depth_);
         cb.set_msgs(msgs_);
 
         if( !thread_pool_.init( min_threads, max_threads,
@@ -75,7 +112,7 @@ namespace csl
           this->addr( addrv );
           socket_ = sock;
 
-          return true;
+          return setup_replies(cb);
         }
         else
         {
@@ -104,30 +141,93 @@ namespace csl
           socket_ = sock;
         }
 
+        return setup_replies(cb);
+      }
+
+      bool recvr::setup_replies(msg_handler & cb)
+      {
+        cb.socket( socket_ );
+
+        if( reply_batch_ <= 1 )
+        {
+          cb.reply_queue(0);
+          return true;
+        }
+
+        if( replies_.start( socket_, reply_batch_, reply_flush_ms_ ) == false )
+        {
+          THR(exc::rs_thread_start,false);
+        }
+
+        cb.reply_queue( &replies_ );
+        return true;
+      }
+
+      bool recvr::msg_handler::send_reply(msg & m)
+      {
+        if( replies_ ) return replies_->send(m);
+
+        if( ::sendto( socket_, reinterpret_cast<const char *>(m.data_), m.size_, 0,
+              reinterpret_cast<const struct sockaddr *>(&(m.sender_)),
+              sizeof(m.sender_) ) != static_cast<int>(m.size_) )
+        {
+          FPRINTF(stderr,L"[%ls:%d] Error in sendto(%d)\n",L""__FILE__,__LINE__,socket_);
+          perror("sendto");
+          return false;
+        }
         return true;
       }
 
       void recvr::operator()(void)
       {
-        unsigned long timeout_ms    = thread_pool_.timeout();
-        unsigned long timeout_sec   = timeout_ms/1000;
-        unsigned long timeout_usec  = (timeout_ms%1000)*1000;
+        int timeout_ms = static_cast<int>(thread_pool_.timeout());
+        bool drain     = false;
+        bool batched   = false;
+
+        /* packets bigger than a slot land in the spill buffer */
+        unsigned int     spill_cls = bufpool::class_of(msg::max_len_v);
+        unsigned char *  spill     = bufpool::instance().get(spill_cls);
+        unsigned int     spill_len = msg::max_len_v;
+
+        if( !spill ) { THRNORET(exc::rs_internal_state); return; }
+
+#ifdef CSL_HAVE_RECVMMSG
+        if( batch_ > 1 )
+        {
+          batch_loop( timeout_ms );
+          batched = true;
+        }
+#endif /*CSL_HAVE_RECVMMSG*/
 
         /* packet loop */
-        while( stop_me() == false )
+        while( batched == false && stop_me() == false )
         {
-          /* wait for incoming packets */
-          fd_set fds;
-          FD_ZERO( &fds );
-          FD_SET( socket_, &fds );
-          struct timeval tv = { timeout_sec, timeout_usec };
-
-          /* wait for new packet to arrive */
-          int err = ::select( socket_+1,&fds,NULL,NULL,&tv );
           int recvd = 0;
+          int flags = 0;
 
-          if( err < 0 )       { THRNORET(exc::rs_select_failed); break; }
-          else if( err == 0 ) { continue; }
+          if( drain )
+          {
+#ifdef MSG_DONTWAIT
+            /* the previous packet arrived, try the next one without polling */
+            flags = MSG_DONTWAIT;
+#else
+            drain = false;
+#endif /*MSG_DONTWAIT*/
+          }
+
+          if( !drain )
+          {
+            /* wait for new packet to arrive */
+            struct pollfd pfd;
+            pfd.fd      = socket_;
+            pfd.events  = POLLIN;
+            pfd.revents = 0;
+
+            int err = PollSocket( &pfd, 1, timeout_ms );
+
+            if( err < 0 )       { THRNORET(exc::rs_poll_failed); break; }
+            else if( err == 0 ) { continue; }
+          }
 
           /* temporary lock messages for getting an entry from it */
           msg * tm = 0;
@@ -137,13 +237,54 @@ namespace csl
           }
           msg & m(*tm);
 
-          socklen_t len = sizeof(m.sender_);
+          if( prepare_slot( m, slot_size_ ) == false )
+          {
+            {
+              scoped_mutex mm(msgs_.mtx_);
+              msgs_.rollback( m );
+            }
+            THRNORET(exc::rs_internal_state);
+            break;
+          }
+
+          /* receive packet: the slot first, the rest into the spill buffer */
+#ifndef WIN32
+          struct iovec  iov[2];
+          struct msghdr mh;
+
+          iov[0].iov_base = m.data_;
+          iov[0].iov_len  = m.max_len();
+          iov[1].iov_base = spill;
+          iov[1].iov_len  = spill_len;
+
+          ::memset( &mh,0,sizeof(mh) );
+          mh.msg_name    = &(m.sender_);
+          mh.msg_namelen = sizeof(m.sender_);
+          mh.msg_iov     = iov;
+          mh.msg_iovlen  = 2;
 
-          /* receive packet */
-          recvd = ::recvfrom( socket_, reinterpret_cast<char *>(m.data_), m.max_len(), 0,
+          recvd = static_cast<int>(::recvmsg( socket_, &mh, flags ));
+#else
+          socklen_t len = sizeof(m.sender_);
+          if( m.alloc( msg::max_len_v ) == false ) { THRNORET(exc::rs_internal_state); break; }
+          recvd = ::recvfrom( socket_, reinterpret_cast<char *>(m.data_), m.max_len(), flags,
             reinterpret_cast<struct sockaddr *>(&(m.sender_)), &len );
+#endif /*WIN32*/
+
+          if( recvd > 0 && unspill( m, static_cast<unsigned int>(recvd), spill ) == false ) { recvd = 0; }
 
-          if( recvd < 0 ) { THRNORET(exc::rs_recv_failed); break; }
+          if( recvd < 0 && drain && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) )
+          {
+            /* drained the socket, go back to poll() */
+            m.size_ = 0;
+            {
+              scoped_mutex mm(msgs_.mtx_);
+              msgs_.rollback( m );
+            }
+            drain = false;
+            continue;
+          }
+          else if( recvd < 0 ) { THRNORET(exc::rs_recv_failed); break; }
           else if( recvd == 0 )
           {
             m.size_ = 0;
@@ -156,7 +297,7 @@ namespace csl
           }
           else
           {
-            m.size_    = recvd;
+            drain      = true;
             /* temporary lock messages for committing new message */
             {
               scoped_mutex mm(msgs_.mtx_);
@@ -169,23 +310,135 @@ namespace csl
           }
         }
 
+        bufpool::instance().put( spill, spill_cls );
+
         if( thread_pool_.graceful_stop() == false )
         {
           thread_pool_.unpolite_stop();
         }
       }
 
+#ifdef CSL_HAVE_RECVMMSG
+      void recvr::batch_loop(int timeout_ms)
+      {
+        struct mmsghdr   hdrs[max_batch_];
+        struct iovec     iovs[max_batch_*2];
+        msg *            slots[max_batch_];
+        unsigned char *  spills[max_batch_];
+        unsigned int     spill_cls = bufpool::class_of(msg::max_len_v);
+        unsigned int     n         = batch_;
+        bool             drain     = false;
+
+        for( unsigned int i=0;i<n;++i )
+        {
+          if( (spills[i] = bufpool::instance().get(spill_cls)) == 0 )
+          {
+            while( i > 0 ) bufpool::instance().put( spills[--i], spill_cls );
+            THRNORET(exc::rs_internal_state);
+            return;
+          }
+        }
+
+        while( stop_me() == false )
+        {
+          if( !drain )
+          {
+            /* wait for new packets to arrive */
+            struct pollfd pfd;
+            pfd.fd      = socket_;
+            pfd.events  = POLLIN;
+            pfd.revents = 0;
+
+            int err = PollSocket( &pfd, 1, timeout_ms );
+
+            if( err < 0 )       { THRNORET(exc::rs_poll_failed); break; }
+            else if( err == 0 ) { continue; }
+          }
+
+          /* reserve a slot for every datagram that may arrive */
+          {
+            /* reserve() does not push out queued messages for slots that may stay empty */
+            scoped_mutex mm(msgs_.mtx_);
+            for( unsigned int i=0;i<n;++i ) slots[i] = &(msgs_.reserve());
+          }
+
+          bool prepared = true;
+
+          for( unsigned int i=0;i<n;++i )
+          {
+            if( prepare_slot( *(slots[i]), slot_size_ ) == false ) { prepared = false; break; }
+
+            iovs[2*i].iov_base             = slots[i]->data_;
+            iovs[2*i].iov_len              = slots[i]->max_len();
+            iovs[2*i+1].iov_base           = spills[i];
+            iovs[2*i+1].iov_len            = msg::max_len_v;
+            hdrs[i].msg_hdr.msg_name       = &(slots[i]->sender_);
+            hdrs[i].msg_hdr.msg_namelen    = sizeof(slots[i]->sender_);
+            hdrs[i].msg_hdr.msg_iov        = &(iovs[2*i]);
+            hdrs[i].msg_hdr.msg_iovlen     = 2;
+            hdrs[i].msg_hdr.msg_control    = 0;
+            hdrs[i].msg_hdr.msg_controllen = 0;
+            hdrs[i].msg_hdr.msg_flags      = 0;
+            hdrs[i].msg_len                = 0;
+          }
+
+          int recvd = -1;
+          int err   = ENOMEM;
+
+          if( prepared )
+          {
+            recvd = ::recvmmsg( socket_, hdrs, n, MSG_DONTWAIT, NULL );
+            err   = errno;
+          }
+
+          /* commit the received ones, release the rest, wake the handlers once */
+          {
+            scoped_mutex mm(msgs_.mtx_);
+            msgs_.begin_batch();
+            for( unsigned int i=0;i<n;++i )
+            {
+              if( recvd > 0 && i < static_cast<unsigned int>(recvd) && hdrs[i].msg_len > 0 &&
+                  unspill( *(slots[i]), hdrs[i].msg_len, spills[i] ) )
+              {
+                msgs_.commit( *(slots[i]) );
+              }
+              else
+              {
+                slots[i]->size_ = 0;
+                msgs_.rollback( *(slots[i]) );
+              }
+            }
+            msgs_.end_batch();
+          }
+
+          if( recvd < 0 )
+          {
+            if( err == EAGAIN || err == EWOULDBLOCK || err == EINTR ) { drain = false; continue; }
+            if( err == ENOMEM ) { THRNORET(exc::rs_internal_state); }
+            else                { THRNORET(exc::rs_recv_failed);    }
+            break;
+          }
+
+          /* a full batch means more may be waiting */
+          drain = (static_cast<unsigned int>(recvd) == n);
+        }
+
+        for( unsigned int i=0;i<n;++i ) bufpool::instance().put( spills[i], spill_cls );
+      }
+#endif /*CSL_HAVE_RECVMMSG*/
+
       bool recvr::stop()
       {
         stop_me(true);
+        bool ret = true;
         if( thread_pool_.graceful_stop() == false )
         {
-          return thread_pool_.unpolite_stop();
-        }
-        else
-        {
-          return true;
+          ret = thread_pool_.unpolite_stop();
         }
+
+        /* the handlers are gone, send what they left in the reply queue */
+        if( replies_.stop() == false ) ret = false;
+        return ret;
       }
 
       recvr::~recvr()
@@ -194,7 +447,9 @@ namespace csl
         socket_ = -1;
       }
 
-      recvr::recvr() : socket_(-1), stop_me_(false), debug_(false)
+      recvr::recvr() : socket_(-1), stop_me_(false), debug_(false), batch_(1),
+                       depth_(default_depth_), slot_size_(default_slot_size_),
+                       reply_batch_(1), reply_flush_ms_(sendq::default_flush_ms_)
       {
       }
 
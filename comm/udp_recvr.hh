@@ -27,12 +27,15 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define _csl_comm_udp_recvr_hh_included_
 
 #include "codesloop/comm/sai.hh"
+#include "codesloop/comm/udp_pool.hh"
+#include "codesloop/comm/udp_sendq.hh"
 #include "codesloop/nthread/thread.hh"
 #include "codesloop/nthread/event.hh"
 #include "codesloop/nthread/mutex.hh"
 #include "codesloop/nthread/thrpool.hh"
 #include "codesloop/common/common.h"
 #include "codesloop/common/obj.hh"
+#include "codesloop/common/metrics.hh"
 #include "codesloop/sec/ecdh_key.hh"
 #ifdef __cplusplus
 
@@ -50,9 +53,19 @@ namespace csl
   {
     namespace udp
     {
+      /**
+      @brief udp packet, an owning handle of a bufpool buffer
+
+      the buffer is taken from bufpool by alloc() and given back by release() or the
+      destructor. the receiver fills the queued messages in place and the handlers take()
+      the buffer over, so the payload is never copied between the socket and the handler.
+
+      max_len() is the capacity of the current buffer (0 if there is none). call alloc()
+      before writing a new message.
+      */
       struct msg
       {
-        enum { max_len_v = 65536 };
+        enum { max_len_v = bufpool::max_size_ };
 
         enum {
           hello_p = 1,
@@ -66,37 +79,136 @@ namespace csl
           salt_p
         };
 
-        unsigned char  data_[max_len_v];
-        unsigned int   size_;
-        SAI            sender_;
+        unsigned char *  data_;
+        unsigned int     size_;
+        SAI              sender_;
+
+        inline msg() : data_(0), size_(0), cap_(0)
+        {
+          memset( &sender_,0,sizeof(sender_) );
+        }
+
+        inline ~msg() { release(); }
 
         inline unsigned int max_len() const
         {
-          return max_len_v;
+          return cap_;
+        }
+
+        /** @brief makes sure the buffer holds sz bytes, the content is not kept if it is replaced */
+        inline bool alloc(unsigned int sz=max_len_v)
+        {
+          if( data_ && cap_ >= sz ) return true;
+          unsigned int cls = bufpool::class_of(sz);
+          unsigned char * p = bufpool::instance().get(cls);
+          if( !p ) return false;
+          release();
+          data_ = p;
+          cap_  = bufpool::class_size(cls);
+          return true;
+        }
+
+        /** @brief gives the buffer back to the pool */
+        inline void release()
+        {
+          if( data_ ) bufpool::instance().put( data_, bufpool::class_of(cap_) );
+          data_ = 0;
+          size_ = 0;
+          cap_  = 0;
+        }
+
+        /** @brief takes over the buffer, size and sender of other, other becomes empty */
+        inline void take(msg & other)
+        {
+          if( &other == this ) return;
+          release();
+          data_  = other.data_;
+          size_  = other.size_;
+          cap_   = other.cap_;
+          memcpy( &sender_,&(other.sender_),sizeof(sender_) );
+          other.data_ = 0;
+          other.size_ = 0;
+          other.cap_  = 0;
+        }
+
+        /** @brief adopts a bufpool buffer of the given capacity */
+        inline void adopt(unsigned char * p, unsigned int cap)
+        {
+          release();
+          data_ = p;
+          cap_  = cap;
         }
 
         inline void copy_to(msg & other)
         {
-          if( size_ )
+          if( size_ && other.alloc(size_) )
           {
             memcpy( other.data_, data_, size_ );
             other.size_ = size_;
           }
           memcpy( &(other.sender_),&sender_,sizeof(sender_) );
         }
+
+      private:
+        unsigned int     cap_;
+
+        // no-copy: the buffer has one owner
+        msg(const msg & other);
+        msg & operator=(const msg & other);
       };
 
       class recvr : public thread::callback, public csl::common::obj
       {
         public:
-          class msgs : public common::circbuf<msg,30>
+          enum {
+            default_depth_      = 1024,  ///<default number of queued packets
+            default_slot_size_  = 2048   ///<default receive slot size
+          };
+
+          class msgs : public common::circbuf<msg,default_depth_>
           {
             public:
-              virtual void on_new_item() { ev_.notify(); }
+              msgs() : received_(common::metrics::instance().get_counter("comm.udp.recvr.received")),
+                       dropped_(common::metrics::instance().get_counter("comm.udp.recvr.dropped")),
+                       batches_(common::metrics::instance().get_counter("comm.udp.recvr.batches")),
+                       batched_(0), in_batch_(false) { }
+
+              virtual void on_new_item()
+              {
+                if( in_batch_ ) { ++batched_; }
+                else            { received_.inc(); ev_.notify(); }
+              }
+              virtual void on_full()     { dropped_.inc(); }
               virtual ~msgs() { }
 
+              /* commits between begin_batch() and end_batch() wake the handlers only once.
+                 both must be called with mtx_ held */
+              inline void begin_batch() { in_batch_ = true; batched_ = 0; }
+              inline void end_batch()
+              {
+                in_batch_ = false;
+                if( batched_ )
+                {
+                  received_.add( batched_ );
+                  batches_.inc();
+                  ev_.notify( batched_ );
+                  batched_ = 0;
+                }
+              }
+
               mutex   mtx_;
               event   ev_;
+
+              /* number of packets committed and dropped because the buffer was full */
+              common::metrics::counter &  received_;
+              common::metrics::counter &  dropped_;
+
+              /* number of non-empty recvmmsg() batches */
+              common::metrics::counter &  batches_;
+
+            private:
+              unsigned int  batched_;
+              bool          in_batch_;
           };
 
           class msg_handler : public thread::callback, public csl::common::obj
@@ -105,7 +217,7 @@ namespace csl
               /* this must lock/unlock msgs_.mtx_ */
               virtual void operator()(void) = 0;
 
-              inline msg_handler() : msgs_(0), debug_(false), socket_(-1) {}
+              inline msg_handler() : msgs_(0), debug_(false), socket_(-1), replies_(0) {}
 
               /* NOTE: all the setter functions are supposed to be called once during
                  initialization. for this reason they are not protected by the mutex. if
@@ -120,6 +232,10 @@ namespace csl
               inline int socket() const    { return socket_; }
               inline void socket(int sock) { socket_ = sock; }
 
+              /* reply queue, the replies are sent directly on socket() if not set */
+              inline sendq * reply_queue() const    { return replies_; }
+              inline void reply_queue(sendq * q)    { replies_ = q; }
+
               /* debug ? */
               inline bool debug() const      { return debug_;  }
               inline void debug(bool yesno)  { debug_ = yesno; }
@@ -133,10 +249,15 @@ namespace csl
               inline void public_key(const ecdh_key & v) { public_key_ = v; }
 
             protected:
+              /* sends m to m.sender_ through the reply queue or with sendto(). the
+                 buffer of m is given to the queue, so m may be empty afterwards */
+              bool send_reply(msg & m);
+
               mutex     mtx_;
               msgs *    msgs_;
               bool      debug_;
               int       socket_;
+              sendq *   replies_;
               bignum    private_key_;
               ecdh_key  public_key_;
 
@@ -150,9 +271,22 @@ namespace csl
           int           socket_;
           bool          stop_me_;
           bool          debug_;
+          unsigned int  batch_;
+          unsigned int  depth_;
+          unsigned int  slot_size_;
+          unsigned int  reply_batch_;
+          unsigned int  reply_flush_ms_;
+          sendq         replies_;
           mutex         mtx_;
 
+          /* receive loop with recvmmsg() */
+          void batch_loop(int timeout_ms);
+
+          /* gives the socket and, if reply_batch() is set, the started reply queue to the handler */
+          bool setup_replies(msg_handler & cb);
+
         public:
+          enum { max_batch_ = 64 };
           inline int socket() { return socket_; }
 
           bool start( unsigned int min_threads,
@@ -178,6 +312,44 @@ namespace csl
           inline void debug(bool yesno) { debug_ = yesno; }
           inline bool debug() const     { return debug_;  }
 
+          /* number of datagrams received by one recvmmsg() call. 1 means one recvfrom() per
+             datagram, which is the default and the only mode where recvmmsg() is missing.
+             must be called before start() */
+          inline void batch(unsigned int n)
+          {
+            batch_ = (n == 0 ? 1 : (n > max_batch_ ? static_cast<unsigned int>(max_batch_) : n));
+          }
+          inline unsigned int batch() const { return batch_; }
+
+          /* maximum number of packets waiting for the handlers. when full the oldest is
+             dropped. must be called before start() */
+          inline void queue_depth(unsigned int n) { depth_ = (n == 0 ? 1 : n); }
+          inline unsigned int queue_depth() const { return depth_; }
+
+          /* the bufpool buffer size a packet is received into. bigger packets are moved to a
+             buffer of their own size class, which costs a copy. the slot is rounded up to a
+             bufpool size class. must be called before start() */
+          inline void slot_size(unsigned int sz)
+          {
+            unsigned int cls = bufpool::class_of(sz);
+            slot_size_ = bufpool::class_size( cls < bufpool::n_classes_ ? cls : bufpool::n_classes_-1 );
+          }
+          inline unsigned int slot_size() const { return slot_size_; }
+
+          /* number of handler replies sent by one sendmmsg() call and the longest time a
+             reply may wait for its batch. 1 means the handlers call sendto() themselves,
+             which is the default. must be called before start() */
+          inline void reply_batch(unsigned int n, unsigned int flush_ms=sendq::default_flush_ms_)
+          {
+            reply_batch_    = (n == 0 ? 1 : (n > sendq::max_batch_ ? static_cast<unsigned int>(sendq::max_batch_) : n));
+            reply_flush_ms_ = flush_ms;
+          }
+          inline unsigned int reply_batch() const    { return reply_batch_; }
+          inline unsigned int reply_flush_ms() const { return reply_flush_ms_; }
+
+          /* pins the handler threads, see thrpool::set_placement(). must be called before start() */
+          inline void set_placement(thrpool::placement_t p, int cpu=-1) { thread_pool_.set_placement(p,cpu); }
+
           CSL_OBJ(csl::comm::udp,recvr);
       };
 
@@ -0,0 +1,286 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+   @file udp_sendq.cc
+   @brief batches the udp replies of the handler threads into sendmmsg() calls
+ */
+
+#include "codesloop/comm/udp_sendq.hh"
+#include "codesloop/comm/udp_recvr.hh"
+#include "codesloop/nthread/thread.hh"
+#include "codesloop/nthread/event.hh"
+#include "codesloop/nthread/mutex.hh"
+#include "codesloop/common/metrics.hh"
+#include "codesloop/common/common.h"
+
+#if defined(__linux__) && defined(MSG_WAITFORONE)
+#define CSL_HAVE_SENDMMSG 1
+#endif
+
+namespace csl
+{
+  using namespace nthread;
+  using common::metrics;
+
+  namespace comm
+  {
+    namespace udp
+    {
+      struct sendq::impl : public thread::callback
+      {
+        /* pending_ is protected by mtx_, out_ and the socket writes by flush_mtx_ */
+        msg            pending_[max_batch_];
+        unsigned int   n_pending_;
+        msg            out_[max_batch_];
+        mutex          mtx_;
+        mutex          flush_mtx_;
+        event          ev_;
+        thread         thread_;
+        int            sock_;
+        unsigned int   batch_;
+        unsigned int   flush_ms_;
+        bool           running_;
+        bool           stop_me_;
+
+        metrics::counter &  sent_;
+        metrics::counter &  calls_;
+        metrics::counter &  errors_;
+
+        impl() : n_pending_(0), sock_(-1), batch_(1), flush_ms_(default_flush_ms_),
+                 running_(false), stop_me_(false),
+                 sent_(metrics::instance().get_counter("comm.udp.sendq.sent")),
+                 calls_(metrics::instance().get_counter("comm.udp.sendq.calls")),
+                 errors_(metrics::instance().get_counter("comm.udp.sendq.errors")) { }
+
+        virtual ~impl() { }
+
+        /* the flusher thread: woken by the first packet of a batch, sends it after flush_ms_ */
+        virtual void operator()(void)
+        {
+          while( true )
+          {
+            ev_.wait(0);
+            {
+              scoped_mutex m(mtx_);
+              if( stop_me_ ) break;
+            }
+            if( flush_ms_ ) { SleepMiliseconds(flush_ms_); }
+            flush();
+          }
+          flush();
+        }
+
+        /* moves the pending packets to out_ and sends them */
+        bool flush()
+        {
+          scoped_mutex fm(flush_mtx_);
+          unsigned int n = 0;
+          {
+            scoped_mutex m(mtx_);
+            for( n=0;n<n_pending_;++n ) { out_[n].take(pending_[n]); }
+            n_pending_ = 0;
+          }
+          if( n == 0 ) return true;
+
+          unsigned int failed = 0;
+#ifdef CSL_HAVE_SENDMMSG
+          struct mmsghdr  hdrs[max_batch_];
+          struct iovec    iovs[max_batch_];
+
+          for( unsigned int i=0;i<n;++i )
+          {
+            iovs[i].iov_base            = out_[i].data_;
+            iovs[i].iov_len             = out_[i].size_;
+            memset( &(hdrs[i]),0,sizeof(hdrs[i]) );
+            hdrs[i].msg_hdr.msg_name    = &(out_[i].sender_);
+            hdrs[i].msg_hdr.msg_namelen = sizeof(out_[i].sender_);
+            hdrs[i].msg_hdr.msg_iov     = &(iovs[i]);
+            hdrs[i].msg_hdr.msg_iovlen  = 1;
+          }
+
+          unsigned int done = 0;
+          while( done < n )
+          {
+            int ret = ::sendmmsg( sock_, hdrs+done, n-done, 0 );
+            calls_.inc();
+            if( ret > 0 )
+            {
+              done += static_cast<unsigned int>(ret);
+            }
+            else if( ret < 0 && errno == EINTR )
+            {
+              continue;
+            }
+            else
+            {
+              /* the first packet failed, skip it and go on with the rest */
+              ++failed;
+              ++done;
+            }
+          }
+#else
+          for( unsigned int i=0;i<n;++i )
+          {
+            calls_.inc();
+            if( ::sendto( sock_, reinterpret_cast<const char *>(out_[i].data_), out_[i].size_, 0,
+                  reinterpret_cast<const struct sockaddr *>(&(out_[i].sender_)),
+                  sizeof(out_[i].sender_) ) != static_cast<int>(out_[i].size_) )
+            {
+              ++failed;
+            }
+          }
+#endif /*CSL_HAVE_SENDMMSG*/
+
+          for( unsigned int i=0;i<n;++i ) { out_[i].release(); }
+
+          sent_.add( n-failed );
+          if( failed ) errors_.add( failed );
+          return (failed == 0);
+        }
+      };
+
+      bool sendq::start(int sock, unsigned int batch, unsigned int flush_ms)
+      {
+        {
+          scoped_mutex m(impl_->mtx_);
+          if( impl_->running_ || sock < 0 ) { return false; }
+          impl_->sock_      = sock;
+          impl_->batch_     = (batch == 0 ? 1 : (batch > max_batch_ ? static_cast<unsigned int>(max_batch_) : batch));
+          impl_->flush_ms_  = flush_ms;
+          impl_->stop_me_   = false;
+        }
+
+        impl_->thread_.set_entry( *impl_ );
+        if( impl_->thread_.start() == false ) { return false; }
+
+        {
+          scoped_mutex m(impl_->mtx_);
+          impl_->running_ = true;
+        }
+        return true;
+      }
+
+      bool sendq::stop()
+      {
+        {
+          scoped_mutex m(impl_->mtx_);
+          if( !impl_->running_ ) { return true; }
+          impl_->running_ = false;
+          impl_->stop_me_ = true;
+        }
+        impl_->ev_.notify();
+
+        bool ret = impl_->thread_.exit_event().wait(1000);
+        /* the flusher sends what was left, this is in case it did not exit */
+        if( !impl_->flush() ) ret = false;
+        return ret;
+      }
+
+      bool sendq::send(msg & m)
+      {
+        if( !m.data_ ) return false;
+
+        bool queued = false;
+        while( !queued )
+        {
+          bool first = false;
+          bool full  = false;
+          {
+            scoped_mutex mt(impl_->mtx_);
+            if( !impl_->running_ ) { m.release(); return false; }
+
+            if( impl_->n_pending_ < impl_->batch_ )
+            {
+              impl_->pending_[impl_->n_pending_].take(m);
+              ++(impl_->n_pending_);
+              queued = true;
+              first  = (impl_->n_pending_ == 1);
+              full   = (impl_->n_pending_ == impl_->batch_);
+            }
+            else
+            {
+              /* the thread that filled the batch has not flushed it yet */
+              full = true;
+            }
+          }
+
+          if( full )       { impl_->flush(); }
+          else if( first ) { impl_->ev_.notify(); }
+        }
+        return true;
+      }
+
+      bool sendq::send(const void * data, unsigned int sz, const SAI & to)
+      {
+        msg m;
+        if( !data || sz == 0 || m.alloc(sz) == false ) return false;
+        memcpy( m.data_, data, sz );
+        m.size_ = sz;
+        memcpy( &(m.sender_), &to, sizeof(to) );
+        return send(m);
+      }
+
+      bool sendq::flush()
+      {
+        return impl_->flush();
+      }
+
+      bool sendq::is_running() const
+      {
+        scoped_mutex m(impl_->mtx_);
+        return impl_->running_;
+      }
+
+      int sendq::socket() const
+      {
+        scoped_mutex m(impl_->mtx_);
+        return impl_->sock_;
+      }
+
+      unsigned int sendq::batch() const
+      {
+        scoped_mutex m(impl_->mtx_);
+        return impl_->batch_;
+      }
+
+      unsigned int sendq::flush_ms() const
+      {
+        scoped_mutex m(impl_->mtx_);
+        return impl_->flush_ms_;
+      }
+
+      sendq::sendq() : impl_(new impl()) { }
+
+      sendq::~sendq()
+      {
+        stop();
+      }
+
+    } /* end of udp namespace */
+  } /* end of comm namespace */
+} /* end of csl namespace */
+
+/* EOF */
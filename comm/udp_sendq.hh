@@ -0,0 +1,129 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _csl_comm_udp_sendq_hh_included_
+#define _csl_comm_udp_sendq_hh_included_
+
+/**
+   @file udp_sendq.hh
+   @brief batches the udp replies of the handler threads into sendmmsg() calls
+ */
+
+#include "codesloop/comm/sai.hh"
+#include "codesloop/common/common.h"
+#include "codesloop/common/obj.hh"
+#ifdef __cplusplus
+#include <memory>
+
+namespace csl
+{
+  namespace comm
+  {
+    namespace udp
+    {
+      struct msg;
+
+      /**
+      @brief per socket outbound queue of udp packets
+
+      the handler threads queue their replies instead of calling sendto() one by one.
+      the queue is flushed with a single sendmmsg() call when batch() packets are
+      pending (by the thread queueing the last one) or when the oldest pending packet
+      waited flush_ms() milliseconds (by the queue's own flusher thread).
+
+      the queued msg buffers are taken over, so the payload is not copied. where
+      sendmmsg() is missing the packets are sent with one sendto() each, still in
+      batches.
+
+      @code
+      sendq q;
+      q.start( sock, 32, 1 );
+      q.send( m );  // m.sender_ is the destination, m becomes empty
+      q.stop();     // flushes the pending packets
+      @endcode
+      */
+      class sendq : public csl::common::obj
+      {
+        public:
+          enum {
+            max_batch_         = 64,  ///<maximum number of packets sent by one call
+            default_flush_ms_  = 1    ///<default deadline of the pending packets
+          };
+
+          /**
+          @brief starts the flusher thread
+          @param sock is the udp socket, not owned by the queue
+          @param batch is the number of packets flushed together (1..max_batch_)
+          @param flush_ms is the deadline of the pending packets
+          @return false if the flusher thread could not be started
+          */
+          bool start(int sock, unsigned int batch, unsigned int flush_ms=default_flush_ms_);
+
+          /** @brief sends the pending packets and stops the flusher thread */
+          bool stop();
+
+          /**
+          @brief queues a packet to m.sender_
+          @return false if the queue is not running or m is empty
+
+          the buffer of m is taken over, m is empty after the call. send errors are
+          counted by the comm.udp.sendq.errors metric
+          */
+          bool send(msg & m);
+
+          /** @brief queues a copy of the given data */
+          bool send(const void * data, unsigned int sz, const SAI & to);
+
+          /** @brief sends the pending packets now */
+          bool flush();
+
+          bool is_running() const;
+          int socket() const;
+          unsigned int batch() const;
+          unsigned int flush_ms() const;
+
+          sendq();
+          virtual ~sendq();
+
+          struct impl;
+
+        private:
+          std::auto_ptr<impl> impl_;
+
+          // no-copy
+          sendq(const sendq & other);
+          sendq & operator=(const sendq & other);
+
+          CSL_OBJ(csl::comm::udp,sendq);
+      };
+
+    } /* end of udp namespace */
+  } /* end of comm namespace */
+} /* end of csl namespace */
+
+#endif /* __cplusplus */
+#endif /* _csl_comm_udp_sendq_hh_included_ */
+
+/* EOF */
@@ -0,0 +1,521 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+   @file udp_session.cc
+   @brief in-process session table of the udp data handlers
+ */
+
+#include "codesloop/comm/udp_session.hh"
+#include "codesloop/comm/udp_data.hh"
+#include "codesloop/nthread/mutex.hh"
+#include "codesloop/common/metrics.hh"
+#include "codesloop/common/common.h"
+#include <vector>
+
+namespace csl
+{
+  using nthread::mutex;
+  using nthread::scoped_mutex;
+  using common::metrics;
+
+  namespace comm
+  {
+    namespace udp
+    {
+      namespace
+      {
+        static inline uint64_t mix(uint64_t k)
+        {
+          k ^= k >> 33;
+          k *= 0xff51afd7ed558ccdULL;
+          k ^= k >> 33;
+          return k;
+        }
+
+        static inline uint64_t salt_key(const saltbuf_t & s)
+        {
+          uint64_t k = 0;
+          memcpy( &k, s.data(), (s.size() < sizeof(k) ? s.size() : sizeof(k)) );
+          return mix(k);
+        }
+
+        static inline uint64_t addr_key(const SAI & a)
+        {
+          return mix( (static_cast<uint64_t>(a.sin_addr.s_addr) << 16) | a.sin_port );
+        }
+
+        static inline bool same_addr(const SAI & a, const SAI & b)
+        {
+          return (a.sin_addr.s_addr == b.sin_addr.s_addr && a.sin_port == b.sin_port);
+        }
+
+        /* the keys are binary, ustr::operator==() would stop at a zero byte */
+        static inline bool same_key(const ustr & a, const ustr & b)
+        {
+          return (a.nbytes() == b.nbytes() &&
+                  ::memcmp( a.data(), b.data(), static_cast<size_t>(a.nbytes()) ) == 0);
+        }
+      }
+
+      struct session_cache::impl
+      {
+        struct entry
+        {
+          saltbuf_t  salt_;     ///<the current salt
+          saltbuf_t  written_;  ///<the salt update_session_callback knows
+          SAI        addr_;
+          ustr       key_;
+          uint64_t   used_;
+          bool       dirty_;
+
+          /* hash chains and the LRU list, the free list reuses next_ */
+          entry *    salt_next_;
+          entry *    addr_next_;
+          entry *    prev_;
+          entry *    next_;
+        };
+
+        struct write
+        {
+          saltbuf_t  old_;
+          saltbuf_t  new_;
+          SAI        addr_;
+          ustr       key_;
+        };
+
+        typedef std::vector<entry *>  entries_t;
+        typedef std::vector<write>    writes_t;
+
+        mutable mutex  mtx_;
+        mutex          flush_mtx_;
+
+        entries_t      salts_;
+        entries_t      addrs_;
+        uint64_t       mask_;
+
+        entry *        head_;   ///<most recently used
+        entry *        tail_;   ///<least recently used
+        entry *        free_;
+
+        /* entries that became dirty since the last flush, may hold stale pointers
+           which are skipped by their dirty_ flag. entries are never deleted before
+           the cache, so the pointers stay valid */
+        entries_t      dirty_;
+        writes_t       evicted_;
+
+        unsigned int   size_;
+        unsigned int   n_dirty_;
+        unsigned int   capacity_;
+        unsigned int   ttl_ms_;
+        unsigned int   write_behind_ms_;
+        uint64_t       last_flush_;
+
+        metrics::counter &  hits_;
+        metrics::counter &  misses_;
+        metrics::counter &  evictions_;
+        metrics::counter &  writes_;
+        metrics::counter &  write_errors_;
+
+        impl() : mask_(0), head_(0), tail_(0), free_(0), size_(0), n_dirty_(0),
+                 capacity_(default_capacity_), ttl_ms_(default_ttl_ms_),
+                 write_behind_ms_(default_write_behind_ms_), last_flush_(metrics::now_usec()),
+                 hits_(metrics::instance().get_counter("comm.udp.session.hits")),
+                 misses_(metrics::instance().get_counter("comm.udp.session.misses")),
+                 evictions_(metrics::instance().get_counter("comm.udp.session.evictions")),
+                 writes_(metrics::instance().get_counter("comm.udp.session.writes")),
+                 write_errors_(metrics::instance().get_counter("comm.udp.session.write_errors")) { }
+
+        ~impl()
+        {
+          entry * e = head_;
+          while( e ) { entry * n = e->next_; delete e; e = n; }
+          e = free_;
+          while( e ) { entry * n = e->next_; delete e; e = n; }
+        }
+
+        /* the tables are sized on first use, so capacity() may be set before */
+        void init_buckets()
+        {
+          if( salts_.empty() == false ) return;
+          uint64_t n = 16;
+          while( n < 2ULL*capacity_ ) n <<= 1;
+          salts_.assign( static_cast<size_t>(n), static_cast<entry *>(0) );
+          addrs_.assign( static_cast<size_t>(n), static_cast<entry *>(0) );
+          mask_ = n-1;
+        }
+
+        inline entry ** salt_slot(const saltbuf_t & s) { return &(salts_[static_cast<size_t>(salt_key(s) & mask_)]); }
+        inline entry ** addr_slot(const SAI & a)       { return &(addrs_[static_cast<size_t>(addr_key(a) & mask_)]); }
+
+        entry * find_salt(const saltbuf_t & s)
+        {
+          if( salts_.empty() ) return 0;
+          for( entry * e = *salt_slot(s);e;e=e->salt_next_ ) { if( e->salt_ == s ) return e; }
+          return 0;
+        }
+
+        entry * find_addr(const SAI & a)
+        {
+          if( addrs_.empty() ) return 0;
+          for( entry * e = *addr_slot(a);e;e=e->addr_next_ ) { if( same_addr(e->addr_,a) ) return e; }
+          return 0;
+        }
+
+        void link_salt(entry * e)
+        {
+          entry ** s = salt_slot(e->salt_);
+          e->salt_next_ = *s;
+          *s = e;
+        }
+
+        void unlink_salt(entry * e)
+        {
+          for( entry ** p = salt_slot(e->salt_);*p;p=&((*p)->salt_next_) )
+          {
+            if( *p == e ) { *p = e->salt_next_; break; }
+          }
+          e->salt_next_ = 0;
+        }
+
+        void link_addr(entry * e)
+        {
+          entry ** s = addr_slot(e->addr_);
+          e->addr_next_ = *s;
+          *s = e;
+        }
+
+        void unlink_addr(entry * e)
+        {
+          for( entry ** p = addr_slot(e->addr_);*p;p=&((*p)->addr_next_) )
+          {
+            if( *p == e ) { *p = e->addr_next_; break; }
+          }
+          e->addr_next_ = 0;
+        }
+
+        void unlink_lru(entry * e)
+        {
+          if( e->prev_ ) e->prev_->next_ = e->next_;
+          else           head_ = e->next_;
+          if( e->next_ ) e->next_->prev_ = e->prev_;
+          else           tail_ = e->prev_;
+          e->prev_ = e->next_ = 0;
+        }
+
+        void push_front(entry * e)
+        {
+          e->prev_ = 0;
+          e->next_ = head_;
+          if( head_ ) head_->prev_ = e;
+          head_ = e;
+          if( !tail_ ) tail_ = e;
+        }
+
+        inline void touch(entry * e, uint64_t now)
+        {
+          e->used_ = now;
+          if( e != head_ ) { unlink_lru(e); push_front(e); }
+        }
+
+        inline void mark_dirty(entry * e)
+        {
+          if( e->dirty_ ) return;
+          e->dirty_ = true;
+          ++n_dirty_;
+          dirty_.push_back(e);
+        }
+
+        /* drops the entry, its pending update is kept for the next flush */
+        void remove(entry * e)
+        {
+          unlink_salt(e);
+          unlink_addr(e);
+          unlink_lru(e);
+
+          if( e->dirty_ )
+          {
+            write w;
+            w.old_  = e->written_;
+            w.new_  = e->salt_;
+            w.addr_ = e->addr_;
+            w.key_  = e->key_;
+            evicted_.push_back(w);
+            e->dirty_ = false;
+            --n_dirty_;
+          }
+
+          e->next_ = free_;
+          free_ = e;
+          --size_;
+        }
+
+        /* called with flush_mtx_ held */
+        unsigned int write_out(const writes_t & w, update_session_callback & cb)
+        {
+          unsigned int ret = 0;
+          for( writes_t::const_iterator it=w.begin();it!=w.end();++it )
+          {
+            if( cb( it->old_, it->new_, it->addr_, it->key_ ) ) { writes_.inc(); }
+            else                                                { write_errors_.inc(); }
+            ++ret;
+          }
+          return ret;
+        }
+
+        inline bool expired(const entry * e, uint64_t now) const
+        {
+          return (ttl_ms_ && now - e->used_ > static_cast<uint64_t>(ttl_ms_)*1000ULL);
+        }
+
+        /* creates the session, the peer's previous session and the holder of the salt are dropped */
+        entry * make(const saltbuf_t & salt, const SAI & addr, const ustr & key, uint64_t now)
+        {
+          init_buckets();
+
+          entry * e = 0;
+          if( (e = find_addr(addr)) != 0 ) remove(e);
+          if( (e = find_salt(salt)) != 0 ) remove(e);
+
+          while( tail_ && expired(tail_,now) ) { remove(tail_); evictions_.inc(); }
+          while( tail_ && size_ >= capacity_ ) { remove(tail_); evictions_.inc(); }
+
+          if( free_ ) { e = free_; free_ = e->next_; }
+          else        { e = new entry(); }
+
+          e->salt_      = salt;
+          e->written_   = salt;
+          e->addr_      = addr;
+          e->key_       = key;
+          e->used_      = now;
+          e->dirty_     = false;
+          e->salt_next_ = 0;
+          e->addr_next_ = 0;
+
+          link_salt(e);
+          link_addr(e);
+          push_front(e);
+          ++size_;
+          return e;
+        }
+      };
+
+      bool session_cache::lookup(const saltbuf_t & salt, const SAI & addr, ustr & sesskey)
+      {
+        scoped_mutex m(impl_->mtx_);
+        uint64_t now = metrics::now_usec();
+        impl::entry * e = impl_->find_salt(salt);
+
+        if( e && impl_->expired(e,now) )
+        {
+          impl_->remove(e);
+          impl_->evictions_.inc();
+          e = 0;
+        }
+
+        if( !e || !same_addr(e->addr_,addr) )
+        {
+          impl_->misses_.inc();
+          return false;
+        }
+
+        impl_->touch(e,now);
+        sesskey = e->key_;
+        impl_->hits_.inc();
+        return true;
+      }
+
+      bool session_cache::find(const SAI & addr, saltbuf_t & salt, ustr & sesskey)
+      {
+        scoped_mutex m(impl_->mtx_);
+        impl::entry * e = impl_->find_addr(addr);
+        if( !e || impl_->expired(e,metrics::now_usec()) ) return false;
+        salt    = e->salt_;
+        sesskey = e->key_;
+        return true;
+      }
+
+      void session_cache::insert(const saltbuf_t & salt, const SAI & addr, const ustr & sesskey)
+      {
+        scoped_mutex m(impl_->mtx_);
+        impl_->make( salt, addr, sesskey, metrics::now_usec() );
+      }
+
+      void session_cache::update(const saltbuf_t & old_salt,
+                                 const saltbuf_t & new_salt,
+                                 const SAI & addr,
+                                 const ustr & sesskey)
+      {
+        scoped_mutex m(impl_->mtx_);
+        uint64_t now = metrics::now_usec();
+        impl::entry * e = impl_->find_salt(old_salt);
+
+        if( e && same_addr(e->addr_,addr) && same_key(e->key_,sesskey) )
+        {
+          impl::entry * other = impl_->find_salt(new_salt);
+          if( other && other != e ) impl_->remove(other);
+
+          impl_->unlink_salt(e);
+          e->salt_ = new_salt;
+          impl_->link_salt(e);
+          impl_->touch(e,now);
+        }
+        else
+        {
+          /* not cached: the callback still knows the old salt */
+          e = impl_->make( new_salt, addr, sesskey, now );
+          e->written_ = old_salt;
+        }
+
+        impl_->mark_dirty(e);
+      }
+
+      bool session_cache::erase(const SAI & addr)
+      {
+        scoped_mutex m(impl_->mtx_);
+        impl::entry * e = impl_->find_addr(addr);
+        if( !e ) return false;
+        impl_->remove(e);
+        return true;
+      }
+
+      bool session_cache::flush_due()
+      {
+        scoped_mutex m(impl_->mtx_);
+        if( impl_->evicted_.empty() == false ) return true;
+        if( impl_->n_dirty_ == 0 ) return false;
+        return ( metrics::now_usec() - impl_->last_flush_ >=
+                 static_cast<uint64_t>(impl_->write_behind_ms_)*1000ULL );
+      }
+
+      unsigned int session_cache::flush(update_session_callback & cb)
+      {
+        scoped_mutex fm(impl_->flush_mtx_);
+        impl::writes_t w;
+
+        {
+          scoped_mutex m(impl_->mtx_);
+          w.swap( impl_->evicted_ );
+
+          for( impl::entries_t::iterator it=impl_->dirty_.begin();it!=impl_->dirty_.end();++it )
+          {
+            impl::entry * e = *it;
+            if( !e->dirty_ ) continue;
+
+            impl::write x;
+            x.old_  = e->written_;
+            x.new_  = e->salt_;
+            x.addr_ = e->addr_;
+            x.key_  = e->key_;
+            w.push_back(x);
+
+            e->written_ = e->salt_;
+            e->dirty_   = false;
+          }
+          impl_->dirty_.clear();
+          impl_->n_dirty_    = 0;
+          impl_->last_flush_ = metrics::now_usec();
+        }
+
+        /* the callbacks may be slow (database), the table is not locked here */
+        return impl_->write_out( w, cb );
+      }
+
+      unsigned int session_cache::flush_evicted(update_session_callback & cb)
+      {
+        scoped_mutex fm(impl_->flush_mtx_);
+        impl::writes_t w;
+
+        {
+          scoped_mutex m(impl_->mtx_);
+          if( impl_->evicted_.empty() ) return 0;
+          w.swap( impl_->evicted_ );
+        }
+
+        return impl_->write_out( w, cb );
+      }
+
+      unsigned int session_cache::size() const
+      {
+        scoped_mutex m(impl_->mtx_);
+        return impl_->size_;
+      }
+
+      unsigned int session_cache::n_dirty() const
+      {
+        scoped_mutex m(impl_->mtx_);
+        return impl_->n_dirty_ + static_cast<unsigned int>(impl_->evicted_.size());
+      }
+
+      void session_cache::capacity(unsigned int n)
+      {
+        scoped_mutex m(impl_->mtx_);
+        impl_->capacity_ = (n == 0 ? 1 : n);
+        while( impl_->tail_ && impl_->size_ > impl_->capacity_ )
+        {
+          impl_->remove(impl_->tail_);
+          impl_->evictions_.inc();
+        }
+      }
+
+      unsigned int session_cache::capacity() const
+      {
+        scoped_mutex m(impl_->mtx_);
+        return impl_->capacity_;
+      }
+
+      void session_cache::ttl_ms(unsigned int ms)
+      {
+        scoped_mutex m(impl_->mtx_);
+        impl_->ttl_ms_ = ms;
+      }
+
+      unsigned int session_cache::ttl_ms() const
+      {
+        scoped_mutex m(impl_->mtx_);
+        return impl_->ttl_ms_;
+      }
+
+      void session_cache::write_behind_ms(unsigned int ms)
+      {
+        scoped_mutex m(impl_->mtx_);
+        impl_->write_behind_ms_ = ms;
+      }
+
+      unsigned int session_cache::write_behind_ms() const
+      {
+        scoped_mutex m(impl_->mtx_);
+        return impl_->write_behind_ms_;
+      }
+
+      session_cache::session_cache() : impl_(new impl()) { }
+
+      session_cache::~session_cache() { }
+
+    } /* end of udp namespace */
+  } /* end of comm namespace */
+} /* end of csl namespace */
+
+/* EOF */
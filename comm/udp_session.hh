@@ -0,0 +1,163 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _csl_comm_udp_session_hh_included_
+#define _csl_comm_udp_session_hh_included_
+
+/**
+   @file udp_session.hh
+   @brief in-process session table of the udp data handlers
+ */
+
+#include "codesloop/comm/udp_auth.hh"
+#include "codesloop/common/common.h"
+#include "codesloop/common/obj.hh"
+#ifdef __cplusplus
+#include <memory>
+
+namespace csl
+{
+  namespace comm
+  {
+    namespace udp
+    {
+      class update_session_callback;
+
+      /**
+      @brief thread-safe cache of the udp sessions, indexed by salt and by peer address
+
+      data_handler looks up the session key of every data packet by its salt and
+      registers the next salt afterwards. with a session_cache set the handler only
+      calls lookup_session_callback on a miss, and the salt updates are written to
+      update_session_callback behind the packet path:
+
+      - updates only mark the cached session dirty, successive updates of a session
+        are coalesced into one callback with the salt the callback saw last and the
+        current one
+      - the dirty sessions are written when write_behind_ms() passed since the last
+        write and by flush(). the evicted ones are also written before the next miss
+        is looked up, so lookup_session_callback sees their last salt
+      - 0 write_behind_ms() means write-through, every update is written at once
+
+      the sessions are evicted in LRU order when capacity() is reached and when they
+      were not used for ttl_ms(). a peer address has at most one session: a new
+      session of the same address replaces the old one.
+
+      the lookups and updates are O(1): both indexes are chained hash tables and the
+      LRU order is an intrusive list. a single mutex protects the table, the callbacks
+      are called without holding it.
+      */
+      class session_cache : public csl::common::obj
+      {
+        public:
+          enum {
+            default_capacity_        = 16384,   ///<default maximum number of sessions
+            default_ttl_ms_          = 300000,  ///<default idle time before eviction
+            default_write_behind_ms_ = 1000     ///<default delay of the salt updates
+          };
+
+          /**
+          @brief finds the session key of a salt
+          @return false if the salt is not cached, it belongs to an other peer or expired
+          */
+          bool lookup(const saltbuf_t & salt, const SAI & addr, ustr & sesskey);
+
+          /** @brief finds the session of a peer address */
+          bool find(const SAI & addr, saltbuf_t & salt, ustr & sesskey);
+
+          /** @brief caches a session as it is known by the callbacks (not dirty) */
+          void insert(const saltbuf_t & salt, const SAI & addr, const ustr & sesskey);
+
+          /**
+          @brief moves the session from old_salt to new_salt and marks it dirty
+
+          the session is inserted if it is not cached
+          */
+          void update(const saltbuf_t & old_salt,
+                      const saltbuf_t & new_salt,
+                      const SAI & addr,
+                      const ustr & sesskey);
+
+          /** @brief drops the session of the peer, its pending update is kept */
+          bool erase(const SAI & addr);
+
+          /** @brief true if there is something to write and write_behind_ms() passed */
+          bool flush_due();
+
+          /**
+          @brief writes the dirty and the evicted sessions to the callback
+          @return the number of callback calls
+
+          the flushes are serialized, so the callback sees the updates of a session in order
+          */
+          unsigned int flush(update_session_callback & cb);
+
+          /**
+          @brief writes only the evicted sessions to the callback
+          @return the number of callback calls
+          */
+          unsigned int flush_evicted(update_session_callback & cb);
+
+          /** @brief number of cached sessions */
+          unsigned int size() const;
+
+          /** @brief number of updates waiting to be written */
+          unsigned int n_dirty() const;
+
+          /* maximum number of sessions, to be set before use */
+          void capacity(unsigned int n);
+          unsigned int capacity() const;
+
+          /* idle time before a session is evicted, 0 means never */
+          void ttl_ms(unsigned int ms);
+          unsigned int ttl_ms() const;
+
+          /* delay of the salt updates */
+          void write_behind_ms(unsigned int ms);
+          unsigned int write_behind_ms() const;
+
+          session_cache();
+          virtual ~session_cache();
+
+          struct impl;
+
+        private:
+          std::auto_ptr<impl> impl_;
+
+          // no-copy
+          session_cache(const session_cache & other);
+          session_cache & operator=(const session_cache & other);
+
+          CSL_OBJ(csl::comm::udp,session_cache);
+      };
+
+    } /* end of udp namespace */
+  } /* end of comm namespace */
+} /* end of csl namespace */
+
+#endif /* __cplusplus */
+#endif /* _csl_comm_udp_session_hh_included_ */
+
+/* EOF */
@@ -0,0 +1,277 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+   @file udp_sharded.cc
+   @brief udp receiver with one SO_REUSEPORT socket per shard
+ */
+
+#include "codesloop/comm/exc.hh"
+#include "codesloop/comm/udp_sharded.hh"
+#include "codesloop/nthread/thread.hh"
+#include "codesloop/nthread/cpuset.hh"
+#include "codesloop/common/common.h"
+#include <vector>
+
+namespace csl
+{
+  using nthread::thread;
+  using nthread::thrpool;
+  using nthread::cpuset;
+
+  namespace comm
+  {
+    namespace udp
+    {
+      struct sharded_recvr::impl
+      {
+        struct shard
+        {
+          recvr                 recvr_;
+          thread                thread_;
+          recvr::msg_handler *  cb_;
+          bool                  started_;
+
+          shard(recvr::msg_handler & cb) : cb_(&cb), started_(false) { }
+        };
+
+        typedef std::vector<shard *> shards_t;
+
+        shards_t               shards_;
+        SAI                    addr_;
+        thrpool::placement_t   placement_;
+        bool                   started_;
+        bool                   debug_;
+
+        impl() : placement_(thrpool::place_none_), started_(false), debug_(false)
+        {
+          memset( &addr_,0,sizeof(addr_) );
+          addr_.sin_family = AF_INET;
+        }
+
+        ~impl()
+        {
+          for( shards_t::iterator it=shards_.begin();it!=shards_.end();++it ) { delete *it; }
+        }
+
+        /* creates and binds the socket of one shard, returns -1 and sets err on failure */
+        int open_socket(SAI & a, bool reuse_port, int & err)
+        {
+          int sock = ::socket( AF_INET, SOCK_DGRAM, 0 );
+          if( sock <= 0 ) { err = exc::rs_socket_failed; return -1; }
+
+          if( reuse_port )
+          {
+#ifdef SO_REUSEPORT
+            /* the kernel spreads the flows among the sockets */
+            int on = 1;
+            if( ::setsockopt( sock, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on) ) < 0 )
+#endif /*SO_REUSEPORT*/
+            {
+              ShutdownCloseSocket( sock );
+              err = exc::rs_setsockopt;
+              return -1;
+            }
+          }
+
+          if( ::bind( sock, reinterpret_cast<const struct sockaddr *>(&a), sizeof(a) ) )
+          {
+            ShutdownCloseSocket( sock );
+            err = exc::rs_bind_failed;
+            return -1;
+          }
+
+          /* the later shards bind to the port chosen for the first one */
+          socklen_t len = sizeof(a);
+          if( ::getsockname( sock, reinterpret_cast<struct sockaddr *>(&a), &len ) )
+          {
+            ShutdownCloseSocket( sock );
+            err = exc::rs_getsockname_failed;
+            return -1;
+          }
+          return sock;
+        }
+
+        bool stop()
+        {
+          bool ret = true;
+          for( shards_t::iterator it=shards_.begin();it!=shards_.end();++it )
+          {
+            if( (*it)->started_ == false ) continue;
+            if( (*it)->recvr_.stop() == false ) ret = false;
+          }
+          for( shards_t::iterator it=shards_.begin();it!=shards_.end();++it )
+          {
+            if( (*it)->started_ == false ) continue;
+            if( (*it)->thread_.exit_event().wait(2000) == false ) ret = false;
+            (*it)->started_ = false;
+          }
+          started_ = false;
+          return ret;
+        }
+      };
+
+      bool sharded_recvr::add_shard(recvr::msg_handler & cb)
+      {
+        if( impl_->started_ || impl_->shards_.size() >= max_shards_ ) return false;
+        impl_->shards_.push_back( new impl::shard(cb) );
+        return true;
+      }
+
+      unsigned int sharded_recvr::n_shards() const
+      {
+        return static_cast<unsigned int>(impl_->shards_.size());
+      }
+
+      recvr & sharded_recvr::shard(unsigned int i)
+      {
+        return impl_->shards_.at(i)->recvr_;
+      }
+
+      bool sharded_recvr::start( unsigned int min_threads,
+                                 unsigned int max_threads,
+                                 unsigned int timeout_ms,
+                                 unsigned int attempts )
+      {
+        if( impl_->started_ )          { THR(exc::rs_internal_state,false); }
+        if( impl_->shards_.empty() )   { THR(exc::rs_not_inited,false); }
+
+        unsigned int n = n_shards();
+        bool reuse_port = (n > 1);
+
+        /* the n-th shard goes to the n-th allowed CPU */
+        cpuset allowed;
+        bool pin = ( impl_->placement_ != thrpool::place_none_ &&
+                     cpuset::allowed(allowed) && allowed.count() > 0 );
+
+        SAI a = impl_->addr_;
+        impl_->started_ = true;
+
+        for( unsigned int i=0;i<n;++i )
+        {
+          impl::shard & s(*(impl_->shards_[i]));
+          int err = exc::rs_unknown;
+          int sock = impl_->open_socket( a, reuse_port, err );
+
+          if( sock < 0 )
+          {
+            int saved = errno;
+            impl_->stop();
+            errno = saved;
+            THRC(err,false);
+          }
+
+          if( pin )
+          {
+            int cpu = allowed.nth( i % allowed.count() );
+            cpuset cs;
+            cs.set( cpu );
+            s.thread_.set_affinity( cs );
+            s.recvr_.set_placement( impl_->placement_, cpu );
+          }
+
+          s.recvr_.debug( impl_->debug_ );
+          s.recvr_.use_exc( use_exc() );
+          s.cb_->debug( impl_->debug_ );
+          s.cb_->use_exc( use_exc() );
+
+          /* the recvr owns the socket from here */
+          if( s.recvr_.start( min_threads, max_threads, timeout_ms, attempts, *(s.cb_), sock ) == false )
+          {
+            impl_->stop();
+            THR(exc::rs_thread_start,false);
+          }
+
+          s.thread_.set_entry( s.recvr_ );
+          if( s.thread_.start() == false )
+          {
+            s.recvr_.stop();
+            impl_->stop();
+            THR(exc::rs_thread_start,false);
+          }
+          s.started_ = true;
+        }
+
+        impl_->addr_ = a;
+        return true;
+      }
+
+      bool sharded_recvr::stop()
+      {
+        return impl_->stop();
+      }
+
+      SAI sharded_recvr::addr()
+      {
+        return impl_->addr_;
+      }
+
+      void sharded_recvr::addr(const SAI & a)
+      {
+        impl_->addr_ = a;
+      }
+
+      void sharded_recvr::set_placement(thrpool::placement_t p)
+      {
+        impl_->placement_ = p;
+      }
+
+      void sharded_recvr::batch(unsigned int n)
+      {
+        for( unsigned int i=0;i<n_shards();++i ) shard(i).batch(n);
+      }
+
+      void sharded_recvr::queue_depth(unsigned int n)
+      {
+        for( unsigned int i=0;i<n_shards();++i ) shard(i).queue_depth(n);
+      }
+
+      void sharded_recvr::reply_batch(unsigned int n, unsigned int flush_ms)
+      {
+        for( unsigned int i=0;i<n_shards();++i ) shard(i).reply_batch(n,flush_ms);
+      }
+
+      void sharded_recvr::debug(bool yesno)
+      {
+        impl_->debug_ = yesno;
+      }
+
+      bool sharded_recvr::debug() const
+      {
+        return impl_->debug_;
+      }
+
+      sharded_recvr::sharded_recvr() : impl_(new impl()) { }
+
+      sharded_recvr::~sharded_recvr()
+      {
+        impl_->stop();
+      }
+
+    } /* end of udp namespace */
+  } /* end of comm namespace */
+} /* end of csl namespace */
+
+/* EOF */
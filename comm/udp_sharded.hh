@@ -0,0 +1,155 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _csl_comm_udp_sharded_hh_included_
+#define _csl_comm_udp_sharded_hh_included_
+
+/**
+   @file udp_sharded.hh
+   @brief udp receiver with one SO_REUSEPORT socket per shard
+ */
+
+#include "codesloop/comm/udp_recvr.hh"
+#include "codesloop/nthread/thrpool.hh"
+#include "codesloop/common/common.h"
+#include "codesloop/common/obj.hh"
+#ifdef __cplusplus
+#include <memory>
+
+namespace csl
+{
+  namespace comm
+  {
+    namespace udp
+    {
+      /**
+      @brief spreads the packets of one udp port over several receivers
+
+      every shard is a complete recvr: its own socket bound to the common address
+      with SO_REUSEPORT, its own receive thread, message ring and handler pool. the
+      kernel hashes the flows to the sockets, so the shards share nothing on the
+      packet path and the throughput scales with the cores.
+
+      the handlers are the usual recvr::msg_handler objects (hello_handler,
+      auth_handler, data_handler, ...), one per shard, configured the same way as
+      for a single recvr. a handler replies on its own shard's socket, which has the
+      same local address.
+
+      @code
+      data_handler h[4];
+      sharded_recvr sr;
+      sr.addr( a );
+      for( int i=0;i<4;++i ) { h[i].lookup_session_cb_ = &lookup; sr.add_shard( h[i] ); }
+      sr.start( 1, 4, 1000, 3 );
+      @endcode
+      */
+      class sharded_recvr : public csl::common::obj
+      {
+        public:
+          enum { max_shards_ = 256 };
+
+          /**
+          @brief adds a shard served by the given handler
+          @return false if started already or max_shards_ is reached
+
+          the handler is not owned and must outlive the receiver
+          */
+          bool add_shard(recvr::msg_handler & cb);
+
+          /** @brief number of shards added */
+          unsigned int n_shards() const;
+
+          /**
+          @brief the receiver of the i-th shard
+
+          its batch(), queue_depth(), slot_size() and reply_batch() may be tuned before start()
+          */
+          recvr & shard(unsigned int i);
+
+          /**
+          @brief opens the sockets and starts the shards
+          @param min_threads,max_threads,timeout_ms,attempts are the thread pool parameters of every shard
+          @throw comm::exc if a socket could not be bound or a shard could not be started
+
+          with more than one shard SO_REUSEPORT is required. when the port of addr() is 0
+          the first shard's port is chosen by the OS and the others bind to it.
+          */
+          bool start( unsigned int min_threads,
+                      unsigned int max_threads,
+                      unsigned int timeout_ms,
+                      unsigned int attempts );
+
+          /** @brief stops the shards and waits for their receive threads */
+          bool stop();
+
+          /** @brief the common address, the actual one after start() */
+          SAI addr();
+          void addr(const SAI & a);
+
+          /**
+          @brief pins the shards
+
+          with a placement other than place_none_ the receive thread of the n-th shard is
+          pinned to the n-th allowed CPU and its handlers are placed as p says, relative to
+          that CPU. to be called before start()
+          */
+          void set_placement(nthread::thrpool::placement_t p);
+
+          /** @brief sets batch() of every shard added so far */
+          void batch(unsigned int n);
+
+          /** @brief sets queue_depth() of every shard added so far */
+          void queue_depth(unsigned int n);
+
+          /** @brief sets reply_batch() of every shard added so far */
+          void reply_batch(unsigned int n, unsigned int flush_ms=sendq::default_flush_ms_);
+
+          /* debug ? */
+          void debug(bool yesno);
+          bool debug() const;
+
+          sharded_recvr();
+          virtual ~sharded_recvr();
+
+          struct impl;
+
+        private:
+          std::auto_ptr<impl> impl_;
+
+          // no-copy
+          sharded_recvr(const sharded_recvr & other);
+          sharded_recvr & operator=(const sharded_recvr & other);
+
+          CSL_OBJ(csl::comm::udp,sharded_recvr);
+      };
+
+    } /* end of udp namespace */
+  } /* end of comm namespace */
+} /* end of csl namespace */
+
+#endif /* __cplusplus */
+#endif /* _csl_comm_udp_sharded_hh_included_ */
+
+/* EOF */
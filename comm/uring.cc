@@ -0,0 +1,381 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+   @file uring.cc
+   @brief minimal Linux io_uring wrapper over the raw system calls
+ */
+
+#include "codesloop/comm/uring.hh"
+#include "codesloop/common/common.h"
+
+#ifdef CSL_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif /*CSL_HAVE_IO_URING*/
+
+namespace csl
+{
+  namespace comm
+  {
+#ifdef CSL_HAVE_IO_URING
+    namespace
+    {
+      inline int sys_setup(unsigned int entries, struct io_uring_params * p)
+      {
+        return static_cast<int>(::syscall( __NR_io_uring_setup, entries, p ));
+      }
+
+      inline int sys_enter(int fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags)
+      {
+        return static_cast<int>(::syscall( __NR_io_uring_enter, fd, to_submit, min_complete, flags, 0, 0 ));
+      }
+
+      inline int sys_register(int fd, unsigned int opcode, const void * arg, unsigned int nr_args)
+      {
+        return static_cast<int>(::syscall( __NR_io_uring_register, fd, opcode, arg, nr_args ));
+      }
+
+      /* the ring indices are shared with the kernel */
+      inline unsigned int load_acquire(const unsigned int * p)
+      {
+        unsigned int v = *const_cast<const volatile unsigned int *>(p);
+        __sync_synchronize();
+        return v;
+      }
+
+      inline void store_release(unsigned int * p, unsigned int v)
+      {
+        __sync_synchronize();
+        *const_cast<volatile unsigned int *>(p) = v;
+      }
+
+      int available_ = -1;
+
+      typedef char more_flag_check[(uring::more_flag_ == IORING_CQE_F_MORE) ? 1 : -1];
+    }
+
+    struct uring::impl
+    {
+      int                      fd_;
+      bool                     fixed_;
+
+      void *                   sq_ptr_;
+      size_t                   sq_sz_;
+      void *                   cq_ptr_;
+      size_t                   cq_sz_;
+      struct io_uring_sqe *    sqes_;
+      size_t                   sqes_sz_;
+
+      unsigned int *           sq_head_;
+      unsigned int *           sq_tail_;
+      unsigned int *           sq_mask_;
+      unsigned int *           sq_array_;
+      unsigned int             sq_entries_;
+      unsigned int             sq_local_tail_;  ///<queued, not yet published to the kernel
+      unsigned int             to_submit_;
+
+      unsigned int *           cq_head_;
+      unsigned int *           cq_tail_;
+      unsigned int *           cq_mask_;
+      struct io_uring_cqe *    cqes_;
+
+      impl() : fd_(-1), fixed_(false),
+               sq_ptr_(MAP_FAILED), sq_sz_(0), cq_ptr_(MAP_FAILED), cq_sz_(0),
+               sqes_(reinterpret_cast<struct io_uring_sqe *>(MAP_FAILED)), sqes_sz_(0),
+               sq_head_(0), sq_tail_(0), sq_mask_(0), sq_array_(0), sq_entries_(0),
+               sq_local_tail_(0), to_submit_(0),
+               cq_head_(0), cq_tail_(0), cq_mask_(0), cqes_(0) { }
+
+      ~impl() { destroy(); }
+
+      bool init(unsigned int entries)
+      {
+        destroy();
+
+        struct io_uring_params p;
+        ::memset( &p,0,sizeof(p) );
+        int fd = sys_setup( entries, &p );
+        if( fd < 0 ) return false;
+        fd_ = fd;
+
+        sq_sz_ = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+        cq_sz_ = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+
+        if( p.features & IORING_FEAT_SINGLE_MMAP )
+        {
+          if( cq_sz_ > sq_sz_ ) sq_sz_ = cq_sz_;
+          cq_sz_ = 0;
+        }
+
+        sq_ptr_ = ::mmap( 0, sq_sz_, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd_, IORING_OFF_SQ_RING );
+        if( sq_ptr_ == MAP_FAILED ) { destroy(); return false; }
+
+        if( cq_sz_ )
+        {
+          cq_ptr_ = ::mmap( 0, cq_sz_, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd_, IORING_OFF_CQ_RING );
+          if( cq_ptr_ == MAP_FAILED ) { destroy(); return false; }
+        }
+
+        sqes_sz_ = p.sq_entries * sizeof(struct io_uring_sqe);
+        sqes_ = reinterpret_cast<struct io_uring_sqe *>(
+                  ::mmap( 0, sqes_sz_, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd_, IORING_OFF_SQES ) );
+        if( sqes_ == MAP_FAILED ) { destroy(); return false; }
+
+        char * sq = reinterpret_cast<char *>(sq_ptr_);
+        char * cq = reinterpret_cast<char *>(cq_sz_ ? cq_ptr_ : sq_ptr_);
+
+        sq_head_       = reinterpret_cast<unsigned int *>(sq + p.sq_off.head);
+        sq_tail_       = reinterpret_cast<unsigned int *>(sq + p.sq_off.tail);
+        sq_mask_       = reinterpret_cast<unsigned int *>(sq + p.sq_off.ring_mask);
+        sq_array_      = reinterpret_cast<unsigned int *>(sq + p.sq_off.array);
+        sq_entries_    = p.sq_entries;
+        sq_local_tail_ = *sq_tail_;
+        to_submit_     = 0;
+
+        cq_head_       = reinterpret_cast<unsigned int *>(cq + p.cq_off.head);
+        cq_tail_       = reinterpret_cast<unsigned int *>(cq + p.cq_off.tail);
+        cq_mask_       = reinterpret_cast<unsigned int *>(cq + p.cq_off.ring_mask);
+        cqes_          = reinterpret_cast<struct io_uring_cqe *>(cq + p.cq_off.cqes);
+        return true;
+      }
+
+      void destroy()
+      {
+        if( sqes_ != MAP_FAILED ) ::munmap( sqes_, sqes_sz_ );
+        if( cq_ptr_ != MAP_FAILED ) ::munmap( cq_ptr_, cq_sz_ );
+        if( sq_ptr_ != MAP_FAILED ) ::munmap( sq_ptr_, sq_sz_ );
+        if( fd_ >= 0 ) ::close( fd_ );
+
+        sqes_   = reinterpret_cast<struct io_uring_sqe *>(MAP_FAILED);
+        cq_ptr_ = MAP_FAILED;
+        sq_ptr_ = MAP_FAILED;
+        fd_     = -1;
+        fixed_  = false;
+        to_submit_ = 0;
+      }
+
+      /* publishes the queued entries to the kernel */
+      void flush_sq()
+      {
+        if( fd_ >= 0 ) store_release( sq_tail_, sq_local_tail_ );
+      }
+
+      int submit(unsigned int wait_nr)
+      {
+        if( fd_ < 0 ) return -EBADF;
+        flush_sq();
+
+        unsigned int flags = (wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0);
+        if( to_submit_ == 0 && wait_nr == 0 ) return 0;
+
+        int ret = 0;
+        do
+        {
+          ret = sys_enter( fd_, to_submit_, wait_nr, flags );
+        } while( ret < 0 && errno == EINTR );
+
+        if( ret < 0 ) return -errno;
+        to_submit_ = (static_cast<unsigned int>(ret) >= to_submit_ ? 0 : to_submit_-ret);
+        return ret;
+      }
+
+      struct io_uring_sqe * get_sqe()
+      {
+        if( fd_ < 0 ) return 0;
+        unsigned int head = load_acquire( sq_head_ );
+        if( sq_local_tail_ - head >= sq_entries_ )
+        {
+          /* full: hand the queued entries to the kernel first */
+          if( submit(0) < 0 ) return 0;
+          head = load_acquire( sq_head_ );
+          if( sq_local_tail_ - head >= sq_entries_ ) return 0;
+        }
+
+        unsigned int idx = sq_local_tail_ & *sq_mask_;
+        struct io_uring_sqe * sqe = &(sqes_[idx]);
+        ::memset( sqe,0,sizeof(*sqe) );
+        sq_array_[idx] = idx;
+        ++sq_local_tail_;
+        ++to_submit_;
+        return sqe;
+      }
+
+      unsigned int reap(completion * out, unsigned int max)
+      {
+        if( fd_ < 0 ) return 0;
+        unsigned int head = *cq_head_;
+        unsigned int tail = load_acquire( cq_tail_ );
+        unsigned int n = 0;
+
+        while( head != tail && n < max )
+        {
+          const struct io_uring_cqe & cqe(cqes_[head & *cq_mask_]);
+          out[n].user_data_ = cqe.user_data;
+          out[n].res_       = cqe.res;
+          out[n].flags_     = cqe.flags;
+          ++n;
+          ++head;
+        }
+        if( n ) store_release( cq_head_, head );
+        return n;
+      }
+    };
+
+    bool uring::available()
+    {
+      int a = available_;
+      if( a < 0 )
+      {
+        struct io_uring_params p;
+        ::memset( &p,0,sizeof(p) );
+        int fd = sys_setup( 2, &p );
+        a = (fd >= 0 ? 1 : 0);
+        if( fd >= 0 ) ::close( fd );
+        available_ = a;
+      }
+      return (a == 1);
+    }
+
+    bool uring::init(unsigned int entries)
+    {
+      if( !entries ) entries = default_entries_;
+      return impl_->init(entries);
+    }
+
+    void uring::destroy()                { impl_->destroy(); }
+    bool uring::is_open() const          { return (impl_->fd_ >= 0); }
+    int uring::fd() const                { return impl_->fd_; }
+    bool uring::has_fixed_buffers() const { return impl_->fixed_; }
+    unsigned int uring::queued() const   { return impl_->to_submit_; }
+
+    bool uring::register_buffers(const struct iovec * iov, unsigned int n)
+    {
+      if( impl_->fd_ < 0 || !iov || !n ) return false;
+      impl_->fixed_ = (sys_register( impl_->fd_, IORING_REGISTER_BUFFERS, iov, n ) == 0);
+      return impl_->fixed_;
+    }
+
+    bool uring::accept(int fd, uint64_t user_data, bool multishot)
+    {
+      struct io_uring_sqe * sqe = impl_->get_sqe();
+      if( !sqe ) return false;
+      sqe->opcode    = IORING_OP_ACCEPT;
+      sqe->fd        = fd;
+      sqe->user_data = user_data;
+      if( multishot ) sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+      return true;
+    }
+
+    bool uring::recv(int fd, void * buf, uint32_t len, uint64_t user_data)
+    {
+      struct io_uring_sqe * sqe = impl_->get_sqe();
+      if( !sqe ) return false;
+      sqe->opcode    = IORING_OP_RECV;
+      sqe->fd        = fd;
+      sqe->addr      = reinterpret_cast<uint64_t>(buf);
+      sqe->len       = len;
+      sqe->user_data = user_data;
+      return true;
+    }
+
+    bool uring::send(int fd, const void * buf, uint32_t len, uint64_t user_data)
+    {
+      struct io_uring_sqe * sqe = impl_->get_sqe();
+      if( !sqe ) return false;
+      sqe->opcode    = IORING_OP_SEND;
+      sqe->fd        = fd;
+      sqe->addr      = reinterpret_cast<uint64_t>(buf);
+      sqe->len       = len;
+      sqe->msg_flags = MSG_NOSIGNAL;
+      sqe->user_data = user_data;
+      return true;
+    }
+
+    bool uring::read_fixed(int fd, void * buf, uint32_t len, uint16_t buf_index, uint64_t user_data)
+    {
+      struct io_uring_sqe * sqe = impl_->get_sqe();
+      if( !sqe ) return false;
+      sqe->opcode    = IORING_OP_READ_FIXED;
+      sqe->fd        = fd;
+      sqe->addr      = reinterpret_cast<uint64_t>(buf);
+      sqe->len       = len;
+      sqe->buf_index = buf_index;
+      sqe->user_data = user_data;
+      return true;
+    }
+
+    bool uring::cancel(uint64_t target, uint64_t user_data)
+    {
+      struct io_uring_sqe * sqe = impl_->get_sqe();
+      if( !sqe ) return false;
+      sqe->opcode    = IORING_OP_ASYNC_CANCEL;
+      sqe->fd        = -1;
+      sqe->addr      = target;
+      sqe->user_data = user_data;
+      return true;
+    }
+
+    int uring::submit(unsigned int wait_nr)
+    {
+      return impl_->submit(wait_nr);
+    }
+
+    unsigned int uring::reap(completion * out, unsigned int max)
+    {
+      return impl_->reap(out,max);
+    }
+
+#else /* no io_uring: every operation fails, the users fall back */
+
+    struct uring::impl { };
+
+    bool uring::available()                                               { return false; }
+    bool uring::init(unsigned int)                                        { return false; }
+    void uring::destroy()                                                 { }
+    bool uring::is_open() const                                           { return false; }
+    int uring::fd() const                                                 { return -1; }
+    bool uring::has_fixed_buffers() const                                 { return false; }
+    unsigned int uring::queued() const                                    { return 0; }
+    bool uring::register_buffers(const struct iovec *, unsigned int)      { return false; }
+    bool uring::accept(int, uint64_t, bool)                               { return false; }
+    bool uring::recv(int, void *, uint32_t, uint64_t)                     { return false; }
+    bool uring::send(int, const void *, uint32_t, uint64_t)               { return false; }
+    bool uring::read_fixed(int, void *, uint32_t, uint16_t, uint64_t)     { return false; }
+    bool uring::cancel(uint64_t, uint64_t)                                { return false; }
+    int uring::submit(unsigned int)                                       { return -ENOSYS; }
+    unsigned int uring::reap(completion *, unsigned int)                  { return 0; }
+
+#endif /*CSL_HAVE_IO_URING*/
+
+    uring::uring() : impl_(new impl()) { }
+    uring::~uring() { }
+  }
+}
+
+/* EOF */
@@ -0,0 +1,160 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _csl_comm_uring_hh_included_
+#define _csl_comm_uring_hh_included_
+
+/**
+   @file uring.hh
+   @brief minimal Linux io_uring wrapper over the raw system calls
+ */
+
+#include "codesloop/common/common.h"
+#include "codesloop/common/obj.hh"
+#ifdef __cplusplus
+#include <memory>
+
+struct iovec;
+
+namespace csl
+{
+  namespace comm
+  {
+    /**
+    @brief a single io_uring instance, driven by one thread
+
+    this only covers what comm needs: accept (single or multishot), recv, read
+    into registered buffers, send and cancel. there is no liburing dependency,
+    the rings are set up with io_uring_setup() and mmap(), and the requests are
+    submitted with io_uring_enter().
+
+    the queueing functions only put a request into the submission queue, so
+    many requests are handed to the kernel by a single submit() call. when the
+    queue is full they submit the queued requests first.
+
+    when the kernel or the build does not support io_uring, available() is false
+    and init() fails. the users are expected to fall back to readiness based IO.
+
+    the object is not thread-safe.
+    */
+    class uring
+    {
+      public:
+        enum {
+          default_entries_ = 256,   ///<default size of the submission queue
+          more_flag_       = 2      ///<IORING_CQE_F_MORE: a multishot request stays active
+        };
+
+        /** @brief a copy of a completion queue entry */
+        struct completion
+        {
+          uint64_t  user_data_;
+          int32_t   res_;       ///<result of the operation or -errno
+          uint32_t  flags_;
+
+          inline bool more() const { return ((flags_ & more_flag_) != 0); }
+        };
+
+        /** @brief tells wether io_uring can be used in this process (probed once) */
+        static bool available();
+
+        uring();
+        ~uring();
+
+        /**
+        @brief sets up the rings
+        @param entries is the size of the submission queue
+        @return false if io_uring is not available
+        */
+        bool init(unsigned int entries=default_entries_);
+
+        /** @brief closes the ring, the pending requests are cancelled by the kernel */
+        void destroy();
+
+        bool is_open() const;   ///<true after a successful init()
+        int fd() const;         ///<the ring's file descriptor, it polls readable when completions are waiting
+
+        /**
+        @brief registers fixed buffers for read_fixed()
+        @param iov are the buffers
+        @param n is the number of buffers
+        @return false if the kernel refused them (e.g. RLIMIT_MEMLOCK)
+        */
+        bool register_buffers(const struct iovec * iov, unsigned int n);
+
+        /** @brief true if register_buffers() succeeded */
+        bool has_fixed_buffers() const;
+
+        /**
+        @brief queues an accept request
+        @param multishot keeps the request active, one completion per new connection
+        */
+        bool accept(int fd, uint64_t user_data, bool multishot);
+
+        bool recv(int fd, void * buf, uint32_t len, uint64_t user_data);       ///<queues a recv()
+        bool send(int fd, const void * buf, uint32_t len, uint64_t user_data); ///<queues a send()
+
+        /** @brief queues a read into the buf_index-th registered buffer */
+        bool read_fixed(int fd, void * buf, uint32_t len, uint16_t buf_index, uint64_t user_data);
+
+        /** @brief queues the cancellation of the requests with the target user data */
+        bool cancel(uint64_t target, uint64_t user_data);
+
+        /** @brief number of queued requests not yet submitted */
+        unsigned int queued() const;
+
+        /**
+        @brief submits the queued requests
+        @param wait_nr is the number of completions to wait for
+        @return the number of submitted requests or -errno
+        */
+        int submit(unsigned int wait_nr=0);
+
+        /**
+        @brief takes the available completions
+        @param out receives the completions
+        @param max is the size of out
+        @return the number of completions copied
+        */
+        unsigned int reap(completion * out, unsigned int max);
+
+        struct impl;
+
+      private:
+        std::auto_ptr<impl> impl_;
+
+        /* no-copy */
+        uring(const uring & other);
+        uring & operator=(const uring & other);
+
+        CSL_OBJ(csl::comm,uring);
+    };
+  }
+}
+
+#endif /*__cplusplus*/
+#endif /* _csl_comm_uring_hh_included_ */
+
+/* EOF */
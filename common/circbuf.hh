@@ -158,7 +158,10 @@ namespace csl
             }
             else
             {
+              /* the oldest active item is dropped */
               ret = head_.unlink_before();
+              --n_items_;
+              on_full();
             }
           }
 
@@ -166,6 +169,26 @@ namespace csl
           return *(ret->item_);
         }
 
+        /**
+        @brief the first step of the 2-phase push without dropping active items
+
+        like prepare(), but when no free item is available a new one is allocated even if
+        the list is full. the oldest active item is only dropped when the reserved item is
+        commit-ed. this helps batched producers that reserve more items than they may fill.
+         */
+        inline T & reserve()
+        {
+          item * ret = freelist_.unlink_before();
+          if( ret == 0 )
+          {
+            ++size_;
+            ret = new item();
+            ret->item_ = new T();
+          }
+          preplist_.link_after( ret );
+          return *(ret->item_);
+        }
+
         /**
         @brief second step of the 2-phase push
         @param t is the item to be commit-ed
@@ -186,12 +209,16 @@ namespace csl
               ++n_items_;
               if( n_items_ > max_ )
               {
-                n_items_ = max_;
+                /* keep the active list and n_items_ in sync: drop the oldest */
+                item * old = head_.unlink_before();
+                freelist_.link_after( old );
+                --n_items_;
                 on_full();
               }
               on_new_item();
               break;
             }
+            it = it->next_;
           }
         }
 
@@ -214,6 +241,7 @@ namespace csl
               freelist_.link_after( it );
               break;
             }
+            it = it->next_;
           }
         }
 
@@ -339,6 +367,10 @@ namespace csl
 
         unsigned long long n_items() { return n_items_; } ///<returns the number of active items
         unsigned long long size()    { return size_;    } ///<returns the number of all allocated items
+        unsigned long long max_items() { return max_;   } ///<returns the maximum number of active items
+
+        /** @brief changes the maximum number of active items (the items above are not dropped until the next push) */
+        void max_items(unsigned long long n) { max_ = (n == 0 ? 1 : n); }
 
         /* event upcalls */
         inline virtual void on_new_item() {} ///<event upcall: called when new item is placed into the list
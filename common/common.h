@@ -94,6 +94,9 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 # ifndef CloseSocket
 #  define CloseSocket(S) { ::closesocket(S); }
 # endif /*CloseSocket*/
+# ifndef PollSocket
+#  define PollSocket(F,N,T) ::WSAPoll(F,N,T)
+# endif /*PollSocket*/
 # ifndef Close
 #  define Close(S) { ::close(S); }
 # endif /*Clos*/
@@ -190,6 +193,10 @@ void gettimeofday(struct timeval * tv, void * p)
 #  define CSL_SYS_TIME_H_INCLUDED
 #  include <sys/time.h>
 # endif /*CSL_SYS_TIME_H_INCLUDED*/
+# ifndef CSL_POLL_H_INCLUDED
+#  define CSL_POLL_H_INCLUDED
+#  include <poll.h>
+# endif /*CSL_POLL_H_INCLUDED*/
 # ifndef SleepSeconds
 #  define SleepSeconds(A) ::sleep(A)
 # endif /*SleepSeconds*/
@@ -205,6 +212,9 @@ void gettimeofday(struct timeval * tv, void * p)
 # ifndef CloseSocket
 #  define CloseSocket(S) { ::close(S); }
 # endif /*CloseSocket*/
+# ifndef PollSocket
+#  define PollSocket(F,N,T) ::poll(F,N,T)
+# endif /*PollSocket*/
 # ifndef Close
 #  define Close(S) { ::close(S); }
 # endif /*Close*/
@@ -365,6 +365,50 @@ namespace csl
         uint64_t size();
         void debug();
 
+        /**
+           @brief a width_ item slice of the storage, the unit of parallel iteration
+
+           bmap_ is a copy of the slice's bitmap taken by blocks(), items_ points
+           to the first item of the slice.
+          */
+        struct block
+        {
+          bitmap_t   bmap_;
+          T *        items_;
+        };
+
+        /**
+           @brief collects the blocks that hold at least one item
+           @param out is a container of blocks (std::vector<block>) to append to
+
+           the container must not be modified while the blocks are in use
+          */
+        template <typename V> void blocks(V & out)
+        {
+          for( item * i = &head_; i != 0; i = i->next_ )
+          {
+            for( mul_t m=0;m<i->mul_;++m )
+            {
+              if( i->bmap_[m] == 0 ) continue;
+              block b;
+              b.bmap_  = i->bmap_[m];
+              b.items_ = i->items_+(m*width_);
+              out.push_back( b );
+            }
+          }
+        }
+
+        /** @brief calls f on every item of the block */
+        template <typename F> static inline void for_each_in(const block & b, F & f)
+        {
+          bitmap_t m = b.bmap_;
+          while( m )
+          {
+            f( b.items_[__builtin_ctzll(m)] );
+            m &= (m-1);
+          }
+        }
+
         // last free position
         iterator last_free();
         iterator & last_free(iterator & ii);
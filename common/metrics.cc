@@ -0,0 +1,480 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "codesloop/common/metrics.hh"
+#include "codesloop/common/exc.hh"
+#include "codesloop/common/ustr.hh"
+#include "codesloop/common/xdrbuf.hh"
+#include <time.h>
+
+/**
+   @file metrics.cc
+   @brief lock-free registry of runtime counters, gauges and latency histograms
+ */
+
+namespace csl
+{
+  namespace common
+  {
+    namespace
+    {
+      // per thread shard index, 0 means not yet assigned
+      __thread unsigned int tls_shard_ = 0;
+      unsigned int          next_shard_ = 0;
+
+      const char * kind_name(int32_t k)
+      {
+        switch( k )
+        {
+          case metrics::counter_:   return "counter";
+          case metrics::gauge_:     return "gauge";
+          case metrics::histogram_: return "histogram";
+        };
+        return "unknown";
+      }
+    }
+
+    /* metric */
+    metrics::metric::metric(const char * nm, kind_t k) : kind_(k), next_(0)
+    {
+      ::strncpy( name_, (nm ? nm : ""), max_name_len_-1 );
+      name_[max_name_len_-1] = 0;
+    }
+
+    /* counter */
+    metrics::counter::counter(const char * nm) : metric(nm,counter_)
+    {
+      ::memset( shards_, 0, sizeof(shards_) );
+    }
+
+    uint64_t metrics::counter::value() const
+    {
+      uint64_t ret = 0;
+      for( unsigned int i=0;i<n_shards_;++i )
+      {
+        ret += __sync_fetch_and_add( const_cast<uint64_t *>(&(shards_[i].value_)), 0 );
+      }
+      return ret;
+    }
+
+    /* gauge */
+    metrics::gauge::gauge(const char * nm) : metric(nm,gauge_), value_(0) { }
+
+    /* histogram */
+    metrics::histogram::histogram(const char * nm)
+      : metric(nm,histogram_), count_(0), sum_(0), min_(~0ULL), max_(0)
+    {
+      ::memset( buckets_, 0, sizeof(buckets_) );
+    }
+
+    unsigned int metrics::histogram::bucket_of(uint64_t v)
+    {
+      if( v < static_cast<uint64_t>(n_sub_) ) return static_cast<unsigned int>(v);
+
+      unsigned int msb   = 63 - __builtin_clzll(v);
+      unsigned int shift = msb - sub_bits_;
+
+      return ((shift+1) << sub_bits_) +
+              static_cast<unsigned int>((v >> shift) - n_sub_);
+    }
+
+    uint64_t metrics::histogram::bucket_upper(unsigned int b)
+    {
+      if( b < static_cast<unsigned int>(n_sub_) ) return b;
+
+      unsigned int shift = (b >> sub_bits_) - 1;
+      uint64_t     sub   = (b & (n_sub_-1)) + n_sub_;
+
+      // the last bucket wraps around to ~0ULL which is what we want
+      return ((sub+1) << shift) - 1;
+    }
+
+    void metrics::histogram::record(uint64_t v)
+    {
+      __sync_fetch_and_add( &(buckets_[bucket_of(v)]), 1 );
+      __sync_fetch_and_add( &count_, 1 );
+      __sync_fetch_and_add( &sum_, v );
+
+      uint64_t m = min_;
+      while( v < m )
+      {
+        uint64_t prev = __sync_val_compare_and_swap( &min_, m, v );
+        if( prev == m ) break;
+        m = prev;
+      }
+
+      m = max_;
+      while( v > m )
+      {
+        uint64_t prev = __sync_val_compare_and_swap( &max_, m, v );
+        if( prev == m ) break;
+        m = prev;
+      }
+    }
+
+    uint64_t metrics::histogram::count() const
+    {
+      return __sync_fetch_and_add( const_cast<uint64_t *>(&count_), 0 );
+    }
+
+    uint64_t metrics::histogram::sum() const
+    {
+      return __sync_fetch_and_add( const_cast<uint64_t *>(&sum_), 0 );
+    }
+
+    uint64_t metrics::histogram::min() const
+    {
+      uint64_t ret = __sync_fetch_and_add( const_cast<uint64_t *>(&min_), 0 );
+      return (ret == ~0ULL ? 0 : ret);
+    }
+
+    uint64_t metrics::histogram::max() const
+    {
+      return __sync_fetch_and_add( const_cast<uint64_t *>(&max_), 0 );
+    }
+
+    uint64_t metrics::histogram::percentile(double pct) const
+    {
+      uint64_t counts[n_buckets_];
+      uint64_t total = 0;
+
+      // take a copy first, so the percentile is computed over a consistent set
+      for( unsigned int i=0;i<n_buckets_;++i )
+      {
+        counts[i] = __sync_fetch_and_add( const_cast<uint64_t *>(&(buckets_[i])), 0 );
+        total += counts[i];
+      }
+
+      if( total == 0 ) return 0;
+
+      if( pct < 0.0 )   pct = 0.0;
+      if( pct > 100.0 ) pct = 100.0;
+
+      uint64_t target = static_cast<uint64_t>((pct * static_cast<double>(total)) / 100.0 + 0.5);
+      if( target == 0 )    target = 1;
+      if( target > total ) target = total;
+
+      uint64_t seen = 0;
+      uint64_t mx   = max();
+
+      for( unsigned int i=0;i<n_buckets_;++i )
+      {
+        seen += counts[i];
+        if( seen >= target )
+        {
+          uint64_t ret = bucket_upper(i);
+          return (ret > mx ? mx : ret);
+        }
+      }
+      return mx;
+    }
+
+    /* scoped_timer */
+    metrics::scoped_timer::scoped_timer(histogram & h) : hist_(&h), start_(now_usec()) { }
+
+    metrics::scoped_timer::~scoped_timer()
+    {
+      hist_->record( now_usec() - start_ );
+    }
+
+    /* snapshot */
+    void metrics::snapshot::to_text(ustr & out) const
+    {
+      char tmp[512];
+      items_t::const_iterator it(items_.begin());
+      items_t::const_iterator ie(items_.end());
+
+      for( ;it!=ie;++it )
+      {
+        if( (*it).kind_ == histogram_ )
+        {
+          SNPRINTF( tmp, sizeof(tmp),
+                    "%-9s %s count=%lld min=%llu p50=%llu p90=%llu p99=%llu p999=%llu max=%llu\n",
+                    kind_name((*it).kind_), (*it).name_,
+                    static_cast<long long>((*it).value_),
+                    static_cast<unsigned long long>((*it).min_),
+                    static_cast<unsigned long long>((*it).p50_),
+                    static_cast<unsigned long long>((*it).p90_),
+                    static_cast<unsigned long long>((*it).p99_),
+                    static_cast<unsigned long long>((*it).p999_),
+                    static_cast<unsigned long long>((*it).max_) );
+        }
+        else
+        {
+          SNPRINTF( tmp, sizeof(tmp), "%-9s %s %lld\n",
+                    kind_name((*it).kind_), (*it).name_,
+                    static_cast<long long>((*it).value_) );
+        }
+        out += tmp;
+      }
+    }
+
+    bool metrics::snapshot::to_xdr(xdrbuf & xb) const
+    {
+      try
+      {
+        xb << static_cast<uint32_t>(items_.size());
+
+        items_t::const_iterator it(items_.begin());
+        items_t::const_iterator ie(items_.end());
+
+        for( ;it!=ie;++it )
+        {
+          xb << (*it).name_;
+          xb << (*it).kind_;
+          xb << (*it).value_;
+          if( (*it).kind_ == histogram_ )
+          {
+            xb << (*it).sum_ << (*it).min_ << (*it).max_;
+            xb << (*it).p50_ << (*it).p90_ << (*it).p99_ << (*it).p999_;
+          }
+        }
+      }
+      catch( common::exc & e )
+      {
+        return false;
+      }
+      return true;
+    }
+
+    bool metrics::snapshot::from_xdr(xdrbuf & xb)
+    {
+      items_.clear();
+      try
+      {
+        uint32_t n = 0;
+        xb >> n;
+
+        for( uint32_t i=0;i<n;++i )
+        {
+          item  itm;
+          ustr  nm;
+
+          ::memset( &itm, 0, sizeof(itm) );
+
+          xb >> nm;
+          ::strncpy( itm.name_, nm.c_str(), max_name_len_-1 );
+          xb >> itm.kind_;
+          xb >> itm.value_;
+          if( itm.kind_ == histogram_ )
+          {
+            xb >> itm.sum_ >> itm.min_ >> itm.max_;
+            xb >> itm.p50_ >> itm.p90_ >> itm.p99_ >> itm.p999_;
+          }
+          items_.push_back( itm );
+        }
+      }
+      catch( common::exc & e )
+      {
+        return false;
+      }
+      return true;
+    }
+
+    const metrics::snapshot::item * metrics::snapshot::find(const char * nm) const
+    {
+      if( !nm ) return 0;
+      items_t::const_iterator it(items_.begin());
+      items_t::const_iterator ie(items_.end());
+
+      for( ;it!=ie;++it )
+      {
+        if( ::strcmp( (*it).name_, nm ) == 0 ) return &(*it);
+      }
+      return 0;
+    }
+
+    /* metrics */
+    metrics & metrics::instance()
+    {
+      // never destructed, so the metrics may be updated from static destructors too
+      static metrics * inst_ = new metrics();
+      return *inst_;
+    }
+
+    metrics::metrics() : head_(0) { }
+
+    metrics::~metrics()
+    {
+      metric * m = head_;
+      while( m )
+      {
+        metric * n = m->next_;
+        delete m;
+        m = n;
+      }
+    }
+
+    unsigned int metrics::shard_id()
+    {
+      if( tls_shard_ == 0 )
+      {
+        tls_shard_ = (__sync_fetch_and_add( &next_shard_, 1 ) % n_shards_) + 1;
+      }
+      return tls_shard_ - 1;
+    }
+
+    uint64_t metrics::now_usec()
+    {
+      struct timespec ts;
+      ::clock_gettime( CLOCK_MONOTONIC, &ts );
+      return (static_cast<uint64_t>(ts.tv_sec) * 1000000ULL) +
+             (static_cast<uint64_t>(ts.tv_nsec) / 1000ULL);
+    }
+
+    metrics::metric * metrics::lookup(metric * from, const char * nm) const
+    {
+      while( from )
+      {
+        if( ::strncmp( from->name_, nm, max_name_len_-1 ) == 0 ) return from;
+        from = from->next_;
+      }
+      return 0;
+    }
+
+    metrics::metric * metrics::find(const char * nm) const
+    {
+      if( !nm ) return 0;
+      return lookup( const_cast<metric *>(head_), nm );
+    }
+
+    metrics::metric * metrics::register_metric(metric * m)
+    {
+      // the list is push-only, so when the CAS fails only the items
+      // pushed in the meantime need to be checked for the same name
+      metric * seen = 0;
+
+      for( ;; )
+      {
+        metric * h = head_;
+        metric * found = 0;
+
+        // check the new items only
+        for( metric * p=h; p && p!=seen; p=p->next_ )
+        {
+          if( ::strcmp( p->name_, m->name_ ) == 0 ) { found = p; break; }
+        }
+
+        if( found )
+        {
+          delete m;
+          return found;
+        }
+
+        m->next_ = h;
+        if( __sync_bool_compare_and_swap( &head_, h, m ) ) return m;
+        seen = h;
+      }
+    }
+
+    metrics::counter & metrics::get_counter(const char * nm)
+    {
+      metric * m = find(nm);
+      if( !m ) m = register_metric( new counter(nm) );
+
+      if( m->kind_ != counter_ )
+        throw common::exc(exc::rs_invalid_param,get_class_name(),L"metric kind mismatch",L"" __FILE__,__LINE__);
+
+      return *(static_cast<counter *>(m));
+    }
+
+    metrics::gauge & metrics::get_gauge(const char * nm)
+    {
+      metric * m = find(nm);
+      if( !m ) m = register_metric( new gauge(nm) );
+
+      if( m->kind_ != gauge_ )
+        throw common::exc(exc::rs_invalid_param,get_class_name(),L"metric kind mismatch",L"" __FILE__,__LINE__);
+
+      return *(static_cast<gauge *>(m));
+    }
+
+    metrics::histogram & metrics::get_histogram(const char * nm)
+    {
+      metric * m = find(nm);
+      if( !m ) m = register_metric( new histogram(nm) );
+
+      if( m->kind_ != histogram_ )
+        throw common::exc(exc::rs_invalid_param,get_class_name(),L"metric kind mismatch",L"" __FILE__,__LINE__);
+
+      return *(static_cast<histogram *>(m));
+    }
+
+    size_t metrics::size() const
+    {
+      size_t ret = 0;
+      for( metric * p=head_; p; p=p->next_ ) ++ret;
+      return ret;
+    }
+
+    void metrics::take_snapshot(snapshot & s) const
+    {
+      s.items_.clear();
+
+      // the list is in reverse registration order, collect it first
+      std::vector<const metric *> ms;
+      for( const metric * p=head_; p; p=p->next_ ) ms.push_back(p);
+
+      std::vector<const metric *>::reverse_iterator it(ms.rbegin());
+      std::vector<const metric *>::reverse_iterator ie(ms.rend());
+
+      for( ;it!=ie;++it )
+      {
+        snapshot::item itm;
+        ::memset( &itm, 0, sizeof(itm) );
+        ::strncpy( itm.name_, (*it)->name_, max_name_len_-1 );
+        itm.kind_ = (*it)->kind_;
+
+        switch( (*it)->kind_ )
+        {
+          case counter_:
+            itm.value_ = static_cast<int64_t>(static_cast<const counter *>(*it)->value());
+            break;
+
+          case gauge_:
+            itm.value_ = static_cast<const gauge *>(*it)->value();
+            break;
+
+          case histogram_:
+          {
+            const histogram * h = static_cast<const histogram *>(*it);
+            itm.value_ = static_cast<int64_t>(h->count());
+            itm.sum_   = h->sum();
+            itm.min_   = h->min();
+            itm.max_   = h->max();
+            itm.p50_   = h->percentile(50.0);
+            itm.p90_   = h->percentile(90.0);
+            itm.p99_   = h->percentile(99.0);
+            itm.p999_  = h->percentile(99.9);
+            break;
+          }
+        };
+        s.items_.push_back( itm );
+      }
+    }
+  }
+}
+
+/* EOF */
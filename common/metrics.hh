@@ -0,0 +1,299 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _csl_common_metrics_hh_included_
+#define _csl_common_metrics_hh_included_
+
+/**
+   @file metrics.hh
+   @brief lock-free registry of runtime counters, gauges and latency histograms
+ */
+
+#include "codesloop/common/common.h"
+#include "codesloop/common/obj.hh"
+#ifdef __cplusplus
+#include <vector>
+
+namespace csl
+{
+  namespace common
+  {
+    class ustr;
+    class xdrbuf;
+
+    /**
+    @brief process wide registry of operational numbers
+
+    metrics are registered by name and live until the process exits, so the
+    returned references may be cached by the instrumented code. registration
+    and updates are lock-free. the common module cannot depend on nthread, so
+    the GCC atomic builtins are used directly.
+
+    three kinds of metrics are supported:
+
+    - counter : monotonic, sharded per thread to avoid cache line ping-pong
+    - gauge : a single signed value that may go up and down
+    - histogram : HDR-style latency histogram with log2 buckets and 16 linear
+      sub-buckets, which gives ~6% relative error on the reported percentiles
+
+    the snapshot() call collects the current values into a snapshot object
+    that can be dumped as text or XDR.
+
+    @code
+    static metrics::counter & accepted(metrics::instance().get_counter("tcp.accepted"));
+    accepted.inc();
+    @endcode
+    */
+    class metrics
+    {
+      public:
+        enum {
+          max_name_len_  = 64,  ///<maximum length of the metric names (incl. trailing zero)
+          n_shards_      = 16,  ///<number of per-thread counter shards
+          sub_bits_      = 4,   ///<log2 of the linear sub-buckets per power of two
+          n_sub_         = (1<<sub_bits_),
+          n_buckets_     = (64-sub_bits_+1)*n_sub_
+        };
+
+        enum kind_t {
+          counter_   = 1,
+          gauge_     = 2,
+          histogram_ = 3
+        };
+
+        /** @brief common base of the metric types */
+        class metric
+        {
+          public:
+            inline const char * name() const { return name_; }
+            inline kind_t kind() const       { return kind_; }
+            inline metric * next() const     { return next_; }
+
+            virtual ~metric() {}
+
+          protected:
+            metric(const char * nm, kind_t k);
+
+          private:
+            friend class metrics;
+            char      name_[max_name_len_];
+            kind_t    kind_;
+            metric *  next_;
+
+            metric(const metric & other);
+            metric & operator=(const metric & other);
+        };
+
+        /**
+        @brief monotonic counter
+
+        every thread updates its own cache line sized shard. the shards are
+        summed when the value is read.
+        */
+        class counter : public metric
+        {
+          public:
+            inline void add(uint64_t v)
+            {
+              __sync_fetch_and_add( &(shards_[shard_id()].value_), v );
+            }
+            inline void inc() { add(1); }
+
+            /** @brief sums the shards */
+            uint64_t value() const;
+
+            counter(const char * nm);
+
+          private:
+            struct shard
+            {
+              uint64_t  value_;
+              char      pad_[64-sizeof(uint64_t)];
+            };
+            shard shards_[n_shards_];
+        };
+
+        /** @brief signed value that may go up and down (queue depth, pool size) */
+        class gauge : public metric
+        {
+          public:
+            inline void set(int64_t v) { __sync_lock_test_and_set( &value_, v ); }
+            inline void add(int64_t v) { __sync_fetch_and_add( &value_, v ); }
+            inline void inc()          { add(1);  }
+            inline void dec()          { add(-1); }
+            inline int64_t value() const
+            {
+              return __sync_fetch_and_add( const_cast<int64_t *>(&value_), 0 );
+            }
+
+            gauge(const char * nm);
+
+          private:
+            int64_t   value_;
+        };
+
+        /**
+        @brief HDR-style histogram of unsigned values (usually microseconds)
+
+        values below 16 have their own bucket, above that every power of two
+        range is split into 16 linear sub-buckets.
+        */
+        class histogram : public metric
+        {
+          public:
+            void record(uint64_t v);
+
+            uint64_t count() const;
+            uint64_t sum() const;
+            uint64_t min() const;
+            uint64_t max() const;
+
+            /**
+            @brief returns the upper bound of the bucket holding the given percentile
+            @param pct is between 0.0 and 100.0
+            */
+            uint64_t percentile(double pct) const;
+
+            /** @brief maps a value to its bucket index */
+            static unsigned int bucket_of(uint64_t v);
+
+            /** @brief the largest value that falls into the given bucket */
+            static uint64_t bucket_upper(unsigned int b);
+
+            histogram(const char * nm);
+
+          private:
+            uint64_t  buckets_[n_buckets_];
+            uint64_t  count_;
+            uint64_t  sum_;
+            uint64_t  min_;
+            uint64_t  max_;
+        };
+
+        /**
+        @brief records the elapsed microseconds between construction and destruction
+        */
+        class scoped_timer
+        {
+          public:
+            scoped_timer(histogram & h);
+            ~scoped_timer();
+
+          private:
+            histogram *  hist_;
+            uint64_t     start_;
+
+            scoped_timer(const scoped_timer & other);
+            scoped_timer & operator=(const scoped_timer & other);
+        };
+
+        /** @brief point in time copy of the registered metrics */
+        class snapshot
+        {
+          public:
+            struct item
+            {
+              char      name_[max_name_len_];
+              int32_t   kind_;
+              int64_t   value_;  ///<counter or gauge value, count for histograms
+              uint64_t  sum_;
+              uint64_t  min_;
+              uint64_t  max_;
+              uint64_t  p50_;
+              uint64_t  p90_;
+              uint64_t  p99_;
+              uint64_t  p999_;
+            };
+
+            typedef std::vector<item> items_t;
+
+            /** @brief one line per metric, in registration order */
+            void to_text(ustr & out) const;
+
+            /** @brief serializes the items to XDR */
+            bool to_xdr(xdrbuf & xb) const;
+
+            /** @brief deserializes the items from XDR */
+            bool from_xdr(xdrbuf & xb);
+
+            /** @brief finds an item by name or returns NULL */
+            const item * find(const char * nm) const;
+
+            inline const items_t & items() const { return items_; }
+            inline size_t size() const           { return items_.size(); }
+
+          private:
+            friend class metrics;
+            items_t items_;
+        };
+
+        /** @brief the process wide registry */
+        static metrics & instance();
+
+        /**
+        @brief returns the named counter, registers it if not yet known
+        @throw common::exc if the name is registered with an other kind
+        */
+        counter & get_counter(const char * nm);
+
+        /** @brief returns the named gauge, registers it if not yet known */
+        gauge & get_gauge(const char * nm);
+
+        /** @brief returns the named histogram, registers it if not yet known */
+        histogram & get_histogram(const char * nm);
+
+        /** @brief returns the named metric or NULL */
+        metric * find(const char * nm) const;
+
+        /** @brief collects the current values */
+        void take_snapshot(snapshot & s) const;
+
+        /** @brief number of registered metrics */
+        size_t size() const;
+
+        /** @brief monotonic clock in microseconds */
+        static uint64_t now_usec();
+
+        metrics();
+        ~metrics();
+
+      private:
+        metric * register_metric(metric * m);
+        metric * lookup(metric * from, const char * nm) const;
+
+        metric *  head_;
+
+        static unsigned int shard_id();
+
+        metrics(const metrics & other);
+        metrics & operator=(const metrics & other);
+
+        CSL_OBJ(csl::common,metrics);
+    };
+  }
+}
+
+#endif /* __cplusplus */
+#endif /* _csl_common_metrics_hh_included_ */
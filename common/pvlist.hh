@@ -360,6 +360,33 @@ namespace csl
           }
       };
 
+      /**
+      @brief a filled part of one chunk, the unit of parallel iteration
+      freed positions hold NULL pointers.
+      */
+      struct chunk
+      {
+        T **    ptrs_;
+        size_t  used_;
+      };
+
+      /**
+      @brief collects the non-empty chunks
+      @param out is a container of chunks (std::vector<chunk>) to append to
+      */
+      template <typename V> void chunks(V & out)
+      {
+        if( !n_items_ ) return;
+        for( item * i = &head_; i != 0; i = i->next_ )
+        {
+          if( !(i->used_) ) continue;
+          chunk c;
+          c.ptrs_ = i->ptrs_;
+          c.used_ = i->used_;
+          out.push_back( c );
+        }
+      }
+
       /** @brief returns iterator pointed at the beginning of the container */
       iterator begin()
       {
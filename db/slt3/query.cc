@@ -25,6 +25,7 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "codesloop/common/str.hh"
 #include "codesloop/common/ustr.hh"
+#include "codesloop/common/metrics.hh"
 #include "codesloop/db/slt3/query.hh"
 #include "codesloop/db/slt3/_shared_impl.hh"
 
@@ -35,6 +36,7 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 using csl::common::str;
 using csl::common::ustr;
+using csl::common::metrics;
 
 namespace csl
 {
@@ -42,6 +44,22 @@ namespace csl
   {
     namespace slt3
     {
+      namespace
+      {
+        /* query latencies in microseconds */
+        metrics::histogram & next_hist()
+        {
+          static metrics::histogram & h_(metrics::instance().get_histogram("db.slt3.query.next_usec"));
+          return h_;
+        }
+
+        metrics::histogram & execute_hist()
+        {
+          static metrics::histogram & h_(metrics::instance().get_histogram("db.slt3.query.execute_usec"));
+          return h_;
+        }
+      }
+
       void query::colhead::debug()
       {
         PRINTF(L"Colhead: Name='%s' Table='%s' DB='%s' Origin='%s' Type=%d\n",
@@ -66,10 +84,30 @@ namespace csl
       void query::reset_data()  { impl_->reset_data(); }
       void query::autoreset_data(bool yesno) { impl_->autoreset_data(yesno); }
       bool query::autoreset_data() { return impl_->autoreset_data(); }
-      bool query::next(columns_t & cols, fields_t & fields) { return impl_->next(cols,fields); }
-      bool query::next() { return impl_->next(); }
-      bool query::execute(const char * sql) { return impl_->execute(sql); }
-      bool query::execute(const char * sql, common::ustr & result)  { return impl_->execute(sql, result); }
+
+      bool query::next(columns_t & cols, fields_t & fields)
+      {
+        metrics::scoped_timer t(next_hist());
+        return impl_->next(cols,fields);
+      }
+
+      bool query::next()
+      {
+        metrics::scoped_timer t(next_hist());
+        return impl_->next();
+      }
+
+      bool query::execute(const char * sql)
+      {
+        metrics::scoped_timer t(execute_hist());
+        return impl_->execute(sql);
+      }
+
+      bool query::execute(const char * sql, common::ustr & result)
+      {
+        metrics::scoped_timer t(execute_hist());
+        return impl_->execute(sql, result);
+      }
 
       void query::use_exc(bool yesno) { impl_->use_exc(yesno); }
       bool query::use_exc() { return impl_->use_exc(); }
@@ -0,0 +1,89 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "codesloop/nthread/adaptive_mutex.hh"
+#include "codesloop/nthread/exc.hh"
+
+#if defined(__linux__) && !defined(CSL_NTHREAD_USE_PTHREAD)
+# include "adaptive_mutex_impl_futex.cc"
+#else /* NOT LINUX */
+# include "adaptive_mutex_impl_pthread.cc"
+#endif /* __linux__ */
+
+/**
+  @file adaptive_mutex.cc
+  @brief implementation of adaptive_mutex
+*/
+
+namespace csl
+{
+  namespace nthread
+  {
+    adaptive_mutex::adaptive_mutex() : impl_(new impl), use_exc_(true) {}
+    adaptive_mutex::~adaptive_mutex() {}
+
+    bool adaptive_mutex::lock()
+    {
+      return impl_->lock();
+    }
+
+    bool adaptive_mutex::try_lock()
+    {
+      return impl_->try_lock();
+    }
+
+    bool adaptive_mutex::unlock()
+    {
+      return impl_->unlock();
+    }
+
+    bool adaptive_mutex::is_locked()
+    {
+      return impl_->is_locked();
+    }
+
+    unsigned int adaptive_mutex::spin_limit()
+    {
+      return impl_->spin_limit();
+    }
+
+    void adaptive_mutex::enable_stats(const char * name)
+    {
+      impl_->stats_.enable(name);
+    }
+
+    void adaptive_mutex::disable_stats()
+    {
+      impl_->stats_.disable();
+    }
+
+    lock_stats & adaptive_mutex::stats()
+    {
+      return impl_->stats_;
+    }
+  }
+}
+
+/* EOF */
@@ -0,0 +1,125 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _csl_nthread_adaptive_mutex_hh_included_
+#define _csl_nthread_adaptive_mutex_hh_included_
+
+/**
+   @file adaptive_mutex.hh
+   @brief mutex that spins for a while before putting the thread to sleep
+ */
+
+#include "codesloop/nthread/lock_stats.hh"
+#include "codesloop/nthread/mutex.hh"
+#include "codesloop/common/common.h"
+#include "codesloop/common/obj.hh"
+#ifdef __cplusplus
+#include <memory>
+
+namespace csl
+{
+  namespace nthread
+  {
+    /**
+       @brief non-recursive mutex for short critical sections
+
+       when the lock is taken, lock() first spins with cpu_relax() hoping that the
+       holder releases it soon, and only parks the thread if that did not happen.
+       the spin limit adapts to the lock: it follows the number of spins that were
+       needed recently (like glibc's PTHREAD_MUTEX_ADAPTIVE_NP), bounded by max_spins_.
+
+       compared to nthread::mutex it is not recursive, does not track the owner
+       and does not unlock when the owner thread exits. this is the price of a
+       lock()/unlock() pair that is a CAS and an atomic decrement when uncontended.
+
+       contention statistics may be turned on at runtime with enable_stats().
+      */
+    class adaptive_mutex
+    {
+    public:
+      enum {
+        max_spins_ = 1000  ///<upper bound of the adaptive spin limit
+      };
+
+      /** @brief constructor */
+      adaptive_mutex();
+
+      /** @brief destructor */
+      ~adaptive_mutex();
+
+      /**
+         @brief locks the mutex
+         @return true if succeed, false if the mutex was destroyed meanwhile
+        */
+      bool lock();
+
+      /** @brief locks the mutex if it is free, never blocks */
+      bool try_lock();
+
+      /**
+         @brief unlocks the mutex
+         @return false if the mutex was not locked
+        */
+      bool unlock();
+
+      /** @brief tells wether the mutex is locked */
+      bool is_locked();
+
+      /** @brief the current adaptive spin limit */
+      unsigned int spin_limit();
+
+      /**
+         @brief enables collecting the wait and hold times
+         @param name is an optional common::metrics name prefix
+        */
+      void enable_stats(const char * name=0);
+
+      /** @brief disables collecting statistics */
+      void disable_stats();
+
+      /** @brief access the collected statistics */
+      lock_stats & stats();
+
+    private:
+      struct impl;
+      std::auto_ptr<impl> impl_;
+
+      // no-copy
+      adaptive_mutex(const adaptive_mutex & other);
+      adaptive_mutex & operator=(const adaptive_mutex & other);
+
+      CSL_OBJ(csl::nthread, adaptive_mutex);
+      USE_EXC();
+    };
+
+    /** @brief scoped adaptive mutex */
+    typedef scoped_mutex_template<adaptive_mutex> scoped_adaptive_mutex;
+  }
+}
+
+#endif /* __cplusplus */
+#endif /* _csl_nthread_adaptive_mutex_hh_included_ */
+
+/* EOF */
@@ -0,0 +1,149 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "codesloop/nthread/adaptive_mutex.hh"
+#include "codesloop/nthread/lock_stats.hh"
+#include "codesloop/nthread/futex_linux.hh"
+#include "codesloop/common/common.h"
+
+/**
+  @file adaptive_mutex_impl_futex.cc
+  @brief futex based implementation of adaptive_mutex (Linux only)
+
+  the lock word is the same three state word as in mutex_impl_futex.cc:
+  0 unlocked, 1 locked, 2 locked with possible waiters. the spinning phase
+  only reads the word and tries the CAS when it looks free, so the spinners
+  do not steal the cache line from the holder.
+*/
+
+namespace csl
+{
+  namespace nthread
+  {
+    struct adaptive_mutex::impl
+    {
+      volatile int   state_;
+      volatile int   invalid_;
+      volatile int   spins_;       ///<moving average of the spins needed
+      uint64_t       held_since_;  ///<written by the owner only
+      lock_stats     stats_;
+
+      impl() : state_(0), invalid_(0), spins_(0), held_since_(0) { }
+
+      ~impl()
+      {
+        // tell waiting threads to abort
+        invalid_ = 1;
+        __sync_lock_test_and_set( &state_, 0 );
+        futex::wake( &state_, INT_MAX );
+      }
+
+      inline void acquired(uint64_t start, bool contended)
+      {
+        if( stats_.enabled() )
+        {
+          uint64_t now = lock_stats::now();
+          stats_.on_acquire( (contended && start) ? now-start : 0, contended );
+          held_since_ = now;
+        }
+      }
+
+      bool lock()
+      {
+        if( invalid_ ) return false;
+
+        // fast path
+        if( __sync_bool_compare_and_swap( &state_, 0, 1 ) ) { acquired(0,false); return true; }
+
+        uint64_t start = (stats_.enabled() ? lock_stats::now() : 0);
+
+        // spin, then park
+        int limit = spins_ * 2 + 10;
+        if( limit > max_spins_ ) limit = max_spins_;
+
+        int cnt = 0;
+        for( ;cnt<limit;++cnt )
+        {
+          cpu_relax();
+          if( state_ == 0 && __sync_bool_compare_and_swap( &state_, 0, 1 ) )
+          {
+            spins_ += (cnt - spins_) / 8;
+            acquired( start, true );
+            return true;
+          }
+        }
+        spins_ += (cnt - spins_) / 8;
+
+        while( __sync_lock_test_and_set( &state_, 2 ) != 0 )
+        {
+          if( invalid_ ) return false;
+          futex::wait( &state_, 2, 0 );
+        }
+
+        acquired( start, true );
+        return true;
+      }
+
+      bool try_lock()
+      {
+        if( invalid_ ) return false;
+        if( __sync_bool_compare_and_swap( &state_, 0, 1 ) ) { acquired(0,false); return true; }
+        return false;
+      }
+
+      bool unlock()
+      {
+        if( state_ == 0 ) return false;
+
+        if( held_since_ )
+        {
+          if( stats_.enabled() ) stats_.on_release( lock_stats::now() - held_since_ );
+          held_since_ = 0;
+        }
+
+        // 1 -> 0 : nobody waits, otherwise wake one waiter up
+        if( __sync_fetch_and_sub( &state_, 1 ) != 1 )
+        {
+          __sync_lock_test_and_set( &state_, 0 );
+          futex::wake( &state_, 1 );
+        }
+        return true;
+      }
+
+      bool is_locked()
+      {
+        return (__sync_fetch_and_add( &state_, 0 ) != 0);
+      }
+
+      unsigned int spin_limit()
+      {
+        int limit = spins_ * 2 + 10;
+        return static_cast<unsigned int>( limit > max_spins_ ? max_spins_ : limit );
+      }
+    };
+  } /* namespace nthread */
+} /* namespace csl */
+
+/* EOF */
@@ -0,0 +1,132 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "codesloop/nthread/adaptive_mutex.hh"
+#include "codesloop/nthread/lock_stats.hh"
+#include "codesloop/common/common.h"
+#include <pthread.h>
+
+/**
+  @file adaptive_mutex_impl_pthread.cc
+  @brief pthread based implementation of adaptive_mutex
+
+  spins on pthread_mutex_trylock() before falling back to a blocking
+  pthread_mutex_lock()
+*/
+
+namespace csl
+{
+  namespace nthread
+  {
+    struct adaptive_mutex::impl
+    {
+      pthread_mutex_t  mtx_;
+      volatile int     locked_;
+      volatile int     spins_;
+      uint64_t         held_since_;
+      lock_stats       stats_;
+
+      impl() : locked_(0), spins_(0), held_since_(0)
+      {
+        pthread_mutex_init( &mtx_, NULL );
+      }
+
+      ~impl()
+      {
+        pthread_mutex_destroy( &mtx_ );
+      }
+
+      inline void acquired(uint64_t start, bool contended)
+      {
+        locked_ = 1;
+        if( stats_.enabled() )
+        {
+          uint64_t now = lock_stats::now();
+          stats_.on_acquire( (contended && start) ? now-start : 0, contended );
+          held_since_ = now;
+        }
+      }
+
+      bool lock()
+      {
+        if( pthread_mutex_trylock( &mtx_ ) == 0 ) { acquired(0,false); return true; }
+
+        uint64_t start = (stats_.enabled() ? lock_stats::now() : 0);
+
+        int limit = spins_ * 2 + 10;
+        if( limit > max_spins_ ) limit = max_spins_;
+
+        int cnt = 0;
+        for( ;cnt<limit;++cnt )
+        {
+          cpu_relax();
+          if( locked_ == 0 && pthread_mutex_trylock( &mtx_ ) == 0 )
+          {
+            spins_ += (cnt - spins_) / 8;
+            acquired( start, true );
+            return true;
+          }
+        }
+        spins_ += (cnt - spins_) / 8;
+
+        if( pthread_mutex_lock( &mtx_ ) != 0 ) return false;
+        acquired( start, true );
+        return true;
+      }
+
+      bool try_lock()
+      {
+        if( pthread_mutex_trylock( &mtx_ ) == 0 ) { acquired(0,false); return true; }
+        return false;
+      }
+
+      bool unlock()
+      {
+        if( locked_ == 0 ) return false;
+
+        if( held_since_ )
+        {
+          if( stats_.enabled() ) stats_.on_release( lock_stats::now() - held_since_ );
+          held_since_ = 0;
+        }
+        locked_ = 0;
+        return (pthread_mutex_unlock( &mtx_ ) == 0);
+      }
+
+      bool is_locked()
+      {
+        return (locked_ != 0);
+      }
+
+      unsigned int spin_limit()
+      {
+        int limit = spins_ * 2 + 10;
+        return static_cast<unsigned int>( limit > max_spins_ ? max_spins_ : limit );
+      }
+    };
+  } /* namespace nthread */
+} /* namespace csl */
+
+/* EOF */
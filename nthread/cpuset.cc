@@ -0,0 +1,279 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+
+#include "codesloop/nthread/cpuset.hh"
+#include "codesloop/common/common.h"
+#include <stdio.h>
+#include <stdlib.h>
+#ifndef WIN32
+# include <unistd.h>
+# include <pthread.h>
+#endif /* WIN32 */
+#ifdef __linux__
+# include <sched.h>
+#endif /* __linux__ */
+
+/**
+  @file cpuset.cc
+  @brief implementation of cpuset
+*/
+
+namespace csl
+{
+  namespace nthread
+  {
+    namespace
+    {
+      /* reads a single line sysfs file */
+      bool read_line(const char * path, char * buf, size_t sz)
+      {
+        FILE * fp = ::fopen( path, "r" );
+        if( !fp ) return false;
+        bool ret = (::fgets( buf, static_cast<int>(sz), fp ) != 0);
+        ::fclose( fp );
+        return ret;
+      }
+
+      bool read_cpulist(const char * path, cpuset & cs)
+      {
+        char buf[4096];
+        if( !read_line( path, buf, sizeof(buf) ) ) return false;
+        return cs.parse( buf );
+      }
+    }
+
+    cpuset::cpuset()
+    {
+      clear();
+    }
+
+    void cpuset::clear()
+    {
+      ::memset( bits_, 0, sizeof(bits_) );
+    }
+
+    void cpuset::set(unsigned int cpu)
+    {
+      if( cpu < max_cpus_ ) bits_[cpu/bits_per_word_] |= (1UL << (cpu%bits_per_word_));
+    }
+
+    void cpuset::unset(unsigned int cpu)
+    {
+      if( cpu < max_cpus_ ) bits_[cpu/bits_per_word_] &= ~(1UL << (cpu%bits_per_word_));
+    }
+
+    bool cpuset::is_set(unsigned int cpu) const
+    {
+      if( cpu >= max_cpus_ ) return false;
+      return ((bits_[cpu/bits_per_word_] & (1UL << (cpu%bits_per_word_))) != 0);
+    }
+
+    unsigned int cpuset::count() const
+    {
+      unsigned int ret = 0;
+      for( unsigned int i=0;i<n_words_;++i ) ret += __builtin_popcountl( bits_[i] );
+      return ret;
+    }
+
+    int cpuset::nth(unsigned int n) const
+    {
+      for( unsigned int i=0;i<max_cpus_;++i )
+      {
+        if( is_set(i) )
+        {
+          if( n == 0 ) return static_cast<int>(i);
+          --n;
+        }
+      }
+      return -1;
+    }
+
+    bool cpuset::parse(const char * list)
+    {
+      clear();
+      if( !list ) return false;
+
+      const char * p = list;
+      while( *p )
+      {
+        if( *p == ',' || *p == ' ' || *p == '\n' || *p == '\t' ) { ++p; continue; }
+
+        char * e = 0;
+        unsigned long from = ::strtoul( p, &e, 10 );
+        if( e == p ) { clear(); return false; }
+
+        unsigned long to = from;
+        p = e;
+        if( *p == '-' )
+        {
+          ++p;
+          to = ::strtoul( p, &e, 10 );
+          if( e == p || to < from ) { clear(); return false; }
+          p = e;
+        }
+        if( to >= max_cpus_ ) { clear(); return false; }
+
+        for( unsigned long i=from;i<=to;++i ) set( static_cast<unsigned int>(i) );
+      }
+      return true;
+    }
+
+    void cpuset::to_text(char * buf, size_t sz) const
+    {
+      if( !buf || !sz ) return;
+      buf[0] = 0;
+
+      size_t pos = 0;
+      unsigned int i = 0;
+
+      while( i < max_cpus_ )
+      {
+        if( !is_set(i) ) { ++i; continue; }
+
+        unsigned int j = i;
+        while( j+1 < max_cpus_ && is_set(j+1) ) ++j;
+
+        int n = 0;
+        if( j == i ) n = ::snprintf( buf+pos, sz-pos, "%s%u", (pos ? "," : ""), i );
+        else         n = ::snprintf( buf+pos, sz-pos, "%s%u-%u", (pos ? "," : ""), i, j );
+
+        if( n < 0 || static_cast<size_t>(n) >= sz-pos ) { buf[pos] = 0; return; }
+        pos += n;
+        i = j+1;
+      }
+    }
+
+    bool cpuset::operator==(const cpuset & other) const
+    {
+      return (::memcmp( bits_, other.bits_, sizeof(bits_) ) == 0);
+    }
+
+    unsigned int cpuset::n_cpus()
+    {
+#ifdef WIN32
+      SYSTEM_INFO si;
+      GetSystemInfo( &si );
+      return static_cast<unsigned int>(si.dwNumberOfProcessors);
+#else
+      long n = ::sysconf( _SC_NPROCESSORS_ONLN );
+      return static_cast<unsigned int>( n > 0 ? n : 1 );
+#endif /* WIN32 */
+    }
+
+    bool cpuset::online(cpuset & cs)
+    {
+      if( read_cpulist( "/sys/devices/system/cpu/online", cs ) ) return true;
+
+      cs.clear();
+      unsigned int n = n_cpus();
+      for( unsigned int i=0;i<n;++i ) cs.set(i);
+      return true;
+    }
+
+    bool cpuset::allowed(cpuset & cs)
+    {
+#ifdef __linux__
+      cpu_set_t s;
+      CPU_ZERO( &s );
+      if( ::pthread_getaffinity_np( pthread_self(), sizeof(s), &s ) == 0 )
+      {
+        cs.clear();
+        for( unsigned int i=0;i<CPU_SETSIZE && i<max_cpus_;++i )
+        {
+          if( CPU_ISSET( i, &s ) ) cs.set(i);
+        }
+        return true;
+      }
+#endif /* __linux__ */
+      return online(cs);
+    }
+
+    unsigned int cpuset::n_numa_nodes()
+    {
+      cpuset nodes;
+      if( read_cpulist( "/sys/devices/system/node/online", nodes ) && nodes.count() > 0 )
+      {
+        return nodes.count();
+      }
+      return 1;
+    }
+
+    bool cpuset::numa_node(unsigned int node, cpuset & cs)
+    {
+      char path[128];
+      ::snprintf( path, sizeof(path), "/sys/devices/system/node/node%u/cpulist", node );
+      if( read_cpulist( path, cs ) ) return true;
+
+      /* no NUMA information: everything is on node 0 */
+      if( node == 0 ) return online(cs);
+
+      cs.clear();
+      return false;
+    }
+
+    unsigned int cpuset::node_of(unsigned int cpu)
+    {
+      unsigned int n = n_numa_nodes();
+      for( unsigned int i=0;i<n;++i )
+      {
+        cpuset cs;
+        if( numa_node(i,cs) && cs.is_set(cpu) ) return i;
+      }
+      return 0;
+    }
+
+    int cpuset::current_cpu()
+    {
+#ifdef __linux__
+      return ::sched_getcpu();
+#else
+      return -1;
+#endif /* __linux__ */
+    }
+
+    bool cpuset::pin_current(const cpuset & cs)
+    {
+#ifdef __linux__
+      if( cs.empty() ) return false;
+
+      cpu_set_t s;
+      CPU_ZERO( &s );
+      for( unsigned int i=0;i<CPU_SETSIZE && i<max_cpus_;++i )
+      {
+        if( cs.is_set(i) ) CPU_SET( i, &s );
+      }
+      return (::pthread_setaffinity_np( pthread_self(), sizeof(s), &s ) == 0);
+#else
+      return false;
+#endif /* __linux__ */
+    }
+  }
+}
+
+/* EOF */
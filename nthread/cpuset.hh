@@ -0,0 +1,131 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _csl_nthread_cpuset_hh_included_
+#define _csl_nthread_cpuset_hh_included_
+
+/**
+   @file cpuset.hh
+   @brief set of CPUs for thread placement
+ */
+
+#include "codesloop/common/common.h"
+#include "codesloop/common/obj.hh"
+#ifdef __cplusplus
+
+namespace csl
+{
+  namespace nthread
+  {
+    /**
+       @brief set of CPU indices, used for pinning threads
+
+       the static functions tell about the machine topology. the NUMA layout is
+       read from /sys/devices/system/node, so there is no libnuma dependency.
+       on systems without that information every CPU is reported to belong to
+       node 0.
+
+       @code
+       cpuset cs;
+       cpuset::numa_node(1, cs);  // all CPUs of the second node
+       thr.set_affinity(cs);
+       @endcode
+      */
+    class cpuset
+    {
+    public:
+      enum {
+        max_cpus_ = 1024  ///<the highest CPU index supported + 1
+      };
+
+      /** @brief constructor, creates an empty set */
+      cpuset();
+
+      void clear();
+      void set(unsigned int cpu);
+      void unset(unsigned int cpu);
+      bool is_set(unsigned int cpu) const;
+
+      /** @brief number of CPUs in the set */
+      unsigned int count() const;
+
+      inline bool empty() const { return (count() == 0); }
+
+      /** @brief the n-th CPU (counting from 0) in the set or -1 */
+      int nth(unsigned int n) const;
+
+      /**
+         @brief parses the Linux cpulist format, like "0-3,8,10-11"
+         @return false on parse errors, the set is cleared then
+        */
+      bool parse(const char * list);
+
+      /** @brief prints the set in the cpulist format */
+      void to_text(char * buf, size_t sz) const;
+
+      bool operator==(const cpuset & other) const;
+      inline bool operator!=(const cpuset & other) const { return !(*this == other); }
+
+      /** @brief the number of online CPUs */
+      static unsigned int n_cpus();
+
+      /** @brief the online CPUs */
+      static bool online(cpuset & cs);
+
+      /** @brief the CPUs the calling thread is allowed to run on */
+      static bool allowed(cpuset & cs);
+
+      /** @brief the number of NUMA nodes, at least 1 */
+      static unsigned int n_numa_nodes();
+
+      /** @brief the CPUs of the given NUMA node */
+      static bool numa_node(unsigned int node, cpuset & cs);
+
+      /** @brief the NUMA node of the given CPU, 0 if unknown */
+      static unsigned int node_of(unsigned int cpu);
+
+      /** @brief the CPU the calling thread is running on or -1 */
+      static int current_cpu();
+
+      /** @brief pins the calling thread to the given CPUs */
+      static bool pin_current(const cpuset & cs);
+
+    private:
+      enum {
+        bits_per_word_ = (8*sizeof(unsigned long)),
+        n_words_       = (max_cpus_/bits_per_word_)
+      };
+
+      unsigned long bits_[n_words_];
+
+      CSL_OBJ(csl::nthread, cpuset);
+    };
+  }
+}
+
+#endif /* __cplusplus */
+#endif /* _csl_nthread_cpuset_hh_included_ */
+
+/* EOF */
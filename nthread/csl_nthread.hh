@@ -33,9 +33,16 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "codesloop/nthread/exc.hh"
 #include "codesloop/nthread/thread.hh"
+#include "codesloop/nthread/cpuset.hh"
 #include "codesloop/nthread/mutex.hh"
+#include "codesloop/nthread/adaptive_mutex.hh"
+#include "codesloop/nthread/rwlock.hh"
 #include "codesloop/nthread/event.hh"
 #include "codesloop/nthread/pevent.hh"
 #include "codesloop/nthread/thrpool.hh"
+#include "codesloop/nthread/executor.hh"
+#include "codesloop/nthread/timer_wheel.hh"
+#include "codesloop/nthread/future.hh"
+#include "codesloop/nthread/parallel.hh"
 
 #endif /* _csl_nthread_csl_nthread_hh_included_ */
@@ -30,7 +30,9 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #ifdef WIN32
 # include "event_impl_windows.cc"
-#else /* NOT WIN32 */
+#elif defined(__linux__) && !defined(CSL_NTHREAD_USE_PTHREAD)
+# include "event_impl_futex.cc"
+#else /* NOT WIN32, NOT LINUX */
 # include "event_impl_pthread.cc"
 #endif /* WIN32 */
 
@@ -0,0 +1,178 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "codesloop/nthread/event.hh"
+#include "codesloop/nthread/futex_linux.hh"
+#include "codesloop/common/common.h"
+
+/**
+  @file event_impl_futex.cc
+  @brief futex based implementation of event class (Linux only)
+
+  the counters are maintained with atomic operations. the futex word is a
+  sequence number that is bumped by the notifiers, so a notification that
+  arrives between checking the counters and going to sleep is not lost.
+  notify() enters the kernel only if there is at least one waiter.
+*/
+
+namespace csl
+{
+  namespace nthread
+  {
+    struct event::impl
+    {
+      volatile int   invalid_;
+      volatile int   waiting_;
+      volatile int   available_;
+      volatile int   seq_;
+
+      impl() : invalid_(0), waiting_(0), available_(0), seq_(0) { }
+
+      ~impl()
+      {
+        // tell waiting threads to abort
+        invalid_ = 1;
+        __sync_synchronize();
+        if( waiting_ > 0 ) wake_waiters( INT_MAX );
+      }
+
+      inline void wake_waiters(int n)
+      {
+        __sync_fetch_and_add( &seq_, 1 );
+        futex::wake( &seq_, n );
+      }
+
+      inline bool try_consume()
+      {
+        int a = available_;
+        while( a > 0 )
+        {
+          int prev = __sync_val_compare_and_swap( &available_, a, a-1 );
+          if( prev == a ) return true;
+          a = prev;
+        }
+        return false;
+      }
+
+      bool notify(unsigned int n)
+      {
+        if( !n ) return false;
+        if( invalid_ ) return false;
+
+        __sync_fetch_and_add( &available_, static_cast<int>(n) );
+
+        // pairs with the waiting_ increment in wait(): the full barrier of the
+        // previous atomic op ensures we see the waiter or it sees the new value
+        int w = waiting_;
+        if( w > 0 )
+        {
+          wake_waiters( static_cast<int>(n) >= w ? INT_MAX : static_cast<int>(n) );
+        }
+        return true;
+      }
+
+      bool notify_all()
+      {
+        if( invalid_ ) return false;
+
+        int w = waiting_;
+        int a = available_;
+
+        // available_ = max(available_,waiting_)
+        while( a < w )
+        {
+          int prev = __sync_val_compare_and_swap( &available_, a, w );
+          if( prev == a ) break;
+          a = prev;
+        }
+
+        if( w > 0 ) wake_waiters( INT_MAX );
+        return true;
+      }
+
+      void clear_available()
+      {
+        __sync_lock_test_and_set( &available_, 0 );
+      }
+
+      bool wait(unsigned long timeout_ms)
+      {
+        if( invalid_ ) return false;
+
+        // fast path: no need to register as a waiter
+        if( try_consume() ) return true;
+
+        futex::deadline dl( timeout_ms );
+        bool ret = false;
+
+        __sync_fetch_and_add( &waiting_, 1 );
+
+        for( ;; )
+        {
+          // the sequence must be read before checking the counters
+          int s = seq_;
+          __sync_synchronize();
+
+          if( invalid_ )      { ret = false; break; }
+          if( try_consume() ) { ret = true;  break; }
+
+          struct timespec ts;
+          bool expired = false;
+          const struct timespec * tp = dl.remaining( ts, expired );
+
+          if( expired ) { ret = false; break; }
+
+          if( futex::wait( &seq_, s, tp ) != 0 && errno == ETIMEDOUT )
+          {
+            // one last chance, the notification may have arrived just now
+            ret = (invalid_ == 0 && try_consume());
+            break;
+          }
+        }
+
+        __sync_fetch_and_sub( &waiting_, 1 );
+        return ret;
+      }
+
+      bool wait_nb()
+      {
+        if( invalid_ ) return false;
+        return try_consume();
+      }
+
+      unsigned int waiting_count()
+      {
+        return static_cast<unsigned int>(__sync_fetch_and_add( &waiting_, 0 ));
+      }
+
+      unsigned int available_count()
+      {
+        return static_cast<unsigned int>(__sync_fetch_and_add( &available_, 0 ));
+      }
+    };
+  } /* namespace nthread */
+} /* namespace csl */
+
+/* EOF */
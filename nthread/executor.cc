@@ -0,0 +1,543 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#if 0
+#ifndef DEBUG
+#define DEBUG
+#define DEBUG_ENABLE_INDENT
+//#define DEBUG_VERBOSE
+#endif /* DEBUG */
+#endif //0
+
+#include "codesloop/nthread/exc.hh"
+#include "codesloop/nthread/executor.hh"
+#include "codesloop/nthread/event.hh"
+#include "codesloop/nthread/mutex.hh"
+#include "codesloop/common/common.h"
+#include "codesloop/common/logger.hh"
+#include <vector>
+#include <deque>
+
+/**
+  @file executor.cc
+  @brief implementation of the work-stealing executor
+ */
+
+namespace csl
+{
+  namespace nthread
+  {
+    namespace
+    {
+      typedef executor::task task_t;
+
+      /*
+      ** Chase-Lev work-stealing deque. the owner pushes and takes at the bottom,
+      ** thieves steal at the top. the array grows when full, the old arrays are
+      ** kept until destruction as thieves may still read from them.
+      */
+      class ws_deque
+      {
+        private:
+          struct array
+          {
+            long long   size_;
+            task_t **   items_;
+
+            array(long long sz) : size_(sz), items_(new task_t*[sz]) { }
+            ~array() { delete [] items_; }
+
+            inline task_t * get(long long i) const   { return items_[i & (size_-1)]; }
+            inline void put(long long i, task_t * t) { items_[i & (size_-1)] = t; }
+          };
+
+          volatile long long  top_;
+          char                pad1_[64-sizeof(long long)];
+          volatile long long  bottom_;
+          char                pad2_[64-sizeof(long long)];
+          array * volatile    array_;
+          std::vector<array *> old_;
+
+          void grow(long long b, long long t)
+          {
+            array * a = array_;
+            array * n = new array(a->size_*2);
+            for( long long i=t;i<b;++i ) n->put( i, a->get(i) );
+            old_.push_back( a );
+            __sync_synchronize();
+            array_ = n;
+          }
+
+        public:
+          ws_deque() : top_(0), bottom_(0), array_(new array(256)) { }
+
+          ~ws_deque()
+          {
+            delete array_;
+            for( std::vector<array *>::iterator it=old_.begin();it!=old_.end();++it ) delete *it;
+          }
+
+          /* owner only */
+          void push(task_t * t)
+          {
+            long long b = bottom_;
+            long long tp = top_;
+            __sync_synchronize();
+            if( b - tp >= array_->size_ - 1 ) grow( b, tp );
+            array_->put( b, t );
+            __sync_synchronize();
+            bottom_ = b+1;
+          }
+
+          /* owner only */
+          task_t * take()
+          {
+            long long b = bottom_ - 1;
+            array * a = array_;
+            bottom_ = b;
+            __sync_synchronize();
+            long long t = top_;
+
+            if( t > b )
+            {
+              // empty
+              bottom_ = b+1;
+              return 0;
+            }
+
+            task_t * ret = a->get(b);
+            if( t == b )
+            {
+              // last item, race against the thieves
+              if( !__sync_bool_compare_and_swap( &top_, t, t+1 ) ) ret = 0;
+              bottom_ = b+1;
+            }
+            return ret;
+          }
+
+          /* any thread */
+          task_t * steal()
+          {
+            long long t = top_;
+            __sync_synchronize();
+            long long b = bottom_;
+
+            if( t >= b ) return 0;
+
+            array * a = array_;
+            task_t * ret = a->get(t);
+            if( !__sync_bool_compare_and_swap( &top_, t, t+1 ) ) return 0;
+            return ret;
+          }
+
+          long long size() const
+          {
+            long long s = bottom_ - top_;
+            return (s < 0 ? 0 : s);
+          }
+      };
+
+      /* runs a thread::callback without owning it */
+      class callback_task : public task_t
+      {
+        public:
+          inline explicit callback_task(thread::callback & cb) : cb_(&cb) {}
+          virtual void operator()(void) { (*cb_)(); }
+          virtual ~callback_task() {}
+        private:
+          thread::callback * cb_;
+      };
+
+      struct worker;
+
+      /* the worker that runs on the current thread */
+      __thread worker * tls_worker_ = 0;
+    }
+
+    struct executor::impl
+    {
+      enum { park_timeout_ms_ = 100 };
+
+      typedef std::vector<worker *> workers_t;
+      typedef std::deque<task_t *>  injected_t;
+
+      executor *                  ex_;
+      workers_t                   workers_;
+      mutex                       inj_mtx_;
+      injected_t                  injected_;
+      volatile long long          n_injected_;
+      event                       park_ev_;
+      volatile int                n_idle_;
+      volatile int                running_;
+      volatile int                stop_;
+      volatile unsigned long long executed_;
+      volatile unsigned long long stolen_;
+
+      impl(executor * ex)
+        : ex_(ex), n_injected_(0), n_idle_(0), running_(0), stop_(0),
+          executed_(0), stolen_(0), use_exc_(true) {}
+
+      ~impl() { stop(); }
+
+      bool start(unsigned int n_workers);
+      bool stop();
+      bool submit(task_t * t);
+      void run(worker * w);
+      task_t * find_task(worker * w);
+      task_t * pop_injected();
+      void execute(task_t * t);
+      long long pending();
+
+      CSL_OBJ(csl::nthread,executor::impl);
+      USE_EXC();
+    };
+
+    namespace
+    {
+      class worker_entry : public thread::callback
+      {
+        public:
+          inline worker_entry(executor::impl * ex, worker * w) : ex_(ex), w_(w) {}
+          virtual void operator()(void) { ex_->run(w_); }
+          virtual ~worker_entry() {}
+        private:
+          executor::impl * ex_;
+          worker *         w_;
+      };
+
+      struct worker
+      {
+        executor::impl *  ex_;
+        ws_deque          dq_;
+        unsigned int      id_;
+        unsigned int      rnd_;
+        worker_entry      entry_;
+        thread            thr_;
+
+        worker(executor::impl * ex, unsigned int id)
+          : ex_(ex), id_(id), rnd_(id*2654435761U+1), entry_(ex,this)
+        {
+          thr_.set_entry( entry_ );
+        }
+
+        inline unsigned int next_rnd()
+        {
+          // xorshift32
+          rnd_ ^= rnd_ << 13;
+          rnd_ ^= rnd_ >> 17;
+          rnd_ ^= rnd_ << 5;
+          return rnd_;
+        }
+      };
+    }
+
+    bool executor::impl::start(unsigned int n_workers)
+    {
+      ENTER_FUNCTION();
+
+      if( n_workers == 0 || n_workers > 2000 ) { THR(nthread::exc::rs_invalid_param, false); }
+      if( running_ )                           { THR(nthread::exc::rs_start_error, false); }
+
+      stop_    = 0;
+      n_idle_  = 0;
+
+      for( unsigned int i=0;i<n_workers;++i )
+      {
+        workers_.push_back( new worker(this,i) );
+      }
+
+      running_ = 1;
+      __sync_synchronize();
+
+      bool ret = true;
+      for( workers_t::iterator it=workers_.begin();it!=workers_.end();++it )
+      {
+        if( (*it)->thr_.start() == false || (*it)->thr_.start_event().wait(10000) == false )
+        {
+          ret = false;
+        }
+      }
+
+      if( ret == false )
+      {
+        stop();
+        THR(nthread::exc::rs_start_error, false);
+      }
+
+      CSL_DEBUGF( L"executor started with %d workers",n_workers );
+      RETURN_FUNCTION( true );
+    }
+
+    bool executor::impl::stop()
+    {
+      ENTER_FUNCTION();
+      bool ret = true;
+
+      if( workers_.size() == 0 ) RETURN_FUNCTION( true );
+
+      {
+        // submit() checks stop_ under the same lock, so no injected task is pushed after this
+        scoped_mutex m(inj_mtx_);
+        stop_ = 1;
+        __sync_synchronize();
+      }
+
+      park_ev_.notify( static_cast<unsigned int>(workers_.size()) );
+
+      for( workers_t::iterator it=workers_.begin();it!=workers_.end();++it )
+      {
+        // idle workers may have eaten each other's notification, repeat it
+        while( (*it)->thr_.exit_event().wait(park_timeout_ms_) == false )
+        {
+          if( (*it)->thr_.is_started() == false ) break;
+          park_ev_.notify( static_cast<unsigned int>(workers_.size()) );
+        }
+      }
+
+      {
+        scoped_mutex m(inj_mtx_);
+        running_ = 0;
+        __sync_synchronize();
+      }
+
+      // delete the tasks that were submitted too late
+      for( workers_t::iterator it=workers_.begin();it!=workers_.end();++it )
+      {
+        task_t * t = 0;
+        while( (t=(*it)->dq_.take()) != 0 ) delete t;
+        delete *it;
+      }
+      workers_.clear();
+
+      {
+        scoped_mutex m(inj_mtx_);
+        for( injected_t::iterator it=injected_.begin();it!=injected_.end();++it ) delete *it;
+        injected_.clear();
+        n_injected_ = 0;
+      }
+
+      park_ev_.clear_available();
+      RETURN_FUNCTION( ret );
+    }
+
+    bool executor::impl::submit(task_t * t)
+    {
+      if( !t ) return false;
+
+      worker * w = tls_worker_;
+      bool own = (w != 0 && w->ex_ == this);
+
+      if( own )
+      {
+        // workers may still spawn tasks while draining the queues at stop
+        if( !running_ ) { delete t; return false; }
+        w->dq_.push( t );
+      }
+      else
+      {
+        bool accepted = false;
+        {
+          // checked and pushed under the lock stop() sets the flags with
+          scoped_mutex m(inj_mtx_);
+          if( running_ && !stop_ )
+          {
+            injected_.push_back( t );
+            __sync_fetch_and_add( &n_injected_, 1 );
+            accepted = true;
+          }
+        }
+        if( !accepted ) { delete t; return false; }
+      }
+
+      // pairs with the n_idle_ increment + recheck in run()
+      __sync_synchronize();
+      if( n_idle_ > 0 ) park_ev_.notify();
+
+      return true;
+    }
+
+    task_t * executor::impl::pop_injected()
+    {
+      if( n_injected_ <= 0 ) return 0;
+
+      task_t * ret = 0;
+      {
+        scoped_mutex m(inj_mtx_);
+        if( !injected_.empty() )
+        {
+          ret = injected_.front();
+          injected_.pop_front();
+          __sync_fetch_and_sub( &n_injected_, 1 );
+        }
+      }
+      return ret;
+    }
+
+    task_t * executor::impl::find_task(worker * w)
+    {
+      task_t * ret = w->dq_.take();
+      if( ret ) return ret;
+
+      ret = pop_injected();
+      if( ret ) return ret;
+
+      unsigned int n = static_cast<unsigned int>(workers_.size());
+      if( n < 2 ) return 0;
+
+      unsigned int start = w->next_rnd() % n;
+      for( unsigned int i=0;i<n;++i )
+      {
+        worker * victim = workers_[(start+i)%n];
+        if( victim == w ) continue;
+
+        if( (ret = victim->dq_.steal()) != 0 )
+        {
+          __sync_fetch_and_add( &stolen_, 1 );
+          return ret;
+        }
+      }
+      return 0;
+    }
+
+    void executor::impl::execute(task_t * t)
+    {
+      try
+      {
+        (*t)();
+      }
+      catch( ... )
+      {
+        // tasks are not supposed to throw, but a worker must not die because of them
+        CSL_DEBUGF( L"task %p has thrown an exception",t );
+      }
+      delete t;
+      __sync_fetch_and_add( &executed_, 1 );
+    }
+
+    void executor::impl::run(worker * w)
+    {
+      tls_worker_ = w;
+
+      for( ;; )
+      {
+        task_t * t = find_task(w);
+        if( t ) { execute(t); continue; }
+
+        if( stop_ )
+        {
+          // a task injected right before stop_ was set may have been missed above
+          if( (t=pop_injected()) != 0 ) { execute(t); continue; }
+          break;
+        }
+
+        // announce that we are going to park, then check the queues once more
+        __sync_fetch_and_add( &n_idle_, 1 );
+
+        t = find_task(w);
+        if( t )
+        {
+          __sync_fetch_and_sub( &n_idle_, 1 );
+          execute(t);
+          continue;
+        }
+
+        if( stop_ )
+        {
+          __sync_fetch_and_sub( &n_idle_, 1 );
+          // a task injected right before stop_ was set may have been missed above
+          if( (t=pop_injected()) != 0 ) { execute(t); continue; }
+          break;
+        }
+
+        park_ev_.wait( park_timeout_ms_ );
+        __sync_fetch_and_sub( &n_idle_, 1 );
+      }
+
+      tls_worker_ = 0;
+    }
+
+    long long executor::impl::pending()
+    {
+      long long ret = n_injected_;
+      for( workers_t::iterator it=workers_.begin();it!=workers_.end();++it )
+      {
+        ret += (*it)->dq_.size();
+      }
+      return ret;
+    }
+
+    /* forwarding functions */
+    executor::executor() : impl_(new impl(this)) { }
+    executor::~executor() { }
+
+    bool executor::start(unsigned int n_workers) { return impl_->start(n_workers); }
+    bool executor::stop()                        { return impl_->stop(); }
+    bool executor::submit(task * t)              { return impl_->submit(t); }
+
+    bool executor::submit_callback(thread::callback & cb)
+    {
+      return impl_->submit( new callback_task(cb) );
+    }
+
+    unsigned int executor::n_workers()
+    {
+      return static_cast<unsigned int>(impl_->workers_.size());
+    }
+
+    unsigned long long executor::pending_count()
+    {
+      long long ret = impl_->pending();
+      return (ret < 0 ? 0 : static_cast<unsigned long long>(ret));
+    }
+
+    unsigned long long executor::executed_count()
+    {
+      return __sync_fetch_and_add( &(impl_->executed_), 0 );
+    }
+
+    unsigned long long executor::stolen_count()
+    {
+      return __sync_fetch_and_add( &(impl_->stolen_), 0 );
+    }
+
+    bool executor::is_worker()
+    {
+      worker * w = tls_worker_;
+      return (w != 0 && w->ex_ == impl_.get());
+    }
+
+    executor * executor::current()
+    {
+      worker * w = tls_worker_;
+      return (w != 0 ? w->ex_->ex_ : 0);
+    }
+
+    /* no copy */
+    executor::executor(const executor & other) : impl_(reinterpret_cast<impl *>(0)) { }
+    executor & executor::operator=(const executor & other) { return *this; }
+  }
+}
+
+/* EOF */
@@ -0,0 +1,178 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _csl_nthread_executor_hh_included_
+#define _csl_nthread_executor_hh_included_
+
+/**
+   @file executor.hh
+   @brief work-stealing task executor
+ */
+
+#include "codesloop/nthread/thread.hh"
+#include "codesloop/common/common.h"
+#include "codesloop/common/obj.hh"
+#ifdef __cplusplus
+#include <memory>
+
+namespace csl
+{
+  namespace nthread
+  {
+    /**
+       @brief runs arbitrary tasks on a fixed set of worker threads
+
+       every worker owns a Chase-Lev deque. tasks submitted from a worker thread
+       are pushed to the bottom of its own deque and popped in LIFO order, which
+       keeps the hot data in cache. idle workers steal from the top of the others'
+       deques. tasks submitted from non-worker threads go to a global injection
+       queue that is polled by the workers.
+
+       idle workers park on an event, but submit() only touches that event when
+       there is at least one parked worker, so a busy executor does not funnel
+       every task through a single contended event (which is what thrpool does).
+
+       tasks are heap allocated objects derived from executor::task. the executor
+       takes ownership and deletes them after they ran. make_task() wraps any
+       callable (function pointer, functor) into a task. thrpool style users
+       may submit their existing thread::callback objects with submit_callback().
+
+       @code
+       executor ex;
+       ex.start(4);
+       ex.submit( executor::make_task(my_function) );
+       ex.stop();
+       @endcode
+      */
+    class executor : public csl::common::obj
+    {
+      public:
+        /** @brief the abstract base class of the tasks */
+        class task
+        {
+          public:
+            virtual void operator()(void) = 0;
+            virtual ~task() {}
+        };
+
+        /** @brief wraps a copyable callable into a task */
+        template <typename F> class fun_task : public task
+        {
+          public:
+            inline explicit fun_task(const F & f) : f_(f) {}
+            virtual void operator()(void) { f_(); }
+            virtual ~fun_task() {}
+          private:
+            F f_;
+        };
+
+        /** @brief creates a task from a copyable callable */
+        template <typename F> static inline task * make_task(F f)
+        {
+          return new fun_task<F>(f);
+        }
+
+        /** @brief constructor */
+        executor();
+
+        /** @brief destructor, stops the workers if they are still running */
+        virtual ~executor();
+
+        /**
+           @brief launches the worker threads
+           @param n_workers is the number of workers to be started (1..2000)
+           @return true if all workers started
+          */
+        bool start(unsigned int n_workers);
+
+        /**
+           @brief stops the workers
+           @return true if all workers exited
+
+           the queued tasks are executed before the workers exit. tasks submitted
+           after stop() was called are deleted without being run.
+          */
+        bool stop();
+
+        /**
+           @brief submits a task
+           @param t is the task, the executor takes its ownership
+           @return false if the executor is not running (t is deleted then)
+
+           may be called from any thread, including the workers
+          */
+        bool submit(task * t);
+
+        /** @brief submits a callable, a shorthand for submit(make_task(f)) */
+        template <typename F> inline bool submit_fun(F f)
+        {
+          return submit( make_task(f) );
+        }
+
+        /**
+           @brief submits a thread::callback, which is not owned by the executor
+
+           a thrpool handler may be submitted where the pool's event would be
+           notified. tcp::lstnr and udp::recvr still run on their own thrpool,
+           they have no executor hook.
+          */
+        bool submit_callback(thread::callback & cb);
+
+        /** @brief the number of workers */
+        unsigned int n_workers();
+
+        /** @brief number of tasks waiting to be executed (approximate) */
+        unsigned long long pending_count();
+
+        /** @brief number of tasks executed so far */
+        unsigned long long executed_count();
+
+        /** @brief number of tasks stolen from other workers */
+        unsigned long long stolen_count();
+
+        /** @brief true if the calling thread is a worker of this executor */
+        bool is_worker();
+
+        /** @brief the executor of the calling worker thread or NULL */
+        static executor * current();
+
+        struct impl;
+
+      private:
+        std::auto_ptr<impl> impl_;
+
+        // no-copy
+        executor(const executor & other);
+        executor & operator=(const executor & other);
+
+        CSL_OBJ(csl::nthread,executor);
+    };
+  }
+}
+
+#endif /* __cplusplus */
+#endif /* _csl_nthread_executor_hh_included_ */
+
+/* EOF */
@@ -0,0 +1,117 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _csl_nthread_futex_linux_hh_included_
+#define _csl_nthread_futex_linux_hh_included_
+
+/**
+   @file futex_linux.hh
+   @brief thin wrappers over the Linux futex(2) system call
+
+   used by the futex based event and mutex implementations only
+*/
+
+#include "codesloop/common/common.h"
+#ifdef __cplusplus
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+namespace csl
+{
+  namespace nthread
+  {
+    namespace futex
+    {
+      /** @brief blocks while *addr == val, or until the relative timeout expires (NULL: forever) */
+      inline int wait(volatile int * addr, int val, const struct timespec * rel)
+      {
+        return static_cast<int>(::syscall( SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, rel, 0, 0 ));
+      }
+
+      /** @brief wakes up at most n threads blocked on addr */
+      inline int wake(volatile int * addr, int n)
+      {
+        return static_cast<int>(::syscall( SYS_futex, addr, FUTEX_WAKE_PRIVATE, n, 0, 0, 0 ));
+      }
+
+      /** @brief helps waiting with a timeout across spurious wakeups */
+      class deadline
+      {
+        public:
+          /** @param timeout_ms is the timeout, 0 means infinite */
+          explicit deadline(unsigned long timeout_ms) : infinite_(timeout_ms == 0)
+          {
+            if( !infinite_ )
+            {
+              ::clock_gettime( CLOCK_MONOTONIC, &end_ );
+              end_.tv_sec  += timeout_ms / 1000;
+              end_.tv_nsec += (timeout_ms % 1000) * 1000000L;
+              if( end_.tv_nsec >= 1000000000L )
+              {
+                end_.tv_sec  += 1;
+                end_.tv_nsec -= 1000000000L;
+              }
+            }
+          }
+
+          /**
+             @brief calculates the remaining time
+             @return NULL if infinite, ts if there is time left, or sets expired
+           */
+          const struct timespec * remaining(struct timespec & ts, bool & expired) const
+          {
+            expired = false;
+            if( infinite_ ) return 0;
+
+            struct timespec now;
+            ::clock_gettime( CLOCK_MONOTONIC, &now );
+
+            ts.tv_sec  = end_.tv_sec - now.tv_sec;
+            ts.tv_nsec = end_.tv_nsec - now.tv_nsec;
+            if( ts.tv_nsec < 0 )
+            {
+              ts.tv_sec  -= 1;
+              ts.tv_nsec += 1000000000L;
+            }
+            if( ts.tv_sec < 0 || (ts.tv_sec == 0 && ts.tv_nsec == 0) ) expired = true;
+            return &ts;
+          }
+
+        private:
+          bool             infinite_;
+          struct timespec  end_;
+      };
+    }
+  }
+}
+
+#endif /* __cplusplus */
+#endif /* _csl_nthread_futex_linux_hh_included_ */
+
+/* EOF */
@@ -0,0 +1,487 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _csl_nthread_future_hh_included_
+#define _csl_nthread_future_hh_included_
+
+/**
+   @file future.hh
+   @brief futures, promises and continuations
+ */
+
+#include "codesloop/nthread/event.hh"
+#include "codesloop/nthread/executor.hh"
+#include "codesloop/common/common.h"
+#ifdef __cplusplus
+#include <vector>
+
+namespace csl
+{
+  namespace nthread
+  {
+    template <typename T> class future;
+    template <typename T> class promise;
+
+    /**
+       @brief the state shared by a promise and its futures (internal)
+
+       the state has no mutex: the value is published by a CAS on state_ and the
+       continuations are kept in a lock-free stack that is closed (swapped for
+       the closed_ marker) when the value is set. a continuation added after
+       that runs immediately in the adding thread. blocking waits are built on
+       continuations that notify an event.
+      */
+    template <typename T> class future_state
+    {
+      public:
+        enum { pending_ = 0, setting_ = 1, ready_ = 2 };
+
+        /** @brief a callback run when the state is ready */
+        class cont
+        {
+          public:
+            cont() : next_(0) {}
+            virtual void run(future_state<T> & s) = 0;
+            virtual ~cont() {}
+            cont * next_;
+        };
+
+        future_state() : refs_(1), promises_(0), state_(pending_), failed_(false), conts_(0) {}
+
+        inline void ref()   { __sync_fetch_and_add( &refs_, 1 ); }
+        inline void unref() { if( __sync_sub_and_fetch( &refs_, 1 ) == 0 ) delete this; }
+
+        inline void promise_ref() { __sync_fetch_and_add( &promises_, 1 ); }
+
+        /* the last promise gone without setting the value breaks the future */
+        inline void promise_unref()
+        {
+          if( __sync_sub_and_fetch( &promises_, 1 ) == 0 ) set_failed();
+        }
+
+        inline bool is_ready() const { return (state_ == ready_); }
+        inline bool failed() const   { return failed_; }
+        inline const T & value() const { return value_; }
+
+        bool set_value(const T & v)
+        {
+          if( !__sync_bool_compare_and_swap( &state_, pending_, setting_ ) ) return false;
+          value_ = v;
+          publish();
+          return true;
+        }
+
+        bool set_failed()
+        {
+          if( !__sync_bool_compare_and_swap( &state_, pending_, setting_ ) ) return false;
+          failed_ = true;
+          publish();
+          return true;
+        }
+
+        /** @brief takes ownership of c, runs it when ready (maybe right now) */
+        void add(cont * c)
+        {
+          for( ;; )
+          {
+            cont * head = conts_;
+            if( head == closed() )
+            {
+              c->run( *this );
+              delete c;
+              return;
+            }
+            c->next_ = head;
+            if( __sync_bool_compare_and_swap( &conts_, head, c ) ) return;
+          }
+        }
+
+      private:
+        static inline cont * closed() { return reinterpret_cast<cont *>(1); }
+
+        void publish()
+        {
+          __sync_synchronize();
+          state_ = ready_;
+
+          cont * c = __sync_lock_test_and_set( &conts_, closed() );
+          __sync_synchronize();
+
+          // run them in the order they were added
+          cont * rev = 0;
+          while( c ) { cont * n = c->next_; c->next_ = rev; rev = c; c = n; }
+          while( rev )
+          {
+            cont * n = rev->next_;
+            rev->run( *this );
+            delete rev;
+            rev = n;
+          }
+        }
+
+        ~future_state()
+        {
+          cont * c = conts_;
+          while( c && c != closed() ) { cont * n = c->next_; delete c; c = n; }
+        }
+
+        volatile int     refs_;
+        volatile int     promises_;
+        volatile int     state_;
+        volatile bool    failed_;
+        T                value_;
+        cont * volatile  conts_;
+
+        future_state(const future_state & other);
+        future_state & operator=(const future_state & other);
+    };
+
+    /**
+       @brief result type of a continuation taking a T
+
+       function pointers are recognized, functors should define result_type
+       (like the std::unary_function derived ones).
+      */
+    template <typename F> struct cont_result           { typedef typename F::result_type type; };
+    template <typename R, typename A> struct cont_result<R (*)(A)> { typedef R type; };
+
+    /**
+       @brief the consumer side of an asynchronous result
+
+       futures are cheap, reference counted handles. copies refer to the same
+       result. the value type must be default constructible and copyable.
+
+       then() chains a continuation that gets the value and whose return value
+       becomes the value of the returned future. the continuation either runs
+       in the thread that sets the value, or as a task on an executor. when the
+       value could not be produced (the promise was dropped or set_failed() was
+       called) the continuations are not called, the failure is propagated.
+
+       @code
+       promise<int> p;
+       future<int>  f( p.get_future() );
+       future<double> g( f.then( ex, half ) );  // double half(int)
+       p.set_value(42);
+       assert( g.get() == 21.0 );
+       @endcode
+      */
+    template <typename T> class future
+    {
+      public:
+        typedef future_state<T> state_t;
+        typedef typename state_t::cont cont_t;
+
+        future() : s_(0) {}
+        future(const future & other) : s_(other.s_) { if( s_ ) s_->ref(); }
+        ~future() { if( s_ ) s_->unref(); }
+
+        future & operator=(const future & other)
+        {
+          if( other.s_ ) other.s_->ref();
+          if( s_ ) s_->unref();
+          s_ = other.s_;
+          return *this;
+        }
+
+        /** @brief true if the future is bound to a promise */
+        inline bool valid() const { return (s_ != 0); }
+
+        /** @brief true if the value is set or the promise failed */
+        inline bool is_ready() const { return (s_ && s_->is_ready()); }
+
+        /** @brief true if the promise failed (only meaningful when ready) */
+        inline bool failed() const { return (!s_ || s_->failed()); }
+
+        /**
+           @brief waits for the result
+           @param timeout_ms is the timeout, 0 means infinite
+           @return true if ready, false on timeout
+          */
+        bool wait(unsigned long timeout_ms=0) const
+        {
+          if( !s_ ) return false;
+          if( s_->is_ready() ) return true;
+
+          waiter * w = new waiter();
+          w->ref();
+          s_->add( new notify_cont(w) );
+          bool ret = w->ev_.wait( timeout_ms );
+          w->unref();
+          return (ret || s_->is_ready());
+        }
+
+        /**
+           @brief waits for the result and returns the value
+           @return the value or a default constructed one if failed()
+          */
+        const T & get() const
+        {
+          static const T empty_ = T();
+          if( !wait() || s_->failed() ) return empty_;
+          return s_->value();
+        }
+
+        /** @brief runs f(value) in the thread that sets the value (or here, if ready) */
+        template <typename F>
+        future<typename cont_result<F>::type> then(F f) const
+        {
+          typedef typename cont_result<F>::type R;
+          promise<R> p;
+          future<R> ret( p.get_future() );
+          if( s_ ) s_->add( new inline_cont<F,R>(f,p) );
+          return ret;
+        }
+
+        /** @brief runs f(value) as a task on the given executor */
+        template <typename F>
+        future<typename cont_result<F>::type> then(executor & ex, F f) const
+        {
+          typedef typename cont_result<F>::type R;
+          promise<R> p;
+          future<R> ret( p.get_future() );
+          if( s_ ) s_->add( new exec_cont<F,R>(ex,f,p) );
+          return ret;
+        }
+
+        /** @brief adds a low level continuation, for the combinators */
+        inline void add_cont(cont_t * c) const { if( s_ ) s_->add(c); else delete c; }
+
+      private:
+        friend class promise<T>;
+        explicit future(state_t * s) : s_(s) { if( s_ ) s_->ref(); }
+
+        /* blocking waits: the event outlives a timed out waiter */
+        class waiter
+        {
+          public:
+            waiter() : refs_(1) {}
+            void ref()   { __sync_fetch_and_add( &refs_, 1 ); }
+            void unref() { if( __sync_sub_and_fetch( &refs_, 1 ) == 0 ) delete this; }
+            event         ev_;
+          private:
+            volatile int  refs_;
+        };
+
+        class notify_cont : public cont_t
+        {
+          public:
+            notify_cont(waiter * w) : w_(w) {}
+            virtual void run(state_t & s) { w_->ev_.notify(); }
+            virtual ~notify_cont() { w_->unref(); }
+          private:
+            waiter * w_;
+        };
+
+        template <typename F, typename R> class inline_cont : public cont_t
+        {
+          public:
+            inline_cont(const F & f, const promise<R> & p) : f_(f), p_(p) {}
+            virtual void run(state_t & s)
+            {
+              if( s.failed() ) p_.set_failed();
+              else             p_.set_value( f_( s.value() ) );
+            }
+            virtual ~inline_cont() {}
+          private:
+            F           f_;
+            promise<R>  p_;
+        };
+
+        template <typename F, typename R> class exec_task : public executor::task
+        {
+          public:
+            exec_task(const F & f, const promise<R> & p, state_t * s) : f_(f), p_(p), s_(s) { s_->ref(); }
+            virtual void operator()(void) { p_.set_value( f_( s_->value() ) ); }
+            virtual ~exec_task() { s_->unref(); }
+          private:
+            F           f_;
+            promise<R>  p_;
+            state_t *   s_;
+        };
+
+        template <typename F, typename R> class exec_cont : public cont_t
+        {
+          public:
+            exec_cont(executor & ex, const F & f, const promise<R> & p) : ex_(ex), f_(f), p_(p) {}
+            virtual void run(state_t & s)
+            {
+              // if the executor does not take it, the dropped promise fails the result
+              if( s.failed() ) p_.set_failed();
+              else             ex_.submit( new exec_task<F,R>(f_,p_,&s) );
+            }
+            virtual ~exec_cont() {}
+          private:
+            executor &  ex_;
+            F           f_;
+            promise<R>  p_;
+        };
+
+        state_t * s_;
+    };
+
+    /**
+       @brief the producer side of an asynchronous result
+
+       copies refer to the same result. when the last copy is destroyed without
+       setting the value, the futures fail.
+      */
+    template <typename T> class promise
+    {
+      public:
+        typedef future_state<T> state_t;
+
+        promise() : s_(new state_t()) { s_->promise_ref(); }
+        promise(const promise & other) : s_(other.s_) { s_->ref(); s_->promise_ref(); }
+        ~promise() { s_->promise_unref(); s_->unref(); }
+
+        promise & operator=(const promise & other)
+        {
+          other.s_->ref();
+          other.s_->promise_ref();
+          s_->promise_unref();
+          s_->unref();
+          s_ = other.s_;
+          return *this;
+        }
+
+        /** @brief returns a future bound to this promise */
+        inline future<T> get_future() const { return future<T>(s_); }
+
+        /**
+           @brief sets the value and runs the continuations
+           @return false if the value was already set
+          */
+        inline bool set_value(const T & v) const { return s_->set_value(v); }
+
+        /** @brief fails the futures */
+        inline bool set_failed() const { return s_->set_failed(); }
+
+        inline bool is_ready() const { return s_->is_ready(); }
+
+      private:
+        state_t * s_;
+    };
+
+    /* helpers of when_all() and when_any() */
+    template <typename T> class when_all_state
+    {
+      public:
+        typedef std::vector<T> result_t;
+
+        when_all_state(size_t n) : refs_(1), left_(static_cast<long>(n)), failed_(0), values_(n) {}
+
+        void ref()   { __sync_fetch_and_add( &refs_, 1 ); }
+        void unref() { if( __sync_sub_and_fetch( &refs_, 1 ) == 0 ) delete this; }
+
+        void done(size_t i, const future_state<T> & s)
+        {
+          if( s.failed() ) failed_ = 1;
+          else             values_[i] = s.value();
+
+          if( __sync_sub_and_fetch( &left_, 1 ) == 0 )
+          {
+            __sync_synchronize();
+            if( failed_ ) p_.set_failed();
+            else          p_.set_value( values_ );
+          }
+        }
+
+        promise<result_t>  p_;
+
+      private:
+        volatile int       refs_;
+        volatile long      left_;
+        volatile int       failed_;
+        result_t           values_;
+    };
+
+    template <typename T> class when_all_cont : public future_state<T>::cont
+    {
+      public:
+        when_all_cont(when_all_state<T> * w, size_t i) : w_(w), i_(i) { w_->ref(); }
+        virtual void run(future_state<T> & s) { w_->done(i_,s); }
+        virtual ~when_all_cont() { w_->unref(); }
+      private:
+        when_all_state<T> *  w_;
+        size_t               i_;
+    };
+
+    /**
+       @brief a future of all the values
+
+       ready when all inputs are ready. fails if any of them failed. an empty
+       input gives a ready, empty vector.
+      */
+    template <typename T>
+    future< std::vector<T> > when_all(const std::vector< future<T> > & fs)
+    {
+      when_all_state<T> * w = new when_all_state<T>(fs.size());
+      future< std::vector<T> > ret( w->p_.get_future() );
+
+      if( fs.empty() ) w->p_.set_value( std::vector<T>() );
+
+      for( size_t i=0;i<fs.size();++i )
+      {
+        fs[i].add_cont( new when_all_cont<T>(w,i) );
+      }
+      w->unref();
+      return ret;
+    }
+
+    template <typename T> class when_any_cont : public future_state<T>::cont
+    {
+      public:
+        when_any_cont(const promise<size_t> & p, size_t i) : p_(p), i_(i) {}
+        virtual void run(future_state<T> & s) { if( !s.failed() ) p_.set_value(i_); }
+        virtual ~when_any_cont() {}
+      private:
+        promise<size_t>  p_;
+        size_t           i_;
+    };
+
+    /**
+       @brief a future of the index of the first input that got a value
+
+       fails if all of the inputs failed, or the input is empty
+      */
+    template <typename T>
+    future<size_t> when_any(const std::vector< future<T> > & fs)
+    {
+      promise<size_t> p;
+      future<size_t> ret( p.get_future() );
+
+      for( size_t i=0;i<fs.size();++i )
+      {
+        fs[i].add_cont( new when_any_cont<T>(p,i) );
+      }
+      return ret;
+    }
+  }
+}
+
+#endif /* __cplusplus */
+#endif /* _csl_nthread_future_hh_included_ */
+
+/* EOF */
@@ -0,0 +1,121 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "codesloop/nthread/lock_stats.hh"
+#include "codesloop/common/common.h"
+#include <stdio.h>
+
+/**
+  @file lock_stats.cc
+  @brief implementation of lock_stats
+ */
+
+namespace csl
+{
+  namespace nthread
+  {
+    lock_stats::lock_stats() : enabled_(false), wait_hist_(0), hold_hist_(0)
+    {
+      ::memset( &data_, 0, sizeof(data_) );
+    }
+
+    void lock_stats::enable(const char * name)
+    {
+      if( name && !wait_hist_ )
+      {
+        char tmp[common::metrics::max_name_len_];
+        common::metrics & m(common::metrics::instance());
+
+        ::snprintf( tmp, sizeof(tmp), "%s.wait_usec", name );
+        common::metrics::histogram * wh = &(m.get_histogram(tmp));
+
+        ::snprintf( tmp, sizeof(tmp), "%s.hold_usec", name );
+        common::metrics::histogram * hh = &(m.get_histogram(tmp));
+
+        hold_hist_ = hh;
+        wait_hist_ = wh;
+      }
+      __sync_synchronize();
+      enabled_ = true;
+    }
+
+    void lock_stats::disable()
+    {
+      enabled_ = false;
+    }
+
+    void lock_stats::reset()
+    {
+      __sync_lock_test_and_set( &data_.acquisitions_, 0 );
+      __sync_lock_test_and_set( &data_.contended_, 0 );
+      __sync_lock_test_and_set( &data_.wait_usec_, 0 );
+      __sync_lock_test_and_set( &data_.max_wait_usec_, 0 );
+      __sync_lock_test_and_set( &data_.hold_usec_, 0 );
+      __sync_lock_test_and_set( &data_.max_hold_usec_, 0 );
+    }
+
+    void lock_stats::get(data & d) const
+    {
+      d.acquisitions_  = __sync_fetch_and_add( const_cast<uint64_t *>(&data_.acquisitions_), 0 );
+      d.contended_     = __sync_fetch_and_add( const_cast<uint64_t *>(&data_.contended_), 0 );
+      d.wait_usec_     = __sync_fetch_and_add( const_cast<uint64_t *>(&data_.wait_usec_), 0 );
+      d.max_wait_usec_ = __sync_fetch_and_add( const_cast<uint64_t *>(&data_.max_wait_usec_), 0 );
+      d.hold_usec_     = __sync_fetch_and_add( const_cast<uint64_t *>(&data_.hold_usec_), 0 );
+      d.max_hold_usec_ = __sync_fetch_and_add( const_cast<uint64_t *>(&data_.max_hold_usec_), 0 );
+    }
+
+    void lock_stats::update_max(uint64_t * where, uint64_t v)
+    {
+      uint64_t old = *where;
+      while( v > old )
+      {
+        uint64_t seen = __sync_val_compare_and_swap( where, old, v );
+        if( seen == old ) break;
+        old = seen;
+      }
+    }
+
+    void lock_stats::on_acquire(uint64_t wait_usec, bool contended)
+    {
+      __sync_fetch_and_add( &data_.acquisitions_, 1 );
+      if( contended )
+      {
+        __sync_fetch_and_add( &data_.contended_, 1 );
+        __sync_fetch_and_add( &data_.wait_usec_, wait_usec );
+        update_max( &data_.max_wait_usec_, wait_usec );
+      }
+      if( wait_hist_ ) wait_hist_->record( wait_usec );
+    }
+
+    void lock_stats::on_release(uint64_t hold_usec)
+    {
+      __sync_fetch_and_add( &data_.hold_usec_, hold_usec );
+      update_max( &data_.max_hold_usec_, hold_usec );
+      if( hold_hist_ ) hold_hist_->record( hold_usec );
+    }
+  }
+}
+
+/* EOF */
@@ -0,0 +1,129 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _csl_nthread_lock_stats_hh_included_
+#define _csl_nthread_lock_stats_hh_included_
+
+/**
+   @file lock_stats.hh
+   @brief contention statistics for the spinning locks
+ */
+
+#include "codesloop/common/common.h"
+#include "codesloop/common/metrics.hh"
+#ifdef __cplusplus
+
+namespace csl
+{
+  namespace nthread
+  {
+    /**
+       @brief hints the CPU that we are in a spin loop
+
+       on x86 this is the pause instruction that saves power and avoids the memory
+       order violation penalty when the spun location changes
+      */
+    inline void cpu_relax()
+    {
+#if defined(__i386__) || defined(__x86_64__)
+      __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+      __asm__ __volatile__ ( "yield" ::: "memory" );
+#else
+      __asm__ __volatile__ ( "" ::: "memory" );
+#endif
+    }
+
+    /**
+       @brief per lock wait and hold time statistics
+
+       the statistics are disabled by default, then the only cost is a branch on
+       enabled(). when enabled every acquisition reads the monotonic clock, so this
+       is meant for finding the hot locks rather than for permanent use.
+
+       if a name is given to enable() the wait and hold times are also recorded
+       into the "<name>.wait_usec" and "<name>.hold_usec" histograms of
+       common::metrics, so they show up in the metrics snapshots.
+      */
+    class lock_stats
+    {
+      public:
+        /** @brief copy of the collected values */
+        struct data
+        {
+          uint64_t  acquisitions_;   ///<number of successful lock operations
+          uint64_t  contended_;      ///<number of lock operations that had to wait
+          uint64_t  wait_usec_;      ///<total time spent waiting for the lock
+          uint64_t  max_wait_usec_;  ///<longest wait
+          uint64_t  hold_usec_;      ///<total time the lock was held (exclusively)
+          uint64_t  max_hold_usec_;  ///<longest hold
+        };
+
+        lock_stats();
+
+        /**
+           @brief starts collecting
+           @param name is an optional metrics name prefix (may be NULL)
+          */
+        void enable(const char * name=0);
+
+        /** @brief stops collecting, the collected values are kept */
+        void disable();
+
+        /** @brief zeros the collected values */
+        void reset();
+
+        /** @brief copies the collected values */
+        void get(data & d) const;
+
+        inline bool enabled() const { return enabled_; }
+
+        /** @brief the time source of the statistics */
+        static inline uint64_t now() { return common::metrics::now_usec(); }
+
+        /** @brief called by the locks when they got the lock */
+        void on_acquire(uint64_t wait_usec, bool contended);
+
+        /** @brief called by the locks before an exclusive holder releases the lock */
+        void on_release(uint64_t hold_usec);
+
+      private:
+        static void update_max(uint64_t * where, uint64_t v);
+
+        volatile bool                 enabled_;
+        data                          data_;
+        common::metrics::histogram *  wait_hist_;
+        common::metrics::histogram *  hold_hist_;
+
+        lock_stats(const lock_stats & other);
+        lock_stats & operator=(const lock_stats & other);
+    };
+  }
+}
+
+#endif /* __cplusplus */
+#endif /* _csl_nthread_lock_stats_hh_included_ */
+
+/* EOF */
@@ -29,7 +29,9 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #ifdef WIN32
 # include "mutex_impl_windows.cc"
-#else /* NOT WIN32 */
+#elif defined(__linux__) && !defined(CSL_NTHREAD_USE_PTHREAD)
+# include "mutex_impl_futex.cc"
+#else /* NOT WIN32, NOT LINUX */
 # include "mutex_impl_pthread.cc"
 #endif /* WIN32 */
 
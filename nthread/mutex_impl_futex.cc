@@ -0,0 +1,176 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "codesloop/nthread/mutex.hh"
+#include "codesloop/nthread/futex_linux.hh"
+#include "codesloop/common/common.h"
+#include <pthread.h>
+
+/**
+  @file mutex_impl_futex.cc
+  @brief futex based implementation of mutex (Linux only)
+
+  the lock word follows the classic three state futex mutex:
+  0 means unlocked, 1 locked without waiters, 2 locked with possible waiters.
+  an uncontended lock() is a single CAS and an uncontended unlock() does
+  not enter the kernel. recursion is handled by the owner only, so it does
+  not need atomic operations.
+
+  unlike the pthread implementation this one does not register a thread
+  specific unlock function, so a thread must not exit while holding the lock.
+*/
+
+namespace csl
+{
+  namespace nthread
+  {
+    struct mutex::impl
+    {
+      volatile int        state_;
+      volatile int        invalid_;
+      volatile int        waiting_;
+      volatile unsigned   locked_;
+      volatile pthread_t  locked_by_;
+
+      impl() : state_(0), invalid_(0), waiting_(0), locked_(0), locked_by_(0) { }
+
+      ~impl()
+      {
+        // tell waiting threads to abort
+        invalid_ = 1;
+        __sync_lock_test_and_set( &state_, 0 );
+        if( waiting_ > 0 ) futex::wake( &state_, INT_MAX );
+        locked_    = 0;
+        locked_by_ = 0;
+      }
+
+      inline bool is_locked_by_me()
+      {
+        pthread_t by = locked_by_;
+        return (by == 0 ? false : pthread_equal(by,pthread_self()));
+      }
+
+      inline void acquired()
+      {
+        locked_by_ = pthread_self();
+        locked_    = 1;
+      }
+
+      inline void release()
+      {
+        locked_by_ = 0;
+        // 1 -> 0 : nobody waits, otherwise wake one waiter up
+        if( __sync_fetch_and_sub( &state_, 1 ) != 1 )
+        {
+          __sync_lock_test_and_set( &state_, 0 );
+          futex::wake( &state_, 1 );
+        }
+      }
+
+      bool lock(unsigned long timeout_ms)
+      {
+        if( invalid_ ) return false;
+
+        // recursive locking
+        if( is_locked_by_me() ) { ++locked_; return true; }
+
+        // fast path
+        if( __sync_bool_compare_and_swap( &state_, 0, 1 ) ) { acquired(); return true; }
+
+        futex::deadline dl( timeout_ms );
+        bool ret = false;
+
+        __sync_fetch_and_add( &waiting_, 1 );
+
+        for( ;; )
+        {
+          // mark the lock contended, if it was free then we own it now
+          if( __sync_lock_test_and_set( &state_, 2 ) == 0 )
+          {
+            if( invalid_ ) { release(); ret = false; }
+            else           { acquired(); ret = true; }
+            break;
+          }
+
+          if( invalid_ ) { ret = false; break; }
+
+          struct timespec ts;
+          bool expired = false;
+          const struct timespec * tp = dl.remaining( ts, expired );
+
+          if( expired ) { ret = false; break; }
+
+          futex::wait( &state_, 2, tp );
+        }
+
+        __sync_fetch_and_sub( &waiting_, 1 );
+        return ret;
+      }
+
+      bool try_lock()
+      {
+        if( invalid_ ) return false;
+        if( is_locked_by_me() ) { ++locked_; return true; }
+        if( __sync_bool_compare_and_swap( &state_, 0, 1 ) ) { acquired(); return true; }
+        return false;
+      }
+
+      bool unlock()
+      {
+        // not locked or locked by someone else ?
+        if( is_locked_by_me() == false ) return false;
+
+        if( --locked_ == 0 ) release();
+        return true;
+      }
+
+      bool recursive_unlock()
+      {
+        if( is_locked_by_me() == false ) return false;
+
+        locked_ = 0;
+        release();
+        return true;
+      }
+
+      bool is_locked()
+      {
+        return (__sync_fetch_and_add( &state_, 0 ) != 0);
+      }
+
+      unsigned int waiting_count()
+      {
+        return static_cast<unsigned int>(__sync_fetch_and_add( &waiting_, 0 ));
+      }
+
+      unsigned int locked_count()
+      {
+        return locked_;
+      }
+    };
+  } /* namespace nthread */
+} /* namespace csl */
+
+/* EOF */
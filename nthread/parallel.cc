@@ -0,0 +1,205 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#if 0
+#ifndef DEBUG
+#define DEBUG
+#define DEBUG_ENABLE_INDENT
+//#define DEBUG_VERBOSE
+#endif /* DEBUG */
+#endif //0
+
+#include "codesloop/nthread/exc.hh"
+#include "codesloop/nthread/parallel.hh"
+#include "codesloop/common/common.h"
+#include "codesloop/common/logger.hh"
+
+/**
+  @file parallel.cc
+  @brief implementation of the parallel job runner
+ */
+
+namespace csl
+{
+  namespace nthread
+  {
+    /*
+    ** one batch is shared by the caller of run() and the workers notified for
+    ** it. it is reference counted because a notification may be picked up
+    ** long after the job was finished by others. the late worker only touches
+    ** the counters, never the job.
+    */
+    struct parallel::batch
+    {
+      parallel::job *   job_;
+      size_t            n_parts_;
+      volatile size_t   next_;
+      volatile size_t   done_;
+      volatile int      refs_;
+      event             done_evt_;
+
+      batch(parallel::job & j, size_t n, int refs)
+        : job_(&j), n_parts_(n), next_(0), done_(0), refs_(refs) { }
+    };
+
+    parallel::parallel() : n_threads_(1), worker_(this) { }
+
+    parallel::~parallel()
+    {
+      stop();
+    }
+
+    bool parallel::start(unsigned int n_threads)
+    {
+      ENTER_FUNCTION();
+
+      if( n_threads == 0 || n_threads > 2000 ) { THR(nthread::exc::rs_invalid_param, false); }
+      if( pool_.count() > 0 )                  { THR(nthread::exc::rs_start_error, false); }
+
+      scoped_mutex m(run_mtx_);
+      n_threads_ = n_threads;
+
+      /* the caller of run() is working too */
+      if( n_threads > 1 )
+      {
+        if( pool_.init( n_threads-1, n_threads-1, 1000, 1, ev_, worker_ ) == false )
+        {
+          n_threads_ = 1;
+          RETURN_FUNCTION(false);
+        }
+      }
+      RETURN_FUNCTION(true);
+    }
+
+    bool parallel::stop()
+    {
+      ENTER_FUNCTION();
+      scoped_mutex m(run_mtx_);
+      bool ret = true;
+
+      if( pool_.count() > 0 )
+      {
+        if( pool_.graceful_stop() == false ) ret = pool_.unpolite_stop();
+      }
+      n_threads_ = 1;
+
+      /* the notifications nobody picked up */
+      std::list<batch *> left;
+      {
+        scoped_mutex q(queue_mtx_);
+        left.swap( queue_ );
+      }
+      for( std::list<batch *>::iterator it=left.begin();it!=left.end();++it )
+        release( *it );
+
+      ev_.clear_available();
+      RETURN_FUNCTION(ret);
+    }
+
+    unsigned int parallel::n_threads()
+    {
+      return n_threads_;
+    }
+
+    size_t parallel::parts_for(size_t n_units, size_t & grain)
+    {
+      if( grain == 0 )
+      {
+        grain = n_units / (n_threads_*parts_per_thread_);
+        if( grain == 0 ) grain = 1;
+      }
+      return (n_units+grain-1)/grain;
+    }
+
+    void parallel::work(batch * b)
+    {
+      while( true )
+      {
+        size_t part = __sync_fetch_and_add( &(b->next_), 1 );
+        if( part >= b->n_parts_ ) break;
+
+        b->job_->run( part );
+
+        if( __sync_add_and_fetch( &(b->done_), 1 ) == b->n_parts_ )
+          b->done_evt_.notify();
+      }
+    }
+
+    void parallel::release(batch * b)
+    {
+      if( __sync_sub_and_fetch( &(b->refs_), 1 ) == 0 ) delete b;
+    }
+
+    void parallel::on_notify()
+    {
+      batch * b = 0;
+      {
+        scoped_mutex q(queue_mtx_);
+        if( queue_.empty() ) return;
+        b = queue_.front();
+        queue_.pop_front();
+      }
+      work( b );
+      release( b );
+    }
+
+    void parallel::run(job & j, size_t n_parts)
+    {
+      ENTER_FUNCTION();
+      if( n_parts == 0 ) { LEAVE_FUNCTION(); }
+
+      scoped_mutex m(run_mtx_);
+
+      size_t n_helpers = n_threads_-1;
+      if( n_helpers > n_parts-1 ) n_helpers = n_parts-1;
+
+      if( n_helpers == 0 )
+      {
+        for( size_t i=0;i<n_parts;++i ) j.run( i );
+        LEAVE_FUNCTION();
+      }
+
+      batch * b = new batch( j, n_parts, static_cast<int>(n_helpers+1) );
+      {
+        scoped_mutex q(queue_mtx_);
+        for( size_t i=0;i<n_helpers;++i ) queue_.push_back( b );
+      }
+      ev_.notify( static_cast<unsigned int>(n_helpers) );
+
+      work( b );
+
+      if( __sync_fetch_and_add( &(b->done_), 0 ) < n_parts ) b->done_evt_.wait();
+
+      release( b );
+      LEAVE_FUNCTION();
+    }
+
+    /* no-copy */
+    parallel::parallel(const parallel & other) : worker_(this) { }
+    parallel & parallel::operator=(const parallel & other) { return *this; }
+  }
+}
+
+/* EOF */
@@ -0,0 +1,340 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _csl_nthread_parallel_hh_included_
+#define _csl_nthread_parallel_hh_included_
+
+/**
+   @file parallel.hh
+   @brief parallel_for and parallel_reduce over inpvec and pvlist
+ */
+
+#include "codesloop/nthread/thrpool.hh"
+#include "codesloop/nthread/event.hh"
+#include "codesloop/nthread/mutex.hh"
+#include "codesloop/common/inpvec.hh"
+#include "codesloop/common/pvlist.hh"
+#include "codesloop/common/common.h"
+#include "codesloop/common/obj.hh"
+#ifdef __cplusplus
+#include <vector>
+#include <list>
+
+namespace csl
+{
+  namespace nthread
+  {
+    /**
+       @brief runs the parts of a job on thrpool workers and the calling thread
+
+       a job is split into numbered parts. run() hands the job to the workers,
+       takes parts itself too and returns when all parts are done. the parts
+       are claimed one by one with an atomic counter, so faster threads simply
+       take more of them.
+
+       the parallel_for() and parallel_reduce() templates below split inpvec
+       containers by their 64 item bitmap blocks and pvlist containers by their
+       chunks, grain blocks or chunks per part.
+
+       @code
+       parallel p;
+       p.start(4);
+       parallel_for( p, sessions, reencrypt );
+       @endcode
+      */
+    class parallel : public csl::common::obj
+    {
+      public:
+        /** @brief a unit of work made of n parts, run(i) may not throw */
+        class job
+        {
+          public:
+            virtual void run(size_t part) = 0;
+            virtual ~job() {}
+        };
+
+        enum { parts_per_thread_ = 4 };  ///<parts per thread when the grain is automatic
+
+        parallel();
+        virtual ~parallel();
+
+        /**
+           @brief starts the workers
+           @param n_threads is the number of threads working on a job, including
+                  the caller of run(), so n_threads-1 workers are started
+           @return true if succeed
+          */
+        bool start(unsigned int n_threads);
+
+        /** @brief stops the workers */
+        bool stop();
+
+        /** @brief the number of threads working on a job */
+        unsigned int n_threads();
+
+        /**
+           @brief runs j.run(0) .. j.run(n_parts-1) in parallel
+           @return when all parts are done
+
+           only one job runs at a time, concurrent run() calls are serialized
+          */
+        void run(job & j, size_t n_parts);
+
+        /** @brief the number of parts for n units and the given grain (0 is automatic) */
+        size_t parts_for(size_t n_units, size_t & grain);
+
+        /* called by the workers */
+        void on_notify();
+
+        struct batch;
+
+      private:
+        void work(batch * b);
+        void release(batch * b);
+
+        class worker : public thread::callback
+        {
+          public:
+            worker(parallel * p) : p_(p) { }
+            virtual void operator()(void) { p_->on_notify(); }
+            virtual ~worker() { }
+          private:
+            parallel * p_;
+        };
+
+        unsigned int         n_threads_;
+        thrpool              pool_;
+        event                ev_;
+        worker               worker_;
+        mutex                run_mtx_;
+        mutex                queue_mtx_;
+        std::list<batch *>   queue_;
+
+        // no-copy
+        parallel(const parallel & other);
+        parallel & operator=(const parallel & other);
+
+        CSL_OBJ(csl::nthread,parallel);
+    };
+
+    /** @brief the parallel_for job over inpvec blocks */
+    template <typename T, typename F> class inpvec_for_job : public parallel::job
+    {
+      public:
+        typedef typename common::inpvec<T>::block block_t;
+
+        inpvec_for_job(std::vector<block_t> & b, F & f, size_t grain)
+          : blocks_(b), f_(f), grain_(grain) { }
+
+        virtual void run(size_t part)
+        {
+          size_t from = part*grain_;
+          size_t to   = from+grain_;
+          if( to > blocks_.size() ) to = blocks_.size();
+          for( size_t i=from;i<to;++i ) common::inpvec<T>::for_each_in( blocks_[i], f_ );
+        }
+
+      private:
+        std::vector<block_t> &  blocks_;
+        F &                     f_;
+        size_t                  grain_;
+    };
+
+    /**
+       @brief calls f(T &) on every item of v in parallel
+       @param grain is the number of 64 item blocks per part, 0 is automatic
+
+       f is shared by the threads, so it must be thread safe. v may not be
+       modified while parallel_for() runs.
+      */
+    template <typename T, typename F>
+    void parallel_for(parallel & p, common::inpvec<T> & v, F & f, size_t grain=0)
+    {
+      std::vector<typename common::inpvec<T>::block> blocks;
+      v.blocks( blocks );
+      if( blocks.empty() ) return;
+      size_t n_parts = p.parts_for( blocks.size(), grain );
+      inpvec_for_job<T,F> j( blocks, f, grain );
+      p.run( j, n_parts );
+    }
+
+    /** @brief the parallel_for job over pvlist chunks */
+    template <typename C, typename T, typename F> class pvlist_for_job : public parallel::job
+    {
+      public:
+        pvlist_for_job(std::vector<C> & c, F & f, size_t grain)
+          : chunks_(c), f_(f), grain_(grain) { }
+
+        virtual void run(size_t part)
+        {
+          size_t from = part*grain_;
+          size_t to   = from+grain_;
+          if( to > chunks_.size() ) to = chunks_.size();
+          for( size_t i=from;i<to;++i )
+          {
+            T ** ptrs = chunks_[i].ptrs_;
+            for( size_t k=0;k<chunks_[i].used_;++k )
+              if( ptrs[k] ) f_( ptrs[k] );
+          }
+        }
+
+      private:
+        std::vector<C> &  chunks_;
+        F &               f_;
+        size_t            grain_;
+    };
+
+    /**
+       @brief calls f(T *) on every non-NULL pointer of l in parallel
+       @param grain is the number of chunks per part, 0 is automatic
+      */
+    template <size_t I, typename T, typename D, typename F>
+    void parallel_for(parallel & p, common::pvlist<I,T,D> & l, F & f, size_t grain=0)
+    {
+      typedef typename common::pvlist<I,T,D>::chunk chunk_t;
+      std::vector<chunk_t> chunks;
+      l.chunks( chunks );
+      if( chunks.empty() ) return;
+      size_t n_parts = p.parts_for( chunks.size(), grain );
+      pvlist_for_job<chunk_t,T,F> j( chunks, f, grain );
+      p.run( j, n_parts );
+    }
+
+    /**
+       @brief folds the items of a part into a partial result
+
+       used by parallel_reduce(): every part starts from a copy of the identity
+       and calls r = fold(r, item) on its items
+      */
+    template <typename R, typename F> class fold_fun
+    {
+      public:
+        fold_fun(const R & identity, F & f) : r_(identity), f_(&f) { }
+        template <typename X> inline void operator()(X & x) { r_ = (*f_)( r_, x ); }
+        const R & result() const { return r_; }
+      private:
+        R    r_;
+        F *  f_;
+    };
+
+    /**
+       @brief reduces the items of v in parallel
+       @param identity is the start value of every part
+       @param fold is called as r = fold(r, T &) for the items of a part
+       @param combine is called as r = combine(r, partial) in part order
+       @param grain is the number of 64 item blocks per part, 0 is automatic
+       @return the combined result
+
+       fold and combine may be function pointers or functors, they must be
+       thread safe but need no locking as the parts work on their own copies.
+      */
+    template <typename T, typename R, typename F, typename G>
+    R parallel_reduce(parallel & p, common::inpvec<T> & v, const R & identity, F & fold, G & combine, size_t grain=0)
+    {
+      typedef typename common::inpvec<T>::block block_t;
+      std::vector<block_t> blocks;
+      v.blocks( blocks );
+      if( blocks.empty() ) return identity;
+      size_t n_parts = p.parts_for( blocks.size(), grain );
+
+      struct part_job : public parallel::job
+      {
+        std::vector<block_t> &  blocks_;
+        std::vector<R> &        partials_;
+        const R &               identity_;
+        F &                     fold_;
+        size_t                  grain_;
+
+        part_job(std::vector<block_t> & b, std::vector<R> & pr, const R & id, F & f, size_t g)
+          : blocks_(b), partials_(pr), identity_(id), fold_(f), grain_(g) { }
+
+        virtual void run(size_t part)
+        {
+          fold_fun<R,F> ff( identity_, fold_ );
+          inpvec_for_job<T,fold_fun<R,F> > j( blocks_, ff, grain_ );
+          j.run( part );
+          partials_[part] = ff.result();
+        }
+      };
+
+      std::vector<R> partials( n_parts, identity );
+      part_job j( blocks, partials, identity, fold, grain );
+      p.run( j, n_parts );
+
+      R ret = identity;
+      for( size_t i=0;i<n_parts;++i ) ret = combine( ret, partials[i] );
+      return ret;
+    }
+
+    /**
+       @brief reduces the non-NULL pointers of l in parallel
+       @param fold is called as r = fold(r, T *)
+       @param grain is the number of chunks per part, 0 is automatic
+       @see the inpvec version for the details
+      */
+    template <size_t I, typename T, typename D, typename R, typename F, typename G>
+    R parallel_reduce(parallel & p, common::pvlist<I,T,D> & l, const R & identity, F & fold, G & combine, size_t grain=0)
+    {
+      typedef typename common::pvlist<I,T,D>::chunk chunk_t;
+      std::vector<chunk_t> chunks;
+      l.chunks( chunks );
+      if( chunks.empty() ) return identity;
+      size_t n_parts = p.parts_for( chunks.size(), grain );
+
+      struct part_job : public parallel::job
+      {
+        std::vector<chunk_t> &  chunks_;
+        std::vector<R> &        partials_;
+        const R &               identity_;
+        F &                     fold_;
+        size_t                  grain_;
+
+        part_job(std::vector<chunk_t> & c, std::vector<R> & pr, const R & id, F & f, size_t g)
+          : chunks_(c), partials_(pr), identity_(id), fold_(f), grain_(g) { }
+
+        virtual void run(size_t part)
+        {
+          fold_fun<R,F> ff( identity_, fold_ );
+          pvlist_for_job<chunk_t,T,fold_fun<R,F> > j( chunks_, ff, grain_ );
+          j.run( part );
+          partials_[part] = ff.result();
+        }
+      };
+
+      std::vector<R> partials( n_parts, identity );
+      part_job j( chunks, partials, identity, fold, grain );
+      p.run( j, n_parts );
+
+      R ret = identity;
+      for( size_t i=0;i<n_parts;++i ) ret = combine( ret, partials[i] );
+      return ret;
+    }
+  }
+}
+
+#endif /* __cplusplus */
+#endif /* _csl_nthread_parallel_hh_included_ */
+
+/* EOF */
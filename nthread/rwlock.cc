@@ -0,0 +1,104 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "codesloop/nthread/rwlock.hh"
+#include "codesloop/nthread/exc.hh"
+
+#if defined(__linux__) && !defined(CSL_NTHREAD_USE_PTHREAD)
+# include "rwlock_impl_futex.cc"
+#else /* NOT LINUX */
+# include "rwlock_impl_pthread.cc"
+#endif /* __linux__ */
+
+/**
+  @file rwlock.cc
+  @brief implementation of rwlock
+*/
+
+namespace csl
+{
+  namespace nthread
+  {
+    rwlock::rwlock() : impl_(new impl), use_exc_(true) {}
+    rwlock::~rwlock() {}
+
+    bool rwlock::rdlock(unsigned long timeout_ms)
+    {
+      return impl_->rdlock(timeout_ms);
+    }
+
+    bool rwlock::wrlock(unsigned long timeout_ms)
+    {
+      return impl_->wrlock(timeout_ms);
+    }
+
+    bool rwlock::try_rdlock()
+    {
+      return impl_->try_rdlock();
+    }
+
+    bool rwlock::try_wrlock()
+    {
+      return impl_->try_wrlock();
+    }
+
+    bool rwlock::unlock()
+    {
+      return impl_->unlock();
+    }
+
+    unsigned int rwlock::reader_count()
+    {
+      return impl_->reader_count();
+    }
+
+    bool rwlock::is_write_locked()
+    {
+      return impl_->is_write_locked();
+    }
+
+    unsigned int rwlock::waiting_writers()
+    {
+      return impl_->waiting_writers();
+    }
+
+    void rwlock::enable_stats(const char * name)
+    {
+      impl_->stats_.enable(name);
+    }
+
+    void rwlock::disable_stats()
+    {
+      impl_->stats_.disable();
+    }
+
+    lock_stats & rwlock::stats()
+    {
+      return impl_->stats_;
+    }
+  }
+}
+
+/* EOF */
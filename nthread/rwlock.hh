@@ -0,0 +1,170 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _csl_nthread_rwlock_hh_included_
+#define _csl_nthread_rwlock_hh_included_
+
+/**
+   @file rwlock.hh
+   @brief reader-writer lock with writer preference
+ */
+
+#include "codesloop/nthread/lock_stats.hh"
+#include "codesloop/common/common.h"
+#include "codesloop/common/obj.hh"
+#ifdef __cplusplus
+#include <memory>
+
+namespace csl
+{
+  namespace nthread
+  {
+    /**
+       @brief reader-writer lock for read-mostly data
+
+       any number of readers may hold the lock together, writers are exclusive.
+       as soon as a writer waits new readers are held back, so a steady stream of
+       readers cannot starve the writers. the price is that a steady stream of
+       writers starves the readers, which is fine for read-mostly data.
+
+       uncontended rdlock() and unlock() are a single atomic operation each. waiters
+       spin briefly before they are parked.
+
+       the lock is not recursive: a thread holding the lock must not lock it
+       again, not even for reading, because a waiting writer would deadlock it.
+
+       contention statistics may be turned on at runtime with enable_stats(). the
+       hold time is measured for the writers only.
+      */
+    class rwlock
+    {
+    public:
+      enum {
+        spin_count_ = 100  ///<spins before parking
+      };
+
+      /** @brief constructor */
+      rwlock();
+
+      /** @brief destructor */
+      ~rwlock();
+
+      /**
+         @brief locks for reading
+         @param timeout_ms is the timeout in milliseconds, 0 means infinite
+         @return true if succeed, false on timeout
+        */
+      bool rdlock(unsigned long timeout_ms=0);
+
+      /**
+         @brief locks for writing
+         @param timeout_ms is the timeout in milliseconds, 0 means infinite
+         @return true if succeed, false on timeout
+        */
+      bool wrlock(unsigned long timeout_ms=0);
+
+      /** @brief locks for reading if possible, never blocks */
+      bool try_rdlock();
+
+      /** @brief locks for writing if possible, never blocks */
+      bool try_wrlock();
+
+      /**
+         @brief releases a read or a write lock
+         @return false if the lock was not held
+        */
+      bool unlock();
+
+      /** @brief number of readers holding the lock */
+      unsigned int reader_count();
+
+      /** @brief tells wether a writer holds the lock */
+      bool is_write_locked();
+
+      /** @brief number of writers waiting for the lock */
+      unsigned int waiting_writers();
+
+      /**
+         @brief enables collecting the wait and hold times
+         @param name is an optional common::metrics name prefix
+        */
+      void enable_stats(const char * name=0);
+
+      /** @brief disables collecting statistics */
+      void disable_stats();
+
+      /** @brief access the collected statistics */
+      lock_stats & stats();
+
+    private:
+      struct impl;
+      std::auto_ptr<impl> impl_;
+
+      // no-copy
+      rwlock(const rwlock & other);
+      rwlock & operator=(const rwlock & other);
+
+      CSL_OBJ(csl::nthread, rwlock);
+      USE_EXC();
+    };
+
+    /** @brief holds a read lock for the lifetime of the object */
+    class scoped_rdlock
+    {
+    public:
+      scoped_rdlock(rwlock & l) : l_(&l) { l_->rdlock(); }
+      ~scoped_rdlock()                   { l_->unlock(); }
+
+    private:
+      rwlock * l_;
+
+      // no default construction and copying
+      scoped_rdlock() : l_(0) {}
+      scoped_rdlock(const scoped_rdlock &) : l_(0) {}
+      scoped_rdlock & operator=(const scoped_rdlock &) { return *this; }
+    };
+
+    /** @brief holds a write lock for the lifetime of the object */
+    class scoped_wrlock
+    {
+    public:
+      scoped_wrlock(rwlock & l) : l_(&l) { l_->wrlock(); }
+      ~scoped_wrlock()                   { l_->unlock(); }
+
+    private:
+      rwlock * l_;
+
+      // no default construction and copying
+      scoped_wrlock() : l_(0) {}
+      scoped_wrlock(const scoped_wrlock &) : l_(0) {}
+      scoped_wrlock & operator=(const scoped_wrlock &) { return *this; }
+    };
+  }
+}
+
+#endif /* __cplusplus */
+#endif /* _csl_nthread_rwlock_hh_included_ */
+
+/* EOF */
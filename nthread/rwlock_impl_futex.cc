@@ -0,0 +1,240 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "codesloop/nthread/rwlock.hh"
+#include "codesloop/nthread/lock_stats.hh"
+#include "codesloop/nthread/futex_linux.hh"
+#include "codesloop/common/common.h"
+
+/**
+  @file rwlock_impl_futex.cc
+  @brief futex based implementation of rwlock (Linux only)
+
+  state_ is the number of readers holding the lock, or -1 if a writer holds it.
+  readers and writers park on separate sequence words (rd_seq_ and wr_seq_), that
+  are bumped before the wakeups, so a wakeup between checking the state and
+  parking is not lost. new readers keep off while writers_waiting_ is not zero.
+*/
+
+namespace csl
+{
+  namespace nthread
+  {
+    struct rwlock::impl
+    {
+      volatile int   state_;
+      volatile int   writers_waiting_;
+      volatile int   readers_waiting_;
+      volatile int   rd_seq_;
+      volatile int   wr_seq_;
+      uint64_t       held_since_;  ///<written by the writer holding the lock only
+      lock_stats     stats_;
+
+      impl() : state_(0), writers_waiting_(0), readers_waiting_(0), rd_seq_(0), wr_seq_(0), held_since_(0) { }
+
+      inline void acquired(uint64_t start, bool contended, bool writer)
+      {
+        if( stats_.enabled() )
+        {
+          uint64_t now = lock_stats::now();
+          stats_.on_acquire( (contended && start) ? now-start : 0, contended );
+          if( writer ) held_since_ = now;
+        }
+      }
+
+      inline bool try_rd()
+      {
+        for( ;; )
+        {
+          int s = state_;
+          if( s < 0 || writers_waiting_ != 0 ) return false;
+          if( __sync_bool_compare_and_swap( &state_, s, s+1 ) ) return true;
+        }
+      }
+
+      inline bool try_wr()
+      {
+        return ( state_ == 0 && __sync_bool_compare_and_swap( &state_, 0, -1 ) );
+      }
+
+      inline void wake_readers()
+      {
+        if( readers_waiting_ > 0 )
+        {
+          __sync_fetch_and_add( &rd_seq_, 1 );
+          futex::wake( &rd_seq_, INT_MAX );
+        }
+      }
+
+      inline void wake_writer()
+      {
+        __sync_fetch_and_add( &wr_seq_, 1 );
+        futex::wake( &wr_seq_, 1 );
+      }
+
+      bool rdlock(unsigned long timeout_ms)
+      {
+        if( try_rd() ) { acquired(0,false,false); return true; }
+
+        uint64_t start = (stats_.enabled() ? lock_stats::now() : 0);
+
+        for( int i=0;i<spin_count_;++i )
+        {
+          cpu_relax();
+          if( try_rd() ) { acquired(start,true,false); return true; }
+        }
+
+        futex::deadline dl( timeout_ms );
+        bool ret = false;
+
+        __sync_fetch_and_add( &readers_waiting_, 1 );
+
+        for( ;; )
+        {
+          int seq = __sync_fetch_and_add( &rd_seq_, 0 );
+          if( try_rd() ) { ret = true; break; }
+
+          struct timespec ts;
+          bool expired = false;
+          const struct timespec * tp = dl.remaining( ts, expired );
+          if( expired ) break;
+
+          futex::wait( &rd_seq_, seq, tp );
+        }
+
+        __sync_fetch_and_sub( &readers_waiting_, 1 );
+        if( ret ) acquired( start, true, false );
+        return ret;
+      }
+
+      bool wrlock(unsigned long timeout_ms)
+      {
+        if( __sync_bool_compare_and_swap( &state_, 0, -1 ) ) { acquired(0,false,true); return true; }
+
+        uint64_t start = (stats_.enabled() ? lock_stats::now() : 0);
+        bool ret = false;
+
+        // from now on the new readers keep off
+        __sync_fetch_and_add( &writers_waiting_, 1 );
+
+        for( int i=0;i<spin_count_ && !ret;++i )
+        {
+          cpu_relax();
+          ret = try_wr();
+        }
+
+        if( !ret )
+        {
+          futex::deadline dl( timeout_ms );
+
+          for( ;; )
+          {
+            int seq = __sync_fetch_and_add( &wr_seq_, 0 );
+            if( __sync_bool_compare_and_swap( &state_, 0, -1 ) ) { ret = true; break; }
+
+            struct timespec ts;
+            bool expired = false;
+            const struct timespec * tp = dl.remaining( ts, expired );
+            if( expired ) break;
+
+            futex::wait( &wr_seq_, seq, tp );
+          }
+        }
+
+        int left = __sync_sub_and_fetch( &writers_waiting_, 1 );
+
+        if( ret )
+        {
+          acquired( start, true, true );
+        }
+        else
+        {
+          // we may have eaten a wakeup meant for an other writer and
+          // the readers may have been waiting for us only
+          if( left > 0 && state_ == 0 ) wake_writer();
+          else if( left == 0 )          wake_readers();
+        }
+        return ret;
+      }
+
+      bool try_rdlock()
+      {
+        if( try_rd() ) { acquired(0,false,false); return true; }
+        return false;
+      }
+
+      bool try_wrlock()
+      {
+        if( __sync_bool_compare_and_swap( &state_, 0, -1 ) ) { acquired(0,false,true); return true; }
+        return false;
+      }
+
+      bool unlock()
+      {
+        int s = state_;
+
+        if( s == -1 )
+        {
+          if( held_since_ )
+          {
+            if( stats_.enabled() ) stats_.on_release( lock_stats::now() - held_since_ );
+            held_since_ = 0;
+          }
+
+          if( !__sync_bool_compare_and_swap( &state_, -1, 0 ) ) return false;
+
+          // writers first
+          if( writers_waiting_ > 0 ) wake_writer();
+          else                       wake_readers();
+          return true;
+        }
+        else if( s > 0 )
+        {
+          if( __sync_fetch_and_sub( &state_, 1 ) == 1 && writers_waiting_ > 0 ) wake_writer();
+          return true;
+        }
+        return false;
+      }
+
+      unsigned int reader_count()
+      {
+        int s = __sync_fetch_and_add( &state_, 0 );
+        return static_cast<unsigned int>( s > 0 ? s : 0 );
+      }
+
+      bool is_write_locked()
+      {
+        return (__sync_fetch_and_add( &state_, 0 ) == -1);
+      }
+
+      unsigned int waiting_writers()
+      {
+        return static_cast<unsigned int>(__sync_fetch_and_add( &writers_waiting_, 0 ));
+      }
+    };
+  } /* namespace nthread */
+} /* namespace csl */
+
+/* EOF */
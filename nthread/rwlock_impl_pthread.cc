@@ -0,0 +1,222 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "codesloop/nthread/rwlock.hh"
+#include "codesloop/nthread/lock_stats.hh"
+#include "codesloop/common/common.h"
+#include <pthread.h>
+#include <errno.h>
+#include <sys/time.h>
+
+/**
+  @file rwlock_impl_pthread.cc
+  @brief pthread implementation of rwlock
+
+  pthread_rwlock_t does not guarantee writer preference, so the lock state
+  is kept under a pthread mutex, with separate conditions for the readers
+  and the writers.
+*/
+
+namespace csl
+{
+  namespace nthread
+  {
+    struct rwlock::impl
+    {
+      pthread_mutex_t  mtx_;
+      pthread_cond_t   rd_cond_;
+      pthread_cond_t   wr_cond_;
+      int              state_;
+      int              writers_waiting_;
+      uint64_t         held_since_;
+      lock_stats       stats_;
+
+      impl() : state_(0), writers_waiting_(0), held_since_(0)
+      {
+        pthread_mutex_init( &mtx_, NULL );
+        pthread_cond_init( &rd_cond_, NULL );
+        pthread_cond_init( &wr_cond_, NULL );
+      }
+
+      ~impl()
+      {
+        pthread_cond_destroy( &wr_cond_ );
+        pthread_cond_destroy( &rd_cond_ );
+        pthread_mutex_destroy( &mtx_ );
+      }
+
+      inline void acquired(uint64_t start, bool contended, bool writer)
+      {
+        if( stats_.enabled() )
+        {
+          uint64_t now = lock_stats::now();
+          stats_.on_acquire( (contended && start) ? now-start : 0, contended );
+          if( writer ) held_since_ = now;
+        }
+      }
+
+      static void deadline(unsigned long timeout_ms, struct timespec & at)
+      {
+        struct timeval tv;
+        gettimeofday(&tv,NULL);
+        tv.tv_usec += (timeout_ms*1000);
+        at.tv_sec   = tv.tv_sec + (tv.tv_usec/1000000);
+        at.tv_nsec  = (tv.tv_usec%1000000)*1000;
+      }
+
+      bool rdlock(unsigned long timeout_ms)
+      {
+        struct timespec at;
+        if( timeout_ms ) deadline( timeout_ms, at );
+
+        bool contended = false;
+        uint64_t start = 0;
+        bool ret = true;
+
+        pthread_mutex_lock( &mtx_ );
+        while( state_ < 0 || writers_waiting_ > 0 )
+        {
+          if( !contended ) { contended = true; if( stats_.enabled() ) start = lock_stats::now(); }
+
+          int err = 0;
+          if( timeout_ms ) err = pthread_cond_timedwait( &rd_cond_, &mtx_, &at );
+          else             err = pthread_cond_wait( &rd_cond_, &mtx_ );
+
+          if( err == ETIMEDOUT && (state_ < 0 || writers_waiting_ > 0) ) { ret = false; break; }
+        }
+        if( ret ) ++state_;
+        pthread_mutex_unlock( &mtx_ );
+
+        if( ret ) acquired( start, contended, false );
+        return ret;
+      }
+
+      bool wrlock(unsigned long timeout_ms)
+      {
+        struct timespec at;
+        if( timeout_ms ) deadline( timeout_ms, at );
+
+        bool contended = false;
+        uint64_t start = 0;
+        bool ret = true;
+
+        pthread_mutex_lock( &mtx_ );
+        ++writers_waiting_;
+        while( state_ != 0 )
+        {
+          if( !contended ) { contended = true; if( stats_.enabled() ) start = lock_stats::now(); }
+
+          int err = 0;
+          if( timeout_ms ) err = pthread_cond_timedwait( &wr_cond_, &mtx_, &at );
+          else             err = pthread_cond_wait( &wr_cond_, &mtx_ );
+
+          if( err == ETIMEDOUT && state_ != 0 ) { ret = false; break; }
+        }
+        --writers_waiting_;
+        if( ret )                        state_ = -1;
+        else if( writers_waiting_ == 0 ) pthread_cond_broadcast( &rd_cond_ );
+        else if( state_ == 0 )           pthread_cond_signal( &wr_cond_ );
+        pthread_mutex_unlock( &mtx_ );
+
+        if( ret ) acquired( start, contended, true );
+        return ret;
+      }
+
+      bool try_rdlock()
+      {
+        bool ret = false;
+        pthread_mutex_lock( &mtx_ );
+        if( state_ >= 0 && writers_waiting_ == 0 ) { ++state_; ret = true; }
+        pthread_mutex_unlock( &mtx_ );
+        if( ret ) acquired( 0, false, false );
+        return ret;
+      }
+
+      bool try_wrlock()
+      {
+        bool ret = false;
+        pthread_mutex_lock( &mtx_ );
+        if( state_ == 0 ) { state_ = -1; ret = true; }
+        pthread_mutex_unlock( &mtx_ );
+        if( ret ) acquired( 0, false, true );
+        return ret;
+      }
+
+      bool unlock()
+      {
+        bool ret = true;
+
+        pthread_mutex_lock( &mtx_ );
+        if( state_ == -1 )
+        {
+          if( held_since_ )
+          {
+            if( stats_.enabled() ) stats_.on_release( lock_stats::now() - held_since_ );
+            held_since_ = 0;
+          }
+          state_ = 0;
+          if( writers_waiting_ > 0 ) pthread_cond_signal( &wr_cond_ );
+          else                       pthread_cond_broadcast( &rd_cond_ );
+        }
+        else if( state_ > 0 )
+        {
+          if( --state_ == 0 && writers_waiting_ > 0 ) pthread_cond_signal( &wr_cond_ );
+        }
+        else
+        {
+          ret = false;
+        }
+        pthread_mutex_unlock( &mtx_ );
+        return ret;
+      }
+
+      unsigned int reader_count()
+      {
+        pthread_mutex_lock( &mtx_ );
+        int s = state_;
+        pthread_mutex_unlock( &mtx_ );
+        return static_cast<unsigned int>( s > 0 ? s : 0 );
+      }
+
+      bool is_write_locked()
+      {
+        pthread_mutex_lock( &mtx_ );
+        bool ret = (state_ == -1);
+        pthread_mutex_unlock( &mtx_ );
+        return ret;
+      }
+
+      unsigned int waiting_writers()
+      {
+        pthread_mutex_lock( &mtx_ );
+        int w = writers_waiting_;
+        pthread_mutex_unlock( &mtx_ );
+        return static_cast<unsigned int>( w );
+      }
+    };
+  } /* namespace nthread */
+} /* namespace csl */
+
+/* EOF */
@@ -69,6 +69,23 @@ namespace csl
       return impl_->get_stack_size();
     }
 
+    bool thread::set_affinity(const cpuset & cs)
+    {
+      return impl_->set_affinity(cs);
+    }
+
+    bool thread::set_numa_node(unsigned int node)
+    {
+      cpuset cs;
+      if( cpuset::numa_node(node,cs) == false ) return false;
+      return impl_->set_affinity(cs);
+    }
+
+    bool thread::get_affinity(cpuset & cs)
+    {
+      return impl_->get_affinity(cs);
+    }
+
     bool thread::start()
     {
       return impl_->start();
@@ -36,6 +36,7 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "codesloop/common/common.h"
 #include "codesloop/common/obj.hh"
 #include "codesloop/nthread/pevent.hh"
+#include "codesloop/nthread/cpuset.hh"
 #ifdef __cplusplus
 #include <memory>
 
@@ -101,6 +102,29 @@ namespace csl
       /** @brief query the given stack size */
       unsigned long get_stack_size();
 
+      /**
+         @brief restricts the thread to the given CPUs
+         @param cs is the set of allowed CPUs
+         @return false if the platform does not support affinity or cs is empty
+
+         if the thread is not yet started then the affinity is applied by the new
+         thread before it calls the entry, so the entry never runs elsewhere.
+         otherwise it is applied immediately.
+        */
+      bool set_affinity(const cpuset & cs);
+
+      /**
+         @brief restricts the thread to the CPUs of the given NUMA node
+         @see set_affinity()
+        */
+      bool set_numa_node(unsigned int node);
+
+      /**
+         @brief query the affinity set by set_affinity()
+         @return false if no affinity was set
+        */
+      bool get_affinity(cpuset & cs);
+
       /**
          @brief starts a new thread
          @return true if OK, false if no entry was set or error happened
@@ -34,9 +34,13 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "codesloop/nthread/thread.hh"
 #include "codesloop/nthread/mutex.hh"
+#include "codesloop/nthread/cpuset.hh"
 #include "codesloop/common/common.h"
 #include "codesloop/common/logger.hh"
 #include <pthread.h>
+#ifdef __linux__
+# include <sched.h>
+#endif /* __linux__ */
 
 /**
   @file thread_impl_pthread.cc
@@ -69,12 +73,14 @@ namespace csl
       mutex  mtx_;
 
       unsigned long           stack_size_;
+      cpuset                  affinity_;
+      bool                    has_affinity_;
       dummy_callback          dummy_callback_;
       thread::callback *      start_routine_;
       pthread_t               tid_;
       pthread_attr_t          attr_;
 
-      impl() : stack_size_(0), start_routine_(&dummy_callback_), tid_(0)
+      impl() : stack_size_(0), has_affinity_(false), start_routine_(&dummy_callback_), tid_(0)
       {
         pthread_attr_init(&attr_);
       }
@@ -115,6 +121,51 @@ namespace csl
         RETURN_FUNCTION( ret );
       }
 
+      bool set_affinity(const cpuset & cs)
+      {
+        ENTER_FUNCTION();
+        bool ret = false;
+#ifdef __linux__
+        if( cs.empty() ) RETURN_FUNCTION( false );
+
+        scoped_mutex m(mtx_);
+        affinity_     = cs;
+        has_affinity_ = true;
+
+        if( is_running() )
+        {
+          cpu_set_t s;
+          CPU_ZERO( &s );
+          for( unsigned int i=0;i<CPU_SETSIZE && i<cpuset::max_cpus_;++i )
+          {
+            if( cs.is_set(i) ) CPU_SET( i, &s );
+          }
+          ret = (pthread_setaffinity_np( tid_, sizeof(s), &s ) == 0);
+        }
+        else
+        {
+          // the new thread applies it in thread_entry_
+          ret = true;
+        }
+#endif /* __linux__ */
+        CSL_DEBUGF( L"set_affinity(cs:%d cpus) => %s",cs.count(),(ret==true?"TRUE":"FALSE") );
+        RETURN_FUNCTION( ret );
+      }
+
+      bool get_affinity(cpuset & cs)
+      {
+        scoped_mutex m(mtx_);
+        if( !has_affinity_ ) return false;
+        cs = affinity_;
+        return true;
+      }
+
+      void apply_affinity()
+      {
+        cpuset cs;
+        if( get_affinity(cs) ) cpuset::pin_current(cs);
+      }
+
       bool start()
       {
         ENTER_FUNCTION();
@@ -204,6 +255,9 @@ namespace csl
           // first set cleanup routine
           pthread_cleanup_push(thread_cleanup_,arg);
 
+          // pin before anything else runs on the thread
+          p->apply_affinity();
+
           // flag start
           p->start_evt_.set_permanent();
 
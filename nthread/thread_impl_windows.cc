@@ -87,6 +87,17 @@ namespace csl
         stack_size_ = sz;
       }
 
+      bool set_affinity(const cpuset & cs)
+      {
+        // not supported here yet
+        return false;
+      }
+
+      bool get_affinity(cpuset & cs)
+      {
+        return false;
+      }
+
       unsigned long get_stack_size()
       {
         unsigned long ret = 0;
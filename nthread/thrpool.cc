@@ -36,7 +36,9 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "codesloop/common/common.h"
 #include "codesloop/common/str.hh"
 #include "codesloop/common/logger.hh"
+#include "codesloop/common/metrics.hh"
 #include <assert.h>
+#include <algorithm>
 
 /**
   @file thrpool.cc
@@ -48,7 +50,10 @@ namespace csl
   namespace nthread
   {
     thrpool::thrpool()
-      : count_(0), min_(1), max_(4), timeout_(1000), attempts_(20), use_exc_(true), stop_me_(false), ev_(0), handler_(0)
+      : count_(0), min_(1), max_(4), timeout_(1000), attempts_(20), use_exc_(true), stop_me_(false), ev_(0), handler_(0),
+        placement_(place_none_), next_cpu_(0),
+        n_samples_(0), adaptive_(0), reported_(0), window_start_(0), window_end_(0),
+        busy_usec_(0), avg_service_usec_(0), idle_windows_(0), retire_(0)
     {
     }
 
@@ -66,6 +71,25 @@ namespace csl
 
     namespace
     {
+      /* process wide numbers, summed over all pools */
+      common::metrics::gauge & threads_gauge()
+      {
+        static common::metrics::gauge & g_(common::metrics::instance().get_gauge("nthread.thrpool.threads"));
+        return g_;
+      }
+
+      common::metrics::counter & started_counter()
+      {
+        static common::metrics::counter & c_(common::metrics::instance().get_counter("nthread.thrpool.started"));
+        return c_;
+      }
+
+      common::metrics::counter & exited_counter()
+      {
+        static common::metrics::counter & c_(common::metrics::instance().get_counter("nthread.thrpool.exited"));
+        return c_;
+      }
+
       class entry :  public thread::callback
       {
         public:
@@ -76,8 +100,19 @@ namespace csl
 
             while( stop_me() == false )
             {
+              bool adaptive = pool_->adaptive();
+
               if( ev_->wait(timeout_) == false )
               {
+                if( adaptive )
+                {
+                  /* the sizing policy decides when to retire */
+                  pool_->evaluate();
+                  if( pool_->retire_one() ) break;
+                  pool_->cleanup();
+                  continue;
+                }
+
                 n_attempts++;
 
                 /* no data so far, so we migh not be needed */
@@ -94,6 +129,20 @@ namespace csl
               {
                 break;
               }
+              else if( adaptive )
+              {
+                n_attempts = 0;
+
+                /* the remaining notifications are the items queued behind this one */
+                unsigned int backlog = ev_->available_count();
+                uint64_t start = common::metrics::now_usec();
+
+                (*handler_)();
+
+                pool_->on_handled( common::metrics::now_usec()-start, backlog );
+                pool_->evaluate();
+                if( pool_->retire_one() ) break;
+              }
               else
               {
                 /* clear unsuccessful attempts */
@@ -192,14 +241,31 @@ namespace csl
       {
         scoped_mutex m(mtx_);
 
-        /* are there too many ? */
-        if( count() > max() ) RETURN_FUNCTION( false );
+        /* are there too many ? the threads being started are not in count_ yet */
+        unsigned int live = 0;
+        for( thrlist_t::iterator it = threads_.begin() ;it!=threads_.end();++it )
+        {
+          if( (*it).first && (*it).first->exit_event().is_permanent() == false ) ++live;
+        }
+        if( live >= max() ) RETURN_FUNCTION( false );
 
         /* create new thread */
         t = new thread();
         e = new entry(this, ev_, handler_);
         thr_t th(t,e);
 
+        /* pin before launch */
+        if( placement_ == place_round_robin_ )
+        {
+          cpuset cs;
+          cs.set( place_cpus_.nth( (next_cpu_++) % place_cpus_.count() ) );
+          t->set_affinity(cs);
+        }
+        else if( placement_ == place_near_ )
+        {
+          t->set_affinity(place_cpus_);
+        }
+
         /* launch thread */
         t->set_entry(*e);
         if( t->start() == false ) RETURN_FUNCTION( false );
@@ -387,8 +453,10 @@ namespace csl
       ENTER_FUNCTION();
       {
         scoped_mutex m(mtx_);
-        ++count_;
+        __sync_fetch_and_add( &count_, 1 );
       }
+      threads_gauge().inc();
+      started_counter().inc();
       start_event().notify();
       LEAVE_FUNCTION();
     }
@@ -398,8 +466,10 @@ namespace csl
       ENTER_FUNCTION();
       {
         scoped_mutex m(mtx_);
-        --count_;
+        __sync_fetch_and_sub( &count_, 1 );
       }
+      threads_gauge().dec();
+      exited_counter().inc();
       exit_event().notify();
       LEAVE_FUNCTION();
     }
@@ -464,6 +534,216 @@ namespace csl
       RETURN_FUNCTION( ret );
     }
 
+    bool thrpool::adaptive()
+    {
+      return (__sync_fetch_and_add( &adaptive_, 0 ) != 0);
+    }
+
+    void thrpool::set_placement(placement_t p, int cpu)
+    {
+      ENTER_FUNCTION();
+      cpuset cs;
+
+      if( p == place_round_robin_ )
+      {
+        cpuset::allowed(cs);
+      }
+      else if( p == place_near_ )
+      {
+        if( cpu < 0 ) cpu = cpuset::current_cpu();
+        if( cpu >= 0 )
+        {
+          cpuset::numa_node( cpuset::node_of(cpu), cs );
+          // leave the given CPU to the loop if there are others on the node
+          if( cs.count() > 1 ) cs.unset(cpu);
+        }
+      }
+
+      scoped_mutex m(mtx_);
+      placement_  = (cs.empty() ? place_none_ : p);
+      place_cpus_ = cs;
+      next_cpu_   = 0;
+      CSL_DEBUGF( L"set_placement(p:%d,cpu:%d) => %d cpus",p,cpu,cs.count() );
+      LEAVE_FUNCTION();
+    }
+
+    thrpool::placement_t thrpool::placement()
+    {
+      scoped_mutex m(mtx_);
+      return placement_;
+    }
+
+    void thrpool::set_policy(const sizing_policy & p)
+    {
+      scoped_mutex m(mtx_);
+      policy_        = p;
+      if( policy_.window_ms_ == 0 ) policy_.window_ms_ = 1;
+      window_start_  = 0;
+      idle_windows_  = 0;
+      __sync_lock_test_and_set( &window_end_, 0 );
+      __sync_lock_test_and_set( &busy_usec_, 0 );
+      __sync_lock_test_and_set( &retire_, 0 );
+      __sync_lock_test_and_set( &reported_, 0 );
+      __sync_lock_test_and_set( &n_samples_, 0 );
+      __sync_lock_test_and_set( &adaptive_, (policy_.target_p95_usec_ > 0 ? 1 : 0) );
+    }
+
+    thrpool::sizing_policy thrpool::policy()
+    {
+      scoped_mutex m(mtx_);
+      return policy_;
+    }
+
+    thrpool::sizing_state thrpool::last_decision()
+    {
+      scoped_mutex m(mtx_);
+      return state_;
+    }
+
+    namespace
+    {
+      /* the slot is claimed atomically. when the ring wraps within a window
+         the older samples are overwritten, evaluate() may read a slot that
+         is being rewritten, which only shifts one sample of the window */
+      inline void add_sample(uint32_t * v, unsigned int & n, unsigned int max_n, uint64_t usec)
+      {
+        uint32_t s = (usec > 0xffffffffULL ? 0xffffffffU : static_cast<uint32_t>(usec));
+        v[ __sync_fetch_and_add( &n, 1 ) % max_n ] = s;
+      }
+    }
+
+    void thrpool::report_latency(uint64_t usec)
+    {
+      if( __sync_bool_compare_and_swap( &reported_, 0, 1 ) )
+      {
+        /* drop the estimates collected so far in this window */
+        __sync_lock_test_and_set( &n_samples_, 0 );
+      }
+      add_sample( samples_, n_samples_, max_samples_, usec );
+    }
+
+    void thrpool::on_handled(uint64_t service_usec, unsigned int backlog)
+    {
+      __sync_fetch_and_add( &busy_usec_, service_usec );
+
+      uint64_t avg = __sync_fetch_and_add( &avg_service_usec_, 0 );
+      uint64_t upd = (avg*7 + service_usec)/8;
+
+      /* a lost update only skips one step of the moving average */
+      __sync_bool_compare_and_swap( &avg_service_usec_, avg, upd );
+
+      if( __sync_fetch_and_add( &reported_, 0 ) == 0 )
+      {
+        /* the items in the backlog are served by count_ workers in parallel */
+        unsigned int n = __sync_fetch_and_add( &count_, 0 );
+        uint64_t est = (static_cast<uint64_t>(backlog) * upd) / (n > 0 ? n : 1);
+        add_sample( samples_, n_samples_, max_samples_, est );
+      }
+    }
+
+    bool thrpool::retire_one()
+    {
+      if( __sync_fetch_and_add( &retire_, 0 ) == 0 ) return false;
+
+      scoped_mutex m(mtx_);
+      if( retire_ == 0 ) return false;
+
+      __sync_fetch_and_sub( &retire_, 1 );
+      return (count_ > min_);
+    }
+
+    thrpool::decision_t thrpool::evaluate()
+    {
+      ENTER_FUNCTION();
+      decision_t   ret     = keep_;
+      unsigned int to_start = 0;
+      uint64_t     now     = common::metrics::now_usec();
+
+      /* the window is still open: no need for the lock */
+      if( now < __sync_fetch_and_add( &window_end_, 0 ) ) RETURN_FUNCTION( keep_ );
+
+      {
+        scoped_mutex m(mtx_);
+
+        if( policy_.target_p95_usec_ == 0 ) RETURN_FUNCTION( keep_ );
+
+        uint64_t window_usec = static_cast<uint64_t>(policy_.window_ms_)*1000ULL;
+
+        if( window_start_ == 0 )
+        {
+          window_start_ = now;
+          __sync_lock_test_and_set( &window_end_, now+window_usec );
+          RETURN_FUNCTION( keep_ );
+        }
+
+        uint64_t elapsed = now - window_start_;
+        if( elapsed < window_usec ) RETURN_FUNCTION( keep_ );
+
+        /* close the window, the workers start filling the next one */
+        __sync_lock_test_and_set( &window_end_, now+window_usec );
+        uint64_t busy = __sync_lock_test_and_set( &busy_usec_, 0 );
+        unsigned int n_samples = __sync_lock_test_and_set( &n_samples_, 0 );
+        if( n_samples > max_samples_ ) n_samples = max_samples_;
+
+        uint64_t p95 = 0;
+
+        if( n_samples > 0 )
+        {
+          std::vector<uint32_t> tmp( samples_, samples_+n_samples );
+          size_t idx = (tmp.size()*95+99)/100 - 1;
+          std::nth_element( tmp.begin(), tmp.begin()+idx, tmp.end() );
+          p95 = tmp[idx];
+        }
+
+        uint64_t capacity = elapsed * (count_ > 0 ? count_ : 1);
+        unsigned int util = static_cast<unsigned int>((busy * 100) / capacity);
+        if( util > 100 ) util = 100;
+
+        if( p95 > policy_.target_p95_usec_ && count_ < max_ )
+        {
+          /* grow by half of the current size, at least by one */
+          ret          = grow_;
+          to_start     = (count_/2 > 0 ? count_/2 : 1);
+          if( count_+to_start > max_ ) to_start = max_-count_;
+          idle_windows_ = 0;
+        }
+        else if( p95 <= policy_.target_p95_usec_/2 && util < policy_.low_util_pct_ )
+        {
+          /* hysteresis: retire only after several quiet windows */
+          if( ++idle_windows_ >= policy_.shrink_after_ && count_ > min_+retire_ )
+          {
+            ret           = shrink_;
+            __sync_fetch_and_add( &retire_, 1 );
+            idle_windows_ = 0;
+          }
+        }
+        else
+        {
+          idle_windows_ = 0;
+        }
+
+        state_.decision_        = ret;
+        state_.p95_usec_        = p95;
+        state_.utilization_pct_ = util;
+        state_.workers_         = count_;
+        state_.samples_         = n_samples;
+        state_.n_windows_      += 1;
+
+        CSL_DEBUGF( L"evaluate() p95:%lld util:%d workers:%d samples:%d => %d",
+                    static_cast<long long>(p95), util, count_, n_samples, ret );
+
+        /* new window */
+        window_start_ = now;
+      }
+
+      for( unsigned int i=0;i<to_start;++i )
+      {
+        if( start_one() == false ) break;
+      }
+
+      RETURN_FUNCTION( ret );
+    }
+
     bool thrpool::use_exc()
     {
       bool ret = false;
@@ -39,16 +39,81 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "codesloop/common/logger.hh"
 #ifdef __cplusplus
 #include <list>
+#include <vector>
 
 namespace csl
 {
   namespace nthread
   {
-    /** @todo document me */
+    /**
+       @brief pool of worker threads that call the same handler when the event is notified
+
+       by default the pool grows when a worker finds more than two pending
+       notifications and a worker exits after the given number of timeouts.
+
+       when a sizing_policy with a non-zero latency target is set, the pool is
+       sized by the observed queue latency instead. the workers collect queue
+       latency samples (reported by the user through report_latency() or
+       estimated from the backlog and the average service time) and the busy
+       time of the workers. at the end of every window the pool decides:
+
+       @li grow_ : p95 latency is above the target, start more workers
+       @li shrink_ : latency is well below the target and the utilization has
+           been low for shrink_after_ consecutive windows, retire one worker
+       @li keep_ : otherwise
+
+       the last decision and the numbers behind it are returned by last_decision().
+
+       the workers float across the CPUs by default. set_placement() pins the
+       workers started afterwards, either round-robin over the allowed CPUs or
+       to the NUMA node of a given CPU (typically the event loop feeding the
+       pool), leaving that CPU to the loop when the node has others.
+     */
     class thrpool : public csl::common::obj
     {
       CSL_OBJ(csl::nthread,thrpool);
       public:
+        /** @brief the pool sizing decisions */
+        enum decision_t {
+          keep_   = 0,
+          grow_   = 1,
+          shrink_ = 2
+        };
+
+        /** @brief worker placement policies */
+        enum placement_t {
+          place_none_        = 0,  ///<workers are not pinned
+          place_round_robin_ = 1,  ///<the n-th worker is pinned to the n-th allowed CPU
+          place_near_        = 2   ///<workers are pinned to the NUMA node of a given CPU
+        };
+
+        /** @brief parameters of the latency driven sizing */
+        struct sizing_policy
+        {
+          unsigned int  target_p95_usec_;  ///<p95 queue latency target, 0 disables the policy
+          unsigned int  window_ms_;        ///<length of the evaluation window
+          unsigned int  low_util_pct_;     ///<utilization below this is considered idle
+          unsigned int  shrink_after_;     ///<number of idle windows before retiring a worker
+
+          sizing_policy()
+            : target_p95_usec_(0), window_ms_(100), low_util_pct_(30), shrink_after_(5) {}
+        };
+
+        /** @brief the result of the last evaluation window */
+        struct sizing_state
+        {
+          decision_t    decision_;
+          uint64_t      p95_usec_;
+          unsigned int  utilization_pct_;
+          unsigned int  workers_;
+          unsigned int  samples_;
+          uint64_t      n_windows_;
+
+          sizing_state()
+            : decision_(keep_), p95_usec_(0), utilization_pct_(0),
+              workers_(0), samples_(0), n_windows_(0) {}
+        };
+
         thrpool();
         virtual ~thrpool();
 
@@ -77,7 +142,45 @@ namespace csl
         void on_entry();
         void on_exit();
 
+        /**
+           @brief sets the placement of the workers started afterwards
+           @param p is the placement policy
+           @param cpu is the CPU for place_near_, -1 means the calling thread's CPU
+          */
+        void set_placement(placement_t p, int cpu=-1);
+
+        /** @brief returns the placement policy */
+        placement_t placement();
+
+        /** @brief sets the sizing policy, may be called at any time */
+        void set_policy(const sizing_policy & p);
+
+        /** @brief returns the current sizing policy */
+        sizing_policy policy();
+
+        /** @brief returns the result of the last evaluation */
+        sizing_state last_decision();
+
+        /**
+           @brief reports the queue latency of an item
+
+           users that timestamp their items may report the measured queue
+           latency. once any latency has been reported the pool stops
+           estimating it.
+          */
+        void report_latency(uint64_t usec);
+
+        /*
+           called by the workers. on_handled(), adaptive() and retire_one()
+           only touch atomics, evaluate() takes the pool lock once per window.
+         */
+        void on_handled(uint64_t service_usec, unsigned int backlog);
+        bool retire_one();
+        bool adaptive();
+        decision_t evaluate();
+
       private:
+        enum { max_samples_ = 4096 };
         typedef std::pair<thread *,thread::callback *> thr_t;
         typedef std::list<thr_t> thrlist_t;
 
@@ -94,6 +197,25 @@ namespace csl
         event *             ev_;
         thread::callback *  handler_;
         thrlist_t           threads_;
+
+        /* worker placement */
+        placement_t         placement_;
+        cpuset              place_cpus_;
+        unsigned int        next_cpu_;
+
+        /* latency driven sizing, the atomics are updated with __sync builtins */
+        sizing_policy          policy_;
+        sizing_state           state_;
+        uint32_t               samples_[max_samples_];
+        unsigned int           n_samples_;         ///<atomic: samples added in this window
+        unsigned int           adaptive_;          ///<atomic: copy of (target_p95_usec_ > 0)
+        unsigned int           reported_;          ///<atomic: report_latency() was called
+        uint64_t               window_start_;
+        uint64_t               window_end_;        ///<atomic: evaluate() is a no-op before this
+        uint64_t               busy_usec_;         ///<atomic
+        uint64_t               avg_service_usec_;  ///<atomic
+        unsigned int           idle_windows_;
+        unsigned int           retire_;            ///<atomic
     };
   }
 }
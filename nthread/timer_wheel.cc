@@ -0,0 +1,271 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#if 0
+#ifndef DEBUG
+#define DEBUG
+#define DEBUG_ENABLE_INDENT
+//#define DEBUG_VERBOSE
+#endif /* DEBUG */
+#endif //0
+
+#include "codesloop/nthread/timer_wheel.hh"
+#include "codesloop/common/metrics.hh"
+#include "codesloop/common/logger.hh"
+
+/**
+  @file timer_wheel.cc
+  @brief implementation of timer_wheel
+ */
+
+namespace csl
+{
+  namespace nthread
+  {
+    timer_wheel::timer_wheel(unsigned int tick_ms)
+      : tick_ms_(tick_ms ? tick_ms : 1),
+        start_usec_(common::metrics::now_usec()),
+        now_tick_(0),
+        n_armed_(0),
+        runner_(this)
+    {
+      thread_.set_entry( runner_ );
+    }
+
+    timer_wheel::~timer_wheel()
+    {
+      stop();
+
+      // disarm what is left, so the timers' destructors will not touch us
+      scoped_adaptive_mutex m(mtx_);
+      for( unsigned int l=0;l<n_levels_;++l )
+      {
+        for( unsigned int s=0;s<n_slots_;++s )
+        {
+          timer * h = &(slots_[l][s]);
+          while( h->next_ != h )
+          {
+            timer * t = h->next_;
+            unlink( t );
+            t->wheel_ = 0;
+          }
+        }
+      }
+      while( expired_.next_ != &expired_ )
+      {
+        timer * t = expired_.next_;
+        unlink( t );
+        t->wheel_ = 0;
+      }
+      n_armed_ = 0;
+    }
+
+    void timer_wheel::link(timer * h, timer * t)
+    {
+      t->prev_        = h->prev_;
+      t->next_        = h;
+      h->prev_->next_ = t;
+      h->prev_        = t;
+    }
+
+    void timer_wheel::unlink(timer * t)
+    {
+      t->prev_->next_ = t->next_;
+      t->next_->prev_ = t->prev_;
+      t->prev_ = t->next_ = 0;
+    }
+
+    void timer_wheel::place(timer * t)
+    {
+      uint64_t expires = t->expires_;
+      uint64_t diff    = (expires > now_tick_ ? expires - now_tick_ : 0);
+
+      if( diff == 0 )
+      {
+        // already due: run at the next advance
+        link( &expired_, t );
+        return;
+      }
+
+      unsigned int level = 0;
+      while( level < n_levels_-1 && diff >= (1ULL << ((level+1)*level_bits_)) ) ++level;
+
+      // beyond the range of the wheel: park in the farthest slot, it will be re-placed
+      if( diff >= (1ULL << (n_levels_*level_bits_)) )
+      {
+        expires = now_tick_ + (1ULL << (n_levels_*level_bits_)) - 1;
+      }
+
+      unsigned int slot = static_cast<unsigned int>((expires >> (level*level_bits_)) & (n_slots_-1));
+      link( &(slots_[level][slot]), t );
+    }
+
+    void timer_wheel::cascade(unsigned int level)
+    {
+      unsigned int slot = static_cast<unsigned int>((now_tick_ >> (level*level_bits_)) & (n_slots_-1));
+
+      // the next level is due when this one wraps around
+      if( slot == 0 && level+1 < n_levels_ ) cascade( level+1 );
+
+      timer * h = &(slots_[level][slot]);
+      while( h->next_ != h )
+      {
+        timer * t = h->next_;
+        unlink( t );
+        place( t );
+      }
+    }
+
+    bool timer_wheel::arm(timer & t, uint64_t delay_ms)
+    {
+      uint64_t elapsed = elapsed_ms();
+
+      scoped_adaptive_mutex m(mtx_);
+
+      // advance_to() may have been called with a time ahead of the clock
+      if( elapsed < now_tick_ * tick_ms_ ) elapsed = now_tick_ * tick_ms_;
+      uint64_t target = (elapsed + delay_ms + tick_ms_ - 1) / tick_ms_;
+
+      if( t.wheel_ != 0 && t.wheel_ != this ) return false;
+
+      if( t.wheel_ == this ) unlink( &t );
+      else                   ++n_armed_;
+
+      if( target <= now_tick_ ) target = now_tick_ + 1;
+
+      t.expires_ = target;
+      t.wheel_   = this;
+      place( &t );
+      return true;
+    }
+
+    bool timer_wheel::cancel(timer & t)
+    {
+      scoped_adaptive_mutex m(mtx_);
+      if( t.wheel_ != this ) return false;
+
+      unlink( &t );
+      t.wheel_ = 0;
+      --n_armed_;
+      return true;
+    }
+
+    unsigned int timer_wheel::advance()
+    {
+      return advance_to( elapsed_ms() );
+    }
+
+    unsigned int timer_wheel::advance_to(uint64_t elapsed)
+    {
+      uint64_t target = elapsed / tick_ms_;
+
+      {
+        scoped_adaptive_mutex m(mtx_);
+
+        if( n_armed_ == 0 )
+        {
+          // nothing to cascade, jump
+          if( target > now_tick_ ) now_tick_ = target;
+        }
+
+        while( now_tick_ < target )
+        {
+          ++now_tick_;
+          unsigned int slot = static_cast<unsigned int>(now_tick_ & (n_slots_-1));
+
+          if( slot == 0 ) cascade( 1 );
+
+          timer * h = &(slots_[0][slot]);
+          while( h->next_ != h )
+          {
+            timer * t = h->next_;
+            unlink( t );
+            link( &expired_, t );
+          }
+        }
+      }
+
+      // call the expired ones one by one, they may be cancelled meanwhile
+      unsigned int ret = 0;
+      for( ;; )
+      {
+        timer * t = 0;
+        {
+          scoped_adaptive_mutex m(mtx_);
+          if( expired_.next_ == &expired_ ) break;
+          t = expired_.next_;
+          unlink( t );
+          t->wheel_ = 0;
+          --n_armed_;
+        }
+        (*t)();
+        ++ret;
+      }
+      return ret;
+    }
+
+    unsigned int timer_wheel::size()
+    {
+      scoped_adaptive_mutex m(mtx_);
+      return n_armed_;
+    }
+
+    uint64_t timer_wheel::elapsed_ms() const
+    {
+      return (common::metrics::now_usec() - start_usec_) / 1000ULL;
+    }
+
+    bool timer_wheel::start()
+    {
+      ENTER_FUNCTION();
+      runner_.stop_ = 0;
+      bool ret = thread_.start();
+      if( ret ) ret = thread_.start_event().wait(10000);
+      RETURN_FUNCTION( ret );
+    }
+
+    bool timer_wheel::stop()
+    {
+      ENTER_FUNCTION();
+      if( thread_.is_running() == false ) RETURN_FUNCTION( false );
+      runner_.stop_ = 1;
+      runner_.wakeup_.notify();
+      bool ret = thread_.exit_event().wait(10000);
+      RETURN_FUNCTION( ret );
+    }
+
+    void timer_wheel::runner::operator()(void)
+    {
+      while( stop_ == 0 )
+      {
+        wakeup_.wait( wheel_->tick_ms() );
+        if( stop_ ) break;
+        wheel_->advance();
+      }
+    }
+  }
+}
+
+/* EOF */
@@ -0,0 +1,209 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _csl_nthread_timer_wheel_hh_included_
+#define _csl_nthread_timer_wheel_hh_included_
+
+/**
+   @file timer_wheel.hh
+   @brief hierarchical timer wheel
+ */
+
+#include "codesloop/nthread/adaptive_mutex.hh"
+#include "codesloop/nthread/event.hh"
+#include "codesloop/nthread/thread.hh"
+#include "codesloop/common/common.h"
+#include "codesloop/common/obj.hh"
+#ifdef __cplusplus
+
+namespace csl
+{
+  namespace nthread
+  {
+    /**
+       @brief O(1) arm and cancel for large numbers of timeouts
+
+       the wheel has 4 levels of 256 slots. level 0 slots are one tick wide, each
+       further level is 256 times coarser. timers far in the future sit in the
+       coarse levels and are cascaded down as the time approaches, so arm() and
+       cancel() are constant time and advancing by one tick is amortized
+       constant time, independently of the number of timers.
+
+       timers are intrusive: the user derives from timer_wheel::timer and owns
+       the object. nothing is allocated by the wheel. a timer object must stay
+       alive while it is armed, its destructor cancels it.
+
+       somebody has to call advance() regularly: either an event loop (the
+       libev timer of tcp::lstnr does that), or the wheel's own thread launched
+       by start(). the expired timers are called from advance(), without the
+       internal lock held, so they may arm and cancel timers.
+
+       @code
+       class my_timeout : public timer_wheel::timer {
+         virtual void operator()(void) { ... }
+       };
+       timer_wheel w(10);    // 10 ms ticks
+       my_timeout t;
+       w.start();
+       w.arm(t, 5000);       // fires in 5 secs
+       w.arm(t, 8000);       // re-arms: now fires in 8 secs
+       w.cancel(t);
+       @endcode
+      */
+    class timer_wheel
+    {
+    public:
+      enum {
+        level_bits_ = 8,
+        n_slots_    = (1<<level_bits_),
+        n_levels_   = 4
+      };
+
+      /** @brief base class of the timers */
+      class timer
+      {
+      public:
+        timer() : prev_(0), next_(0), expires_(0), wheel_(0) {}
+        virtual ~timer() { if( wheel_ ) wheel_->cancel(*this); }
+
+        /** @brief called when the timer expires */
+        virtual void operator()(void) = 0;
+
+        /** @brief tells wether the timer is armed (racy if others arm or cancel it) */
+        inline bool is_armed() const { return (wheel_ != 0); }
+
+      private:
+        friend class timer_wheel;
+        timer *          prev_;
+        timer *          next_;
+        uint64_t         expires_;  ///<expiry tick
+        timer_wheel *    wheel_;    ///<the wheel holding the timer or NULL
+
+        // no-copy
+        timer(const timer & other);
+        timer & operator=(const timer & other);
+      };
+
+      /**
+         @brief constructor
+         @param tick_ms is the resolution of the wheel in milliseconds
+        */
+      explicit timer_wheel(unsigned int tick_ms=10);
+
+      /** @brief destructor, stops the thread and disarms the remaining timers */
+      ~timer_wheel();
+
+      /**
+         @brief arms or re-arms the timer
+         @param t is the timer
+         @param delay_ms is the delay, rounded up to ticks
+         @return false if t is armed on an other wheel
+        */
+      bool arm(timer & t, uint64_t delay_ms);
+
+      /** @brief same as arm(), reads better where the timer is known to be armed */
+      inline bool rearm(timer & t, uint64_t delay_ms) { return arm(t,delay_ms); }
+
+      /**
+         @brief disarms the timer
+         @return false if the timer was not armed on this wheel
+        */
+      bool cancel(timer & t);
+
+      /**
+         @brief calls the expired timers
+         @return the number of timers called
+        */
+      unsigned int advance();
+
+      /** @brief advances to the given time (milliseconds since the wheel was created) */
+      unsigned int advance_to(uint64_t elapsed_ms);
+
+      /** @brief the number of armed timers */
+      unsigned int size();
+
+      /** @brief the tick length */
+      inline unsigned int tick_ms() const { return tick_ms_; }
+
+      /** @brief milliseconds since the wheel was created */
+      uint64_t elapsed_ms() const;
+
+      /** @brief launches a thread that calls advance() every tick */
+      bool start();
+
+      /** @brief stops the thread launched by start() */
+      bool stop();
+
+    private:
+      class runner : public thread::callback
+      {
+      public:
+        runner(timer_wheel * w) : wheel_(w), stop_(0) {}
+        virtual void operator()(void);
+        virtual ~runner() {}
+
+        timer_wheel *   wheel_;
+        volatile int    stop_;
+        event           wakeup_;
+      };
+
+      void place(timer * t);
+      void cascade(unsigned int level);
+      static void link(timer * head, timer * t);
+      static void unlink(timer * t);
+
+      unsigned int   tick_ms_;
+      uint64_t       start_usec_;
+      uint64_t       now_tick_;
+      unsigned int   n_armed_;
+      adaptive_mutex mtx_;
+      runner         runner_;
+      thread         thread_;
+
+      /* list heads: a dummy timer per slot, plus the expired list */
+      class head : public timer
+      {
+      public:
+        head() { prev_ = next_ = this; }
+        virtual void operator()(void) {}
+        virtual ~head() { prev_ = next_ = this; }
+      };
+
+      head   slots_[n_levels_][n_slots_];
+      head   expired_;
+
+      // no-copy
+      timer_wheel(const timer_wheel & other);
+      timer_wheel & operator=(const timer_wheel & other);
+
+      CSL_OBJ(csl::nthread, timer_wheel);
+    };
+  }
+}
+
+#endif /* __cplusplus */
+#endif /* _csl_nthread_timer_wheel_hh_included_ */
+
+/* EOF */
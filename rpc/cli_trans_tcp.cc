@@ -43,6 +43,39 @@ namespace csl
 {
   namespace rpc
   {
+    cli_trans_tcp::cli_trans_tcp() : pool_(0), conn_(0), n_pending_(0), broken_(false)
+    {
+      ::memset( &peer_,0,sizeof(peer_) );
+    }
+
+    cli_trans_tcp::~cli_trans_tcp()
+    {
+      // unread responses would be left for the next user of the connection
+      if( pool_ && conn_ ) { pool_->give_back( conn_, !broken_ && n_pending_ == 0 ); }
+    }
+
+    void cli_trans_tcp::use_pool(csl::comm::tcp::pool & p)
+    {
+      pool_ = &p;
+    }
+
+    /* leases a pooled connection for the next exchange, unless one is held */
+    bool cli_trans_tcp::acquire()
+    {
+      if( conn_ ) return true;
+      if( pool_ == 0 ) return false;
+      conn_   = pool_->lease( peer_ );
+      broken_ = false;
+      return (conn_ != 0);
+    }
+
+    /* gives back the pooled connection once every response has been read */
+    void cli_trans_tcp::release()
+    {
+      if( pool_ == 0 || conn_ == 0 || n_pending_ > 0 ) return;
+      pool_->give_back( conn_, !broken_ );
+      conn_ = 0;
+    }
 
     void cli_trans_tcp::connect(const char * hostname, unsigned short port)
     {
@@ -60,7 +93,21 @@ namespace csl
       peer.sin_family  = AF_INET;
       peer.sin_port = htons( port );
 
-      bool iret = client_.init( peer );
+      bool iret = false;
+
+      if( pool_ )
+      {
+        if( conn_ ) { pool_->give_back( conn_, !broken_ && n_pending_ == 0 ); }
+        conn_      = 0;
+        n_pending_ = 0;
+        peer_      = peer;
+        iret       = acquire();
+      }
+      else
+      {
+        conn_ = &client_;
+        iret  = client_.init( peer );
+      }
 
       if ( iret ) 
         CSL_DEBUGF( L"Client connected to %s:%d", hostname, port);
@@ -88,13 +135,21 @@ namespace csl
       if ( hdata == outp_ptrs_.end() ) {
         throw csl::rpc::exc(csl::rpc::exc::rs_invalid_handle,L"cli_trans_tcp::wait");
       }
+      if ( n_pending_ > 0 ) --n_pending_;
+      if ( conn_ == 0 ) {
+        throw csl::rpc::exc(csl::rpc::exc::rs_invalid_handle,L"cli_trans_tcp::wait");
+      }
 
       // TODO: implement async
       csl::common::read_res rr;
       CSL_DEBUGF(L"Handle: %llu, Function id: %d", __handle, hdata->second.first );
-      client_.read(1024/*bytes*/,1000/*timeout*/,rr);
+      conn_->read(1024/*bytes*/,1000/*timeout*/,rr);
+      if ( rr.failed() || rr.timed_out() ) broken_ = true;
       CSL_DEBUGF(L"Read %llu bytes from socket.", rr.bytes() );
 
+      // the response is in rr, the connection may serve others meanwhile
+      release();
+
       csl::common::pbuf pb;
       csl::common::arch arch( csl::common::arch::DESERIALIZE) ;
       pb.append( rr.data(), rr.bytes() );
@@ -113,7 +168,9 @@ namespace csl
       uint8_t * data = new uint8_t[ p->size() ]; 
 
       p->copy_to( data, p->size());
-      client_.write(data, p->size());
+      if ( pool_ ) acquire();
+      if ( conn_ == 0 || conn_->write(data, p->size()) == false ) broken_ = true;
+      ++n_pending_;
 
       delete data;
     }
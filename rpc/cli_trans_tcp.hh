@@ -32,6 +32,7 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "codesloop/common/pbuf.hh"
 #include "codesloop/rpc/handle.hh"
 #include "codesloop/comm/tcp_client.hh"
+#include "codesloop/comm/tcp_pool.hh"
 #include "codesloop/rpc/cli_trans.hh"
 
 
@@ -45,6 +46,21 @@ namespace csl
       CSL_OBJ(csl::rpc,cli_trans);
 
     public:
+      cli_trans_tcp();
+      virtual ~cli_trans_tcp();
+
+      /**
+       * takes the connection from a shared pool instead of opening
+       * a private one. must be called before connect()
+       *
+       * the connection is leased for each exchange: from the first send()
+       * until the wait() for the last outstanding response, and it is
+       * given back in between, so an idle transport does not hold it.
+       *
+       * @param p the pool, must outlive this object
+       */
+      void use_pool(csl::comm::tcp::pool & p);
+
       /**
        * connects to a remote server object
        *
@@ -58,7 +74,19 @@ namespace csl
       void send(handle &, csl::common::pbuf *);
 
     private:
-      csl::comm::tcp::client client_;
+      bool acquire();
+      void release();
+
+      csl::comm::tcp::client    client_;
+      csl::comm::tcp::pool *    pool_;
+      csl::comm::tcp::client *  conn_;
+      csl::comm::SAI            peer_;
+      unsigned int              n_pending_;   ///<sent requests not waited for yet
+      bool                      broken_;
+
+      // no-copy
+      cli_trans_tcp(const cli_trans_tcp & other);
+      cli_trans_tcp & operator=(const cli_trans_tcp & other);
 
     };
   }
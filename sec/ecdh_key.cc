@@ -30,7 +30,9 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <openssl/ecdh.h>
 #include <openssl/bn.h>
 #include <openssl/objects.h>
+#include <openssl/sha.h>
 #include "codesloop/common/ustr.hh"
+#include "codesloop/common/metrics.hh"
 #include "codesloop/common/csl_common.hh"
 
 /**
@@ -44,20 +46,6 @@ namespace csl
 {
   namespace
   {
-    extern "C" void * save_to_pbuf_as_is_( const void  * in,
-                                           size_t        inlen,
-                                           void        * out,
-                                           size_t      * outlen )
-    {
-      if( !in || !inlen || !out || !outlen ) return 0;
-
-      pbuf * pbp = (pbuf *)out;
-      pbp->append((unsigned char *)in,inlen);
-      *outlen = inlen;
-
-      return out;
-    }
-
     struct oEXC
     {
       const char * reason_;
@@ -150,6 +138,220 @@ namespace csl
       return alg_nid;
     }
 
+    /* sec does not depend on nthread, so the locks are spinning on the GCC builtins */
+    struct spin_lock
+    {
+      volatile int locked_;
+
+      spin_lock() : locked_(0) {}
+
+      inline void lock()
+      {
+        while( __sync_lock_test_and_set( &locked_, 1 ) ) { while( locked_ ) { } }
+      }
+
+      inline void unlock() { __sync_lock_release( &locked_ ); }
+    };
+
+    struct scoped_spin
+    {
+      spin_lock & l_;
+      scoped_spin(spin_lock & l) : l_(l) { l_.lock(); }
+      ~scoped_spin() { l_.unlock(); }
+    };
+
+    /*
+    ** the EC_GROUP of a curve is built once per process, together with the precomputed
+    ** multiples of its generator. EC_KEY_new_by_curve_name() would rebuild it for every key.
+    */
+    struct group_cache
+    {
+      enum { max_groups_ = 16 };
+
+      struct item
+      {
+        int         nid_;
+        EC_GROUP *  group_;
+      };
+
+      item          items_[max_groups_];
+      unsigned int  n_items_;
+      spin_lock     lock_;
+
+      group_cache() : n_items_(0) {}
+
+      const EC_GROUP * get(int nid)
+      {
+        scoped_spin l(lock_);
+        for( unsigned int i=0;i<n_items_;++i )
+        {
+          if( items_[i].nid_ == nid ) return items_[i].group_;
+        }
+
+        if( n_items_ == max_groups_ ) return 0;
+
+        EC_GROUP * g = EC_GROUP_new_by_curve_name(nid);
+        if( !g ) return 0;
+        EC_GROUP_precompute_mult( g, NULL );
+
+        items_[n_items_].nid_   = nid;
+        items_[n_items_].group_ = g;
+        ++n_items_;
+        return g;
+      }
+
+      /* never destructed: keys may be converted until the very end of the process */
+      static group_cache & instance()
+      {
+        static group_cache * g = new group_cache();
+        return *g;
+      }
+    };
+
+    /*
+    ** bounded, direct mapped cache of the derived shared keys. the slots are identified
+    ** by the SHA1 of (kind, algorithm, peer public key, own private key), so no key
+    ** material is kept besides the results. the slots are protected by striped locks.
+    */
+    struct shared_key_cache
+    {
+      enum {
+        n_stripes_    = 64,
+        max_result_   = 96,
+        max_id_data_  = 1024,
+        default_size_ = 1024
+      };
+
+      struct slot
+      {
+        unsigned char  id_[SHA_DIGEST_LENGTH];
+        unsigned int   len_;
+        unsigned char  result_[max_result_];
+      };
+
+      spin_lock      stripes_[n_stripes_];
+      slot *         slots_;
+      unsigned int   size_;
+
+      csl::common::metrics::counter &  hits_;
+      csl::common::metrics::counter &  misses_;
+
+      shared_key_cache() : slots_(0), size_(0),
+        hits_(csl::common::metrics::instance().get_counter("sec.ecdh.cache.hits")),
+        misses_(csl::common::metrics::instance().get_counter("sec.ecdh.cache.misses"))
+      {
+        resize(default_size_);
+      }
+
+      void lock_all()   { for( unsigned int i=0;i<n_stripes_;++i ) stripes_[i].lock(); }
+      void unlock_all() { for( unsigned int i=n_stripes_;i>0;--i ) stripes_[i-1].unlock(); }
+
+      void resize(unsigned int n)
+      {
+        unsigned int sz = 0;
+        if( n ) { sz = 1; while( sz < n ) sz <<= 1; }
+
+        slot * s = 0;
+        if( sz ) { s = new slot[sz]; memset( s, 0, sizeof(slot)*sz ); }
+
+        lock_all();
+        slot * old = slots_;
+        slots_ = s;
+        size_  = sz;
+        unlock_all();
+
+        delete [] old;
+      }
+
+      unsigned int size()
+      {
+        scoped_spin l(stripes_[0]);
+        return size_;
+      }
+
+      static inline unsigned int index_of(const unsigned char * id)
+      {
+        unsigned int ix = 0;
+        memcpy( &ix, id, sizeof(ix) );
+        return ix;
+      }
+
+      static inline void add(unsigned char * buf, size_t & len, const void * p, size_t sz)
+      {
+        if( len+sz <= max_id_data_ ) memcpy( buf+len, p, sz );
+        len += sz;
+      }
+
+      /* computes the slot id, returns false if the keys are too big to be cached */
+      static bool make_id( unsigned char kind,
+                           const common::ustr & algname,
+                           const sec::bignum & x,
+                           const sec::bignum & y,
+                           const sec::bignum & priv,
+                           unsigned char * id )
+      {
+        unsigned char buf[max_id_data_];
+        size_t len = 0;
+        const sec::bignum * bns[3] = { &x, &y, &priv };
+
+        add( buf, len, &kind, 1 );
+        add( buf, len, algname.c_str(), algname.size()+1 );
+        for( unsigned int i=0;i<3;++i )
+        {
+          uint32_t sz = static_cast<uint32_t>(bns[i]->size());
+          unsigned char neg = (bns[i]->is_negative() ? 1 : 0);
+          add( buf, len, &sz, sizeof(sz) );
+          add( buf, len, &neg, 1 );
+          add( buf, len, bns[i]->data(), sz );
+        }
+
+        if( len > max_id_data_ ) return false;
+        SHA1( buf, len, id );
+        return true;
+      }
+
+      bool get(const unsigned char * id, unsigned char * out, unsigned int & len)
+      {
+        unsigned int ix = index_of(id);
+        scoped_spin l(stripes_[ix % n_stripes_]);
+
+        if( size_ )
+        {
+          slot & s(slots_[ix & (size_-1)]);
+          if( s.len_ && memcmp( s.id_, id, SHA_DIGEST_LENGTH ) == 0 )
+          {
+            memcpy( out, s.result_, s.len_ );
+            len = s.len_;
+            hits_.inc();
+            return true;
+          }
+        }
+        misses_.inc();
+        return false;
+      }
+
+      void put(const unsigned char * id, const unsigned char * data, unsigned int len)
+      {
+        if( len == 0 || len > max_result_ ) return;
+
+        unsigned int ix = index_of(id);
+        scoped_spin l(stripes_[ix % n_stripes_]);
+
+        if( size_ == 0 ) return;
+
+        slot & s(slots_[ix & (size_-1)]);
+        memcpy( s.id_, id, SHA_DIGEST_LENGTH );
+        memcpy( s.result_, data, len );
+        s.len_ = len;
+      }
+
+      static shared_key_cache & instance()
+      {
+        static shared_key_cache * c = new shared_key_cache();
+        return *c;
+      }
+    };
+
     struct oEC_KEY
     {
       EC_KEY * key_;
@@ -158,6 +360,27 @@ namespace csl
 
       void reset() { if( key_ ) { EC_KEY_free(key_); key_ = 0; } }
 
+      /* allocates the key on the process wide group of the curve */
+      void new_key(int alg_nid)
+      {
+        const EC_GROUP * group = group_cache::instance().get(alg_nid);
+
+        if( !group )
+        {
+          THROWEXC("oEC_KEY cannot get group!");
+        }
+
+        if( (key_=EC_KEY_new()) == NULL )
+        {
+          THROWEXC("oEC_KEY cannot allocate key!");
+        }
+
+        if( EC_KEY_set_group(key_,group) == 0 )
+        {
+          THROWEXC("oEC_KEY cannot set group!");
+        }
+      }
+
       bool gen_key(const common::ustr & algname)
       {
         int alg_nid = NID_undef;
@@ -174,10 +397,7 @@ namespace csl
         /* get algorithm id */
         if( (alg_nid = name_to_nid_(algname.c_str())) != NID_undef ) // TODO
         {
-          if( (key_=EC_KEY_new_by_curve_name(alg_nid)) == NULL )
-          {
-            THROWEXC("oEC_KEY cannot allocate key!");
-          }
+          new_key(alg_nid);
 
           if( (EC_KEY_generate_key(key_)) == 0 )
           {
@@ -205,10 +425,7 @@ namespace csl
         /* get algorithm id */
         if( (alg_nid = name_to_nid_(algname.c_str())) != NID_undef )
         {
-          if( (key_=EC_KEY_new_by_curve_name(alg_nid)) == NULL )
-          {
-            THROWEXC("oEC_KEY cannot allocate key!");
-          }
+          new_key(alg_nid);
           return true;
         }
         return false;
@@ -356,7 +573,7 @@ namespace csl
     unsigned int ecdh_key::algorithm_strength(const common::ustr & algname)
     {
       int nid = NID_undef;
-      EC_GROUP * group = 0;
+      const EC_GROUP * group = 0;
       unsigned int strength = 0;
 
       if( !algname.size() ) return 0;
@@ -365,12 +582,10 @@ namespace csl
       if( (nid = name_to_nid_(algname.c_str())) == NID_undef )
         return 0;  /* unknown algorithm */
 
-      if( (group = EC_GROUP_new_by_curve_name(nid)) == NULL )
+      if( (group = group_cache::instance().get(nid)) == NULL )
         return 0;  /* cannot allocate memory ? */
 
       strength = EC_GROUP_get_degree( group );
-
-      EC_GROUP_free( group );
       return strength;
     }
 
@@ -405,6 +620,19 @@ namespace csl
     {
       try
       {
+        shared_key_cache & cache(shared_key_cache::instance());
+        unsigned char id[SHA_DIGEST_LENGTH];
+        unsigned char cached[shared_key_cache::max_result_];
+        unsigned int  cached_len = 0;
+
+        bool has_id = shared_key_cache::make_id( 'h', algname_, x_, y_, peer_private_key, id );
+
+        if( has_id && cache.get( id, cached, cached_len ) )
+        {
+          shared_key = reinterpret_cast<const char *>(cached);
+          return true;
+        }
+
         oEC_POINT pub_key;
         oEC_KEY   priv_key;
 
@@ -423,6 +651,11 @@ namespace csl
           return false;
         }
         shared_key = tmpdigest;
+
+        if( has_id )
+        {
+          cache.put( id, reinterpret_cast<const unsigned char *>(tmpdigest), SHA1_HEX_DIGEST_STR_LENGTH );
+        }
         return true;
       }
       catch(oEXC xc)
@@ -436,6 +669,18 @@ namespace csl
     {
       try
       {
+        shared_key_cache & cache(shared_key_cache::instance());
+        unsigned char id[SHA_DIGEST_LENGTH];
+        unsigned char cached[shared_key_cache::max_result_];
+        unsigned int  cached_len = 0;
+
+        bool has_id = shared_key_cache::make_id( 'r', algname_, x_, y_, peer_private_key, id );
+
+        if( has_id && cache.get( id, cached, cached_len ) )
+        {
+          return shared_key.append( cached, cached_len );
+        }
+
         oEC_POINT pub_key;
         oEC_KEY   priv_key;
 
@@ -443,15 +688,20 @@ namespace csl
         priv_key.privkey_from_bignum( peer_private_key, algname_ );
         pub_key.from_coordinates( x_, y_, priv_key );
 
-        if( (ECDH_compute_key( &shared_key,
-                               pbuf::buf_size,
-                               pub_key.point_,
-                               priv_key.key_,
-                               save_to_pbuf_as_is_ )) == 0 )
+        /* the raw secret is never longer than the field size */
+        unsigned char res[shared_key_cache::max_result_];
+        int len = ECDH_compute_key( res,
+                                    shared_key_cache::max_result_,
+                                    pub_key.point_,
+                                    priv_key.key_,
+                                    NULL );
+        if( len <= 0 )
         {
           return false;
         }
-        return true;
+
+        if( has_id ) { cache.put( id, res, static_cast<unsigned int>(len) ); }
+        return shared_key.append( res, static_cast<uint64_t>(len) );
       }
       catch(oEXC xc)
       {
@@ -509,6 +759,16 @@ namespace csl
       return ret;
     }
 
+    void ecdh_key::shared_key_cache_size(unsigned int n)
+    {
+      shared_key_cache::instance().resize(n);
+    }
+
+    unsigned int ecdh_key::shared_key_cache_size()
+    {
+      return shared_key_cache::instance().size();
+    }
+
     ecdh_key::ecdh_key() { }
     ecdh_key::~ecdh_key() { }
 
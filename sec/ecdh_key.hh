@@ -130,6 +130,20 @@ namespace csl
          */
         bool gen_shared_key(const bignum & peer_private_key, pbuf & shared_key) const;
 
+        /**
+        @brief sets the number of shared keys remembered by the process
+        @param n is rounded up to a power of two, 0 disables the cache
+
+        gen_shared_key() and gen_sha1hex_shared_key() look up their result in a process
+        wide, direct mapped cache before doing the ECDH computation, so a reconnecting
+        peer costs a hash instead of a point multiplication. the slots are identified
+        by the SHA1 of the (algorithm, public key, private key) triple. 1024 by default.
+        */
+        static void shared_key_cache_size(unsigned int n);
+
+        /** @brief the number of slots in the shared key cache */
+        static unsigned int shared_key_cache_size();
+
 
         /** @brief print debug info */
         void print() const;
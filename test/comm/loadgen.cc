@@ -0,0 +1,794 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+   @file loadgen.cc
+   @brief loopback load generator of the comm module (csl_loadgen)
+
+   starts the servers and the clients in one process and reports the request
+   rate and the latency distribution:
+
+   @code
+   csl_loadgen [-c conns] [-s size] [-r rate] [-d seconds] [-t threads]
+               [-b batch] [-p port] [-i] [-u] tcp|udp|handshake|all
+   @endcode
+
+   - tcp : echo over tcp::lstnr (-i runs the handler on the loop, -u uses io_uring)
+   - udp : echo over udp::recvr (-b sets the recvmmsg() and sendmmsg() batch)
+   - handshake : hello, auth and a data exchange per client over the udp servers
+
+   -r 0 (the default) is closed loop: every client waits for the reply before it
+   sends the next request. otherwise the clients send rate requests per second
+   together, on schedule, and the latency is measured from the scheduled time so
+   a stalled server shows up in the tail instead of slowing the clients down.
+ */
+
+#include "codesloop/comm/tcp_lstnr.hh"
+#include "codesloop/comm/tcp_client.hh"
+#include "codesloop/comm/udp_recvr.hh"
+#include "codesloop/comm/udp_hello.hh"
+#include "codesloop/comm/udp_auth.hh"
+#include "codesloop/comm/udp_data.hh"
+#include "codesloop/comm/udp_session.hh"
+#include "codesloop/comm/initcomm.hh"
+#include "codesloop/nthread/thread.hh"
+#include "codesloop/nthread/mutex.hh"
+#include "codesloop/common/metrics.hh"
+#include "codesloop/common/read_res.hh"
+#include "codesloop/common/common.h"
+#include <unistd.h>
+#include <poll.h>
+#include <string>
+#include <vector>
+#include <map>
+
+using namespace csl::common;
+using namespace csl::comm;
+using namespace csl::nthread;
+using namespace csl::sec;
+
+/** @brief the load generator */
+namespace loadgen {
+
+  /*
+  ** DEBUG support --------------------------------------------------------------------
+  */
+  static inline const wchar_t * get_namespace()   { return L"loadgen"; }
+  static inline const wchar_t * get_class_name()  { return L"loadgen::noclass"; }
+  static inline const wchar_t * get_class_short() { return L"noclass"; }
+
+  enum {
+    seq_size_     = 8,        ///<every request starts with its sequence number
+    window_       = 1<<16,    ///<the most requests a client may have in flight
+    timeout_ms_   = 1000,     ///<a reply later than this is counted as lost
+    max_udp_size_ = 1400,
+    max_data_     = 1024      ///<the payload limit of udp::data_cli
+  };
+
+  /* the default ports are below the ephemeral range, client sockets cannot hold them */
+  struct options
+  {
+    unsigned int conns_;
+    unsigned int size_;
+    unsigned int rate_;
+    unsigned int seconds_;
+    unsigned int threads_;
+    unsigned int batch_;
+    unsigned int port_;
+    bool         inline_;
+    bool         uring_;
+
+    options() : conns_(4), size_(64), rate_(0), seconds_(5), threads_(4),
+                batch_(1), port_(17790), inline_(false), uring_(false) { }
+  };
+
+  static SAI loopback(unsigned int port)
+  {
+    SAI addr;
+    ::memset( &addr,0,sizeof(addr) );
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port        = htons(static_cast<unsigned short>(port));
+    return addr;
+  }
+
+  static void put_seq(uint8_t * p, uint64_t seq) { ::memcpy( p, &seq, seq_size_ ); }
+  static uint64_t get_seq(const uint8_t * p)     { uint64_t s; ::memcpy( &s, p, seq_size_ ); return s; }
+
+  /**
+  @brief one client thread: sends the requests and matches the replies
+
+  the derived classes implement the transport, this class does the scheduling
+  and the bookkeeping.
+  */
+  class load_client : public thread::callback
+  {
+    public:
+      uint64_t sent_;
+      uint64_t received_;
+      uint64_t errors_;
+
+      load_client(const options & o, unsigned int rate, metrics::histogram & h)
+        : sent_(0), received_(0), errors_(0), size_(o.size_), seconds_(o.seconds_),
+          rate_(rate), hist_(&h), sched_(window_,0) { }
+
+      virtual ~load_client() { }
+
+      virtual void operator()(void)
+      {
+        if( connect() == false ) { ++errors_; return; }
+
+        std::vector<uint8_t> req(size_,'x');
+        uint64_t start = metrics::now_usec();
+        uint64_t end   = start + static_cast<uint64_t>(seconds_)*1000000;
+
+        if( rate_ == 0 ) closed_loop( req, end );
+        else             open_loop( req, start, end );
+
+        // what did not arrive by now is lost
+        if( sent_ > received_+errors_ ) errors_ = sent_-received_;
+        disconnect();
+      }
+
+    protected:
+      unsigned int  size_;
+
+      virtual bool connect() = 0;
+      virtual void disconnect() = 0;
+      virtual bool send_req(const uint8_t * req) = 0;
+
+      /* waits up to timeout_us for replies, stores their sequence numbers, returns their count */
+      virtual unsigned int recv_replies(uint64_t timeout_us, uint64_t * seqs, unsigned int max) = 0;
+
+      /* poll() only has millisecond resolution, which is too coarse for the schedule */
+      static bool wait_readable(int fd, uint64_t timeout_us)
+      {
+        struct pollfd pfd;
+        pfd.fd      = fd;
+        pfd.events  = POLLIN;
+        pfd.revents = 0;
+#ifdef __linux__
+        struct timespec ts;
+        ts.tv_sec  = static_cast<time_t>(timeout_us / 1000000);
+        ts.tv_nsec = static_cast<long>((timeout_us % 1000000) * 1000);
+        return ( ::ppoll( &pfd, 1, &ts, 0 ) > 0 );
+#else
+        return ( PollSocket( &pfd, 1, static_cast<int>((timeout_us+999)/1000) ) > 0 );
+#endif /*__linux__*/
+      }
+
+    private:
+      unsigned int            seconds_;
+      unsigned int            rate_;
+      metrics::histogram *    hist_;
+      std::vector<uint64_t>   sched_;
+
+      void closed_loop(std::vector<uint8_t> & req, uint64_t end)
+      {
+        uint64_t seq = 0;
+        uint64_t got[64];
+
+        while( metrics::now_usec() < end )
+        {
+          uint64_t sent_at = metrics::now_usec();
+          put_seq( &(req[0]), seq );
+          if( send_req( &(req[0]) ) == false ) { ++errors_; return; }
+          ++sent_;
+
+          // late replies of earlier requests are skipped
+          bool found = false;
+          while( found == false )
+          {
+            uint64_t waited = metrics::now_usec()-sent_at;
+            if( waited >= timeout_ms_*1000 ) break;
+
+            unsigned int n = recv_replies( timeout_ms_*1000-waited, got, 64 );
+            for( unsigned int i=0;i<n;++i ) { if( got[i] == seq ) found = true; }
+          }
+
+          if( found ) { hist_->record( metrics::now_usec()-sent_at ); ++received_; }
+          else        { ++errors_; }
+          ++seq;
+        }
+      }
+
+      void open_loop(std::vector<uint8_t> & req, uint64_t start, uint64_t end)
+      {
+        uint64_t interval = 1000000 / rate_;
+        uint64_t next     = start;
+        uint64_t seq      = 0;
+        uint64_t got[64];
+
+        if( interval == 0 ) interval = 1;
+
+        while( true )
+        {
+          uint64_t now = metrics::now_usec();
+
+          for( ; next <= now && next < end; next += interval )
+          {
+            if( sent_-received_ >= window_ ) { ++errors_; continue; }
+
+            sched_[seq % window_] = next;
+            put_seq( &(req[0]), seq );
+            if( send_req( &(req[0]) ) == false ) { ++errors_; return; }
+            ++sent_;
+            ++seq;
+          }
+
+          if( next >= end && (received_ >= sent_ || now >= end+timeout_ms_*1000) ) break;
+
+          uint64_t wait_us = ( next > now ? next-now : 0 );
+          if( next >= end ) wait_us = 10000;
+
+          unsigned int n = recv_replies( wait_us, got, 64 );
+          now = metrics::now_usec();
+          for( unsigned int i=0;i<n;++i )
+          {
+            if( got[i] >= seq || seq-got[i] > window_ ) continue;
+            hist_->record( now-sched_[got[i] % window_] );
+            ++received_;
+          }
+        }
+      }
+  };
+
+  /* echo server handler of the tcp scenario, the loop sends the appended reply */
+  class tcp_echo : public csl::comm::handler
+  {
+    public:
+      virtual bool on_connected( connid_t id, const SAI & sai, bfd & buf_fd ) { return true; }
+
+      virtual bool on_data_arrival( connid_t id, const SAI & sai, bfd & buf_fd )
+      {
+        read_res rr;
+        while( buf_fd.size() > 0 && buf_fd.read_buf( rr, buf_fd.size() ) )
+        {
+          if( buf_fd.append( rr.data(), rr.bytes() ) == false ) return false;
+        }
+        return true;
+      }
+
+      virtual void on_disconnected( connid_t id, const SAI & sai ) { }
+
+      CSL_OBJ(loadgen,tcp_echo);
+  };
+
+  class tcp_load : public load_client
+  {
+    public:
+      tcp_load(const options & o, unsigned int rate, metrics::histogram & h, SAI addr)
+        : load_client(o,rate,h), addr_(addr), have_(0), part_(o.size_) { }
+
+    protected:
+      virtual bool connect()
+      {
+        if( c_.init( addr_, timeout_ms_ ) == false ) return false;
+        c_.set_nodelay( true );
+        return true;
+      }
+
+      virtual void disconnect() { c_.close(); }
+
+      virtual bool send_req(const uint8_t * req) { return c_.write( req, size_ ); }
+
+      virtual unsigned int recv_replies(uint64_t timeout_us, uint64_t * seqs, unsigned int max)
+      {
+        unsigned int n = 0;
+        read_res rr;
+        c_.read( size_-have_, 0, rr );
+        if( rr.bytes() == 0 && wait_readable( c_.socket(), timeout_us ) ) c_.read( size_-have_, 0, rr );
+
+        // the stream is cut into replies of size_ bytes
+        while( rr.bytes() > 0 )
+        {
+          ::memcpy( &(part_[have_]), rr.data(), static_cast<size_t>(rr.bytes()) );
+          have_ += static_cast<unsigned int>(rr.bytes());
+          if( have_ == size_ )
+          {
+            if( n < max ) seqs[n++] = get_seq( &(part_[0]) );
+            have_ = 0;
+          }
+          rr.reset();
+          c_.read( size_-have_, 0, rr );
+        }
+        return n;
+      }
+
+    private:
+      SAI                    addr_;
+      tcp::client            c_;
+      unsigned int           have_;
+      std::vector<uint8_t>   part_;
+  };
+
+  /* echo server handler of the udp scenario */
+  class udp_echo : public udp::recvr::msg_handler
+  {
+    public:
+      virtual void operator()(void)
+      {
+        udp::msg ms;
+        {
+          scoped_mutex mm(msgs_->mtx_);
+          if( msgs_->n_items() == 0 ) return;
+          ms.take( msgs_->pop() );
+        }
+        send_reply( ms );
+      }
+  };
+
+  class udp_load : public load_client
+  {
+    public:
+      udp_load(const options & o, unsigned int rate, metrics::histogram & h, SAI addr)
+        : load_client(o,rate,h), addr_(addr), sock_(-1), buf_(max_udp_size_) { }
+
+    protected:
+      virtual bool connect()
+      {
+        sock_ = static_cast<int>(::socket( AF_INET, SOCK_DGRAM, 0 ));
+        if( sock_ < 0 ) return false;
+        return ( ::connect( sock_, reinterpret_cast<struct sockaddr *>(&addr_), sizeof(addr_) ) == 0 );
+      }
+
+      virtual void disconnect() { if( sock_ >= 0 ) ShutdownCloseSocket( sock_ ); sock_ = -1; }
+
+      virtual bool send_req(const uint8_t * req)
+      {
+        return ( ::send( sock_, reinterpret_cast<const char *>(req), size_, 0 ) == static_cast<int>(size_) );
+      }
+
+      virtual unsigned int recv_replies(uint64_t timeout_us, uint64_t * seqs, unsigned int max)
+      {
+        unsigned int n = 0;
+
+        // waits for the first one only, then takes what is there
+        while( n < max && wait_readable( sock_, (n == 0 ? timeout_us : 0) ) )
+        {
+          int r = static_cast<int>(::recv( sock_, reinterpret_cast<char *>(&(buf_[0])), buf_.size(), 0 ));
+          if( r < seq_size_ ) break;
+          seqs[n++] = get_seq( &(buf_[0]) );
+        }
+        return n;
+      }
+
+    private:
+      SAI                    addr_;
+      int                    sock_;
+      std::vector<uint8_t>   buf_;
+  };
+
+  /* the session table behind the udp data server, as an application would keep it */
+  struct session_store
+  {
+    typedef std::vector<unsigned char>  key_t;
+    typedef std::map<key_t,ustr>        map_t;
+
+    mutex  mtx_;
+    map_t  m_;
+
+    static key_t key(const udp::saltbuf_t & s) { return key_t( s.data(), s.data()+s.size() ); }
+  };
+
+  class register_cb : public udp::register_auth_callback
+  {
+    public:
+      session_store * store_;
+      register_cb(session_store & s) : store_(&s) { }
+
+      bool operator()( const SAI & addr, const ustr & login, const ustr & pass,
+                       const ustr & session_key, const udp::saltbuf_t & peer_salt,
+                       udp::saltbuf_t & my_salt )
+      {
+        scoped_mutex m(store_->mtx_);
+        store_->m_[session_store::key(peer_salt)] = session_key;
+        return true;
+      }
+  };
+
+  class lookup_cb : public udp::lookup_session_callback
+  {
+    public:
+      session_store * store_;
+      lookup_cb(session_store & s) : store_(&s) { }
+
+      bool operator()( const udp::saltbuf_t & old_salt, const SAI & addr, ustr & sesskey )
+      {
+        scoped_mutex m(store_->mtx_);
+        session_store::map_t::iterator it = store_->m_.find( session_store::key(old_salt) );
+        if( it == store_->m_.end() ) return false;
+        sesskey = it->second;
+        return true;
+      }
+  };
+
+  class update_cb : public udp::update_session_callback
+  {
+    public:
+      session_store * store_;
+      update_cb(session_store & s) : store_(&s) { }
+
+      bool operator()( const udp::saltbuf_t & old_salt, const udp::saltbuf_t & new_salt,
+                       const SAI & addr, const ustr & sesskey )
+      {
+        scoped_mutex m(store_->mtx_);
+        store_->m_.erase( session_store::key(old_salt) );
+        store_->m_[session_store::key(new_salt)] = sesskey;
+        return true;
+      }
+  };
+
+  /* echoes the data packets */
+  class data_echo_cb : public udp::handle_data_callback
+  {
+    public:
+      bool operator()( const udp::saltbuf_t & old_salt, const udp::saltbuf_t & new_salt,
+                       const SAI & addr, const ustr & sesskey, int sock,
+                       const udp::b1024_t & data )
+      {
+        return send_reply( old_salt, new_salt, addr, sesskey, sock, data );
+      }
+  };
+
+  /**
+  @brief a client of the handshake scenario
+
+  every client does its own hello and auth, then exchanges data packets until the
+  time is up. the data protocol changes the salt with every reply, so there is one
+  request in flight and the rate is not applied.
+  */
+  class handshake_load : public thread::callback
+  {
+    public:
+      uint64_t sent_;
+      uint64_t received_;
+      uint64_t errors_;
+
+      handshake_load(const options & o, SAI hello_addr, SAI auth_addr, SAI data_addr,
+                     metrics::histogram & hs, metrics::histogram & dh)
+        : sent_(0), received_(0), errors_(0), seconds_(o.seconds_),
+          size_(o.size_ > max_data_ ? static_cast<unsigned int>(max_data_) : o.size_),
+          hello_addr_(hello_addr), auth_addr_(auth_addr), data_addr_(data_addr),
+          handshake_(&hs), data_(&dh) { }
+
+      virtual ~handshake_load() { }
+
+      virtual void operator()(void)
+      {
+        udp::hello_cli ch;
+        udp::auth_cli  ca;
+        udp::data_cli  cd;
+
+        ch.use_exc(false);
+        ca.use_exc(false);
+        cd.use_exc(false);
+        ch.addr( hello_addr_ );
+        ca.addr( auth_addr_ );
+        cd.addr( data_addr_ );
+
+        ecdh_key pubkey;
+        bignum   privkey;
+        pubkey.algname("prime192v3");
+        if( pubkey.gen_keypair(privkey) == false ) { ++errors_; return; }
+
+        ch.private_key( privkey );
+        ch.public_key( pubkey );
+        ca.private_key( privkey );
+        ca.public_key( pubkey );
+        ca.login( "loadgen" );
+        ca.pass( "loadgen" );
+
+        uint64_t start = metrics::now_usec();
+        if( ch.hello( timeout_ms_ ) == false ) { ++errors_; return; }
+        ca.server_public_key( ch.server_public_key() );
+        if( ca.auth( timeout_ms_ ) == false )  { ++errors_; return; }
+        handshake_->record( metrics::now_usec()-start );
+
+        cd.server_salt( ca.server_salt() );
+        cd.my_salt( ca.my_salt() );
+        cd.session_key( ca.session_key() );
+
+        std::vector<uint8_t> payload( size_, 'x' );
+        udp::b1024_t in, out;
+        in.set( &(payload[0]), size_ );
+
+        uint64_t end = start + static_cast<uint64_t>(seconds_)*1000000;
+        while( metrics::now_usec() < end )
+        {
+          uint64_t sent_at = metrics::now_usec();
+          if( cd.send( in ) == false ) { ++errors_; return; }
+          ++sent_;
+          // a lost packet leaves the salts out of sync, the client stops then
+          if( cd.recv( out, timeout_ms_ ) == false ) { ++errors_; return; }
+          data_->record( metrics::now_usec()-sent_at );
+          ++received_;
+        }
+      }
+
+    private:
+      unsigned int          seconds_;
+      unsigned int          size_;
+      SAI                   hello_addr_;
+      SAI                   auth_addr_;
+      SAI                   data_addr_;
+      metrics::histogram *  handshake_;
+      metrics::histogram *  data_;
+  };
+
+  static void print_result( const char * name, const options & o,
+                            uint64_t sent, uint64_t received, uint64_t errors,
+                            uint64_t elapsed, const metrics::histogram & h )
+  {
+    printf( "%-10s conns:%u size:%u rate:%u sent:%llu recv:%llu lost:%llu %10.1f req/s\n",
+            name, o.conns_, o.size_, o.rate_,
+            static_cast<unsigned long long>(sent),
+            static_cast<unsigned long long>(received),
+            static_cast<unsigned long long>(errors),
+            (elapsed ? 1000000.0*static_cast<double>(received)/static_cast<double>(elapsed) : 0.0) );
+    printf( "%-10s usec p50:%llu p90:%llu p99:%llu p99.9:%llu max:%llu\n", "",
+            static_cast<unsigned long long>(h.percentile(50.0)),
+            static_cast<unsigned long long>(h.percentile(90.0)),
+            static_cast<unsigned long long>(h.percentile(99.0)),
+            static_cast<unsigned long long>(h.percentile(99.9)),
+            static_cast<unsigned long long>(h.max()) );
+  }
+
+  /* starts the clients, waits for them and prints the summary, false if nothing came back */
+  template <typename C> static bool run_clients( const char * name, const options & o,
+                                                 std::vector<C *> & clients,
+                                                 const metrics::histogram & h )
+  {
+    std::vector<thread *> threads;
+    uint64_t start = metrics::now_usec();
+
+    for( size_t i=0;i<clients.size();++i )
+    {
+      thread * t = new thread();
+      t->set_entry( *(clients[i]) );
+      if( t->start() == false ) { delete t; continue; }
+      threads.push_back( t );
+    }
+
+    uint64_t sent = 0, received = 0, errors = 0;
+    for( size_t i=0;i<threads.size();++i )
+    {
+      threads[i]->exit_event().wait( (o.seconds_+10)*1000 );
+      delete threads[i];
+    }
+    uint64_t elapsed = metrics::now_usec() - start;
+
+    for( size_t i=0;i<clients.size();++i )
+    {
+      sent     += clients[i]->sent_;
+      received += clients[i]->received_;
+      errors   += clients[i]->errors_;
+      delete clients[i];
+    }
+    clients.clear();
+
+    print_result( name, o, sent, received, errors, elapsed, h );
+    return ( received > 0 );
+  }
+
+  /* the total rate split between the clients */
+  static unsigned int client_rate(const options & o, unsigned int i)
+  {
+    if( o.rate_ == 0 ) return 0;
+    unsigned int r = o.rate_ / o.conns_ + ( i < o.rate_ % o.conns_ ? 1 : 0 );
+    return ( r ? r : 1 );
+  }
+
+  bool run_tcp(const options & o)
+  {
+    SAI addr = loopback( o.port_ );
+    tcp_echo h;
+    tcp::lstnr l;
+
+    l.set_inline( o.inline_ );
+    l.set_workers( 1, o.threads_ );
+    if( o.uring_ ) l.set_backend( tcp::lstnr::uring_ );
+    if( l.init( h, addr ) == false || l.start() == false )
+    {
+      fprintf( stderr, "cannot start the tcp listener on port %u\n", o.port_ );
+      return false;
+    }
+
+    metrics::histogram & hist( metrics::instance().get_histogram("loadgen.tcp.rtt_usec") );
+    std::vector<tcp_load *> clients;
+    for( unsigned int i=0;i<o.conns_;++i ) clients.push_back( new tcp_load( o, client_rate(o,i), hist, addr ) );
+
+    bool ret = run_clients( (l.backend() == tcp::lstnr::uring_ ? "tcp/uring" : "tcp"), o, clients, hist );
+
+    l.stop();
+    l.exit_event().wait( 7000 );
+    return ret;
+  }
+
+  bool run_udp(const options & o)
+  {
+    udp_echo   h;
+    udp::recvr r;
+    thread     t;
+
+    r.addr( loopback( o.port_+1 ) );
+    r.batch( o.batch_ );
+    r.reply_batch( o.batch_ );
+    if( r.start( 1, o.threads_, 200, 3, h ) == false )
+    {
+      fprintf( stderr, "cannot start the udp receiver on port %u\n", o.port_+1 );
+      return false;
+    }
+    t.set_entry( r );
+    t.start();
+
+    metrics::histogram & hist( metrics::instance().get_histogram("loadgen.udp.rtt_usec") );
+    std::vector<udp_load *> clients;
+    for( unsigned int i=0;i<o.conns_;++i ) clients.push_back( new udp_load( o, client_rate(o,i), hist, r.addr() ) );
+
+    bool ret = run_clients( "udp", o, clients, hist );
+
+    r.stop();
+    t.exit_event().wait( 2000 );
+    return ret;
+  }
+
+  bool run_handshake(const options & o)
+  {
+    SAI ha = loopback( o.port_+2 );
+    SAI aa = loopback( o.port_+3 );
+    SAI da = loopback( o.port_+4 );
+
+    // the servers go first at the end, they still use the callbacks and the cache
+    session_store       store;
+    register_cb         rcb( store );
+    lookup_cb           lcb( store );
+    update_cb           ucb( store );
+    data_echo_cb        dcb;
+    udp::session_cache  cache;
+
+    udp::hello_srv hs;
+    udp::auth_srv  as;
+    udp::data_srv  ds;
+    hs.use_exc(false);
+    as.use_exc(false);
+    ds.use_exc(false);
+    hs.addr( ha );
+    as.addr( aa );
+    ds.addr( da );
+
+    ecdh_key pubkey;
+    bignum   privkey;
+    pubkey.algname("prime192v3");
+    if( pubkey.gen_keypair(privkey) == false ) return false;
+    hs.private_key( privkey );
+    hs.public_key( pubkey );
+    as.private_key( privkey );
+    as.public_key( pubkey );
+
+    as.register_auth_cb( rcb );
+    ds.lookup_session_cb( lcb );
+    ds.update_session_cb( ucb );
+    ds.handle_data_cb( dcb );
+    ds.use_session_cache( cache );
+    hs.set_threadpool_params( 1, o.threads_, 200, 3 );
+    as.set_threadpool_params( 1, o.threads_, 200, 3 );
+    ds.set_threadpool_params( 1, o.threads_, 200, 3 );
+
+    if( hs.start() == false || as.start() == false || ds.start() == false )
+    {
+      fprintf( stderr, "cannot start the udp servers on ports %u-%u\n", o.port_+2, o.port_+4 );
+      return false;
+    }
+
+    metrics::histogram & hist( metrics::instance().get_histogram("loadgen.handshake.usec") );
+    metrics::histogram & data( metrics::instance().get_histogram("loadgen.data.rtt_usec") );
+    std::vector<handshake_load *> clients;
+    for( unsigned int i=0;i<o.conns_;++i ) clients.push_back( new handshake_load( o, ha, aa, da, hist, data ) );
+
+    bool ret = run_clients( "data", o, clients, data );
+    printf( "%-10s usec p50:%llu p90:%llu p99:%llu max:%llu (%llu handshakes)\n", "handshake",
+            static_cast<unsigned long long>(hist.percentile(50.0)),
+            static_cast<unsigned long long>(hist.percentile(90.0)),
+            static_cast<unsigned long long>(hist.percentile(99.0)),
+            static_cast<unsigned long long>(hist.max()),
+            static_cast<unsigned long long>(hist.count()) );
+
+    ds.stop();
+    as.stop();
+    hs.stop();
+    return ret;
+  }
+
+  static void usage()
+  {
+    fprintf( stderr,
+             "usage: csl_loadgen [options] tcp|udp|handshake|all\n"
+             "  -c conns    number of client connections (4)\n"
+             "  -s size     request size in bytes, at least 8 (64)\n"
+             "  -r rate     total requests per second, 0 is closed loop (0)\n"
+             "  -d seconds  duration of a scenario (5)\n"
+             "  -t threads  maximum number of server handler threads (4)\n"
+             "  -b batch    udp recvmmsg()/sendmmsg() batch size (1)\n"
+             "  -p port     first loopback port, up to port+4 is used (17790)\n"
+             "  -i          run the tcp handler on the loop thread\n"
+             "  -u          use the io_uring backend of the tcp listener\n" );
+  }
+
+} /* end of loadgen */
+
+using namespace loadgen;
+
+int main(int argc, char ** argv)
+{
+  options o;
+  int     opt;
+
+  while( (opt = ::getopt( argc, argv, "c:s:r:d:t:b:p:iuh" )) != -1 )
+  {
+    switch( opt )
+    {
+      case 'c': o.conns_   = static_cast<unsigned int>(::atoi( optarg )); break;
+      case 's': o.size_    = static_cast<unsigned int>(::atoi( optarg )); break;
+      case 'r': o.rate_    = static_cast<unsigned int>(::atoi( optarg )); break;
+      case 'd': o.seconds_ = static_cast<unsigned int>(::atoi( optarg )); break;
+      case 't': o.threads_ = static_cast<unsigned int>(::atoi( optarg )); break;
+      case 'b': o.batch_   = static_cast<unsigned int>(::atoi( optarg )); break;
+      case 'p': o.port_    = static_cast<unsigned int>(::atoi( optarg )); break;
+      case 'i': o.inline_  = true; break;
+      case 'u': o.uring_   = true; break;
+      default:  usage(); return 2;
+    };
+  }
+
+  if( optind != argc-1 || o.conns_ == 0 || o.seconds_ == 0 || o.threads_ == 0 ||
+      o.size_ < seq_size_ || o.size_ > 65536 )
+  {
+    usage();
+    return 2;
+  }
+
+  std::string what( argv[optind] );
+  bool all = ( what == "all" );
+  if( !all && what != "tcp" && what != "udp" && what != "handshake" ) { usage(); return 2; }
+
+  initcomm w;
+  bool ok = true;
+
+  if( all || what == "tcp" ) ok = run_tcp( o ) && ok;
+
+  if( all || what == "udp" )
+  {
+    options uo(o);
+    if( uo.size_ > max_udp_size_ ) uo.size_ = max_udp_size_;
+    ok = run_udp( uo ) && ok;
+  }
+
+  if( all || what == "handshake" ) ok = run_handshake( o ) && ok;
+
+  return ( ok ? 0 : 1 );
+}
+
+/* EOF */
@@ -44,7 +44,12 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "codesloop/common/auto_close.hh"
 #include "codesloop/common/common.h"
 #include "codesloop/common/test_timer.h"
+#include "codesloop/common/metrics.hh"
+#include "codesloop/nthread/thread.hh"
 #include <assert.h>
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <vector>
 
 using namespace csl::comm;
 using namespace csl::common;
@@ -103,6 +108,344 @@ namespace test_bfd {
     LEAVE_FUNCTION();
   }
 
+  /* poll() has no FD_SETSIZE limit, so descriptors above 1024 must work too */
+  void high_fd()
+  {
+    struct rlimit rl;
+    int sv[2];
+
+    if( ::getrlimit( RLIMIT_NOFILE, &rl ) != 0 || rl.rlim_cur < 1600 ) return;
+    assert( ::socketpair( AF_UNIX, SOCK_STREAM, 0, sv ) == 0 );
+
+    int high = ::dup2( sv[0], 1500 );
+    assert( high == 1500 );
+    ::close( sv[0] );
+
+    bfd bf;
+    bf.init( high );
+
+    /* nothing to read: must time out without closing the socket */
+    uint32_t timeout_ms = 10;
+    assert( bf.recv_some( timeout_ms ) == 0 );
+    assert( bf.size() == 0 );
+
+    const char * msg = "hello";
+    assert( ::write( sv[1], msg, 5 ) == 5 );
+
+    timeout_ms = 1000;
+    read_res rr;
+    read_res & rf(bf.recv( 5, timeout_ms, rr ));
+    assert( rf.bytes() == 5 );
+    assert( ::memcmp( rf.data(), msg, 5 ) == 0 );
+
+    bf.close();
+    ::close( sv[1] );
+  }
+
+  /* data already waiting on the socket is read without a poll() call */
+  static int pair_[2] = { -1, -1 };
+  static bfd * pair_bfd_ = 0;
+
+  void recv_ready()
+  {
+    static const uint8_t data[64] = { 0 };
+    uint32_t timeout_ms = 1000;
+    read_res rr;
+
+    assert( ::write( pair_[1], data, sizeof(data) ) == sizeof(data) );
+    pair_bfd_->recv_some( timeout_ms );
+    assert( pair_bfd_->recv( sizeof(data), timeout_ms, rr ).bytes() == sizeof(data) );
+  }
+
+  /* appended pieces arrive in order, also around unbuffered and oversized writes */
+  void coalesce()
+  {
+    int sv[2];
+    assert( ::socketpair( AF_UNIX, SOCK_STREAM, 0, sv ) == 0 );
+
+    bfd bf;
+    bf.init( sv[0] );
+    bf.set_out_size( 64 );
+
+    uint8_t big[200];
+    for( unsigned int i=0;i<sizeof(big);++i ) big[i] = static_cast<uint8_t>(i);
+
+    assert( bf.append( reinterpret_cast<const uint8_t *>("abc"), 3 ) == true );
+    assert( bf.append( reinterpret_cast<const uint8_t *>("def"), 3 ) == true );
+    assert( bf.out_pending() == 6 );
+    /* send() must not overtake the buffered bytes */
+    assert( bf.send( reinterpret_cast<const uint8_t *>("gh"), 2 ) == true );
+    assert( bf.out_pending() == 0 );
+    assert( bf.append( reinterpret_cast<const uint8_t *>("i"), 1 ) == true );
+    /* does not fit: buffered byte and the big piece go out together */
+    assert( bf.append( big, sizeof(big) ) == true );
+    assert( bf.out_pending() == 0 );
+    assert( bf.append( reinterpret_cast<const uint8_t *>("z"), 1 ) == true );
+    assert( bf.flush( true ) == true );
+    assert( bf.flush() == true );
+
+    uint8_t rd[256];
+    size_t got = 0;
+    while( got < 8+1+sizeof(big)+1 )
+    {
+      ssize_t r = ::recv( sv[1], rd+got, sizeof(rd)-got, 0 );
+      assert( r > 0 );
+      got += static_cast<size_t>(r);
+    }
+    assert( got == 8+1+sizeof(big)+1 );
+    assert( ::memcmp( rd, "abcdefghi", 9 ) == 0 );
+    assert( ::memcmp( rd+9, big, sizeof(big) ) == 0 );
+    assert( rd[9+sizeof(big)] == 'z' );
+
+    /* pipes are not sockets: flush falls back to writev() */
+    int pp[2];
+    assert( ::pipe( pp ) == 0 );
+    {
+      bfd pb;
+      pb.init( pp[1] );
+      assert( pb.append( reinterpret_cast<const uint8_t *>("pipe"), 4 ) == true );
+      assert( pb.flush() == true );
+      assert( ::read( pp[0], rd, sizeof(rd) ) == 4 );
+      assert( ::memcmp( rd, "pipe", 4 ) == 0 );
+      /* close() sends what is left */
+      assert( pb.append( reinterpret_cast<const uint8_t *>("left"), 4 ) == true );
+    }
+    assert( ::read( pp[0], rd, sizeof(rd) ) == 4 );
+    assert( ::memcmp( rd, "left", 4 ) == 0 );
+    ::close( pp[0] );
+
+    bf.close();
+    ::close( sv[1] );
+  }
+
+  /* pieces appended for a udp reply are sent as one datagram */
+  void datagram()
+  {
+    int rs = ::socket( AF_INET, SOCK_DGRAM, 0 );
+    int ss = ::socket( AF_INET, SOCK_DGRAM, 0 );
+    assert( rs > 0 && ss > 0 );
+
+    SAI addr;
+    ::memset( &addr,0,sizeof(addr) );
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    addr.sin_port        = 0;
+    assert( ::bind( rs, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr) ) == 0 );
+    socklen_t len = sizeof(addr);
+    assert( ::getsockname( rs, reinterpret_cast<struct sockaddr *>(&addr), &len ) == 0 );
+
+    bfd bf;
+    bf.init( ss );
+    assert( bf.append( reinterpret_cast<const uint8_t *>("hdr:"), 4 ) == true );
+    assert( bf.append( reinterpret_cast<const uint8_t *>("body"), 4 ) == true );
+    assert( bf.flush_to( addr ) == true );
+
+    uint8_t rd[64];
+    assert( ::recv( rs, rd, sizeof(rd), 0 ) == 8 );
+    assert( ::memcmp( rd, "hdr:body", 8 ) == 0 );
+
+    bf.close();
+    ::close( rs );
+  }
+
+  /* small message throughput: 16 x 32 byte pieces per message */
+  static const size_t n_pieces_  = 16;
+  static const size_t piece_len_ = 32;
+  static uint8_t piece_[piece_len_];
+  static uint8_t drain_[n_pieces_*piece_len_];
+
+  static void drain_message()
+  {
+    size_t got = 0;
+    while( got < sizeof(drain_) )
+    {
+      ssize_t r = ::recv( pair_[1], drain_+got, sizeof(drain_)-got, 0 );
+      assert( r > 0 );
+      got += static_cast<size_t>(r);
+    }
+  }
+
+  void small_send()
+  {
+    for( size_t i=0;i<n_pieces_;++i ) pair_bfd_->send( piece_, piece_len_ );
+    drain_message();
+  }
+
+  void small_append()
+  {
+    for( size_t i=0;i<n_pieces_;++i ) pair_bfd_->append( piece_, piece_len_ );
+    pair_bfd_->flush();
+    drain_message();
+  }
+
+  static const char * file_name_ = "t__bfd_send_file.tmp";
+
+  /* writes n bytes of a known pattern, returns the fd opened for reading */
+  static int pattern_file(const char * name, size_t n)
+  {
+    FILE * fp = fopen( name, "wb" );
+    assert( fp != NULL );
+    for( size_t i=0;i<n;++i ) fputc( static_cast<int>(i%251), fp );
+    fclose( fp );
+    int fd = ::open( name, O_RDONLY );
+    assert( fd >= 0 );
+    return fd;
+  }
+
+  static void recv_all(int fd, uint8_t * buf, size_t n)
+  {
+    size_t got = 0;
+    while( got < n )
+    {
+      ssize_t r = ::recv( fd, buf+got, n-got, 0 );
+      assert( r > 0 );
+      got += static_cast<size_t>(r);
+    }
+  }
+
+  /* file ranges and pipe contents arrive behind the buffered output */
+  void send_file()
+  {
+    int sv[2];
+    assert( ::socketpair( AF_UNIX, SOCK_STREAM, 0, sv ) == 0 );
+    int fd = pattern_file( file_name_, 20000 );
+
+    bfd bf;
+    bf.init( sv[0] );
+
+    /* regular file: sendfile() */
+    std::vector<uint8_t> rd(8192);
+    assert( bf.append( reinterpret_cast<const uint8_t *>("hdr"), 3 ) == true );
+    assert( bf.send_file( fd, 1000, 5000 ) == true );
+    assert( bf.out_pending() == 0 );
+    recv_all( sv[1], &(rd[0]), 5003 );
+    assert( ::memcmp( &(rd[0]), "hdr", 3 ) == 0 );
+    for( size_t i=0;i<5000;++i ) assert( rd[3+i] == static_cast<uint8_t>((1000+i)%251) );
+
+    /* pipe: splice() */
+    int pp[2];
+    assert( ::pipe( pp ) == 0 );
+    uint8_t src[3000];
+    for( size_t i=0;i<sizeof(src);++i ) src[i] = static_cast<uint8_t>(i*7);
+    assert( ::write( pp[1], src, sizeof(src) ) == sizeof(src) );
+    assert( bf.send_file( pp[0], 0, sizeof(src) ) == true );
+    recv_all( sv[1], &(rd[0]), sizeof(src) );
+    assert( ::memcmp( &(rd[0]), src, sizeof(src) ) == 0 );
+    ::close( pp[0] );
+    ::close( pp[1] );
+
+    /* empty range */
+    assert( bf.send_file( fd, 0, 0 ) == true );
+
+    /* the file is shorter than the range: the connection is closed */
+    assert( bf.send_file( fd, 19000, 2000 ) == false );
+    assert( bf.state() != bfd::ok_ );
+    assert( bf.send_file( fd, 0, 10 ) == false );
+
+    ::close( fd );
+    ::unlink( file_name_ );
+    ::close( sv[1] );
+  }
+
+  /* a .zf file is sent as it is and decompresses on the other side */
+  void send_zfile()
+  {
+    int sv[2];
+    assert( ::socketpair( AF_UNIX, SOCK_STREAM, 0, sv ) == 0 );
+
+    std::vector<uint8_t> text(30000);
+    for( size_t i=0;i<text.size();++i ) text[i] = static_cast<uint8_t>('a'+(i/100)%26);
+
+    zfile zo;
+    assert( zo.put_data( &(text[0]), text.size() ) == true );
+    assert( zo.write_zfile( file_name_ ) == true );
+    uint64_t zsz = zo.get_zsize();
+    assert( zsz > 0 && zsz < text.size() );
+
+    bfd bf;
+    bf.init( sv[0] );
+    assert( bf.send_zfile( file_name_ ) == true );
+    assert( bf.send_zfile( "no/such/file.zf" ) == false );
+
+    std::vector<uint8_t> rd( static_cast<size_t>(zsz) );
+    recv_all( sv[1], &(rd[0]), rd.size() );
+
+    zfile zi;
+    assert( zi.put_zdata( &(rd[0]), zsz ) == true );
+    assert( zi.get_size() == text.size() );
+    std::vector<uint8_t> out( text.size() );
+    assert( zi.get_data( &(out[0]) ) == true );
+    assert( out == text );
+
+    ::unlink( file_name_ );
+    ::close( sv[1] );
+  }
+
+  /* reads until the other side closes */
+  class drainer : public csl::nthread::thread::callback
+  {
+    public:
+      int               fd_;
+      volatile uint64_t got_;
+
+      drainer(int fd) : fd_(fd), got_(0) { }
+
+      virtual void operator()(void)
+      {
+        static uint8_t buf[64*1024];
+        ssize_t r = 0;
+        while( (r=::recv( fd_, buf, sizeof(buf), 0 )) > 0 ) got_ += static_cast<uint64_t>(r);
+      }
+  };
+
+  /* MB/s of a large transfer: read into a buffer and send() vs. send_file() */
+  double transfer_rate(bool zero_copy)
+  {
+    enum { file_size_ = 64*1024*1024 };
+    int sv[2];
+    assert( ::socketpair( AF_UNIX, SOCK_STREAM, 0, sv ) == 0 );
+
+    drainer d( sv[1] );
+    csl::nthread::thread t;
+    t.set_entry( d );
+    assert( t.start() == true );
+
+    int fd = ::open( file_name_, O_RDONLY );
+    assert( fd >= 0 );
+
+    uint64_t start = metrics::now_usec();
+    {
+      bfd bf;
+      bf.init( sv[0] );
+      if( zero_copy )
+      {
+        assert( bf.send_file( fd, 0, file_size_ ) == true );
+      }
+      else
+      {
+        /* what serving a file looked like before */
+        zfile zf;
+        assert( zf.read_file( file_name_ ) == true );
+        assert( bf.send( zf.get_buff(), zf.get_size() ) == true );
+      }
+    }
+    assert( t.exit_event().wait(60000) == true );
+    uint64_t elapsed = metrics::now_usec() - start;
+
+    ::close( fd );
+    ::close( sv[1] );
+    assert( d.got_ == file_size_ );
+    return (elapsed ? (static_cast<double>(file_size_) / static_cast<double>(elapsed)) : 0.0);
+  }
+
+  void send_file_benchmark()
+  {
+    ::close( pattern_file( file_name_, 64*1024*1024 ) );
+    printf( "%-18s %10.1f MB/s\n", "read + send",  transfer_rate(false) );
+    printf( "%-18s %10.1f MB/s\n", "send_file",    transfer_rate(true) );
+    ::unlink( file_name_ );
+  }
+
 } /* end of test_bfd */
 
 using namespace test_bfd;
@@ -111,7 +454,25 @@ int main()
 {
   initcomm w;
   conn();
+  high_fd();
+  coalesce();
+  datagram();
+  send_file();
+  send_zfile();
+  send_file_benchmark();
   csl_common_print_results( "baseline          ", csl_common_test_timer_v0(baseline),"" );
+
+  assert( ::socketpair( AF_UNIX, SOCK_STREAM, 0, pair_ ) == 0 );
+  {
+    bfd bf;
+    bf.init( pair_[0] );
+    pair_bfd_ = &bf;
+    csl_common_print_results( "recv_ready        ", csl_common_test_timer_v0(recv_ready),"" );
+    csl_common_print_results( "small_send        ", csl_common_test_timer_v0(small_send),"" );
+    csl_common_print_results( "small_append      ", csl_common_test_timer_v0(small_append),"" );
+    pair_bfd_ = 0;
+  }
+  ::close( pair_[1] );
   return 0;
 }
 
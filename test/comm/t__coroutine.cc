@@ -0,0 +1,583 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+  @file t__coroutine.cc
+  @brief tests the stackless coroutine handlers
+*/
+
+#include "codesloop/comm/coroutine.hh"
+#include "codesloop/comm/bfd.hh"
+#include "codesloop/comm/tcp_lstnr.hh"
+#include "codesloop/comm/tcp_client.hh"
+#include "codesloop/comm/initcomm.hh"
+#include "codesloop/common/common.h"
+#include "codesloop/common/test_timer.h"
+#include "codesloop/common/metrics.hh"
+#include "codesloop/common/read_res.hh"
+#include "codesloop/nthread/thread.hh"
+#include <sys/socket.h>
+#include <assert.h>
+
+using namespace csl::comm;
+using namespace csl::comm::tcp;
+using namespace csl::nthread;
+using csl::common::read_res;
+
+/** @brief @todo */
+namespace test_coroutine {
+
+  /*
+  ** the protocol:
+  **  client: "HELO"                server: "OK"
+  **  client: len(4) payload(len)   server: sum of the payload bytes (4)
+  **  ...
+  **  client: len(4)=0              server: "BYE" and closes
+  */
+  class exchange : public coroutine
+  {
+    private:
+      read_res   rr_;
+      uint32_t   len_;
+      uint32_t   deadline_ms_;
+
+    public:
+      static uint32_t deadline_ms;
+
+      exchange() : len_(0), deadline_ms_(deadline_ms) { }
+
+      status_t resume(bfd & b)
+      {
+        CSL_CO_BEGIN;
+
+        if( deadline_ms_ ) set_deadline( deadline_ms_ );
+
+        CSL_CO_READ( b, 4, rr_ );
+        if( ::memcmp( rr_.data(), "HELO", 4 ) != 0 ) CSL_CO_FAIL;
+        if( b.send( reinterpret_cast<const uint8_t *>("OK"), 2 ) == false ) CSL_CO_FAIL;
+
+        while( true )
+        {
+          CSL_CO_READ( b, 4, rr_ );
+          len_ = ntohl( *(reinterpret_cast<const uint32_t *>(rr_.data())) );
+          if( len_ == 0 ) break;
+          if( len_ > 1024 ) CSL_CO_FAIL;
+
+          CSL_CO_READ( b, len_, rr_ );
+          {
+            uint32_t sum = 0;
+            for( uint32_t i=0;i<len_;++i ) sum += rr_.data()[i];
+            sum = htonl( sum );
+            if( b.send( reinterpret_cast<const uint8_t *>(&sum), 4 ) == false ) CSL_CO_FAIL;
+          }
+        }
+
+        b.send( reinterpret_cast<const uint8_t *>("BYE"), 3 );
+        CSL_CO_END;
+      }
+  };
+
+  uint32_t exchange::deadline_ms = 0;
+
+  /* feeds the data to the coroutine through a socketpair in small pieces */
+  coroutine::status_t feed( coroutine & ex, bfd & b, int peer, const uint8_t * data, size_t sz, size_t piece )
+  {
+    coroutine::status_t st = coroutine::wait_;
+    for( size_t pos=0;pos<sz && st==coroutine::wait_;pos+=piece )
+    {
+      size_t n = ( sz-pos < piece ? sz-pos : piece );
+      assert( ::send( peer, data+pos, n, 0 ) == static_cast<ssize_t>(n) );
+      uint32_t timeout_ms = 1000;
+      assert( b.recv_some( timeout_ms ) > 0 );
+      st = ex.resume( b );
+    }
+    return st;
+  }
+
+  /* builds a full session with two messages */
+  size_t build_session( uint8_t * out )
+  {
+    size_t pos = 0;
+    ::memcpy( out, "HELO", 4 ); pos += 4;
+    for( uint32_t m=1;m<=2;++m )
+    {
+      uint32_t len = htonl( m*10 );
+      ::memcpy( out+pos, &len, 4 ); pos += 4;
+      for( uint32_t i=0;i<m*10;++i ) out[pos++] = static_cast<uint8_t>(i+m);
+    }
+    uint32_t zero = 0;
+    ::memcpy( out+pos, &zero, 4 ); pos += 4;
+    return pos;
+  }
+
+  void byte_by_byte()
+  {
+    int sv[2];
+    assert( ::socketpair( AF_UNIX, SOCK_STREAM, 0, sv ) == 0 );
+    {
+      bfd b(sv[1]);
+      exchange ex;
+      uint8_t session[128];
+      size_t sz = build_session( session );
+
+      /* every single byte resumes the coroutine, it must wait until the last */
+      for( size_t piece=1;piece<=sz;piece+=7 )
+      {
+        ex.start( 1, SAI() );
+        assert( feed( ex, b, sv[0], session, sz, piece ) == coroutine::done_ );
+        assert( ex.is_finished() == true );
+        assert( b.size() == 0 );
+
+        /* drain the replies: OK, 2 sums, BYE */
+        uint8_t reply[64];
+        ssize_t got = 0;
+        while( got < 2+4+4+3 ) got += ::recv( sv[0], reply+got, sizeof(reply)-got, 0 );
+        assert( got == 2+4+4+3 );
+        assert( ::memcmp( reply, "OK", 2 ) == 0 );
+        assert( ::memcmp( reply+10, "BYE", 3 ) == 0 );
+        uint32_t sum = 0;
+        ::memcpy( &sum, reply+2, 4 );
+        assert( ntohl(sum) == 55 );
+      }
+    }
+    ::close( sv[0] );
+  }
+
+  void bad_hello()
+  {
+    int sv[2];
+    assert( ::socketpair( AF_UNIX, SOCK_STREAM, 0, sv ) == 0 );
+    {
+      bfd b(sv[1]);
+      exchange ex;
+      assert( feed( ex, b, sv[0], reinterpret_cast<const uint8_t *>("HELL"), 4, 1 ) == coroutine::failed_ );
+      assert( ex.is_finished() == true );
+    }
+    ::close( sv[0] );
+  }
+
+  void deadline()
+  {
+    int sv[2];
+    assert( ::socketpair( AF_UNIX, SOCK_STREAM, 0, sv ) == 0 );
+    {
+      bfd b(sv[1]);
+      exchange::deadline_ms = 20;
+      exchange ex;
+      exchange::deadline_ms = 0;
+      assert( ex.resume( b ) == coroutine::wait_ );
+      assert( feed( ex, b, sv[0], reinterpret_cast<const uint8_t *>("HE"), 2, 1 ) == coroutine::wait_ );
+      SleepMiliseconds( 40 );
+      /* the rest of the hello arrives too late */
+      assert( feed( ex, b, sv[0], reinterpret_cast<const uint8_t *>("L"), 1, 1 ) == coroutine::failed_ );
+    }
+    ::close( sv[0] );
+  }
+
+  enum { n_conns_ = 200, n_rounds_ = 5 };
+
+  bool read_exact( client & c, uint8_t * out, uint64_t sz )
+  {
+    uint64_t got = 0;
+    while( got < sz )
+    {
+      read_res rr;
+      c.read( sz-got, 2000, rr );
+      if( rr.bytes() == 0 ) return false;
+      ::memcpy( out+got, rr.data(), static_cast<size_t>(rr.bytes()) );
+      got += rr.bytes();
+    }
+    return true;
+  }
+
+  /*
+  ** a single client thread keeps all connections in the middle of their
+  ** exchange at the same time, the listener's workers are never blocked
+  */
+  void interleaved()
+  {
+    in_addr_t   saddr = inet_addr("127.0.0.1");
+    SAI         addr;
+
+    ::memset( &addr,0,sizeof(addr) );
+    ::memcpy( &(addr.sin_addr),&saddr,sizeof(saddr) );
+
+    addr.sin_family  = AF_INET;
+    addr.sin_port    = htons(49915);
+
+    lstnr l;
+    coro_handler<exchange> h;
+    assert( l.init(h, addr, 256) == true );
+    assert( l.start() == true );
+
+    client * cl[n_conns_];
+    uint8_t reply[8];
+
+    uint64_t start = csl::common::metrics::now_usec();
+
+    for( int i=0;i<n_conns_;++i )
+    {
+      cl[i] = new client();
+      assert( cl[i]->init( addr ) == true );
+      assert( cl[i]->write( reinterpret_cast<const uint8_t *>("HELO"), 4 ) == true );
+    }
+
+    for( int i=0;i<n_conns_;++i )
+    {
+      assert( read_exact( *(cl[i]), reply, 2 ) == true );
+      assert( ::memcmp( reply, "OK", 2 ) == 0 );
+    }
+
+    for( int r=0;r<n_rounds_;++r )
+    {
+      /* the length and the payload are sent separately */
+      for( int i=0;i<n_conns_;++i )
+      {
+        uint32_t len = htonl( 3 );
+        assert( cl[i]->write( reinterpret_cast<const uint8_t *>(&len), 4 ) == true );
+      }
+      for( int i=0;i<n_conns_;++i )
+      {
+        uint8_t payload[3] = { static_cast<uint8_t>(i), static_cast<uint8_t>(r), 1 };
+        assert( cl[i]->write( payload, 3 ) == true );
+      }
+      for( int i=0;i<n_conns_;++i )
+      {
+        uint32_t sum = 0;
+        assert( read_exact( *(cl[i]), reinterpret_cast<uint8_t *>(&sum), 4 ) == true );
+        assert( ntohl(sum) == static_cast<uint32_t>((i&0xff)+r+1) );
+      }
+    }
+
+    for( int i=0;i<n_conns_;++i )
+    {
+      uint32_t zero = 0;
+      assert( cl[i]->write( reinterpret_cast<const uint8_t *>(&zero), 4 ) == true );
+    }
+
+    for( int i=0;i<n_conns_;++i )
+    {
+      assert( read_exact( *(cl[i]), reply, 3 ) == true );
+      assert( ::memcmp( reply, "BYE", 3 ) == 0 );
+    }
+
+    uint64_t elapsed = csl::common::metrics::now_usec() - start;
+
+    /* the handler returns after sending BYE, wait for the bookkeeping */
+    for( int i=0;i<100 && h.finished_count() < n_conns_;++i ) SleepMiliseconds( 10 );
+
+    assert( h.finished_count() == n_conns_ );
+    assert( h.failed_count() == 0 );
+    assert( h.size() == 0 );
+
+    for( int i=0;i<n_conns_;++i ) delete cl[i];
+
+    l.stop();
+    assert( l.exit_event().wait(7000) == true );
+
+    printf( "interleaved: %d connections x %d exchanges in %llu usec\n",
+            n_conns_, n_rounds_+2, static_cast<unsigned long long>(elapsed) );
+  }
+
+  SAI local_addr()
+  {
+    in_addr_t   saddr = inet_addr("127.0.0.1");
+    SAI         addr;
+
+    ::memset( &addr,0,sizeof(addr) );
+    ::memcpy( &(addr.sin_addr),&saddr,sizeof(saddr) );
+
+    addr.sin_family  = AF_INET;
+    addr.sin_port    = htons(49915);
+    return addr;
+  }
+
+  /* a peer that sends nothing fails on its deadline, not on the idle timeout */
+  void silent_peer(lstnr::backend_t backend)
+  {
+    SAI addr = local_addr();
+
+    lstnr l;
+    coro_handler<exchange> h;
+    assert( h.attach( l ) == true );
+    l.set_backend( backend );
+    assert( l.init(h, addr) == true );
+    assert( l.start() == true );
+
+    exchange::deadline_ms = 200;
+    client c;
+    uint64_t start = csl::common::metrics::now_usec();
+    assert( c.init( addr ) == true );
+
+    read_res rr;
+    c.read( 4, 3000, rr );
+    uint64_t elapsed = csl::common::metrics::now_usec() - start;
+    exchange::deadline_ms = 0;
+
+    /* closed by the server well before the read times out */
+    assert( rr.bytes() == 0 );
+    assert( elapsed < 2000000 );
+
+    for( int i=0;i<100 && h.failed_count() < 1;++i ) SleepMiliseconds( 10 );
+    assert( h.failed_count() == 1 );
+    assert( h.size() == 0 );
+
+    l.stop();
+    assert( l.exit_event().wait(7000) == true );
+  }
+
+  /*
+  ** resumed by a timer and by an event:
+  **  client: "PING"         server sleeps 100 ms, then "SLEPT"
+  **                         server waits for go, then "GO" and closes
+  */
+  class waiter : public coroutine
+  {
+    private:
+      read_res   rr_;
+
+    public:
+      static co_event go;
+
+      status_t resume(bfd & b)
+      {
+        CSL_CO_BEGIN;
+        CSL_CO_READ( b, 4, rr_ );
+        CSL_CO_SLEEP( 100 );
+        CSL_CO_WRITE( b, reinterpret_cast<const uint8_t *>("SLEPT"), 5 );
+        CSL_CO_AWAIT_EVENT( go );
+        CSL_CO_WRITE( b, reinterpret_cast<const uint8_t *>("GO"), 2 );
+        CSL_CO_END;
+      }
+  };
+
+  co_event waiter::go;
+
+  void wakeups(lstnr::backend_t backend)
+  {
+    SAI addr = local_addr();
+
+    lstnr l;
+    coro_handler<waiter> h;
+    assert( h.attach( l ) == true );
+    l.set_backend( backend );
+    assert( l.init(h, addr) == true );
+    assert( l.start() == true );
+
+    enum { n_cli_ = 8 };
+    client c[n_cli_];
+    uint8_t reply[8];
+
+    uint64_t start = csl::common::metrics::now_usec();
+    for( int i=0;i<n_cli_;++i )
+    {
+      assert( c[i].init( addr ) == true );
+      assert( c[i].write( reinterpret_cast<const uint8_t *>("PING"), 4 ) == true );
+    }
+    for( int i=0;i<n_cli_;++i )
+    {
+      assert( read_exact( c[i], reply, 5 ) == true );
+      assert( ::memcmp( reply, "SLEPT", 5 ) == 0 );
+    }
+    assert( csl::common::metrics::now_usec() - start >= 100000 );
+
+    /* nobody goes before the event */
+    read_res rr;
+    c[0].read( 2, 100, rr );
+    assert( rr.bytes() == 0 );
+
+    waiter::go.notify( n_cli_ );
+    for( int i=0;i<n_cli_;++i )
+    {
+      assert( read_exact( c[i], reply, 2 ) == true );
+      assert( ::memcmp( reply, "GO", 2 ) == 0 );
+    }
+
+    for( int i=0;i<100 && h.finished_count() < n_cli_;++i ) SleepMiliseconds( 10 );
+    assert( h.finished_count() == n_cli_ );
+    assert( h.failed_count() == 0 );
+    assert( waiter::go.available_count() == 0 );
+
+    l.stop();
+    assert( l.exit_event().wait(7000) == true );
+  }
+
+#ifdef CSL_COMM_CXX20_COROUTINES
+  /* the exchange protocol written as a C++20 coroutine */
+  class co_exchange : public co_coroutine
+  {
+    public:
+      co_task run(bfd & b)
+      {
+        read_res rr;
+        co_await co_read( b, 4, rr );
+        if( ::memcmp( rr.data(), "HELO", 4 ) != 0 ) co_await co_fail();
+        if( b.send( reinterpret_cast<const uint8_t *>("OK"), 2 ) == false ) co_await co_fail();
+
+        while( true )
+        {
+          co_await co_read( b, 4, rr );
+          uint32_t len = ntohl( *(reinterpret_cast<const uint32_t *>(rr.data())) );
+          if( len == 0 ) break;
+          if( len > 1024 ) co_await co_fail();
+
+          co_await co_read( b, len, rr );
+          uint32_t sum = 0;
+          for( uint32_t i=0;i<len;++i ) sum += rr.data()[i];
+          sum = htonl( sum );
+          if( b.send( reinterpret_cast<const uint8_t *>(&sum), 4 ) == false ) co_await co_fail();
+        }
+
+        b.send( reinterpret_cast<const uint8_t *>("BYE"), 3 );
+      }
+  };
+
+  void co_byte_by_byte()
+  {
+    int sv[2];
+    assert( ::socketpair( AF_UNIX, SOCK_STREAM, 0, sv ) == 0 );
+    {
+      bfd b(sv[1]);
+      co_exchange ex;
+      uint8_t session[128];
+      size_t sz = build_session( session );
+
+      for( size_t piece=1;piece<=sz;piece+=7 )
+      {
+        ex.start( 1, SAI() );
+        assert( feed( ex, b, sv[0], session, sz, piece ) == coroutine::done_ );
+        assert( ex.is_finished() == true );
+        assert( b.size() == 0 );
+
+        uint8_t reply[64];
+        ssize_t got = 0;
+        while( got < 2+4+4+3 ) got += ::recv( sv[0], reply+got, sizeof(reply)-got, 0 );
+        assert( got == 2+4+4+3 );
+        assert( ::memcmp( reply, "OK", 2 ) == 0 );
+        assert( ::memcmp( reply+10, "BYE", 3 ) == 0 );
+      }
+
+      /* a bad hello fails it */
+      ex.start( 1, SAI() );
+      assert( feed( ex, b, sv[0], reinterpret_cast<const uint8_t *>("HELL"), 4, 1 ) == coroutine::failed_ );
+      assert( ex.is_finished() == true );
+
+      /* the rest of the hello arrives after the deadline */
+      ex.start( 1, SAI() );
+      ex.set_deadline( 20 );
+      assert( ex.resume( b ) == coroutine::wait_ );
+      SleepMiliseconds( 40 );
+      assert( feed( ex, b, sv[0], reinterpret_cast<const uint8_t *>("HEL"), 3, 1 ) == coroutine::failed_ );
+      ex.set_deadline( 0 );
+    }
+    ::close( sv[0] );
+  }
+
+  /* the waiter written as a C++20 coroutine */
+  class co_waiter : public co_coroutine
+  {
+    public:
+      static co_event go;
+
+      co_task run(bfd & b)
+      {
+        read_res rr;
+        co_await co_read( b, 4, rr );
+        co_await co_sleep( 100 );
+        co_await co_write( b, reinterpret_cast<const uint8_t *>("SLEPT"), 5 );
+        co_await co_wait( go );
+        co_await co_write( b, reinterpret_cast<const uint8_t *>("GO"), 2 );
+      }
+  };
+
+  co_event co_waiter::go;
+
+  void co_wakeups(lstnr::backend_t backend)
+  {
+    SAI addr = local_addr();
+
+    lstnr l;
+    coro_handler<co_waiter> h;
+    assert( h.attach( l ) == true );
+    l.set_backend( backend );
+    assert( l.init(h, addr) == true );
+    assert( l.start() == true );
+
+    enum { n_cli_ = 8 };
+    client c[n_cli_];
+    uint8_t reply[8];
+
+    uint64_t start = csl::common::metrics::now_usec();
+    for( int i=0;i<n_cli_;++i )
+    {
+      assert( c[i].init( addr ) == true );
+      assert( c[i].write( reinterpret_cast<const uint8_t *>("PING"), 4 ) == true );
+    }
+    for( int i=0;i<n_cli_;++i )
+    {
+      assert( read_exact( c[i], reply, 5 ) == true );
+      assert( ::memcmp( reply, "SLEPT", 5 ) == 0 );
+    }
+    assert( csl::common::metrics::now_usec() - start >= 100000 );
+
+    co_waiter::go.notify( n_cli_ );
+    for( int i=0;i<n_cli_;++i )
+    {
+      assert( read_exact( c[i], reply, 2 ) == true );
+      assert( ::memcmp( reply, "GO", 2 ) == 0 );
+    }
+
+    for( int i=0;i<100 && h.finished_count() < n_cli_;++i ) SleepMiliseconds( 10 );
+    assert( h.finished_count() == n_cli_ );
+    assert( h.failed_count() == 0 );
+
+    l.stop();
+    assert( l.exit_event().wait(7000) == true );
+  }
+#endif /* CSL_COMM_CXX20_COROUTINES */
+
+} // end of test_coroutine
+
+using namespace test_coroutine;
+
+int main()
+{
+  initcomm w;
+  csl_common_print_results( "byte_by_byte      ", csl_common_test_timer_v0(byte_by_byte),"" );
+  csl_common_print_results( "bad_hello         ", csl_common_test_timer_v0(bad_hello),"" );
+  deadline();
+  interleaved();
+  silent_peer( lstnr::libev_ );
+  silent_peer( lstnr::uring_ );
+  wakeups( lstnr::libev_ );
+  wakeups( lstnr::uring_ );
+#ifdef CSL_COMM_CXX20_COROUTINES
+  csl_common_print_results( "co_byte_by_byte   ", csl_common_test_timer_v0(co_byte_by_byte),"" );
+  co_wakeups( lstnr::libev_ );
+#endif /* CSL_COMM_CXX20_COROUTINES */
+  return 0;
+}
+
+/* EOF */
@@ -40,9 +40,12 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "codesloop/comm/tcp_lstnr.hh"
 #include "codesloop/comm/tcp_client.hh"
 #include "codesloop/comm/initcomm.hh"
+#include "codesloop/comm/uring.hh"
 #include "codesloop/common/logger.hh"
 #include "codesloop/common/common.h"
 #include "codesloop/common/test_timer.h"
+#include "codesloop/common/metrics.hh"
+#include "codesloop/common/read_res.hh"
 #include "codesloop/nthread/thrpool.hh"
 #include <assert.h>
 
@@ -221,6 +224,787 @@ namespace test_tcp_lstnr {
     }
   }
 
+  /* echoes back whatever arrives */
+  class echo_handler : public csl::comm::handler
+  {
+    public:
+      virtual bool on_connected( connid_t id, const SAI & sai, bfd & buf_fd ) { return true; }
+
+      virtual bool on_data_arrival( connid_t id, const SAI & sai, bfd & buf_fd )
+      {
+        csl::common::read_res rr;
+        while( buf_fd.size() > 0 && buf_fd.read_buf( rr, buf_fd.size() ) )
+        {
+          if( buf_fd.send( rr.data(), rr.bytes() ) == false ) return false;
+        }
+        return true;
+      }
+
+      virtual void on_disconnected( connid_t id, const SAI & sai ) { }
+
+      CSL_OBJ(test_tcp_lstnr,echo_handler);
+  };
+
+  enum { n_clients_ = 4, n_requests_ = 2000 };
+
+  /* request-response client: sends 12 bytes and waits for the echo */
+  class echo_client : public thread::callback
+  {
+    private:
+      SAI server_addr_;
+
+    public:
+      volatile int done_;
+
+      echo_client(SAI server_addr) : server_addr_(server_addr), done_(0) { }
+      virtual ~echo_client() { }
+
+      virtual void operator()(void)
+      {
+        client c;
+        if( c.init( server_addr_ ) == false ) return;
+
+        uint8_t text[] = { 'H', 'e', 'l', 'l', 'o', ' ',
+                           'W', 'o', 'r', 'l', 'd', '\n'  };
+
+        for( int i=0;i<n_requests_;++i )
+        {
+          if( c.write( text, 12 ) == false ) return;
+
+          uint64_t got = 0;
+          while( got < 12 )
+          {
+            csl::common::read_res rr;
+            c.read( 12-got, 2000, rr );
+            if( rr.bytes() == 0 ) return;
+            got += rr.bytes();
+          }
+          ++done_;
+        }
+      }
+  };
+
+  /* request throughput of the listener with the given placement */
+  double throughput(thrpool::placement_t placement)
+  {
+    in_addr_t   saddr = inet_addr("127.0.0.1");
+    SAI         addr;
+
+    ::memset( &addr,0,sizeof(addr) );
+    ::memcpy( &(addr.sin_addr),&saddr,sizeof(saddr) );
+
+    addr.sin_family  = AF_INET;
+    addr.sin_port    = htons(49913);
+
+    lstnr l;
+    echo_handler h;
+    l.set_placement( placement );
+    assert( l.init(h, addr) == true );
+    assert( l.start() == true );
+
+    echo_client * cl[n_clients_];
+    thread        t[n_clients_];
+
+    uint64_t start = csl::common::metrics::now_usec();
+
+    for( int i=0;i<n_clients_;++i )
+    {
+      cl[i] = new echo_client(addr);
+      t[i].set_entry( *(cl[i]) );
+      assert( t[i].start() == true );
+    }
+
+    int done = 0;
+    for( int i=0;i<n_clients_;++i )
+    {
+      assert( t[i].exit_event().wait(60000) == true );
+      done += cl[i]->done_;
+    }
+
+    uint64_t elapsed = csl::common::metrics::now_usec() - start;
+
+    l.stop();
+    assert( l.exit_event().wait(7000) == true );
+
+    for( int i=0;i<n_clients_;++i ) delete cl[i];
+
+    assert( done == n_clients_*n_requests_ );
+    return (elapsed ? (1000000.0 * done / static_cast<double>(elapsed)) : 0.0);
+  }
+
+  /* idle connections are closed by the listener */
+  void idle_close(lstnr::backend_t backend)
+  {
+    in_addr_t   saddr = inet_addr("127.0.0.1");
+    SAI         addr;
+
+    ::memset( &addr,0,sizeof(addr) );
+    ::memcpy( &(addr.sin_addr),&saddr,sizeof(saddr) );
+
+    addr.sin_family  = AF_INET;
+    addr.sin_port    = htons(49914);
+
+    csl::common::metrics::counter & closed(
+      csl::common::metrics::instance().get_counter("comm.tcp.lstnr.idle_closed") );
+    uint64_t closed_before = closed.value();
+
+    lstnr l;
+    echo_handler h;
+    l.set_backend( backend );
+    l.set_idle_timeout( 300 );
+    assert( l.init(h, addr) == true );
+    assert( l.start() == true );
+
+    client active, idle;
+    assert( active.init( addr ) == true );
+    assert( idle.init( addr ) == true );
+
+    uint8_t text[] = { 'p', 'i', 'n', 'g' };
+    uint64_t start = csl::common::metrics::now_usec();
+
+    /* the active client keeps talking for a second, the idle one is silent */
+    while( csl::common::metrics::now_usec() - start < 1000000 )
+    {
+      csl::common::read_res rr;
+      assert( active.write( text, 4 ) == true );
+      active.read( 4, 2000, rr );
+      assert( rr.bytes() > 0 );
+      SleepMiliseconds( 50 );
+    }
+
+    /* the idle one has been closed by now */
+    csl::common::read_res rr;
+    idle.read( 4, 1000, rr );
+    assert( rr.bytes() == 0 );
+    assert( closed.value() == closed_before+1 );
+
+    l.stop();
+    assert( l.exit_event().wait(7000) == true );
+  }
+
+  void placement_benchmark()
+  {
+    printf( "%-18s %10.1f req/s\n", "placement none",  throughput(thrpool::place_none_) );
+    printf( "%-18s %10.1f req/s\n", "placement rr",    throughput(thrpool::place_round_robin_) );
+    printf( "%-18s %10.1f req/s\n", "placement near",  throughput(thrpool::place_near_) );
+  }
+
+  /* remembers which loops accepted connections */
+  class loop_echo_handler : public echo_handler
+  {
+    public:
+      volatile uint64_t loops_seen_;
+
+      loop_echo_handler() : loops_seen_(0) { }
+
+      virtual bool on_connected( connid_t id, const SAI & sai, bfd & buf_fd )
+      {
+        unsigned int loop = static_cast<unsigned int>((id >> 32) & 0xff);
+        if( loop < 64 ) __sync_fetch_and_or( &loops_seen_, (1ULL << loop) );
+        return true;
+      }
+
+      /* the server closes first, so the TIME_WAIT sockets do not take
+      ** ephemeral ports that the other tests listen on */
+      virtual bool on_data_arrival( connid_t id, const SAI & sai, bfd & buf_fd )
+      {
+        echo_handler::on_data_arrival( id, sai, buf_fd );
+        return false;
+      }
+  };
+
+  enum { n_storm_clients_ = 4, n_storm_conns_ = 500 };
+
+  /* connect, one request-response and the server closes */
+  class storm_client : public thread::callback
+  {
+    private:
+      SAI server_addr_;
+
+    public:
+      volatile int done_;
+
+      storm_client(SAI server_addr) : server_addr_(server_addr), done_(0) { }
+      virtual ~storm_client() { }
+
+      virtual void operator()(void)
+      {
+        uint8_t text[] = { 'p', 'i', 'n', 'g' };
+        for( int i=0;i<n_storm_conns_;++i )
+        {
+          client c;
+          if( c.init( server_addr_ ) == false ) return;
+          if( c.write( text, 4 ) == false ) return;
+          csl::common::read_res rr;
+          c.read( 4, 2000, rr );
+          if( rr.bytes() == 0 ) return;
+          ++done_;
+          /* wait for the server to close */
+          c.read( 4, 2000, rr );
+        }
+      }
+  };
+
+  /* connection rate with the given number of loops */
+  double conn_rate(unsigned int n_loops)
+  {
+    in_addr_t   saddr = inet_addr("127.0.0.1");
+    SAI         addr;
+
+    ::memset( &addr,0,sizeof(addr) );
+    ::memcpy( &(addr.sin_addr),&saddr,sizeof(saddr) );
+
+    addr.sin_family  = AF_INET;
+    addr.sin_port    = htons(49916);
+
+    lstnr l;
+    loop_echo_handler h;
+    l.set_loops( n_loops );
+    l.set_workers( 1, 2 );
+    assert( l.init(h, addr, 1024) == true );
+    assert( l.start() == true );
+
+    storm_client * cl[n_storm_clients_];
+    thread         t[n_storm_clients_];
+
+    uint64_t start = csl::common::metrics::now_usec();
+
+    for( int i=0;i<n_storm_clients_;++i )
+    {
+      cl[i] = new storm_client(addr);
+      t[i].set_entry( *(cl[i]) );
+      assert( t[i].start() == true );
+    }
+
+    int done = 0;
+    for( int i=0;i<n_storm_clients_;++i )
+    {
+      assert( t[i].exit_event().wait(60000) == true );
+      done += cl[i]->done_;
+    }
+
+    uint64_t elapsed = csl::common::metrics::now_usec() - start;
+
+    l.stop();
+    assert( l.exit_event().wait(7000) == true );
+
+    for( int i=0;i<n_storm_clients_;++i ) delete cl[i];
+
+    assert( done == n_storm_clients_*n_storm_conns_ );
+
+    /* the kernel has spread the connections among the loops */
+    if( n_loops > 1 ) assert( (h.loops_seen_ & ~1ULL) != 0 );
+    else              assert( h.loops_seen_ == 1 );
+
+    return (elapsed ? (1000000.0 * done / static_cast<double>(elapsed)) : 0.0);
+  }
+
+  /* with port 0 every loop listens on the port the first one got */
+  void ephemeral_port()
+  {
+    SAI addr;
+    ::memset( &addr,0,sizeof(addr) );
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    addr.sin_port        = 0;
+
+    lstnr l;
+    loop_echo_handler h;
+    l.set_loops( 4 );
+    assert( l.init(h, addr, 1024) == true );
+    assert( l.own_addr().sin_port != 0 );
+    assert( l.start() == true );
+
+    storm_client cl( l.own_addr() );
+    thread       t;
+    t.set_entry( cl );
+    assert( t.start() == true );
+    assert( t.exit_event().wait(60000) == true );
+
+    l.stop();
+    assert( l.exit_event().wait(7000) == true );
+
+    assert( cl.done_ == n_storm_conns_ );
+    assert( (h.loops_seen_ & ~1ULL) != 0 );
+  }
+
+  void conn_rate_benchmark()
+  {
+    printf( "%-18s %10.1f conn/s\n", "1 loop",  conn_rate(1) );
+    printf( "%-18s %10.1f conn/s\n", "4 loops", conn_rate(4) );
+  }
+
+  /* sends every second call to the worker pool */
+  class offload_echo_handler : public echo_handler
+  {
+    public:
+      volatile int n_;
+
+      offload_echo_handler() : n_(0) { }
+
+      virtual bool offload( connid_t id, const SAI & sai, bfd & buf_fd )
+      {
+        return ( (__sync_fetch_and_add( &n_, 1 ) & 1) == 1 );
+      }
+  };
+
+  /* average round trip of a single client in microseconds */
+  double round_trip(bool inl, bool offload)
+  {
+    in_addr_t   saddr = inet_addr("127.0.0.1");
+    SAI         addr;
+
+    ::memset( &addr,0,sizeof(addr) );
+    ::memcpy( &(addr.sin_addr),&saddr,sizeof(saddr) );
+
+    addr.sin_family  = AF_INET;
+    addr.sin_port    = htons(49917);
+
+    csl::common::metrics & m(csl::common::metrics::instance());
+    uint64_t inline_before    = m.get_counter("comm.tcp.lstnr.inline_calls").value();
+    uint64_t offloaded_before = m.get_counter("comm.tcp.lstnr.offloaded").value();
+
+    lstnr l;
+    echo_handler e;
+    offload_echo_handler o;
+    handler * h = ( offload ? static_cast<handler *>(&o) : static_cast<handler *>(&e) );
+
+    l.set_inline( inl );
+    assert( l.init(*h, addr) == true );
+    assert( l.start() == true );
+
+    echo_client cl(addr);
+    thread      t;
+
+    uint64_t start = csl::common::metrics::now_usec();
+    t.set_entry( cl );
+    assert( t.start() == true );
+    assert( t.exit_event().wait(60000) == true );
+    uint64_t elapsed = csl::common::metrics::now_usec() - start;
+
+    l.stop();
+    assert( l.exit_event().wait(7000) == true );
+    assert( cl.done_ == n_requests_ );
+
+    uint64_t inline_calls = m.get_counter("comm.tcp.lstnr.inline_calls").value() - inline_before;
+    uint64_t offloaded    = m.get_counter("comm.tcp.lstnr.offloaded").value() - offloaded_before;
+
+    if( inl == false )   { assert( inline_calls == 0 ); assert( offloaded == 0 ); }
+    else if( offload )   { assert( inline_calls > 0 );  assert( offloaded > 0 );  }
+    else                 { assert( inline_calls > 0 );  assert( offloaded == 0 ); }
+
+    return static_cast<double>(elapsed) / n_requests_;
+  }
+
+  void inline_benchmark()
+  {
+    printf( "%-18s %10.1f usec/req\n", "pool round trip",    round_trip(false,false) );
+    printf( "%-18s %10.1f usec/req\n", "inline round trip",  round_trip(true,false) );
+    printf( "%-18s %10.1f usec/req\n", "inline w/ offload",  round_trip(true,true) );
+  }
+
+  /* keeps everything in the buffer */
+  class hoard_handler : public csl::comm::handler
+  {
+    public:
+      virtual bool on_data_arrival( connid_t id, const SAI & sai, bfd & buf_fd ) { return true; }
+      CSL_OBJ(test_tcp_lstnr,hoard_handler);
+  };
+
+  /* echoes slowly */
+  class slow_echo_handler : public echo_handler
+  {
+    public:
+      virtual bool on_data_arrival( connid_t id, const SAI & sai, bfd & buf_fd )
+      {
+        SleepMiliseconds( 100 );
+        return echo_handler::on_data_arrival( id, sai, buf_fd );
+      }
+  };
+
+  bool pinged(client & c, uint32_t timeout_ms)
+  {
+    uint8_t text[] = { 'p', 'i', 'n', 'g' };
+    if( c.write( text, 4 ) == false ) return false;
+    csl::common::read_res rr;
+    c.read( 4, timeout_ms, rr );
+    return ( rr.bytes() > 0 );
+  }
+
+  uint64_t counter_value(const char * name)
+  {
+    return csl::common::metrics::instance().get_counter(name).value();
+  }
+
+  void limits(lstnr::backend_t backend)
+  {
+    in_addr_t   saddr = inet_addr("127.0.0.1");
+    SAI         addr;
+
+    ::memset( &addr,0,sizeof(addr) );
+    ::memcpy( &(addr.sin_addr),&saddr,sizeof(saddr) );
+
+    addr.sin_family  = AF_INET;
+    addr.sin_port    = htons(49918);
+
+    /* connection limit, pause: the third one waits in the backlog */
+    {
+      uint64_t fired = counter_value("comm.tcp.lstnr.limit.connections");
+      lstnr l;
+      echo_handler h;
+      lstnr::limits lim;
+      lim.max_connections_ = 2;
+      l.set_backend( backend );
+      l.set_limits( lim );
+      assert( l.init(h, addr) == true );
+      assert( l.start() == true );
+
+      client * c1 = new client();
+      client c2, c3;
+      assert( c1->init( addr ) == true && pinged( *c1, 2000 ) == true );
+      assert( c2.init( addr ) == true && pinged( c2, 2000 ) == true );
+      assert( c3.init( addr ) == true );
+      assert( pinged( c3, 300 ) == false );
+
+      /* room again: the echo arrives */
+      delete c1;
+      csl::common::read_res rr;
+      c3.read( 4, 2000, rr );
+      assert( rr.bytes() > 0 );
+      assert( counter_value("comm.tcp.lstnr.limit.connections") > fired );
+
+      l.stop();
+      assert( l.exit_event().wait(7000) == true );
+    }
+
+    /* connection limit, reject: the third one is closed */
+    {
+      lstnr l;
+      echo_handler h;
+      lstnr::limits lim;
+      lim.max_connections_    = 2;
+      lim.on_max_connections_ = lstnr::reject_;
+      l.set_backend( backend );
+      l.set_limits( lim );
+      assert( l.init(h, addr) == true );
+      assert( l.start() == true );
+
+      client c1, c2, c3;
+      assert( c1.init( addr ) == true && pinged( c1, 2000 ) == true );
+      assert( c2.init( addr ) == true && pinged( c2, 2000 ) == true );
+      assert( c3.init( addr ) == true );
+      assert( pinged( c3, 2000 ) == false );
+
+      l.stop();
+      assert( l.exit_event().wait(7000) == true );
+    }
+
+    /* buffered bytes limit: the hoarding connection is closed */
+    {
+      uint64_t fired = counter_value("comm.tcp.lstnr.limit.buffered");
+      lstnr l;
+      hoard_handler h;
+      lstnr::limits lim;
+      lim.max_buffered_ = 8;
+      l.set_backend( backend );
+      l.set_limits( lim );
+      assert( l.init(h, addr) == true );
+      assert( l.start() == true );
+
+      client c;
+      uint8_t text[16];
+      ::memset( text, 'x', sizeof(text) );
+      assert( c.init( addr ) == true );
+      assert( c.write( text, 4 ) == true );
+      SleepMiliseconds( 50 );
+      assert( c.write( text, sizeof(text) ) == true );
+
+      csl::common::read_res rr;
+      c.read( 4, 2000, rr );
+      assert( rr.bytes() == 0 );
+      assert( counter_value("comm.tcp.lstnr.limit.buffered") == fired+1 );
+
+      l.stop();
+      assert( l.exit_event().wait(7000) == true );
+    }
+
+    /* queue limit, pause: the slow worker serves everybody in the end */
+    {
+      uint64_t fired = counter_value("comm.tcp.lstnr.limit.queued");
+      lstnr l;
+      slow_echo_handler h;
+      lstnr::limits lim;
+      lim.max_queued_ = 1;
+      l.set_workers( 1, 1 );
+      l.set_backend( backend );
+      l.set_limits( lim );
+      assert( l.init(h, addr) == true );
+      assert( l.start() == true );
+
+      enum { n_cli_ = 4 };
+      client c[n_cli_];
+      uint8_t text[] = { 'p', 'i', 'n', 'g' };
+      for( int i=0;i<n_cli_;++i ) assert( c[i].init( addr ) == true && c[i].write( text, 4 ) == true );
+      for( int i=0;i<n_cli_;++i )
+      {
+        csl::common::read_res rr;
+        c[i].read( 4, 5000, rr );
+        assert( rr.bytes() > 0 );
+      }
+      assert( counter_value("comm.tcp.lstnr.limit.queued") > fired );
+
+      l.stop();
+      assert( l.exit_event().wait(7000) == true );
+    }
+  }
+
+  /* echoes with append(), the loop sends the replies */
+  class append_echo_handler : public echo_handler
+  {
+    public:
+      virtual bool on_data_arrival( connid_t id, const SAI & sai, bfd & buf_fd )
+      {
+        csl::common::read_res rr;
+        while( buf_fd.size() > 0 && buf_fd.read_buf( rr, buf_fd.size() ) )
+        {
+          if( buf_fd.append( rr.data(), rr.bytes() ) == false ) return false;
+        }
+        return true;
+      }
+  };
+
+  /* request throughput of the given backend */
+  double backend_throughput(lstnr::backend_t backend, bool inl, unsigned int n_buffers)
+  {
+    in_addr_t   saddr = inet_addr("127.0.0.1");
+    SAI         addr;
+
+    ::memset( &addr,0,sizeof(addr) );
+    ::memcpy( &(addr.sin_addr),&saddr,sizeof(saddr) );
+
+    addr.sin_family  = AF_INET;
+    addr.sin_port    = htons(49919);
+
+    uint64_t completions = counter_value("comm.tcp.lstnr.uring.completions");
+
+    lstnr l;
+    append_echo_handler h;
+    l.set_inline( inl );
+    l.set_backend( backend, n_buffers );
+    assert( l.init(h, addr) == true );
+    assert( l.start() == true );
+
+    echo_client * cl[n_clients_];
+    thread        t[n_clients_];
+
+    uint64_t start = csl::common::metrics::now_usec();
+
+    for( int i=0;i<n_clients_;++i )
+    {
+      cl[i] = new echo_client(addr);
+      t[i].set_entry( *(cl[i]) );
+      assert( t[i].start() == true );
+    }
+
+    int done = 0;
+    for( int i=0;i<n_clients_;++i )
+    {
+      assert( t[i].exit_event().wait(60000) == true );
+      done += cl[i]->done_;
+    }
+
+    uint64_t elapsed = csl::common::metrics::now_usec() - start;
+
+    bool uring_used = ( backend == lstnr::uring_ && uring::available() );
+    assert( l.backend() == (uring_used ? lstnr::uring_ : lstnr::libev_) );
+
+    l.stop();
+    assert( l.exit_event().wait(7000) == true );
+
+    for( int i=0;i<n_clients_;++i ) delete cl[i];
+
+    assert( done == n_clients_*n_requests_ );
+    if( uring_used ) assert( counter_value("comm.tcp.lstnr.uring.completions") > completions );
+    return (elapsed ? (1000000.0 * done / static_cast<double>(elapsed)) : 0.0);
+  }
+
+  enum { big_reply_ = 32*1024*1024 };
+
+  /* answers 'b' with a reply larger than the socket buffers, echoes the rest */
+  class big_reply_handler : public echo_handler
+  {
+    public:
+      virtual bool on_connected( connid_t id, const SAI & sai, bfd & buf_fd )
+      {
+        buf_fd.set_out_size( big_reply_ );
+        return true;
+      }
+
+      virtual bool on_data_arrival( connid_t id, const SAI & sai, bfd & buf_fd )
+      {
+        csl::common::read_res rr;
+        while( buf_fd.size() > 0 && buf_fd.read_buf( rr, buf_fd.size() ) )
+        {
+          if( rr.data()[0] == 'b' )
+          {
+            std::vector<uint8_t> reply( big_reply_, 'x' );
+            if( buf_fd.append( &(reply[0]), reply.size() ) == false ) return false;
+          }
+          else if( buf_fd.append( rr.data(), rr.bytes() ) == false ) return false;
+        }
+        return true;
+      }
+  };
+
+  /* a peer that does not read its reply does not hold up the others */
+  void slow_reader( lstnr::backend_t backend )
+  {
+    if( backend == lstnr::uring_ && uring::available() == false ) return;
+
+    in_addr_t   saddr = inet_addr("127.0.0.1");
+    SAI         addr;
+
+    ::memset( &addr,0,sizeof(addr) );
+    ::memcpy( &(addr.sin_addr),&saddr,sizeof(saddr) );
+
+    addr.sin_family  = AF_INET;
+    addr.sin_port    = htons(49919);
+
+    lstnr l;
+    big_reply_handler h;
+    l.set_inline( true );
+    l.set_backend( backend );
+    assert( l.init(h, addr) == true );
+    assert( l.start() == true );
+
+    client slow, quick;
+    uint8_t text[] = { 'b', 'i', 'g', '!' };
+    assert( slow.init( addr ) == true && slow.write( text, 4 ) == true );
+    SleepMiliseconds( 100 );
+    assert( quick.init( addr ) == true && pinged( quick, 2000 ) == true );
+
+    /* the whole reply arrives once the peer reads */
+    uint64_t got = 0;
+    while( got < big_reply_ )
+    {
+      csl::common::read_res rr;
+      slow.read( 64*1024, 2000, rr );
+      if( rr.bytes() == 0 ) break;
+      got += rr.bytes();
+    }
+    assert( got == big_reply_ );
+    assert( pinged( slow, 2000 ) == true );
+
+    l.stop();
+    assert( l.exit_event().wait(7000) == true );
+  }
+
+  /* remembers the last connection and counts the calls it gets */
+  class wake_handler : public csl::comm::handler
+  {
+    public:
+      volatile connid_t  last_id_;
+      volatile uint64_t  connected_;
+      volatile uint64_t  disconnected_;
+      volatile uint64_t  arrivals_;
+
+      wake_handler() : last_id_(0), connected_(0), disconnected_(0), arrivals_(0) { }
+
+      virtual bool on_connected( connid_t id, const SAI & sai, bfd & buf_fd )
+      {
+        last_id_ = id;
+        __sync_fetch_and_add( &connected_, 1 );
+        return true;
+      }
+
+      virtual bool on_data_arrival( connid_t id, const SAI & sai, bfd & buf_fd )
+      {
+        if( id == last_id_ ) __sync_fetch_and_add( &arrivals_, 1 );
+        return true;
+      }
+
+      virtual void on_disconnected( connid_t id, const SAI & sai )
+      {
+        __sync_fetch_and_add( &disconnected_, 1 );
+      }
+
+      CSL_OBJ(test_tcp_lstnr,wake_handler);
+  };
+
+  /* a wake for a closed connection does not reach the one that took its slot */
+  void stale_wake()
+  {
+    in_addr_t   saddr = inet_addr("127.0.0.1");
+    SAI         addr;
+
+    ::memset( &addr,0,sizeof(addr) );
+    ::memcpy( &(addr.sin_addr),&saddr,sizeof(saddr) );
+
+    addr.sin_family  = AF_INET;
+    addr.sin_port    = htons(49920);
+
+    lstnr l;
+    wake_handler h;
+    assert( l.init(h, addr) == true );
+    assert( l.start() == true );
+
+    connid_t old_id = 0;
+    {
+      client c;
+      assert( c.init( addr ) == true );
+      for( int i=0;i<200 && h.connected_ < 1;++i ) SleepMiliseconds( 5 );
+      assert( h.connected_ == 1 );
+      old_id = h.last_id_;
+    }
+    for( int i=0;i<200 && h.disconnected_ < 1;++i ) SleepMiliseconds( 5 );
+    assert( h.disconnected_ == 1 );
+
+    client c;
+    assert( c.init( addr ) == true );
+    for( int i=0;i<200 && h.connected_ < 2;++i ) SleepMiliseconds( 5 );
+    assert( h.connected_ == 2 );
+    connid_t new_id = h.last_id_;
+
+    /* same slot, other generation */
+    assert( (new_id & 0xffffffffULL) == (old_id & 0xffffffffULL) );
+    assert( new_id != old_id );
+
+    assert( l.wake( old_id ) == true );
+    SleepMiliseconds( 100 );
+    assert( h.arrivals_ == 0 );
+
+    assert( l.wake( new_id ) == true );
+    for( int i=0;i<200 && h.arrivals_ < 1;++i ) SleepMiliseconds( 5 );
+    assert( h.arrivals_ == 1 );
+
+    l.stop();
+    assert( l.exit_event().wait(7000) == true );
+  }
+
+  /* the io_uring backend serves the same way, or falls back to libev */
+  void uring_backend()
+  {
+    backend_throughput( lstnr::uring_, true, lstnr::default_uring_buffers_ );
+    backend_throughput( lstnr::uring_, false, lstnr::default_uring_buffers_ );
+
+    /* more connections than read buffers: the rest is watched by libev */
+    uint64_t no_slot = counter_value("comm.tcp.lstnr.uring.no_slot");
+    backend_throughput( lstnr::uring_, true, 2 );
+    if( uring::available() ) assert( counter_value("comm.tcp.lstnr.uring.no_slot") > no_slot );
+
+    idle_close( lstnr::uring_ );
+    limits( lstnr::uring_ );
+    slow_reader( lstnr::uring_ );
+  }
+
+  void backend_benchmark()
+  {
+    printf( "%-18s %10.1f req/s\n", "libev inline",  backend_throughput(lstnr::libev_,true,0) );
+    printf( "%-18s %10.1f req/s\n", "uring inline",  backend_throughput(lstnr::uring_,true,lstnr::default_uring_buffers_) );
+    printf( "%-18s %10.1f req/s\n", "libev pool",    backend_throughput(lstnr::libev_,false,0) );
+    printf( "%-18s %10.1f req/s\n", "uring pool",    backend_throughput(lstnr::uring_,false,lstnr::default_uring_buffers_) );
+  }
+
 } /* end of test_tcp_lstnr */
 
 using namespace test_tcp_lstnr;
@@ -231,6 +1015,16 @@ int main()
   csl_common_print_results( "baseline          ", csl_common_test_timer_v0(baseline),"" );
   csl_common_print_results( "start_stop        ", csl_common_test_timer_v0(start_stop),"" );
   csl_common_print_results( "threaded          ", csl_common_test_timer_v0(threaded),"" );
+  idle_close( lstnr::libev_ );
+  placement_benchmark();
+  ephemeral_port();
+  conn_rate_benchmark();
+  inline_benchmark();
+  limits( lstnr::libev_ );
+  slow_reader( lstnr::libev_ );
+  stale_wake();
+  uring_backend();
+  backend_benchmark();
   conn();
   return 0;
 }
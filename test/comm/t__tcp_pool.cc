@@ -0,0 +1,361 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+   @file t__tcp_pool.cc
+   @brief tests tcp::pool leasing, health checks, limits and reaping
+ */
+
+#include "codesloop/comm/tcp_pool.hh"
+#include "codesloop/comm/initcomm.hh"
+#include "codesloop/nthread/thread.hh"
+#include "codesloop/common/metrics.hh"
+#include "codesloop/common/test_timer.h"
+#include "codesloop/common/common.h"
+#include <assert.h>
+
+using namespace csl::common;
+using namespace csl::comm;
+using namespace csl::nthread;
+
+/** @brief contains tests related to tcp::pool */
+namespace test_tcp_pool {
+
+  /* echoes everything back, closes the connection when it receives "quit" */
+  class echo_server : public thread::callback
+  {
+    public:
+      enum { max_conns_ = 64 };
+
+      echo_server() : lsock_(-1), n_conns_(0), stop_me_(false)
+      {
+        ::memset( &addr_,0,sizeof(addr_) );
+        addr_.sin_family      = AF_INET;
+        addr_.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr_.sin_port        = 0;
+
+        lsock_ = ::socket( AF_INET, SOCK_STREAM, 0 );
+        assert( lsock_ > 0 );
+        int on = 1;
+        ::setsockopt( lsock_, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char *>(&on), sizeof(on) );
+        assert( ::bind( lsock_, reinterpret_cast<struct sockaddr *>(&addr_), sizeof(addr_) ) == 0 );
+        assert( ::listen( lsock_, 128 ) == 0 );
+        socklen_t len = sizeof(addr_);
+        assert( ::getsockname( lsock_, reinterpret_cast<struct sockaddr *>(&addr_), &len ) == 0 );
+      }
+
+      virtual ~echo_server()
+      {
+        for( unsigned int i=0;i<n_conns_;++i ) { CloseSocket( conns_[i] ); }
+        CloseSocket( lsock_ );
+      }
+
+      virtual void operator()(void)
+      {
+        char buf[1024];
+        while( stop_me_ == false )
+        {
+          struct pollfd pfd[max_conns_+1];
+          pfd[0].fd      = lsock_;
+          pfd[0].events  = POLLIN;
+          pfd[0].revents = 0;
+          for( unsigned int i=0;i<n_conns_;++i )
+          {
+            pfd[i+1].fd      = conns_[i];
+            pfd[i+1].events  = POLLIN;
+            pfd[i+1].revents = 0;
+          }
+
+          if( PollSocket( pfd, n_conns_+1, 10 ) <= 0 ) continue;
+
+          for( unsigned int i=n_conns_;i>0;--i )
+          {
+            if( pfd[i].revents == 0 ) continue;
+            ssize_t n = ::recv( conns_[i-1], buf, sizeof(buf), 0 );
+            if( n <= 0 || (n == 4 && ::memcmp( buf,"quit",4 ) == 0) )
+            {
+              CloseSocket( conns_[i-1] );
+              conns_[i-1] = conns_[--n_conns_];
+            }
+            else
+            {
+              ::send( conns_[i-1], buf, n, 0 );
+            }
+          }
+
+          if( pfd[0].revents )
+          {
+            int s = ::accept( lsock_, 0, 0 );
+            if( s > 0 && n_conns_ < max_conns_ ) { conns_[n_conns_++] = s; }
+            else if( s > 0 )                     { CloseSocket( s ); }
+          }
+        }
+      }
+
+      SAI             addr_;
+      int             lsock_;
+      int             conns_[max_conns_];
+      unsigned int    n_conns_;
+      bool            stop_me_;
+  };
+
+  echo_server * server_ = 0;
+  tcp::pool *   pool_   = 0;
+
+  /* sends a request and reads the echoed reply */
+  bool request(tcp::client & c, const char * req)
+  {
+    uint64_t sz = ::strlen(req);
+    if( c.write( reinterpret_cast<const uint8_t *>(req), sz ) == false ) return false;
+    read_res rr;
+    c.read( sz, 2000, rr );
+    return (rr.bytes() == sz && ::memcmp( rr.data(), req, sz ) == 0);
+  }
+
+  uint64_t count(const char * nm) { return metrics::instance().get_counter(nm).value(); }
+
+  /* a given back connection is leased again without connecting */
+  void reuse()
+  {
+    tcp::pool p;
+    uint64_t connects = count("comm.tcp.pool.connects");
+    uint64_t hits     = count("comm.tcp.pool.hits");
+
+    tcp::client * c1 = p.lease( server_->addr_ );
+    assert( c1 != 0 );
+    assert( p.n_leased() == 1 );
+    assert( request( *c1, "hello" ) == true );
+    p.give_back( c1 );
+    assert( p.n_leased() == 0 );
+    assert( p.n_idle() == 1 );
+
+    for( unsigned int i=0;i<10;++i )
+    {
+      tcp::pool::handle h( p, server_->addr_ );
+      assert( h.ok() == true );
+      assert( h.get() == c1 );
+      assert( request( *(h.get()), "again" ) == true );
+    }
+
+    assert( count("comm.tcp.pool.connects") - connects == 1 );
+    assert( count("comm.tcp.pool.hits") - hits == 10 );
+
+    /* a broken handle is not reused */
+    {
+      tcp::pool::handle h( p, server_->addr_ );
+      h.broken();
+    }
+    assert( p.n_idle() == 0 );
+    assert( p.n_leased() == 0 );
+  }
+
+  /* connections closed by the peer or with stray data on them are dropped */
+  void health()
+  {
+    tcp::pool p;
+
+    tcp::client * c = p.lease( server_->addr_ );
+    assert( c != 0 );
+    assert( c->write( reinterpret_cast<const uint8_t *>("quit"), 4 ) == true );
+    SleepMiliseconds( 100 );
+    assert( c->healthy() == false );
+    p.give_back( c );
+    assert( p.n_idle() == 0 );
+
+    c = p.lease( server_->addr_ );
+    assert( c != 0 );
+    assert( c->write( reinterpret_cast<const uint8_t *>("unread"), 6 ) == true );
+    SleepMiliseconds( 100 );
+    p.give_back( c );
+    assert( p.n_idle() == 0 );
+
+    /* the peer closes an idle connection */
+    c = p.lease( server_->addr_ );
+    assert( c != 0 );
+    p.give_back( c );
+    assert( p.n_idle() == 1 );
+    assert( c->write( reinterpret_cast<const uint8_t *>("quit"), 4 ) == true );
+    SleepMiliseconds( 100 );
+
+    uint64_t broken = count("comm.tcp.pool.broken");
+    tcp::client * c2 = p.lease( server_->addr_ );
+    assert( c2 != 0 );
+    assert( count("comm.tcp.pool.broken") - broken == 1 );
+    assert( request( *c2, "fresh" ) == true );
+    p.give_back( c2 );
+  }
+
+  /* max_per_host() limits the open connections, lease() waits for a free one */
+  void limits()
+  {
+    tcp::pool p;
+    p.max_per_host( 2 );
+    p.connect_timeout_ms( 50 );
+
+    tcp::client * c1 = p.lease( server_->addr_ );
+    tcp::client * c2 = p.lease( server_->addr_ );
+    assert( c1 != 0 && c2 != 0 && c1 != c2 );
+
+    uint64_t timeouts = count("comm.tcp.pool.timeouts");
+    assert( p.lease( server_->addr_ ) == 0 );
+    assert( count("comm.tcp.pool.timeouts") - timeouts == 1 );
+
+    p.give_back( c2 );
+    tcp::client * c3 = p.lease( server_->addr_ );
+    assert( c3 == c2 );
+    p.give_back( c1 );
+    p.give_back( c3 );
+
+    /* the idle limit */
+    p.max_per_host( 8 );
+    p.max_idle( 2 );
+    assert( p.warm( server_->addr_, 4 ) == 2 );
+    assert( p.n_idle() == 2 );
+  }
+
+  /* idle connections expire */
+  void reaping()
+  {
+    tcp::pool p;
+    p.idle_timeout_ms( 20 );
+    assert( p.warm( server_->addr_, 3 ) == 3 );
+    assert( p.reap() == 0 );
+    SleepMiliseconds( 50 );
+    assert( p.reap() == 3 );
+    assert( p.n_idle() == 0 );
+
+    assert( p.warm( server_->addr_, 2 ) == 2 );
+    p.clear();
+    assert( p.n_idle() == 0 );
+  }
+
+  /* a closed port fails fast */
+  void refused()
+  {
+    SAI addr;
+    ::memset( &addr,0,sizeof(addr) );
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port        = 0;
+
+    int s = ::socket( AF_INET, SOCK_STREAM, 0 );
+    socklen_t len = sizeof(addr);
+    assert( ::bind( s, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr) ) == 0 );
+    assert( ::getsockname( s, reinterpret_cast<struct sockaddr *>(&addr), &len ) == 0 );
+    CloseSocket( s );
+
+    tcp::pool p;
+    uint64_t errors = count("comm.tcp.pool.connect_errors");
+    assert( p.lease( addr ) == 0 );
+    assert( count("comm.tcp.pool.connect_errors") - errors == 1 );
+    assert( p.n_leased() == 0 );
+  }
+
+  /* many threads share a few connections */
+  class worker : public thread::callback
+  {
+    public:
+      worker() : ok_(0), failed_(0) {}
+
+      virtual void operator()(void)
+      {
+        for( unsigned int i=0;i<200;++i )
+        {
+          tcp::pool::handle h( *pool_, server_->addr_ );
+          if( h.ok() && request( *(h.get()), "threaded" ) ) { ++ok_; }
+          else                                              { ++failed_; h.broken(); }
+        }
+      }
+
+      unsigned long ok_;
+      unsigned long failed_;
+  };
+
+  void threads()
+  {
+    tcp::pool p;
+    p.max_per_host( 3 );
+    pool_ = &p;
+
+    uint64_t connects = count("comm.tcp.pool.connects");
+    worker   w[8];
+    thread   t[8];
+    for( unsigned int i=0;i<8;++i ) { t[i].set_entry( w[i] ); assert( t[i].start() == true ); }
+    for( unsigned int i=0;i<8;++i ) { assert( t[i].exit_event().wait(20000) == true ); }
+
+    for( unsigned int i=0;i<8;++i ) { assert( w[i].failed_ == 0 ); assert( w[i].ok_ == 200 ); }
+    assert( count("comm.tcp.pool.connects") - connects <= 3 );
+    assert( p.n_leased() == 0 );
+    pool_ = 0;
+  }
+
+  void baseline() { tcp::pool p; }
+
+  void pooled()
+  {
+    tcp::pool::handle h( *pool_, server_->addr_ );
+    assert( request( *(h.get()), "bench" ) == true );
+  }
+
+  void unpooled()
+  {
+    tcp::client c;
+    assert( c.init( server_->addr_ ) == true );
+    assert( request( c, "bench" ) == true );
+  }
+
+} /* end of test_tcp_pool */
+
+using namespace test_tcp_pool;
+
+int main()
+{
+  initcomm w;
+  echo_server srv;
+  thread t;
+  t.set_entry( srv );
+  assert( t.start() == true );
+  server_ = &srv;
+
+  reuse();
+  health();
+  limits();
+  reaping();
+  refused();
+  threads();
+
+  tcp::pool p;
+  pool_ = &p;
+  csl_common_print_results( "baseline      ", csl_common_test_timer_v0(baseline),"" );
+  csl_common_print_results( "pooled        ", csl_common_test_timer_v0(pooled),"" );
+  csl_common_print_results( "unpooled      ", csl_common_test_timer_v0(unpooled),"" );
+  pool_ = 0;
+
+  srv.stop_me_ = true;
+  assert( t.exit_event().wait(2000) == true );
+  return 0;
+}
+
+/* EOF */
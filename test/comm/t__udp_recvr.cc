@@ -0,0 +1,403 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+   @file t__udp_recvr.cc
+   @brief loopback tests of udp::recvr: packet sizes, reply batching, recvmmsg() rate
+ */
+
+#include "codesloop/comm/udp_recvr.hh"
+#include "codesloop/comm/initcomm.hh"
+#include "codesloop/nthread/thread.hh"
+#include "codesloop/common/metrics.hh"
+#include "codesloop/common/test_timer.h"
+#include "codesloop/common/common.h"
+#include <assert.h>
+
+using namespace csl::common;
+using namespace csl::comm;
+using namespace csl::nthread;
+
+/** @brief contains tests related to udp::recvr */
+namespace test_udp_recvr {
+
+  class counting_handler : public udp::recvr::msg_handler
+  {
+    public:
+      counting_handler() : handled_(0) {}
+
+      virtual void operator()(void)
+      {
+        scoped_mutex mm(msgs_->mtx_);
+        if( msgs_->n_items() > 0 )
+        {
+          msgs_->pop();
+          __sync_fetch_and_add( &handled_, 1 );
+        }
+      }
+
+      unsigned long handled_;
+  };
+
+  /* the message owns a pool buffer and hands it over without a copy */
+  void msg_handle()
+  {
+    udp::bufpool & pool(udp::bufpool::instance());
+    unsigned int c512 = udp::bufpool::class_of(100);
+
+    assert( udp::bufpool::class_size(c512) == 512 );
+    assert( udp::bufpool::class_of(65536) == udp::bufpool::n_classes_-1 );
+    assert( udp::bufpool::class_of(65537) == udp::bufpool::n_classes_ );
+
+    udp::msg a;
+    assert( a.max_len() == 0 && a.data_ == 0 );
+    assert( a.alloc(100) == true );
+    assert( a.max_len() == 512 );
+
+    unsigned long long nfree = pool.n_free(c512);
+    unsigned char * p = a.data_;
+    ::memcpy( p, "packet", 6 );
+    a.size_ = 6;
+    a.sender_.sin_port = htons(1234);
+
+    udp::msg b;
+    b.take(a);
+    assert( a.data_ == 0 && a.size_ == 0 && a.max_len() == 0 );
+    assert( b.data_ == p && b.size_ == 6 && b.max_len() == 512 );
+    assert( b.sender_.sin_port == htons(1234) );
+
+    /* growing replaces the buffer */
+    assert( b.alloc(3000) == true );
+    assert( b.max_len() == 8192 );
+    assert( pool.n_free(c512) == nfree+1 );
+
+    udp::msg c;
+    ::memcpy( b.data_, "copy", 4 );
+    b.size_ = 4;
+    b.copy_to(c);
+    assert( c.size_ == 4 && c.max_len() == 512 && ::memcmp( c.data_, "copy", 4 ) == 0 );
+
+    b.release();
+    assert( b.data_ == 0 );
+  }
+
+  /* takes the packets over and checks their size and content */
+  class checking_handler : public udp::recvr::msg_handler
+  {
+    public:
+      enum { max_sizes_ = 16 };
+
+      checking_handler() : n_sizes_(0), handled_(0), bad_(0), depth_(0)
+      {
+        ::memset( seen_, 0, sizeof(seen_) );
+      }
+
+      virtual void operator()(void)
+      {
+        udp::msg ms;
+        {
+          scoped_mutex mm(msgs_->mtx_);
+          if( msgs_->n_items() == 0 ) return;
+          depth_ = msgs_->max_items();
+          ms.take( msgs_->pop() );
+        }
+
+        bool ok = false;
+        for( unsigned int i=0;i<n_sizes_;++i )
+        {
+          if( sizes_[i] != ms.size_ ) continue;
+          ok = (ms.max_len() >= ms.size_);
+          for( unsigned int j=0;ok && j<ms.size_;++j )
+          {
+            if( ms.data_[j] != static_cast<unsigned char>(j*7+ms.size_) ) ok = false;
+          }
+          if( ok ) __sync_fetch_and_add( &(seen_[i]), 1 );
+        }
+        if( ok ) __sync_fetch_and_add( &handled_, 1 );
+        else     __sync_fetch_and_add( &bad_, 1 );
+      }
+
+      unsigned int        sizes_[max_sizes_];
+      unsigned int        n_sizes_;
+      unsigned long       seen_[max_sizes_];
+      unsigned long       handled_;
+      unsigned long       bad_;
+      unsigned long long  depth_;
+  };
+
+  /* packets smaller and bigger than the receive slot arrive intact */
+  void sizes(unsigned int batch)
+  {
+    static const unsigned int sz[] = { 1, 100, 511, 2048, 2049, 9000, 65507 };
+    static const unsigned int n_sz = sizeof(sz)/sizeof(sz[0]);
+
+    checking_handler h;
+    for( unsigned int i=0;i<n_sz;++i ) h.sizes_[i] = sz[i];
+    h.n_sizes_ = n_sz;
+
+    udp::recvr r;
+    thread t;
+
+    SAI addr;
+    ::memset( &addr,0,sizeof(addr) );
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port        = 0;
+    r.addr( addr );
+
+    r.batch( batch );
+    r.queue_depth( 4096 );
+    r.slot_size( 2000 );
+    assert( r.slot_size() == 2048 );
+    assert( r.start( 1, 2, 200, 3, h ) == true );
+    t.set_entry( r );
+    assert( t.start() == true );
+    addr = r.addr();
+
+    int ss = ::socket( AF_INET, SOCK_DGRAM, 0 );
+    assert( ss > 0 );
+
+    unsigned char * pkt = reinterpret_cast<unsigned char *>(::malloc( 65536 ));
+    for( unsigned int i=0;i<n_sz;++i )
+    {
+      for( unsigned int j=0;j<sz[i];++j ) pkt[j] = static_cast<unsigned char>(j*7+sz[i]);
+      assert( ::sendto( ss, reinterpret_cast<const char *>(pkt), sz[i], 0,
+              reinterpret_cast<const struct sockaddr *>(&addr), sizeof(addr) ) == static_cast<int>(sz[i]) );
+    }
+    ::free( pkt );
+
+    for( unsigned int w=0;w<500 && h.handled_+h.bad_ < n_sz;++w ) SleepMiliseconds(10);
+
+    r.stop();
+    assert( t.exit_event().wait(2000) == true );
+    ShutdownCloseSocket( ss );
+
+    assert( h.bad_ == 0 );
+    assert( h.handled_ == n_sz );
+    for( unsigned int i=0;i<n_sz;++i ) assert( h.seen_[i] == 1 );
+    assert( h.depth_ == 4096 );
+  }
+
+  /* sends every packet back to its sender */
+  class echo_handler : public udp::recvr::msg_handler
+  {
+    public:
+      virtual void operator()(void)
+      {
+        udp::msg ms;
+        {
+          scoped_mutex mm(msgs_->mtx_);
+          if( msgs_->n_items() == 0 ) return;
+          ms.take( msgs_->pop() );
+        }
+        send_reply( ms );
+      }
+  };
+
+  /* the replies come back intact, batched ones with a fraction of the send calls */
+  void replies(unsigned int batch)
+  {
+    static const unsigned int n_replies = 4096;
+    static const unsigned int burst     = 64;
+
+    metrics::counter & calls(metrics::instance().get_counter("comm.udp.sendq.calls"));
+    metrics::counter & qsent(metrics::instance().get_counter("comm.udp.sendq.sent"));
+
+    echo_handler h;
+    udp::recvr r;
+    thread t;
+
+    SAI addr;
+    ::memset( &addr,0,sizeof(addr) );
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port        = 0;
+    r.addr( addr );
+
+    r.reply_batch( batch, 2 );
+    assert( r.reply_batch() == batch );
+    assert( r.start( 1, 4, 200, 3, h ) == true );
+    assert( (h.reply_queue() != 0) == (batch > 1) );
+    t.set_entry( r );
+    assert( t.start() == true );
+    addr = r.addr();
+
+    int ss = ::socket( AF_INET, SOCK_DGRAM, 0 );
+    assert( ss > 0 );
+    assert( ::connect( ss, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr) ) == 0 );
+
+    uint64_t calls_before = calls.value();
+    uint64_t sent_before  = qsent.value();
+    uint64_t start        = metrics::now_usec();
+    unsigned int got = 0;
+    unsigned int bad = 0;
+
+    for( unsigned int sent=0;sent<n_replies; )
+    {
+      unsigned int in_burst = 0;
+      for( ;in_burst<burst;++in_burst,++sent )
+      {
+        uint32_t v = htonl(sent);
+        assert( ::send( ss, reinterpret_cast<const char *>(&v), sizeof(v), 0 ) == sizeof(v) );
+      }
+
+      /* wait for the burst to come back */
+      for( unsigned int i=0;i<in_burst;++i )
+      {
+        struct pollfd pfd;
+        pfd.fd      = ss;
+        pfd.events  = POLLIN;
+        pfd.revents = 0;
+        if( PollSocket( &pfd, 1, 2000 ) <= 0 ) break;
+
+        uint32_t v = 0;
+        if( ::recv( ss, reinterpret_cast<char *>(&v), sizeof(v), 0 ) != sizeof(v) || ntohl(v) >= n_replies ) ++bad;
+        else ++got;
+      }
+    }
+
+    uint64_t elapsed = metrics::now_usec() - start;
+    uint64_t ncalls  = calls.value() - calls_before;
+
+    r.stop();
+    assert( t.exit_event().wait(2000) == true );
+    ShutdownCloseSocket( ss );
+
+    assert( bad == 0 );
+    assert( got == n_replies );
+
+    if( batch > 1 )
+    {
+      assert( qsent.value() - sent_before == n_replies );
+      assert( ncalls < n_replies/4 );
+    }
+    else
+    {
+      assert( ncalls == 0 );
+    }
+
+    printf( "replies batch(%2u)   %10.0f replies/sec %8llu sendmmsg calls\n", batch,
+            static_cast<double>(got) * 1000000.0 / static_cast<double>(elapsed ? elapsed : 1),
+            static_cast<unsigned long long>(ncalls) );
+  }
+
+  static const unsigned int n_packets_ = 50000;
+  static const unsigned int max_burst_ = 2048;
+
+  /* sends n_packets_ datagrams and returns the packets per second committed by the receiver */
+  double packet_rate(unsigned int batch)
+  {
+    metrics::counter & received(metrics::instance().get_counter("comm.udp.recvr.received"));
+
+    int rs = ::socket( AF_INET, SOCK_DGRAM, 0 );
+    assert( rs > 0 );
+
+    int rcvbuf = 8*1024*1024;
+    socklen_t optlen = sizeof(rcvbuf);
+    ::setsockopt( rs, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf) );
+    assert( ::getsockopt( rs, SOL_SOCKET, SO_RCVBUF, &rcvbuf, &optlen ) == 0 );
+
+    /* a burst must fit into the socket buffer (~1k accounted per small datagram) */
+    unsigned int burst = static_cast<unsigned int>(rcvbuf)/1024;
+    if( burst > max_burst_ ) burst = max_burst_;
+    if( burst < 16 )         burst = 16;
+
+    SAI addr;
+    ::memset( &addr,0,sizeof(addr) );
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port        = 0;
+    socklen_t len = sizeof(addr);
+    assert( ::bind( rs, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr) ) == 0 );
+    assert( ::getsockname( rs, reinterpret_cast<struct sockaddr *>(&addr), &len ) == 0 );
+
+    counting_handler h;
+    udp::recvr r;
+    thread t;
+
+    r.batch( batch );
+    assert( r.batch() == batch );
+    assert( r.start( 1, 2, 200, 3, h, rs ) == true );
+    t.set_entry( r );
+    assert( t.start() == true );
+
+    int ss = ::socket( AF_INET, SOCK_DGRAM, 0 );
+    assert( ss > 0 );
+    assert( ::connect( ss, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr) ) == 0 );
+
+    char pkt[64];
+    ::memset( pkt, 'x', sizeof(pkt) );
+
+    uint64_t before = received.value();
+    uint64_t start  = metrics::now_usec();
+    unsigned int sent = 0;
+
+    while( sent < n_packets_ )
+    {
+      for( unsigned int i=0;i<burst && sent < n_packets_;++i,++sent )
+      {
+        assert( ::send( ss, pkt, sizeof(pkt), 0 ) == sizeof(pkt) );
+      }
+      /* let the receiver drain the socket buffer before the next burst */
+      while( received.value() - before < sent ) SleepMiliseconds(0);
+    }
+
+    uint64_t deadline = metrics::now_usec() + 5000000;
+    while( received.value() - before < sent && metrics::now_usec() < deadline ) SleepMiliseconds(1);
+
+    uint64_t got     = received.value() - before;
+    uint64_t elapsed = metrics::now_usec() - start;
+
+    r.stop();
+    assert( t.exit_event().wait(2000) == true );
+    ShutdownCloseSocket( ss );
+
+    assert( got == sent );
+    return static_cast<double>(got) * 1000000.0 / static_cast<double>(elapsed ? elapsed : 1);
+  }
+
+} /* end of test_udp_recvr */
+
+using namespace test_udp_recvr;
+
+int main()
+{
+  initcomm w;
+
+  msg_handle();
+  sizes( 1 );
+  sizes( 8 );
+  replies( 1 );
+  replies( 32 );
+
+  double single  = packet_rate( 1 );
+  double batched = packet_rate( 32 );
+
+  printf( "recvfrom            %10.0f packets/sec\n", single );
+  printf( "recvmmsg(32)        %10.0f packets/sec\n", batched );
+  return 0;
+}
+
+/* EOF */
@@ -0,0 +1,280 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+   @file t__udp_session.cc
+   @brief tests udp::session_cache lookups, write-behind and eviction
+ */
+
+#include "codesloop/comm/udp_data.hh"
+#include "codesloop/comm/udp_session.hh"
+#include "codesloop/nthread/thread.hh"
+#include "codesloop/common/metrics.hh"
+#include "codesloop/common/test_timer.h"
+#include "codesloop/common/common.h"
+#include <assert.h>
+
+using namespace csl::common;
+using namespace csl::comm;
+using namespace csl::nthread;
+
+/** @brief contains tests related to udp::session_cache */
+namespace test_udp_session {
+
+  /* remembers the last written update */
+  class recording_cb : public udp::update_session_callback
+  {
+    public:
+      recording_cb() : calls_(0) {}
+
+      virtual bool operator()( const udp::saltbuf_t & old_salt,
+                               const udp::saltbuf_t & new_salt,
+                               const SAI & addr,
+                               const ustr & sesskey )
+      {
+        __sync_fetch_and_add( &calls_, 1 );
+        old_ = old_salt;
+        new_ = new_salt;
+        key_ = sesskey;
+        return true;
+      }
+
+      unsigned long     calls_;
+      udp::saltbuf_t    old_;
+      udp::saltbuf_t    new_;
+      ustr              key_;
+  };
+
+  udp::saltbuf_t salt(uint64_t v)
+  {
+    udp::saltbuf_t ret;
+    ret.set( reinterpret_cast<const uint8_t *>(&v), sizeof(v) );
+    return ret;
+  }
+
+  SAI peer(unsigned int n)
+  {
+    SAI ret;
+    ::memset( &ret,0,sizeof(ret) );
+    ret.sin_family      = AF_INET;
+    ret.sin_addr.s_addr = htonl(0x0a000000+(n>>8));
+    ret.sin_port        = htons(static_cast<unsigned short>(1024+(n&0xff)));
+    return ret;
+  }
+
+  /* hits need the salt and the peer address */
+  void lookup()
+  {
+    udp::session_cache c;
+    ustr k;
+
+    assert( c.lookup( salt(1), peer(1), k ) == false );
+    c.insert( salt(1), peer(1), ustr("key1") );
+    assert( c.size() == 1 );
+    assert( c.n_dirty() == 0 );
+
+    assert( c.lookup( salt(1), peer(1), k ) == true );
+    assert( k == "key1" );
+    assert( c.lookup( salt(1), peer(2), k ) == false );
+    assert( c.lookup( salt(2), peer(1), k ) == false );
+
+    udp::saltbuf_t s;
+    assert( c.find( peer(1), s, k ) == true );
+    assert( s == salt(1) );
+
+    /* a new session of the same peer replaces the old one */
+    c.insert( salt(5), peer(1), ustr("key5") );
+    assert( c.size() == 1 );
+    assert( c.lookup( salt(1), peer(1), k ) == false );
+    assert( c.lookup( salt(5), peer(1), k ) == true );
+    assert( k == "key5" );
+
+    assert( c.erase( peer(1) ) == true );
+    assert( c.erase( peer(1) ) == false );
+    assert( c.size() == 0 );
+  }
+
+  /* successive salt updates are written as one */
+  void write_behind()
+  {
+    udp::session_cache c;
+    recording_cb cb;
+    ustr k;
+
+    c.write_behind_ms( 100000 );
+    c.insert( salt(10), peer(1), ustr("key") );
+
+    c.update( salt(10), salt(11), peer(1), ustr("key") );
+    c.update( salt(11), salt(12), peer(1), ustr("key") );
+    c.update( salt(12), salt(13), peer(1), ustr("key") );
+
+    assert( c.size() == 1 );
+    assert( c.n_dirty() == 1 );
+    assert( c.flush_due() == false );
+    assert( c.lookup( salt(10), peer(1), k ) == false );
+    assert( c.lookup( salt(13), peer(1), k ) == true );
+
+    assert( c.flush( cb ) == 1 );
+    assert( cb.calls_ == 1 );
+    assert( cb.old_ == salt(10) );
+    assert( cb.new_ == salt(13) );
+    assert( cb.key_ == "key" );
+    assert( c.n_dirty() == 0 );
+    assert( c.flush( cb ) == 0 );
+
+    /* an update of an uncached session carries the old salt to the callback */
+    c.update( salt(20), salt(21), peer(2), ustr("other") );
+    assert( c.lookup( salt(21), peer(2), k ) == true );
+    assert( c.flush( cb ) == 1 );
+    assert( cb.old_ == salt(20) && cb.new_ == salt(21) );
+
+    /* write-through */
+    c.write_behind_ms( 0 );
+    c.update( salt(21), salt(22), peer(2), ustr("other") );
+    assert( c.flush_due() == true );
+  }
+
+  /* the least recently used and the idle sessions go, their updates are kept */
+  void eviction()
+  {
+    udp::session_cache c;
+    recording_cb cb;
+    ustr k;
+
+    c.capacity( 2 );
+    c.write_behind_ms( 100000 );
+    c.insert( salt(1), peer(1), ustr("a") );
+    c.insert( salt(2), peer(2), ustr("b") );
+    c.update( salt(2), salt(3), peer(2), ustr("b") );
+    assert( c.lookup( salt(1), peer(1), k ) == true );
+
+    /* peer(2) is the least recently used */
+    c.insert( salt(4), peer(4), ustr("c") );
+    assert( c.size() == 2 );
+    assert( c.lookup( salt(3), peer(2), k ) == false );
+    assert( c.lookup( salt(1), peer(1), k ) == true );
+
+    /* the evicted dirty session is written before the next miss, the cached ones wait */
+    c.update( salt(1), salt(5), peer(1), ustr("a") );
+    assert( c.flush_due() == true );
+    assert( c.flush_evicted( cb ) == 1 );
+    assert( cb.old_ == salt(2) && cb.new_ == salt(3) && cb.key_ == "b" );
+    assert( c.flush_evicted( cb ) == 0 );
+    assert( c.n_dirty() == 1 );
+    assert( c.flush( cb ) == 1 );
+    assert( cb.old_ == salt(1) && cb.new_ == salt(5) );
+
+    c.ttl_ms( 20 );
+    SleepMiliseconds( 50 );
+    assert( c.lookup( salt(5), peer(1), k ) == false );
+  }
+
+  /* handler threads working on their own sessions */
+  struct worker
+  {
+    udp::session_cache * c_;
+    unsigned int         base_;
+    unsigned long        hits_;
+
+    void operator()()
+    {
+      ustr k;
+      for( unsigned int r=0;r<50;++r )
+      {
+        for( unsigned int i=0;i<64;++i )
+        {
+          unsigned int n = base_+i;
+          uint64_t s = (static_cast<uint64_t>(n)<<20)+r;
+          if( c_->lookup( salt(s), peer(n), k ) ) ++hits_;
+          else c_->insert( salt(s), peer(n), ustr("k") );
+          c_->update( salt(s), salt(s+1), peer(n), ustr("k") );
+        }
+      }
+    }
+  };
+
+  class worker_cb : public thread::callback
+  {
+    public:
+      worker w_;
+      virtual void operator()(void) { w_(); }
+  };
+
+  void threads()
+  {
+    udp::session_cache c;
+    recording_cb cb;
+    worker_cb wc[4];
+    thread t[4];
+
+    for( unsigned int i=0;i<4;++i )
+    {
+      wc[i].w_.c_    = &c;
+      wc[i].w_.base_ = i*1000;
+      wc[i].w_.hits_ = 0;
+      t[i].set_entry( wc[i] );
+      assert( t[i].start() == true );
+    }
+    for( unsigned int i=0;i<4;++i ) assert( t[i].exit_event().wait(10000) == true );
+
+    /* every session was found by its next salt after the first round */
+    for( unsigned int i=0;i<4;++i ) assert( wc[i].w_.hits_ == 49*64 );
+    assert( c.size() == 4*64 );
+    assert( c.flush( cb ) == 4*64 );
+  }
+
+  static udp::session_cache * bench_cache_ = 0;
+
+  void baseline() { }
+
+  void bench_lookup()
+  {
+    static unsigned int n = 0;
+    ustr k;
+    unsigned int i = (n++) & 1023;
+    bench_cache_->lookup( salt(i), peer(i), k );
+  }
+
+} /* end of test_udp_session */
+
+using namespace test_udp_session;
+
+int main()
+{
+  lookup();
+  write_behind();
+  eviction();
+  threads();
+
+  udp::session_cache c;
+  for( unsigned int i=0;i<1024;++i ) c.insert( salt(i), peer(i), ustr("benchmark key") );
+  bench_cache_ = &c;
+
+  csl_common_print_results( "baseline      ", csl_common_test_timer_v0(baseline),"" );
+  csl_common_print_results( "lookup        ", csl_common_test_timer_v0(bench_lookup),"" );
+  return 0;
+}
+
+/* EOF */
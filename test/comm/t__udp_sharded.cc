@@ -0,0 +1,200 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+   @file t__udp_sharded.cc
+   @brief loopback tests of udp::sharded_recvr: flow spreading and packet rate
+ */
+
+#include "codesloop/comm/udp_sharded.hh"
+#include "codesloop/comm/initcomm.hh"
+#include "codesloop/nthread/thread.hh"
+#include "codesloop/common/metrics.hh"
+#include "codesloop/common/test_timer.h"
+#include "codesloop/common/common.h"
+#include <assert.h>
+
+using namespace csl::common;
+using namespace csl::comm;
+using namespace csl::nthread;
+
+/** @brief contains tests related to udp::sharded_recvr */
+namespace test_udp_sharded {
+
+  class counting_handler : public udp::recvr::msg_handler
+  {
+    public:
+      counting_handler() : handled_(0) {}
+
+      virtual void operator()(void)
+      {
+        scoped_mutex mm(msgs_->mtx_);
+        if( msgs_->n_items() > 0 )
+        {
+          msgs_->pop();
+          __sync_fetch_and_add( &handled_, 1 );
+        }
+      }
+
+      unsigned long handled() { return __sync_fetch_and_add( &handled_, 0 ); }
+
+    private:
+      unsigned long handled_;
+  };
+
+  enum {
+    max_shards_  = 8,
+    n_flows_     = 16
+  };
+
+  struct fixture
+  {
+    counting_handler       h_[max_shards_];
+    udp::sharded_recvr     sr_;
+    int                    flows_[n_flows_];
+    unsigned int           n_;
+
+    fixture(unsigned int n) : n_(n)
+    {
+      SAI addr;
+      ::memset( &addr,0,sizeof(addr) );
+      addr.sin_family      = AF_INET;
+      addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      addr.sin_port        = 0;
+      sr_.addr( addr );
+
+      for( unsigned int i=0;i<n;++i ) assert( sr_.add_shard( h_[i] ) == true );
+      assert( sr_.n_shards() == n );
+      sr_.queue_depth( 4096 );
+      assert( sr_.start( 1, 2, 200, 3 ) == true );
+      assert( sr_.add_shard( h_[0] ) == false );
+
+      addr = sr_.addr();
+      assert( addr.sin_port != 0 );
+
+      /* every flow is a socket of its own, the kernel hashes them to the shards */
+      for( unsigned int i=0;i<n_flows_;++i )
+      {
+        flows_[i] = ::socket( AF_INET, SOCK_DGRAM, 0 );
+        assert( flows_[i] > 0 );
+        assert( ::connect( flows_[i], reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr) ) == 0 );
+      }
+    }
+
+    ~fixture()
+    {
+      assert( sr_.stop() == true );
+      for( unsigned int i=0;i<n_flows_;++i ) ShutdownCloseSocket( flows_[i] );
+    }
+
+    unsigned long handled()
+    {
+      unsigned long ret = 0;
+      for( unsigned int i=0;i<n_;++i ) ret += h_[i].handled();
+      return ret;
+    }
+
+    /* sends n packets round-robin on the flows, in bursts the socket buffers hold */
+    unsigned long send(unsigned int n)
+    {
+      static const unsigned int burst = 256;
+      char pkt[64];
+      ::memset( pkt, 'x', sizeof(pkt) );
+
+      unsigned long before = handled();
+      unsigned int sent = 0;
+      while( sent < n )
+      {
+        for( unsigned int i=0;i<burst && sent < n;++i,++sent )
+        {
+          assert( ::send( flows_[sent%n_flows_], pkt, sizeof(pkt), 0 ) == sizeof(pkt) );
+        }
+        uint64_t deadline = metrics::now_usec() + 5000000;
+        while( handled() - before < sent && metrics::now_usec() < deadline ) SleepMiliseconds(0);
+      }
+      return handled() - before;
+    }
+  };
+
+  /* the shards share the port and the flows are spread among them */
+  void spread()
+  {
+    fixture f(4);
+
+    SAI a = f.sr_.addr();
+    for( unsigned int i=0;i<f.n_;++i )
+    {
+      assert( f.sr_.shard(i).addr().sin_port == a.sin_port );
+      assert( f.h_[i].socket() == f.sr_.shard(i).socket() );
+    }
+
+    assert( f.send( 1600 ) == 1600 );
+
+    unsigned int active = 0;
+    for( unsigned int i=0;i<f.n_;++i ) if( f.h_[i].handled() > 0 ) ++active;
+    assert( active > 1 );
+  }
+
+  /* a single shard needs no SO_REUSEPORT */
+  void single()
+  {
+    fixture f(1);
+    assert( f.send( 100 ) == 100 );
+  }
+
+  /* packets per second with the given number of shards */
+  double packet_rate(unsigned int n)
+  {
+    static const unsigned int n_packets = 40000;
+    fixture f(n);
+
+    uint64_t start = metrics::now_usec();
+    unsigned long got = f.send( n_packets );
+    uint64_t elapsed = metrics::now_usec() - start;
+
+    assert( got == n_packets );
+    return static_cast<double>(got) * 1000000.0 / static_cast<double>(elapsed ? elapsed : 1);
+  }
+
+} /* end of test_udp_sharded */
+
+using namespace test_udp_sharded;
+
+int main()
+{
+  initcomm w;
+
+  single();
+  spread();
+
+  double one  = packet_rate( 1 );
+  double four = packet_rate( 4 );
+
+  printf( "1 shard             %10.0f packets/sec\n", one );
+  printf( "4 shards            %10.0f packets/sec\n", four );
+  return 0;
+}
+
+/* EOF */
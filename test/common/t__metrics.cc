@@ -0,0 +1,174 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**
+   @file t__metrics.cc
+   @brief Tests to verify metrics
+ */
+
+#include "codesloop/common/metrics.hh"
+#include "codesloop/common/ustr.hh"
+#include "codesloop/common/pbuf.hh"
+#include "codesloop/common/xdrbuf.hh"
+#include "codesloop/common/exc.hh"
+#include "codesloop/common/test_timer.h"
+#include "codesloop/common/common.h"
+#include <assert.h>
+
+using namespace csl::common;
+
+/** @brief contains tests related to metrics */
+namespace test_metrics {
+
+  static metrics::counter &    cnt_(metrics::instance().get_counter("test.counter"));
+  static metrics::gauge &      gau_(metrics::instance().get_gauge("test.gauge"));
+  static metrics::histogram &  hst_(metrics::instance().get_histogram("test.histogram"));
+
+  /** @test performance baseline */
+  void baseline() { }
+
+  void counter_inc() { cnt_.inc(); }
+
+  void gauge_inc() { gau_.inc(); }
+
+  void histogram_record() { hst_.record(1234); }
+
+  void timer() { metrics::scoped_timer t(hst_); }
+
+  void registry()
+  {
+    metrics m;
+    metrics::counter & c1(m.get_counter("a"));
+    metrics::counter & c2(m.get_counter("a"));
+    assert( &c1 == &c2 );
+    assert( m.size() == 1 );
+    assert( m.find("a") == &c1 );
+    assert( m.find("b") == 0 );
+
+    c1.add(10);
+    c2.inc();
+    assert( c1.value() == 11 );
+
+    metrics::gauge & g(m.get_gauge("g"));
+    g.set(5);
+    g.dec();
+    g.add(-10);
+    assert( g.value() == -6 );
+
+    /* the same name cannot be registered with a different kind */
+    bool caught = false;
+    try { m.get_gauge("a"); } catch( exc & e ) { caught = true; }
+    assert( caught == true );
+  }
+
+  void buckets()
+  {
+    /* every value must fall into a bucket whose upper bound is not below it */
+    for( uint64_t v=0; v<100000; v+=7 )
+    {
+      unsigned int b = metrics::histogram::bucket_of(v);
+      assert( b < metrics::n_buckets_ );
+      assert( metrics::histogram::bucket_upper(b) >= v );
+      if( b > 0 ) { assert( metrics::histogram::bucket_upper(b-1) < v ); }
+    }
+    assert( metrics::histogram::bucket_of(~0ULL) == metrics::n_buckets_-1 );
+    assert( metrics::histogram::bucket_upper(metrics::n_buckets_-1) == ~0ULL );
+  }
+
+  void percentiles()
+  {
+    metrics m;
+    metrics::histogram & h(m.get_histogram("h"));
+
+    assert( h.count() == 0 );
+    assert( h.percentile(50.0) == 0 );
+
+    for( uint64_t i=1;i<=1000;++i ) h.record(i);
+
+    assert( h.count() == 1000 );
+    assert( h.min() == 1 );
+    assert( h.max() == 1000 );
+    assert( h.sum() == 500500 );
+
+    /* within the 1/16 relative error of the sub-buckets */
+    uint64_t p50 = h.percentile(50.0);
+    uint64_t p99 = h.percentile(99.0);
+    assert( p50 >= 500 && p50 <= 500+500/16 );
+    assert( p99 >= 990 && p99 <= 1000 );
+    assert( h.percentile(100.0) == 1000 );
+  }
+
+  void snapshot()
+  {
+    metrics m;
+    m.get_counter("s.counter").add(42);
+    m.get_gauge("s.gauge").set(-3);
+    m.get_histogram("s.hist").record(100);
+
+    metrics::snapshot s;
+    m.take_snapshot(s);
+    assert( s.size() == 3 );
+    assert( s.items()[0].kind_ == metrics::counter_ );
+    assert( s.find("s.counter")->value_ == 42 );
+    assert( s.find("s.gauge")->value_ == -3 );
+    assert( s.find("s.hist")->value_ == 1 );
+    assert( s.find("s.hist")->max_ == 100 );
+
+    ustr txt;
+    s.to_text(txt);
+    assert( txt.size() > 0 );
+
+    pbuf pb;
+    xdrbuf xb(pb);
+    assert( s.to_xdr(xb) == true );
+
+    xdrbuf xr(pb);
+    metrics::snapshot r;
+    assert( r.from_xdr(xr) == true );
+    assert( r.size() == 3 );
+    assert( r.find("s.counter")->value_ == 42 );
+    assert( r.find("s.gauge")->value_ == -3 );
+    assert( r.find("s.hist")->p50_ == s.find("s.hist")->p50_ );
+  }
+
+} // end of namespace test_metrics
+
+using namespace test_metrics;
+
+int main()
+{
+  registry();
+  buckets();
+  percentiles();
+  snapshot();
+
+  csl_common_print_results( "baseline       ", csl_common_test_timer_v0(baseline),"" );
+  csl_common_print_results( "counter_inc    ", csl_common_test_timer_v0(counter_inc),"" );
+  csl_common_print_results( "gauge_inc      ", csl_common_test_timer_v0(gauge_inc),"" );
+  csl_common_print_results( "hist_record    ", csl_common_test_timer_v0(histogram_record),"" );
+  csl_common_print_results( "scoped_timer   ", csl_common_test_timer_v0(timer),"" );
+  return 0;
+}
+
+/* EOF */
@@ -0,0 +1,208 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+   @file t__adaptive_mutex.cc
+   @brief Tests to check csl adaptive_mutex behaviour
+*/
+
+#include "codesloop/common/test_timer.h"
+#include "codesloop/nthread/adaptive_mutex.hh"
+#include "codesloop/nthread/mutex.hh"
+#include "codesloop/nthread/thread.hh"
+#include <assert.h>
+#include <stdio.h>
+
+using namespace csl::nthread;
+
+/** @brief contains tests related to csl adaptive mutexes */
+namespace test_adaptive_mutex
+{
+  /** @test lock semantics in a single thread */
+  void test_semantics()
+  {
+    adaptive_mutex m;
+    assert( m.is_locked() == false );
+    assert( m.unlock() == false );
+    assert( m.lock() == true );
+    assert( m.is_locked() == true );
+    assert( m.try_lock() == false );
+    assert( m.unlock() == true );
+    assert( m.is_locked() == false );
+    assert( m.try_lock() == true );
+    assert( m.unlock() == true );
+    {
+      scoped_adaptive_mutex sm(m);
+      assert( m.is_locked() == true );
+    }
+    assert( m.is_locked() == false );
+    assert( m.spin_limit() >= 10 );
+    assert( m.spin_limit() <= adaptive_mutex::max_spins_ );
+  }
+
+  /** @test the statistics are only collected when enabled */
+  void test_stats()
+  {
+    adaptive_mutex m;
+    lock_stats::data d;
+
+    m.lock(); m.unlock();
+    m.stats().get(d);
+    assert( d.acquisitions_ == 0 );
+
+    m.enable_stats();
+    m.lock(); SleepMiliseconds(2); m.unlock();
+    m.lock(); m.unlock();
+    m.stats().get(d);
+    assert( d.acquisitions_ == 2 );
+    assert( d.contended_ == 0 );
+    assert( d.max_hold_usec_ >= 1000 );
+    assert( d.hold_usec_ >= d.max_hold_usec_ );
+
+    m.disable_stats();
+    m.lock(); m.unlock();
+    m.stats().get(d);
+    assert( d.acquisitions_ == 2 );
+
+    m.stats().reset();
+    m.stats().get(d);
+    assert( d.acquisitions_ == 0 );
+    assert( d.hold_usec_ == 0 );
+  }
+
+  enum { n_threads_ = 4, n_loops_ = 50000 };
+
+  template <typename M> class counter_callback : public thread::callback
+  {
+  public:
+    counter_callback() : value_(0) {}
+
+    virtual void operator()(void)
+    {
+      for( int i=0;i<n_loops_;++i )
+      {
+        scoped_mutex_template<M> m(mtx_);
+        ++value_;
+      }
+    }
+    virtual ~counter_callback() {}
+
+    M              mtx_;
+    volatile long  value_;
+  };
+
+  template <typename M> void contended(counter_callback<M> & cb)
+  {
+    thread t[n_threads_];
+    cb.value_ = 0;
+
+    for( int i=0;i<n_threads_;++i )
+    {
+      t[i].set_entry(cb);
+      assert( t[i].start() == true );
+    }
+    for( int i=0;i<n_threads_;++i )
+    {
+      assert( t[i].exit_event().wait(30000) == true );
+    }
+    assert( cb.value_ == n_threads_*n_loops_ );
+  }
+
+  static counter_callback<adaptive_mutex> adaptive_cb_;
+  static counter_callback<mutex>          mutex_cb_;
+
+  /** @test 4 threads incrementing a shared counter */
+  void test_contended_adaptive() { contended(adaptive_cb_); }
+
+  /** @test the same with the recursive mutex */
+  void test_contended_mutex()    { contended(mutex_cb_); }
+
+  /** @test contention is reported */
+  void test_contended_stats()
+  {
+    adaptive_cb_.mtx_.stats().reset();
+    adaptive_cb_.mtx_.enable_stats("test.adaptive_mutex");
+    contended(adaptive_cb_);
+    adaptive_cb_.mtx_.disable_stats();
+
+    lock_stats::data d;
+    adaptive_cb_.mtx_.stats().get(d);
+    assert( d.acquisitions_ == n_threads_*n_loops_ );
+    assert( d.contended_ <= d.acquisitions_ );
+    assert( d.max_wait_usec_ <= d.wait_usec_ );
+
+    printf("contended: %llu/%llu  wait: %llu usec (max %llu)  hold: %llu usec (max %llu)  spin limit: %u\n",
+      static_cast<unsigned long long>(d.contended_), static_cast<unsigned long long>(d.acquisitions_),
+      static_cast<unsigned long long>(d.wait_usec_), static_cast<unsigned long long>(d.max_wait_usec_),
+      static_cast<unsigned long long>(d.hold_usec_), static_cast<unsigned long long>(d.max_hold_usec_),
+      adaptive_cb_.mtx_.spin_limit());
+  }
+
+  static adaptive_mutex bench_adaptive_;
+  static mutex          bench_mutex_;
+
+  /** @test uncontended lock/unlock */
+  void test_lock_unlock_adaptive()
+  {
+    bench_adaptive_.lock();
+    bench_adaptive_.unlock();
+  }
+
+  /** @test uncontended lock/unlock with the recursive mutex */
+  void test_lock_unlock_mutex()
+  {
+    bench_mutex_.lock();
+    bench_mutex_.unlock();
+  }
+}
+
+using namespace test_adaptive_mutex;
+
+int main()
+{
+  test_semantics();
+  test_stats();
+  test_contended_stats();
+
+  csl_common_print_results(
+    "adaptive lock+unlock        ",
+    csl_common_test_timer_v0(test_lock_unlock_adaptive),"" );
+
+  csl_common_print_results(
+    "mutex    lock+unlock        ",
+    csl_common_test_timer_v0(test_lock_unlock_mutex),"" );
+
+  csl_common_print_results(
+    "adaptive 4 threads x 50000  ",
+    csl_common_test_timer_v0(test_contended_adaptive),"" );
+
+  csl_common_print_results(
+    "mutex    4 threads x 50000  ",
+    csl_common_test_timer_v0(test_contended_mutex),"" );
+
+  return 0;
+}
+
+/* EOF */
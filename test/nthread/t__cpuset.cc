@@ -0,0 +1,190 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+   @file t__cpuset.cc
+   @brief Tests to check cpuset and thread placement
+*/
+
+#include "codesloop/common/test_timer.h"
+#include "codesloop/nthread/cpuset.hh"
+#include "codesloop/nthread/thread.hh"
+#include "codesloop/nthread/thrpool.hh"
+#include "codesloop/nthread/event.hh"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+using namespace csl::nthread;
+
+/** @brief contains tests related to cpusets */
+namespace test_cpuset
+{
+  /** @test set operations and the cpulist format */
+  void test_parse()
+  {
+    cpuset cs;
+    char buf[256];
+
+    assert( cs.empty() == true );
+    assert( cs.parse("0-3,8,10-11\n") == true );
+    assert( cs.count() == 7 );
+    assert( cs.is_set(2) == true );
+    assert( cs.is_set(4) == false );
+    assert( cs.nth(4) == 8 );
+    assert( cs.nth(7) == -1 );
+
+    cs.to_text( buf, sizeof(buf) );
+    assert( ::strcmp( buf, "0-3,8,10-11" ) == 0 );
+
+    cpuset other;
+    assert( other.parse(buf) == true );
+    assert( other == cs );
+    other.unset(8);
+    assert( other != cs );
+
+    assert( cs.parse("3-1") == false );
+    assert( cs.empty() == true );
+    assert( cs.parse("x") == false );
+    assert( cs.parse("100000") == false );
+  }
+
+  /** @test topology queries are consistent */
+  void test_topology()
+  {
+    cpuset on, al;
+    assert( cpuset::online(on) == true );
+    assert( on.count() >= 1 );
+    assert( cpuset::allowed(al) == true );
+    assert( al.count() >= 1 );
+
+    unsigned int total = 0;
+    for( unsigned int n=0;n<cpuset::n_numa_nodes();++n )
+    {
+      cpuset node;
+      if( cpuset::numa_node(n,node) ) total += node.count();
+    }
+    assert( total >= 1 );
+    assert( cpuset::node_of( al.nth(0) ) < cpuset::n_numa_nodes() );
+
+    char buf[256];
+    on.to_text( buf, sizeof(buf) );
+    printf( "online cpus: %s  numa nodes: %u\n", buf, cpuset::n_numa_nodes() );
+  }
+
+  class where_callback : public thread::callback
+  {
+  public:
+    where_callback() : cpu_(-2) {}
+    virtual void operator()(void)
+    {
+      /* give the scheduler a chance to move us */
+      for( int i=0;i<10;++i ) SleepMiliseconds(1);
+      cpu_ = cpuset::current_cpu();
+    }
+    virtual ~where_callback() {}
+    volatile int cpu_;
+  };
+
+  /** @test a pinned thread runs where it was pinned */
+  void test_thread_affinity()
+  {
+    cpuset al;
+    cpuset::allowed(al);
+    int last = al.nth( al.count()-1 );
+
+    cpuset cs;
+    cs.set( last );
+
+    where_callback cb;
+    thread t;
+    t.set_entry(cb);
+
+    cpuset got;
+    assert( t.get_affinity(got) == false );
+
+#ifdef __linux__
+    assert( t.set_affinity(cs) == true );
+    assert( t.get_affinity(got) == true );
+    assert( got == cs );
+    assert( t.start() == true );
+    assert( t.exit_event().wait(5000) == true );
+    assert( cb.cpu_ == last );
+#endif /* __linux__ */
+
+    cpuset empty;
+    assert( t.set_affinity(empty) == false );
+  }
+
+  class pool_callback : public thread::callback
+  {
+  public:
+    virtual void operator()(void) { }
+    virtual ~pool_callback() {}
+  };
+
+  /** @test thrpool placement settings */
+  void test_thrpool_placement()
+  {
+    thrpool p;
+    assert( p.placement() == thrpool::place_none_ );
+
+#ifdef __linux__
+    p.set_placement( thrpool::place_round_robin_ );
+    assert( p.placement() == thrpool::place_round_robin_ );
+
+    p.set_placement( thrpool::place_near_, 0 );
+    assert( p.placement() == thrpool::place_near_ );
+#endif /* __linux__ */
+
+    event ev;
+    pool_callback cb;
+    assert( p.init( 2, 4, 100, 2, ev, cb ) == true );
+    assert( p.start_event().wait(1000) == true );
+    ev.notify( 10 );
+    assert( p.graceful_stop() == true );
+
+    p.set_placement( thrpool::place_none_ );
+    assert( p.placement() == thrpool::place_none_ );
+  }
+}
+
+using namespace test_cpuset;
+
+int main()
+{
+  test_parse();
+  test_topology();
+  test_thread_affinity();
+  test_thrpool_placement();
+
+  csl_common_print_results(
+    "cpuset parse                ",
+    csl_common_test_timer_v0(test_parse),"" );
+
+  return 0;
+}
+
+/* EOF */
@@ -41,6 +41,12 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 # define SleepSeconds(A) ::Sleep(A*1000)
 #endif /* WIN32 */
 
+#if defined(__linux__) && !defined(CSL_NTHREAD_USE_PTHREAD)
+# define BACKEND "futex  "
+#else
+# define BACKEND "pthread"
+#endif
+
 using namespace csl::nthread;
 
 /** @brief contains tests related to csl events */
@@ -191,6 +197,52 @@ namespace test_event
     assert( e.wait(10) == false );
     assert( e.waiting_count() == 0 );
   }
+
+  static event bench_ev_;
+
+  /** @test notification without waiters, consumed by a non-blocking wait */
+  void test_notify_nb()
+  {
+    bench_ev_.notify();
+    bench_ev_.wait_nb();
+  }
+
+  /** @test notification without waiters, consumed by a blocking wait */
+  void test_notify_wait()
+  {
+    bench_ev_.notify();
+    bench_ev_.wait();
+  }
+
+  class pong_callback : public thread::callback
+  {
+  public:
+    pong_callback() : stop_(false) {}
+
+    virtual void operator()(void)
+    {
+      for( ;; )
+      {
+        ping_.wait();
+        if( stop_ ) break;
+        pong_.notify();
+      }
+    }
+    virtual ~pong_callback() {}
+
+    event          ping_;
+    event          pong_;
+    volatile bool  stop_;
+  };
+
+  static pong_callback * pong_ = 0;
+
+  /** @test round trip between two threads */
+  void test_ping_pong()
+  {
+    pong_->ping_.notify();
+    pong_->pong_.wait();
+  }
 }
 
 using namespace test_event;
@@ -205,6 +257,32 @@ int main()
   test_waiting();
   test_notify1();
 
+  /* these are to compare the futex and the pthread backends */
+  csl_common_print_results(
+    BACKEND " notify+wait_nb          ",
+    csl_common_test_timer_v0(test_notify_nb),"" );
+
+  csl_common_print_results(
+    BACKEND " notify+wait             ",
+    csl_common_test_timer_v0(test_notify_wait),"" );
+
+  {
+    pong_callback cb;
+    thread t;
+    pong_ = &cb;
+    t.set_entry(cb);
+    assert( t.start() == true );
+    assert( t.start_event().wait() == true );
+
+    csl_common_print_results(
+      BACKEND " ping-pong               ",
+      csl_common_test_timer_v0(test_ping_pong),"" );
+
+    cb.stop_ = true;
+    cb.ping_.notify();
+    assert( t.exit_event().wait(5000) == true );
+  }
+
   return 0;
 }
 
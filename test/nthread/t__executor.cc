@@ -0,0 +1,224 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/**
+   @file t__executor.cc
+   @brief Tests to check executor behaviour
+ */
+
+#include "codesloop/common/test_timer.h"
+#include "codesloop/nthread/executor.hh"
+#include "codesloop/nthread/event.hh"
+#include "codesloop/nthread/thrpool.hh"
+#include "codesloop/common/common.h"
+#include <assert.h>
+#include <stdio.h>
+
+using namespace csl::nthread;
+
+/** @brief contains tests related to the executor */
+namespace test_executor
+{
+  static volatile long long counter_ = 0;
+
+  void incr() { __sync_fetch_and_add( &counter_, 1 ); }
+
+  /* spawns two children until depth reaches zero: 2^(depth+1)-1 tasks in total */
+  class spawner
+  {
+    public:
+      spawner(executor * ex, int depth) : ex_(ex), depth_(depth) {}
+
+      void operator()()
+      {
+        incr();
+        if( depth_ > 0 )
+        {
+          assert( executor::current() == ex_ );
+          assert( ex_->submit_fun( spawner(ex_,depth_-1) ) == true );
+          assert( ex_->submit_fun( spawner(ex_,depth_-1) ) == true );
+        }
+      }
+
+    private:
+      executor * ex_;
+      int        depth_;
+  };
+
+  class handler : public thread::callback
+  {
+    public:
+      virtual void operator()(void) { incr(); }
+      virtual ~handler() {}
+  };
+
+  void basic()
+  {
+    counter_ = 0;
+
+    executor ex;
+    assert( ex.start(4) == true );
+    assert( ex.n_workers() == 4 );
+    assert( ex.is_worker() == false );
+    assert( executor::current() == 0 );
+
+    for( int i=0;i<10000;++i ) assert( ex.submit_fun(incr) == true );
+
+    /* stop() runs the queued tasks before returning */
+    assert( ex.stop() == true );
+    assert( counter_ == 10000 );
+    assert( ex.executed_count() == 10000 );
+
+    /* not running */
+    assert( ex.submit_fun(incr) == false );
+  }
+
+  void spawn()
+  {
+    counter_ = 0;
+
+    executor ex;
+    assert( ex.start(4) == true );
+    assert( ex.submit_fun( spawner(&ex,14) ) == true );
+
+    while( counter_ != (1<<15)-1 ) SleepMiliseconds(10);
+
+    assert( ex.stop() == true );
+    assert( counter_ == (1<<15)-1 );
+    fprintf(stderr,"spawn: executed:%llu stolen:%llu\n",ex.executed_count(),ex.stolen_count());
+  }
+
+  void callback()
+  {
+    counter_ = 0;
+
+    handler h;
+    executor ex;
+    assert( ex.start(2) == true );
+    for( int i=0;i<100;++i ) assert( ex.submit_callback(h) == true );
+    assert( ex.stop() == true );
+    assert( counter_ == 100 );
+
+    /* restart */
+    assert( ex.start(1) == true );
+    assert( ex.submit_callback(h) == true );
+    assert( ex.stop() == true );
+    assert( counter_ == 101 );
+  }
+
+  /* a non-worker thread submitting while the executor stops */
+  class submitter : public thread::callback
+  {
+    public:
+      submitter(executor * ex) : ex_(ex), accepted_(0) {}
+
+      virtual void operator()(void)
+      {
+        while( ex_->submit_fun(incr) == true ) ++accepted_;
+      }
+
+      virtual ~submitter() {}
+
+      executor *  ex_;
+      long long   accepted_;
+  };
+
+  /* every accepted task runs, the rejected ones are dropped */
+  void stop_race()
+  {
+    for( int r=0;r<20;++r )
+    {
+      counter_ = 0;
+
+      executor ex;
+      assert( ex.start(2) == true );
+
+      submitter s(&ex);
+      thread t;
+      t.set_entry( s );
+      assert( t.start() == true );
+
+      SleepMiliseconds( 5 );
+      assert( ex.stop() == true );
+      assert( t.exit_event().wait(10000) == true );
+      assert( counter_ == s.accepted_ );
+    }
+  }
+
+  /* performance: submit + wait for the completion of 1000 tasks */
+  static executor * bench_ex_ = 0;
+
+  void submit_1000()
+  {
+    long long target = counter_ + 1000;
+    for( int i=0;i<1000;++i ) bench_ex_->submit_fun(incr);
+    while( counter_ < target ) { }
+  }
+
+  class done_handler : public thread::callback
+  {
+    public:
+      virtual void operator()(void) { incr(); }
+      virtual ~done_handler() {}
+  };
+
+  static event * bench_ev_ = 0;
+
+  void thrpool_1000()
+  {
+    long long target = counter_ + 1000;
+    for( int i=0;i<1000;++i ) bench_ev_->notify();
+    while( counter_ < target ) { }
+  }
+}
+
+using namespace test_executor;
+
+int main()
+{
+  basic();
+  spawn();
+  callback();
+  stop_race();
+
+  {
+    executor ex;
+    ex.start(4);
+    bench_ex_ = &ex;
+    csl_common_print_results( "executor 1000 tasks ", csl_common_test_timer_v0(submit_1000),"" );
+    ex.stop();
+  }
+
+  {
+    event ev;
+    done_handler h;
+    thrpool pool;
+    pool.init( 4,4,1000,3,ev,h );
+    bench_ev_ = &ev;
+    csl_common_print_results( "thrpool 1000 events ", csl_common_test_timer_v0(thrpool_1000),"" );
+  }
+  return 0;
+}
+
+/* EOF */
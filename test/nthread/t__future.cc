@@ -0,0 +1,249 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+   @file t__future.cc
+   @brief Tests to check future and promise behaviour
+ */
+
+#include "codesloop/common/test_timer.h"
+#include "codesloop/nthread/future.hh"
+#include "codesloop/nthread/executor.hh"
+#include "codesloop/nthread/event.hh"
+#include "codesloop/nthread/thread.hh"
+#include <assert.h>
+#include <stdio.h>
+
+using namespace csl::nthread;
+
+/** @brief contains tests related to futures */
+namespace test_future
+{
+  double half(int v)         { return v / 2.0; }
+  int    plus_one(int v)     { return v + 1; }
+  int    twice(const int & v) { return v * 2; }
+
+  class adder
+  {
+    public:
+      typedef long result_type;
+      adder(long n) : n_(n) {}
+      long operator()(double v) const { return static_cast<long>(v) + n_; }
+    private:
+      long n_;
+  };
+
+  /** @test value, then() chains and copies */
+  void basic()
+  {
+    promise<int> p;
+    future<int> f( p.get_future() );
+    future<int> f2( f );
+    assert( f.valid() == true );
+    assert( f.is_ready() == false );
+
+    future<double> h( f.then( half ) );
+    future<long>   a( h.then( adder(100) ) );
+
+    assert( p.set_value(42) == true );
+    assert( p.set_value(43) == false );
+
+    assert( f.is_ready() == true );
+    assert( f2.get() == 42 );
+    assert( h.get() == 21.0 );
+    assert( a.get() == 121 );
+
+    /* added after the value was set: runs right away */
+    future<int> late( f.then( twice ) );
+    assert( late.is_ready() == true );
+    assert( late.get() == 84 );
+
+    future<int> empty;
+    assert( empty.valid() == false );
+    assert( empty.wait(1) == false );
+  }
+
+  /** @test failures and dropped promises propagate */
+  void failure()
+  {
+    future<double> h;
+    {
+      promise<int> p;
+      future<int> f( p.get_future() );
+      h = f.then( half );
+    }
+    /* the promise is gone without a value */
+    assert( h.is_ready() == true );
+    assert( h.failed() == true );
+    assert( h.get() == 0.0 );
+
+    promise<int> p2;
+    future<int> f2( p2.get_future().then( plus_one ) );
+    assert( p2.set_failed() == true );
+    assert( p2.set_value(1) == false );
+    assert( f2.failed() == true );
+  }
+
+  /** @test timed wait */
+  void timeout()
+  {
+    promise<int> p;
+    future<int> f( p.get_future() );
+    assert( f.wait(20) == false );
+    p.set_value(7);
+    assert( f.wait(20) == true );
+    assert( f.get() == 7 );
+  }
+
+  class setter : public thread::callback
+  {
+    public:
+      virtual void operator()(void)
+      {
+        SleepMiliseconds(20);
+        p_.set_value(5);
+      }
+      virtual ~setter() {}
+      promise<int> p_;
+  };
+
+  /** @test the value is set by an other thread, then() runs on the executor */
+  void threaded()
+  {
+    executor ex;
+    assert( ex.start(2) == true );
+
+    setter s;
+    future<int> f( s.p_.get_future() );
+    future<int> g( f.then( ex, plus_one ).then( ex, twice ) );
+
+    thread t;
+    t.set_entry(s);
+    assert( t.start() == true );
+
+    assert( g.get() == 12 );
+    assert( t.exit_event().wait(5000) == true );
+    ex.stop();
+
+    /* the stopped executor does not run the continuation: the result fails */
+    promise<int> p;
+    future<int> h( p.get_future().then( ex, plus_one ) );
+    p.set_value(1);
+    assert( h.failed() == true );
+  }
+
+  /** @test combinators */
+  void combinators()
+  {
+    std::vector< promise<int> > ps(4);
+    std::vector< future<int> >  fs;
+    for( size_t i=0;i<ps.size();++i ) fs.push_back( ps[i].get_future() );
+
+    future< std::vector<int> > all( when_all(fs) );
+    future<size_t>             any( when_any(fs) );
+
+    ps[2].set_value(20);
+    assert( any.is_ready() == true );
+    assert( any.get() == 2 );
+    assert( all.is_ready() == false );
+
+    ps[0].set_value(0);
+    ps[3].set_value(30);
+    ps[1].set_value(10);
+    assert( all.is_ready() == true );
+    assert( all.get().size() == 4 );
+    assert( all.get()[1] == 10 );
+    assert( all.get()[3] == 30 );
+
+    /* one failure fails when_all, but not when_any */
+    std::vector< promise<int> > qs(2);
+    std::vector< future<int> >  gs;
+    for( size_t i=0;i<qs.size();++i ) gs.push_back( qs[i].get_future() );
+    future< std::vector<int> > all2( when_all(gs) );
+    future<size_t>             any2( when_any(gs) );
+    qs[0].set_failed();
+    assert( any2.is_ready() == false );
+    qs[1].set_value(1);
+    assert( all2.failed() == true );
+    assert( any2.get() == 1 );
+
+    std::vector< future<int> > none;
+    assert( when_all(none).get().size() == 0 );
+    assert( when_any(none).failed() == true );
+  }
+
+  /** @test set and get in a single thread */
+  void bench_set_get()
+  {
+    promise<int> p;
+    future<int> f( p.get_future() );
+    p.set_value(1);
+    f.get();
+  }
+
+  /** @test a three step inline chain */
+  void bench_chain()
+  {
+    promise<int> p;
+    future<int> f( p.get_future().then( plus_one ).then( twice ).then( plus_one ) );
+    p.set_value(1);
+    assert( f.get() == 5 );
+  }
+
+  static executor * bench_ex_ = 0;
+
+  /** @test a round trip through the executor */
+  void bench_executor()
+  {
+    promise<int> p;
+    future<int> f( p.get_future().then( *bench_ex_, plus_one ) );
+    p.set_value(1);
+    assert( f.get() == 2 );
+  }
+}
+
+using namespace test_future;
+
+int main()
+{
+  basic();
+  failure();
+  timeout();
+  threaded();
+  combinators();
+
+  executor ex;
+  ex.start(2);
+  bench_ex_ = &ex;
+
+  csl_common_print_results( "set+get            ", csl_common_test_timer_v0(bench_set_get),"" );
+  csl_common_print_results( "inline chain x3    ", csl_common_test_timer_v0(bench_chain),"" );
+  csl_common_print_results( "executor round trip", csl_common_test_timer_v0(bench_executor),"" );
+
+  ex.stop();
+  return 0;
+}
+
+/* EOF */
@@ -40,6 +40,12 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #  include <windows.h>
 #endif /* WIN32 */
 
+#if defined(__linux__) && !defined(CSL_NTHREAD_USE_PTHREAD)
+# define BACKEND "futex  "
+#else
+# define BACKEND "pthread"
+#endif
+
 using namespace csl::nthread;
 
 /** @brief contains tests related to csl mutexes */
@@ -89,15 +95,104 @@ namespace test_mutex
       assert( m.locked_count() <= 1 );
     }
 
+    /* the last thread may still hold the lock after notifying */
+    for( int i=0;i<100;++i )
+    {
+      assert( t[i].exit_event().wait(5000) == true );
+    }
+
     assert( m.waiting_count() == 0 );
     assert( m.locked_count() == 0 );
   }
+
+  static mutex bench_mtx_;
+
+  /** @test uncontended lock/unlock */
+  void test_lock_unlock()
+  {
+    bench_mtx_.lock();
+    bench_mtx_.unlock();
+  }
+
+  /** @test uncontended recursive lock */
+  void test_recursive()
+  {
+    scoped_mutex m1(bench_mtx_);
+    scoped_mutex m2(bench_mtx_);
+  }
+
+  /** @test recursion and ownership semantics */
+  void test_semantics()
+  {
+    mutex m;
+    assert( m.is_locked() == false );
+    assert( m.unlock() == false );
+    assert( m.lock() == true );
+    assert( m.try_lock() == true );
+    assert( m.lock(10) == true );
+    assert( m.locked_count() == 3 );
+    assert( m.unlock() == true );
+    assert( m.locked_count() == 2 );
+    assert( m.recursive_unlock() == true );
+    assert( m.locked_count() == 0 );
+    assert( m.is_locked() == false );
+    assert( m.unlock() == false );
+  }
+
+  class holder_callback : public thread::callback
+  {
+  public:
+    virtual void operator()(void)
+    {
+      m_.lock();
+      locked_.notify();
+      release_.wait();
+      m_.unlock();
+    }
+    virtual ~holder_callback() {}
+
+    mutex m_;
+    event locked_;
+    event release_;
+  };
+
+  /** @test timed lock against an other thread */
+  void test_timeout()
+  {
+    holder_callback cb;
+    thread t;
+    t.set_entry(cb);
+    assert( t.start() == true );
+    assert( cb.locked_.wait() == true );
+
+    assert( cb.m_.is_locked() == true );
+    assert( cb.m_.try_lock() == false );
+    assert( cb.m_.unlock() == false );
+    assert( cb.m_.lock(50) == false );
+
+    cb.release_.notify();
+    assert( cb.m_.lock(5000) == true );
+    assert( cb.m_.unlock() == true );
+    assert( t.exit_event().wait(5000) == true );
+  }
 }
 
 using namespace test_mutex;
 
 int main()
 {
+  test_semantics();
+  test_timeout();
+
+  /* these are to compare the futex and the pthread backends */
+  csl_common_print_results(
+    BACKEND " lock+unlock         ",
+    csl_common_test_timer_v0(test_lock_unlock),"" );
+
+  csl_common_print_results(
+    BACKEND " recursive           ",
+    csl_common_test_timer_v0(test_recursive),"" );
+
   csl_common_print_results(
     "test_init                   ",
     csl_common_test_timer_v0(test_init),"" );
@@ -0,0 +1,225 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+   @file t__parallel.cc
+   @brief Tests to check parallel_for and parallel_reduce
+ */
+
+#include "codesloop/common/test_timer.h"
+#include "codesloop/common/metrics.hh"
+#include "codesloop/common/inpvec.hh"
+#include "codesloop/common/pvlist.hh"
+#include "codesloop/nthread/parallel.hh"
+#include <assert.h>
+#include <stdio.h>
+
+using namespace csl::nthread;
+using csl::common::inpvec;
+using csl::common::pvlist;
+using csl::common::metrics;
+
+/** @brief contains tests related to parallel iteration */
+namespace test_parallel
+{
+  enum { n_items_ = 100000, n_rounds_ = 16 };
+
+  typedef pvlist< 64,uint64_t,csl::common::delete_destructor<uint64_t> > ptrlist_t;
+
+  /* some CPU work per item, like a cipher round */
+  inline uint64_t mix(uint64_t x)
+  {
+    for( int i=0;i<n_rounds_;++i )
+    {
+      x ^= x >> 33;
+      x *= 0xff51afd7ed558ccdULL;
+      x ^= x >> 29;
+    }
+    return x;
+  }
+
+  struct mixer
+  {
+    inline void operator()(uint64_t & x) const { x = mix(x); }
+    inline void operator()(uint64_t * x) const { *x = mix(*x); }
+  };
+
+  struct counter
+  {
+    volatile uint64_t n_;
+    counter() : n_(0) {}
+    inline void operator()(uint64_t &) { __sync_fetch_and_add( &n_, 1 ); }
+    inline void operator()(uint64_t *) { __sync_fetch_and_add( &n_, 1 ); }
+  };
+
+  uint64_t fold_val(uint64_t r, uint64_t & x) { return r + x; }
+  uint64_t fold_ptr(uint64_t r, uint64_t * x) { return r + *x; }
+  uint64_t sum(uint64_t a, uint64_t b)       { return a + b; }
+
+  void fill(inpvec<uint64_t> & v)
+  {
+    for( uint64_t i=0;i<n_items_;++i ) v.push_back( i );
+    /* leave holes, including some completely empty blocks */
+    for( uint64_t i=0;i<n_items_;i+=3 ) v.free_at( i );
+    for( uint64_t i=640;i<1280;++i )    v.free_at( i );
+  }
+
+  void fill(ptrlist_t & l)
+  {
+    for( uint64_t i=0;i<n_items_;++i ) l.push_back( new uint64_t(i) );
+  }
+
+  /** @test every item is visited exactly once, with any grain */
+  void visit_once()
+  {
+    inpvec<uint64_t> v;
+    ptrlist_t l;
+    fill( v );
+    fill( l );
+
+    parallel p;
+    assert( p.start(4) == true );
+    assert( p.n_threads() == 4 );
+
+    size_t grains[] = { 0, 1, 3, 1000 };
+    for( size_t g=0;g<sizeof(grains)/sizeof(grains[0]);++g )
+    {
+      counter c1, c2;
+      parallel_for( p, v, c1, grains[g] );
+      parallel_for( p, l, c2, grains[g] );
+      assert( c1.n_ == v.n_items() );
+      assert( c2.n_ == n_items_ );
+    }
+
+    /* empty containers */
+    inpvec<uint64_t> ev;
+    ptrlist_t el;
+    counter c3;
+    parallel_for( p, ev, c3 );
+    parallel_for( p, el, c3 );
+    assert( c3.n_ == 0 );
+
+    assert( p.stop() == true );
+  }
+
+  /** @test the parallel results match the sequential ones */
+  void results()
+  {
+    inpvec<uint64_t> v;
+    ptrlist_t l;
+    fill( v );
+    fill( l );
+
+    uint64_t expect_v = 0, expect_l = 0;
+    {
+      inpvec<uint64_t>::iterator it(v.begin()), end(v.end());
+      for( ;it!=end;++it ) if( !it.is_empty() ) expect_v += mix( **it );
+      for( uint64_t i=0;i<n_items_;++i ) expect_l += mix(i);
+    }
+
+    parallel p;
+    assert( p.start(3) == true );
+
+    mixer m;
+    parallel_for( p, v, m );
+    parallel_for( p, l, m );
+
+    uint64_t (*fv)(uint64_t, uint64_t &) = fold_val;
+    uint64_t (*fp)(uint64_t, uint64_t *) = fold_ptr;
+    uint64_t (*cb)(uint64_t, uint64_t)   = sum;
+
+    assert( parallel_reduce( p, v, uint64_t(0), fv, cb ) == expect_v );
+    assert( parallel_reduce( p, l, uint64_t(0), fp, cb, 7 ) == expect_l );
+
+    /* a single thread runs the parts inline */
+    parallel one;
+    assert( one.start(1) == true );
+    assert( parallel_reduce( one, v, uint64_t(0), fv, cb ) == expect_v );
+
+    /* freed pointers are skipped */
+    ptrlist_t::iterator it(l.begin());
+    it.free();
+    assert( parallel_reduce( p, l, uint64_t(0), fp, cb ) == expect_l - mix(0) );
+  }
+
+  /** @test the number of items processed per second at 1..16 threads */
+  void scaling()
+  {
+    inpvec<uint64_t> v;
+    ptrlist_t l;
+    fill( v );
+    fill( l );
+    mixer m;
+
+    unsigned int threads[] = { 1, 2, 4, 8, 16 };
+    for( size_t t=0;t<sizeof(threads)/sizeof(threads[0]);++t )
+    {
+      parallel p;
+      assert( p.start(threads[t]) == true );
+
+      uint64_t start = metrics::now_usec();
+      for( int i=0;i<10;++i ) parallel_for( p, v, m );
+      uint64_t mid = metrics::now_usec();
+      for( int i=0;i<10;++i ) parallel_for( p, l, m );
+      uint64_t end = metrics::now_usec();
+
+      printf( "scaling %2u threads: inpvec %8.2f Mitems/s  pvlist %8.2f Mitems/s\n",
+              threads[t],
+              (10.0*static_cast<double>(v.n_items()))/static_cast<double>(mid-start+1),
+              (10.0*n_items_)/static_cast<double>(end-mid+1) );
+
+      assert( p.stop() == true );
+    }
+  }
+
+  parallel * bench_p_ = 0;
+
+  /* the overhead of a small job */
+  void bench_small_job()
+  {
+    static inpvec<uint64_t> * v = 0;
+    if( !v ) { v = new inpvec<uint64_t>(); for( uint64_t i=0;i<256;++i ) v->push_back(i); }
+    counter c;
+    parallel_for( *bench_p_, *v, c, 1 );
+  }
+}
+
+using namespace test_parallel;
+
+int main()
+{
+  visit_once();
+  results();
+  scaling();
+
+  parallel p;
+  p.start(2);
+  bench_p_ = &p;
+  csl_common_print_results( "small job 2 threads ", csl_common_test_timer_v0(bench_small_job),"" );
+  p.stop();
+  return 0;
+}
+
+/* EOF */
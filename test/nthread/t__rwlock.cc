@@ -0,0 +1,245 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+   @file t__rwlock.cc
+   @brief Tests to check csl rwlock behaviour
+*/
+
+#include "codesloop/common/test_timer.h"
+#include "codesloop/common/metrics.hh"
+#include "codesloop/nthread/rwlock.hh"
+#include "codesloop/nthread/event.hh"
+#include "codesloop/nthread/thread.hh"
+#include <assert.h>
+#include <stdio.h>
+
+using namespace csl::nthread;
+using csl::common::metrics;
+
+/** @brief contains tests related to csl rwlocks */
+namespace test_rwlock
+{
+  /** @test read and write lock semantics in a single thread */
+  void test_semantics()
+  {
+    rwlock l;
+    assert( l.unlock() == false );
+
+    assert( l.rdlock() == true );
+    assert( l.try_rdlock() == true );
+    assert( l.reader_count() == 2 );
+    assert( l.try_wrlock() == false );
+    assert( l.wrlock(10) == false );
+    assert( l.waiting_writers() == 0 );
+    assert( l.unlock() == true );
+    assert( l.unlock() == true );
+    assert( l.reader_count() == 0 );
+
+    assert( l.wrlock() == true );
+    assert( l.is_write_locked() == true );
+    assert( l.try_rdlock() == false );
+    assert( l.try_wrlock() == false );
+    assert( l.rdlock(10) == false );
+    assert( l.unlock() == true );
+    assert( l.is_write_locked() == false );
+    assert( l.unlock() == false );
+
+    {
+      scoped_rdlock r1(l);
+      scoped_rdlock r2(l);
+      assert( l.reader_count() == 2 );
+    }
+    {
+      scoped_wrlock w(l);
+      assert( l.is_write_locked() == true );
+    }
+    assert( l.try_wrlock() == true );
+    assert( l.unlock() == true );
+  }
+
+  class writer_callback : public thread::callback
+  {
+  public:
+    writer_callback() : l_(0), done_(0) {}
+
+    virtual void operator()(void)
+    {
+      if( l_->wrlock() ) { done_ = 1; l_->unlock(); }
+    }
+    virtual ~writer_callback() {}
+
+    rwlock *      l_;
+    volatile int  done_;
+  };
+
+  /** @test a waiting writer holds back the new readers */
+  void test_writer_preference()
+  {
+    rwlock l;
+    writer_callback cb;
+    cb.l_ = &l;
+    thread t;
+    t.set_entry(cb);
+
+    assert( l.rdlock() == true );
+    assert( t.start() == true );
+
+    for( int i=0;i<5000 && l.waiting_writers() == 0;++i ) { SleepMiliseconds(1); }
+    assert( l.waiting_writers() == 1 );
+
+    /* an other reader would succeed without writer preference */
+    assert( l.try_rdlock() == false );
+    assert( l.rdlock(20) == false );
+
+    assert( l.unlock() == true );
+    assert( t.exit_event().wait(5000) == true );
+    assert( cb.done_ == 1 );
+    assert( l.try_rdlock() == true );
+    assert( l.unlock() == true );
+  }
+
+  /** @test a writer that timed out lets the readers in */
+  void test_writer_timeout()
+  {
+    rwlock l;
+    assert( l.rdlock() == true );
+    assert( l.wrlock(20) == false );
+    assert( l.waiting_writers() == 0 );
+    assert( l.rdlock(20) == true );
+    assert( l.reader_count() == 2 );
+    assert( l.unlock() == true );
+    assert( l.unlock() == true );
+  }
+
+  static rwlock        shared_lock_;
+  static volatile int  shared_a_ = 0;
+  static volatile int  shared_b_ = 0;
+  static volatile int  torn_     = 0;
+
+  class mixed_callback : public thread::callback
+  {
+  public:
+    virtual void operator()(void)
+    {
+      for( int i=0;i<20000;++i )
+      {
+        if( (i % 16) == 0 )
+        {
+          scoped_wrlock w(shared_lock_);
+          ++shared_a_;
+          ++shared_b_;
+        }
+        else
+        {
+          scoped_rdlock r(shared_lock_);
+          if( shared_a_ != shared_b_ ) torn_ = 1;
+        }
+      }
+    }
+    virtual ~mixed_callback() {}
+  };
+
+  /** @test readers never see a half done update */
+  void test_concurrent()
+  {
+    mixed_callback cb;
+    thread t[8];
+
+    shared_a_ = shared_b_ = 0;
+    shared_lock_.stats().reset();
+    shared_lock_.enable_stats("test.rwlock");
+
+    for( int i=0;i<8;++i )
+    {
+      t[i].set_entry(cb);
+      assert( t[i].start() == true );
+    }
+    for( int i=0;i<8;++i )
+    {
+      assert( t[i].exit_event().wait(30000) == true );
+    }
+
+    assert( torn_ == 0 );
+    assert( shared_a_ == 8*(20000/16) );
+    assert( shared_lock_.reader_count() == 0 );
+    assert( shared_lock_.is_write_locked() == false );
+    assert( shared_lock_.waiting_writers() == 0 );
+
+    lock_stats::data d;
+    shared_lock_.stats().get(d);
+    assert( d.acquisitions_ == 8*20000 );
+    assert( d.contended_ <= d.acquisitions_ );
+    assert( d.max_wait_usec_ <= d.wait_usec_ );
+    assert( d.max_hold_usec_ <= d.hold_usec_ );
+
+    /* also visible through the metrics registry */
+    metrics::histogram & wh(metrics::instance().get_histogram("test.rwlock.wait_usec"));
+    assert( wh.count() >= d.acquisitions_ );
+
+    shared_lock_.disable_stats();
+  }
+
+  static rwlock bench_lock_;
+
+  /** @test uncontended read lock */
+  void test_rdlock_unlock()
+  {
+    bench_lock_.rdlock();
+    bench_lock_.unlock();
+  }
+
+  /** @test uncontended write lock */
+  void test_wrlock_unlock()
+  {
+    bench_lock_.wrlock();
+    bench_lock_.unlock();
+  }
+}
+
+using namespace test_rwlock;
+
+int main()
+{
+  test_semantics();
+  test_writer_preference();
+  test_writer_timeout();
+
+  csl_common_print_results(
+    "rdlock+unlock               ",
+    csl_common_test_timer_v0(test_rdlock_unlock),"" );
+
+  csl_common_print_results(
+    "wrlock+unlock               ",
+    csl_common_test_timer_v0(test_wrlock_unlock),"" );
+
+  csl_common_print_results(
+    "concurrent 8 threads        ",
+    csl_common_test_timer_v0(test_concurrent),"" );
+
+  return 0;
+}
+
+/* EOF */
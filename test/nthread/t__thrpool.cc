@@ -31,11 +31,16 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "codesloop/common/test_timer.h"
 #include "codesloop/nthread/thrpool.hh"
 #include "codesloop/nthread/mutex.hh"
+#include "codesloop/common/metrics.hh"
 #include "codesloop/common/common.h"
 #include <assert.h>
 #include <stdio.h>
+#include <deque>
+#include <vector>
+#include <algorithm>
 
 using namespace csl::nthread;
+using csl::common::metrics;
 
 /** @brief contains tests related to csl threads */
 namespace test_thrpool
@@ -87,6 +92,107 @@ namespace test_thrpool
       fprintf(stderr," /%d:%d:%d/",ev.waiting_count(),ev.available_count(),pool.count());
     }
   }
+
+  /* items are timestamps, the handler measures how long they were queued */
+  class timed_handler : public thread::callback
+  {
+    public:
+      virtual void operator()(void)
+      {
+        uint64_t ts = 0;
+        {
+          scoped_mutex m(mtx_);
+          if( items_.empty() ) return;
+          ts = items_.front();
+          items_.pop_front();
+        }
+
+        uint64_t lat = metrics::now_usec() - ts;
+        pool_->report_latency( lat );
+
+        {
+          scoped_mutex m(mtx_);
+          latencies_.push_back( lat );
+        }
+
+        /* service time */
+        SleepMiliseconds(1);
+      }
+
+      void push(unsigned int n)
+      {
+        {
+          scoped_mutex m(mtx_);
+          for( unsigned int i=0;i<n;++i ) items_.push_back( metrics::now_usec() );
+        }
+        ev_.notify(n);
+      }
+
+      uint64_t p95_and_clear()
+      {
+        scoped_mutex m(mtx_);
+        if( latencies_.empty() ) return 0;
+        std::sort( latencies_.begin(), latencies_.end() );
+        uint64_t ret = latencies_[(latencies_.size()*95)/100];
+        latencies_.clear();
+        return ret;
+      }
+
+      virtual ~timed_handler() {}
+
+      thrpool *               pool_;
+      event                   ev_;
+      mutex                   mtx_;
+      std::deque<uint64_t>    items_;
+      std::vector<uint64_t>   latencies_;
+  };
+
+  void adaptive()
+  {
+    timed_handler h;
+    thrpool pool;
+    h.pool_ = &pool;
+
+    thrpool::sizing_policy p;
+    p.target_p95_usec_ = 20000;
+    p.window_ms_       = 50;
+    p.shrink_after_    = 3;
+
+    pool.set_policy( p );
+    assert( pool.policy().target_p95_usec_ == 20000 );
+    assert( pool.init( 1,16,100,3,h.ev_,h ) == true );
+    assert( pool.start_event().wait(1000) == true );
+
+    unsigned int max_workers = 0;
+    uint64_t     late_p95    = 0;
+
+    /* bursts of 100 items of 1ms service time: ~100ms queueing with one worker */
+    for( int burst=0;burst<15;++burst )
+    {
+      h.push(100);
+      for( int i=0;i<20;++i )
+      {
+        SleepMiliseconds(10);
+        if( pool.count() > max_workers ) max_workers = pool.count();
+      }
+
+      uint64_t p95 = h.p95_and_clear();
+      if( burst >= 10 && p95 > late_p95 ) late_p95 = p95;
+
+      thrpool::sizing_state st = pool.last_decision();
+      fprintf(stderr," [burst:%d p95:%lld workers:%d decision:%d util:%d]\n",
+              burst,static_cast<long long>(p95),pool.count(),st.decision_,st.utilization_pct_);
+    }
+
+    /* the pool must have grown and kept the latency bounded */
+    assert( max_workers > 1 );
+    assert( late_p95 < 3*p.target_p95_usec_ );
+
+    /* quiet period: the pool shrinks back to the minimum */
+    for( int i=0;i<300 && pool.count() > 1;++i ) SleepMiliseconds(100);
+    fprintf(stderr," [idle workers:%d]\n",pool.count());
+    assert( pool.count() == 1 );
+  }
 }
 
 using namespace test_thrpool;
@@ -94,6 +200,7 @@ using namespace test_thrpool;
 int main()
 {
   basic();
+  adaptive();
   return 0;
 }
 
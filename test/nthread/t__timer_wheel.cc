@@ -0,0 +1,210 @@
+/*
+Copyright (c) 2008,2009,2010, CodeSLoop Team
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+   @file t__timer_wheel.cc
+   @brief Tests to check the timer wheel
+*/
+
+#include "codesloop/common/test_timer.h"
+#include "codesloop/nthread/timer_wheel.hh"
+#include <assert.h>
+#include <stdio.h>
+#include <vector>
+
+using namespace csl::nthread;
+
+/** @brief contains tests related to the timer wheel */
+namespace test_timer_wheel
+{
+  class counting_timer : public timer_wheel::timer
+  {
+  public:
+    counting_timer() : fired_(0), at_(0), wheel_(0) {}
+    virtual void operator()(void)
+    {
+      ++fired_;
+      if( wheel_ ) at_ = now_;
+    }
+    virtual ~counting_timer() {}
+
+    volatile int    fired_;
+    uint64_t        at_;
+    timer_wheel *   wheel_;
+    static uint64_t now_;
+  };
+
+  uint64_t counting_timer::now_ = 0;
+
+  /* advances a virtual clock in single ms steps, remembering the time of the expiry */
+  void run_until(timer_wheel & w, uint64_t until)
+  {
+    for( ;counting_timer::now_<=until;++counting_timer::now_ )
+    {
+      w.advance_to( counting_timer::now_ );
+    }
+  }
+
+  /** @test arm, cancel and re-arm */
+  void test_basic()
+  {
+    timer_wheel w(1);
+    counting_timer a, b, c;
+    a.wheel_ = b.wheel_ = c.wheel_ = &w;
+    counting_timer::now_ = 0;
+
+    assert( w.arm(a,10) == true );
+    assert( w.arm(b,20) == true );
+    assert( w.arm(c,30) == true );
+    assert( w.size() == 3 );
+    assert( a.is_armed() == true );
+
+    assert( w.cancel(b) == true );
+    assert( w.cancel(b) == false );
+    assert( b.is_armed() == false );
+    assert( w.rearm(c,50) == true );
+    assert( w.size() == 2 );
+
+    run_until( w, 100 );
+    assert( a.fired_ == 1 );
+    assert( b.fired_ == 0 );
+    assert( c.fired_ == 1 );
+    assert( a.at_ >= 10 && a.at_ <= 11 );
+    assert( c.at_ >= 50 && c.at_ <= 51 );
+    assert( w.size() == 0 );
+    assert( a.is_armed() == false );
+
+    /* an other wheel cannot take an armed timer */
+    timer_wheel w2(1);
+    assert( w.arm(a,10) == true );
+    assert( w2.arm(a,10) == false );
+    assert( w2.cancel(a) == false );
+  }
+
+  /** @test timers on all levels fire on time and in order */
+  void test_levels()
+  {
+    timer_wheel w(1);
+    uint64_t delays[] = { 1, 255, 256, 257, 1000, 65535, 65536, 70000, 200000 };
+    const unsigned int n = sizeof(delays)/sizeof(delays[0]);
+    counting_timer t[n];
+    counting_timer::now_ = 0;
+
+    for( unsigned int i=0;i<n;++i )
+    {
+      t[i].wheel_ = &w;
+      assert( w.arm(t[i],delays[i]) == true );
+    }
+
+    run_until( w, 200010 );
+
+    for( unsigned int i=0;i<n;++i )
+    {
+      assert( t[i].fired_ == 1 );
+      assert( t[i].at_ >= delays[i] );
+      assert( t[i].at_ <= delays[i]+1 );
+    }
+  }
+
+  /** @test the destructor of an armed timer disarms it */
+  void test_destroy()
+  {
+    timer_wheel w(1);
+    {
+      counting_timer t;
+      w.arm(t,10);
+      assert( w.size() == 1 );
+    }
+    assert( w.size() == 0 );
+    assert( w.advance_to(100) == 0 );
+
+    /* and the wheel's destructor leaves the timers disarmed */
+    counting_timer t;
+    {
+      timer_wheel w2(1);
+      w2.arm(t,10);
+    }
+    assert( t.is_armed() == false );
+  }
+
+  /** @test the wheel's own thread drives the timers */
+  void test_thread()
+  {
+    timer_wheel w(5);
+    counting_timer t;
+    assert( w.start() == true );
+    assert( w.arm(t,20) == true );
+    for( int i=0;i<200 && t.fired_ == 0;++i ) SleepMiliseconds(5);
+    assert( t.fired_ == 1 );
+    assert( w.stop() == true );
+    assert( w.stop() == false );
+  }
+
+  enum { n_bench_ = 100000 };
+  static timer_wheel *                 bench_wheel_ = 0;
+  static std::vector<counting_timer> * bench_timers_ = 0;
+
+  /** @test arming and cancelling 100k timers */
+  void test_arm_cancel()
+  {
+    std::vector<counting_timer> & v(*bench_timers_);
+    for( unsigned int i=0;i<n_bench_;++i ) bench_wheel_->arm( v[i], 1000 + i*7 );
+    for( unsigned int i=0;i<n_bench_;++i ) bench_wheel_->cancel( v[i] );
+  }
+
+  /** @test re-arming 100k armed timers (idle timeout refresh) */
+  void test_rearm()
+  {
+    std::vector<counting_timer> & v(*bench_timers_);
+    for( unsigned int i=0;i<n_bench_;++i ) bench_wheel_->rearm( v[i], 30000 + (i&1023) );
+  }
+}
+
+using namespace test_timer_wheel;
+
+int main()
+{
+  test_basic();
+  test_levels();
+  test_destroy();
+  test_thread();
+
+  timer_wheel w(10);
+  std::vector<counting_timer> v(n_bench_);
+  bench_wheel_  = &w;
+  bench_timers_ = &v;
+
+  csl_common_print_results(
+    "arm+cancel 100k             ",
+    csl_common_test_timer_v0(test_arm_cancel),"" );
+
+  csl_common_print_results(
+    "rearm 100k                  ",
+    csl_common_test_timer_v0(test_rearm),"" );
+
+  return 0;
+}
+
+/* EOF */
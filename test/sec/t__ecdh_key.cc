@@ -37,6 +37,7 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "codesloop/common/common.h"
 #include "codesloop/common/str.hh"
 #include "codesloop/common/ustr.hh"
+#include "codesloop/common/metrics.hh"
 #include <assert.h>
 
 using namespace csl::sec;
@@ -135,6 +136,77 @@ namespace test_ecdh_key {
     PRINTF(L"SHARED KEY: %s\n",shared1.c_str());
   }
 
+  /** @test cached shared keys are the same as the computed ones */
+  void shared_key_cache()
+  {
+    metrics::counter & hits(metrics::instance().get_counter("sec.ecdh.cache.hits"));
+
+    ecdh_key k1,k2;
+    k1.algname("prime192v3");
+    k2.algname("prime192v3");
+
+    bignum private_key1;
+    bignum private_key2;
+
+    assert( k1.gen_keypair(private_key1) == true );
+    assert( k2.gen_keypair(private_key2) == true );
+
+    assert( ecdh_key::shared_key_cache_size() == 1024 );
+
+    ustr shared1,shared2,shared3;
+    pbuf pb1,pb2,pb3;
+
+    uint64_t before = hits.value();
+    assert( k1.gen_sha1hex_shared_key(private_key2,shared1) == true );
+    assert( k1.gen_sha1hex_shared_key(private_key2,shared2) == true );
+    assert( k1.gen_shared_key(private_key2,pb1) == true );
+    assert( k1.gen_shared_key(private_key2,pb2) == true );
+    assert( hits.value() - before == 2 );
+
+    /* the other side computes the same keys */
+    assert( k2.gen_sha1hex_shared_key(private_key1,shared3) == true );
+    assert( k2.gen_shared_key(private_key1,pb3) == true );
+
+    assert( shared1 == shared2 );
+    assert( shared1 == shared3 );
+    assert( shared1.size() == 40 );
+    assert( pb1 == pb2 );
+    assert( pb1 == pb3 );
+    assert( pb1.size() == 24 );
+
+    /* uncached */
+    ecdh_key::shared_key_cache_size(0);
+    assert( ecdh_key::shared_key_cache_size() == 0 );
+
+    ustr shared4;
+    pbuf pb4;
+    before = hits.value();
+    assert( k1.gen_sha1hex_shared_key(private_key2,shared4) == true );
+    assert( k1.gen_shared_key(private_key2,pb4) == true );
+    assert( hits.value() == before );
+    assert( shared1 == shared4 );
+    assert( pb1 == pb4 );
+
+    /* an other private key must not hit the slot of the first */
+    ecdh_key::shared_key_cache_size(1000);
+    assert( ecdh_key::shared_key_cache_size() == 1024 );
+
+    ustr shared5;
+    assert( k1.gen_sha1hex_shared_key(private_key2,shared5) == true );
+    assert( k1.gen_sha1hex_shared_key(private_key1,shared5) == true );
+    assert( !(shared1 == shared5) );
+  }
+
+  static ecdh_key  bench_key_;
+  static bignum    bench_private_key_;
+
+  /** @test shared key of a returning peer */
+  void shared_key_repeated()
+  {
+    ustr shared;
+    bench_key_.gen_sha1hex_shared_key(bench_private_key_,shared);
+  }
+
   struct rndata
   {
     size_t len_;
@@ -190,6 +262,20 @@ int main()
   print_prime192v3();
   prime192v3_keypair();
 
+  shared_key_cache();
+
+  bignum peer_private_key;
+  bench_key_.algname("prime192v3");
+  assert( bench_key_.gen_keypair(peer_private_key) == true );
+  ecdh_key own_key;
+  own_key.algname("prime192v3");
+  assert( own_key.gen_keypair(bench_private_key_) == true );
+
+  csl_common_print_results( "shared_cached    ", csl_common_test_timer_v0(shared_key_repeated),"" );
+  ecdh_key::shared_key_cache_size(0);
+  csl_common_print_results( "shared_uncached  ", csl_common_test_timer_v0(shared_key_repeated),"" );
+  ecdh_key::shared_key_cache_size(1024);
+
   csl_common_print_results( "baseline         ", csl_common_test_timer_v0(baseline),"" );
   csl_common_print_results( "bl_prime192v3_1  ", csl_common_test_timer_v0(bl_prime192v3_1),"" );
   csl_common_print_results( "bl_prime192v3_2  ", csl_common_test_timer_v0(bl_prime192v3_2),"" );